@@ -0,0 +1,78 @@
+#include "benchmark.hh"
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+constexpr int EXIT_REGRESSION = 2; // (EXIT_FAILURE means the comparison itself failed)
+
+void usage( const char* argv0 )
+{
+  cerr << "Usage: " << argv0 << " [-t THRESHOLD] BASELINE.json CURRENT.json\n\n"
+       << "   -t THRESHOLD   how much slower (as a fraction) a benchmark may get before it is a regression\n"
+       << "                  (default: 0.05)\n\n"
+       << "Exits with status " << EXIT_REGRESSION << " if any benchmark regressed, or " << EXIT_FAILURE
+       << " if the results couldn't be compared.\n";
+}
+
+vector<BenchmarkResult> read_results( const string& path )
+{
+  ifstream file { path };
+  if ( not file ) {
+    throw runtime_error( "could not open " + path );
+  }
+  return benchmarks_from_json( string { istreambuf_iterator<char>( file ), istreambuf_iterator<char>() } );
+}
+} // namespace
+
+int main( int argc, char** argv )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort(); // For sticklers: don't try to access argv[0] if argc <= 0.
+    }
+
+    const span<char*> args( argv, argc );
+    double threshold = 0.05;
+    vector<string> files;
+    for ( int i = 1; i < argc; ++i ) {
+      const string arg { args[i] };
+      if ( arg == "-t" and i + 1 < argc ) {
+        threshold = stod( args[++i] );
+      } else if ( arg.starts_with( "-" ) ) {
+        usage( args[0] );
+        return EXIT_FAILURE;
+      } else {
+        files.push_back( arg );
+      }
+    }
+    if ( files.size() != 2 ) {
+      usage( args[0] );
+      return EXIT_FAILURE;
+    }
+
+    const auto comparisons = compare_benchmarks( read_results( files[0] ), read_results( files[1] ), threshold );
+    bool regressed = false;
+    cout << left << setw( 40 ) << "benchmark" << right << setw( 14 ) << "baseline ns" << setw( 14 ) << "current ns"
+         << setw( 10 ) << "change" << "\n";
+    for ( const auto& c : comparisons ) {
+      cout << left << setw( 40 ) << c.name << right << fixed << setprecision( 2 ) << setw( 14 )
+           << c.baseline_ns_per_item << setw( 14 ) << c.current_ns_per_item << setw( 9 ) << showpos
+           << c.change * 100 << noshowpos << "%" << ( c.regression ? "  REGRESSION" : "" ) << "\n";
+      regressed |= c.regression;
+    }
+    return regressed ? EXIT_REGRESSION : EXIT_SUCCESS;
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+}
@@ -10,12 +10,21 @@
 using namespace std;
 
 void bidirectional_stream_copy( Socket& socket, string_view peer_name )
+{
+  EventLoop eventloop {};
+  FileDescriptor input { STDIN_FILENO };
+  FileDescriptor output { STDOUT_FILENO };
+  bidirectional_stream_copy( eventloop, socket, input, output, peer_name );
+}
+
+void bidirectional_stream_copy( EventLoop& _eventloop,
+                                Socket& socket,
+                                FileDescriptor& _input,
+                                FileDescriptor& _output,
+                                string_view peer_name )
 {
   constexpr size_t buffer_size = 1048576;
 
-  EventLoop _eventloop {};
-  FileDescriptor _input { STDIN_FILENO };
-  FileDescriptor _output { STDOUT_FILENO };
   ByteStream _outbound { buffer_size };
   ByteStream _inbound { buffer_size };
   bool _outbound_shutdown { false };
@@ -1,6 +1,14 @@
 #pragma once
 
+#include "eventloop.hh"
 #include "socket.hh"
 
 //! Copy socket input/output to stdin/stdout until finished
 void bidirectional_stream_copy( Socket& socket, std::string_view peer_name );
+
+//! Copy `input` to the socket and socket input to `output` until finished, using `eventloop`
+void bidirectional_stream_copy( EventLoop& eventloop,
+                                Socket& socket,
+                                FileDescriptor& input,
+                                FileDescriptor& output,
+                                std::string_view peer_name );
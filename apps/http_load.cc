@@ -0,0 +1,178 @@
+#include "async_tcp.hh"
+#include "latency.hh"
+#include "tcp_config.hh"
+#include "tcp_reactor.hh"
+#include "tun.hh"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <span>
+#include <string>
+
+using namespace std;
+using namespace std::chrono;
+
+constexpr const char* TUN_DFLT = "tun144";
+constexpr const char* LOCAL_ADDRESS_DFLT = "169.254.144.9";
+
+namespace {
+void show_usage( const char* argv0, const char* msg )
+{
+  cout << "Usage: " << argv0 << " [options] <host> <path>\n\n"
+       << "   Fetch http://<host><path> over and over, with many fetches in flight at once, all on one thread.\n\n"
+       << "   Option                                                          Default\n"
+       << "   --                                                              --\n\n"
+
+       << "   -n <count>      Fetch <count> times in all                      1000\n"
+       << "   -c <flows>      Keep <flows> fetches in flight                  100\n"
+       << "   -p <port>       Connect to <port>                               80\n"
+       << "   -t <ms>         Give up on a fetch after <ms> milliseconds      10000\n\n"
+
+       << "   -d <tundev>     Connect to tun <tundev>                         " << TUN_DFLT << "\n"
+       << "   -s <addr>       Connect from <addr>                             " << LOCAL_ADDRESS_DFLT << "\n"
+       << "   -o              Use checksum and segmentation offloads          (no offloads)\n\n"
+
+       << "   -h              Show this message.\n\n";
+
+  if ( msg != nullptr ) {
+    cout << msg;
+  }
+  cout << endl;
+}
+
+struct Load
+{
+  Address server;
+  string request;
+  milliseconds timeout;
+  uint64_t remaining; // fetches not yet started
+  uint64_t fetched {};
+  uint64_t failed {};
+  uint64_t bytes {};
+};
+
+// Cancels a timer when it goes out of scope
+struct TimerGuard
+{
+  EventLoop::RuleHandle timer;
+  ~TimerGuard() { timer.cancel(); }
+};
+
+// One flow: fetch, one connection per fetch, until there are none left to start
+Task<> flow( AsyncTCP& tcp, EventLoop& loop, const size_t timer_category, Load& load )
+{
+  while ( load.remaining > 0 ) {
+    --load.remaining;
+    try {
+      AsyncTCP::Socket socket = co_await tcp.connect( load.server );
+
+      // (a reset connection reads as finished)
+      bool timed_out = false;
+      const TimerGuard guard { loop.add_timer( timer_category, EventLoop::Clock::now() + load.timeout, [&] {
+        timed_out = true;
+        socket.abort();
+      } ) };
+
+      co_await socket.write( load.request );
+      for ( string data = co_await socket.read(); not data.empty(); data = co_await socket.read() ) {
+        load.bytes += data.size();
+      }
+      ++( timed_out ? load.failed : load.fetched );
+    } catch ( const exception& e ) {
+      cerr << "DEBUG: fetch failed: " << e.what() << "\n";
+      ++load.failed;
+    }
+  }
+}
+} // namespace
+
+int main( int argc, char** argv )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort(); // For sticklers: don't try to access argv[0] if argc <= 0.
+    }
+
+    auto args = span( argv, argc );
+    if ( argc < 3 ) {
+      show_usage( args.front(), "ERROR: required arguments are missing." );
+      return EXIT_FAILURE;
+    }
+
+    uint64_t count = 1000;
+    uint64_t flows = 100;
+    uint16_t port = 80;
+    uint64_t timeout_ms = 10000;
+    const char* tundev = TUN_DFLT;
+    const char* local_address = LOCAL_ADDRESS_DFLT;
+    bool offload = false;
+
+    size_t curr = 1;
+    while ( args.size() - curr > 2 ) {
+      if ( strncmp( "-n", args[curr], 3 ) == 0 and curr + 3 < args.size() ) {
+        count = strtoull( args[curr + 1], nullptr, 0 );
+        curr += 2;
+      } else if ( strncmp( "-c", args[curr], 3 ) == 0 and curr + 3 < args.size() ) {
+        flows = strtoull( args[curr + 1], nullptr, 0 );
+        curr += 2;
+      } else if ( strncmp( "-p", args[curr], 3 ) == 0 and curr + 3 < args.size() ) {
+        port = static_cast<uint16_t>( strtol( args[curr + 1], nullptr, 0 ) );
+        curr += 2;
+      } else if ( strncmp( "-t", args[curr], 3 ) == 0 and curr + 3 < args.size() ) {
+        timeout_ms = strtoull( args[curr + 1], nullptr, 0 );
+        curr += 2;
+      } else if ( strncmp( "-d", args[curr], 3 ) == 0 and curr + 3 < args.size() ) {
+        tundev = args[curr + 1];
+        curr += 2;
+      } else if ( strncmp( "-s", args[curr], 3 ) == 0 and curr + 3 < args.size() ) {
+        local_address = args[curr + 1];
+        curr += 2;
+      } else if ( strncmp( "-o", args[curr], 3 ) == 0 ) {
+        offload = true;
+        curr += 1;
+      } else if ( strncmp( "-h", args[curr], 3 ) == 0 ) {
+        show_usage( args[0], nullptr );
+        return EXIT_SUCCESS;
+      } else {
+        show_usage( args[0], string( "ERROR: unrecognized option " + string( args[curr] ) ).c_str() );
+        return EXIT_FAILURE;
+      }
+    }
+    if ( flows == 0 or port == 0 ) {
+      show_usage( args[0], "ERROR: flows and port cannot be zero." );
+      return EXIT_FAILURE;
+    }
+
+    const string host { args[curr] };
+    const string path { args[curr + 1] };
+    Load load { .server = Address { host, to_string( port ) },
+                .request = "GET " + path + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n\r\n",
+                .timeout = milliseconds( timeout_ms ),
+                .remaining = count };
+
+    TCPReactor reactor { TCPOverIPv4OverTunFdAdapter { TunFD { tundev, false, offload } } };
+    AsyncTCP tcp { reactor, Address { local_address } };
+    const size_t timer_category = reactor.loop().add_category( "http_load: fetch timeout" );
+
+    const auto start = steady_clock::now();
+    for ( uint64_t i = 0; i < min( flows, count ); ++i ) {
+      tcp.spawn( flow( tcp, reactor.loop(), timer_category, load ) );
+    }
+    tcp.run();
+    const duration<double> elapsed = steady_clock::now() - start;
+
+    cout << load.fetched << " fetches (" << load.bytes << " bytes) in " << fixed << setprecision( 3 )
+         << elapsed.count() << " s: " << setprecision( 0 ) << static_cast<double>( load.fetched ) / elapsed.count()
+         << " fetches/s with " << min( flows, count ) << " in flight (" << load.failed << " failed).\n";
+    print_latency_report( cout );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
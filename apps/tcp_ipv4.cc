@@ -1,15 +1,22 @@
 #include "bidirectional_stream_copy.hh"
+#include "latency.hh"
 #include "tcp_config.hh"
 #include "tcp_minnow_socket.hh"
+#include "trace.hh"
 #include "tun.hh"
 
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <mutex>
+#include <optional>
 #include <random>
 #include <span>
 #include <string>
+#include <thread>
 #include <tuple>
 
 using namespace std;
@@ -35,11 +42,15 @@ void show_usage( const char* argv0, const char* msg )
 
        << "   -t <tmout>      Set rt_timeout to tmout                         " << TCPConfig::TIMEOUT_DFLT << "\n\n"
 
-       << "   -d <tundev>     Connect to tun <tundev>                         " << TUN_DFLT << "\n\n"
+       << "   -d <tundev>     Connect to tun <tundev>                         " << TUN_DFLT << "\n"
+       << "   -o              Use checksum and segmentation offloads          (no offloads)\n\n"
 
        << "   -Lu <loss>      Set uplink loss to <rate> (float in 0..1)       (no loss)\n"
        << "   -Ld <loss>      Set downlink loss to <rate> (float in 0..1)     (no loss)\n\n"
 
+       << "   -S <ms>         Print connection statistics every <ms> ms       (never)\n"
+       << "   -T <file>       Write the trace events to <file> at exit        (no trace)\n\n"
+
        << "   -h              Show this message.\n\n";
 
   if ( msg != nullptr ) {
@@ -56,13 +67,17 @@ void check_argc( const span<char*>& args, size_t curr, const char* err )
   }
 }
 
-tuple<TCPConfig, FdAdapterConfig, bool, const char*> get_config( const span<char*>& args )
+tuple<TCPConfig, FdAdapterConfig, bool, const char*, bool, uint64_t, const char*> get_config(
+  const span<char*>& args )
 {
   TCPConfig c_fsm {};
   c_fsm.isn = Wrap32 { random_device()() };
 
   FdAdapterConfig c_filt {};
   const char* tundev = nullptr;
+  bool offload = false;
+  uint64_t stats_ms = 0;
+  const char* trace_file = nullptr;
 
   size_t curr = 1;
   bool listen = false;
@@ -101,6 +116,10 @@ tuple<TCPConfig, FdAdapterConfig, bool, const char*> get_config( const span<char
       tundev = args[curr + 1];
       curr += 2;
 
+    } else if ( strncmp( "-o", args[curr], 3 ) == 0 ) {
+      offload = true;
+      curr += 1;
+
     } else if ( strncmp( "-Lu", args[curr], 3 ) == 0 ) {
       check_argc( args, curr, "ERROR: -Lu requires one argument." );
       const float lossrate = strtof( args[curr + 1], nullptr );
@@ -117,6 +136,16 @@ tuple<TCPConfig, FdAdapterConfig, bool, const char*> get_config( const span<char
         = static_cast<LossRateDnT>( static_cast<float>( numeric_limits<LossRateDnT>::max() ) * lossrate );
       curr += 2;
 
+    } else if ( strncmp( "-S", args[curr], 3 ) == 0 ) {
+      check_argc( args, curr, "ERROR: -S requires one argument." );
+      stats_ms = strtoull( args[curr + 1], nullptr, 0 );
+      curr += 2;
+
+    } else if ( strncmp( "-T", args[curr], 3 ) == 0 ) {
+      check_argc( args, curr, "ERROR: -T requires one argument." );
+      trace_file = args[curr + 1];
+      curr += 2;
+
     } else if ( strncmp( "-h", args[curr], 3 ) == 0 ) {
       show_usage( args[0], nullptr );
       exit( 0 );
@@ -139,8 +168,41 @@ tuple<TCPConfig, FdAdapterConfig, bool, const char*> get_config( const span<char
     c_filt.source = { source_address, source_port };
   }
 
-  return make_tuple( c_fsm, c_filt, listen, tundev );
+  return make_tuple( c_fsm, c_filt, listen, tundev, offload, stats_ms, trace_file );
 }
+
+// Prints a socket's statistics to stderr every so often, from its own thread, until destroyed
+template<class SocketT>
+class StatsPrinter
+{
+  mutex mutex_ {};
+  condition_variable done_ {};
+  bool finished_ {};
+  thread thread_;
+
+public:
+  StatsPrinter( const SocketT& socket, chrono::milliseconds interval )
+    : thread_( [this, &socket, interval] {
+      unique_lock lock { mutex_ };
+      while ( not done_.wait_for( lock, interval, [&] { return finished_; } ) ) {
+        cerr << "DEBUG: minnow stats: " << socket.stats().to_string() << "\n";
+      }
+    } )
+  {}
+
+  StatsPrinter( const StatsPrinter& other ) = delete;
+  StatsPrinter& operator=( const StatsPrinter& other ) = delete;
+
+  ~StatsPrinter()
+  {
+    {
+      const lock_guard lock { mutex_ };
+      finished_ = true;
+    }
+    done_.notify_one();
+    thread_.join();
+  }
+};
 } // namespace
 
 int main( int argc, char** argv )
@@ -157,9 +219,14 @@ int main( int argc, char** argv )
       return EXIT_FAILURE;
     }
 
-    auto [c_fsm, c_filt, listen, tun_dev_name] = get_config( args );
+    auto [c_fsm, c_filt, listen, tun_dev_name, offload, stats_ms, trace_file] = get_config( args );
     LossyTCPOverIPv4MinnowSocket tcp_socket( LossyFdAdapter<TCPOverIPv4OverTunFdAdapter>(
-      TCPOverIPv4OverTunFdAdapter( TunFD( tun_dev_name == nullptr ? TUN_DFLT : tun_dev_name ) ) ) );
+      TCPOverIPv4OverTunFdAdapter( TunFD( tun_dev_name == nullptr ? TUN_DFLT : tun_dev_name, false, offload ) ) ) );
+
+    optional<StatsPrinter<LossyTCPOverIPv4MinnowSocket>> stats_printer;
+    if ( stats_ms > 0 ) {
+      stats_printer.emplace( tcp_socket, chrono::milliseconds( stats_ms ) );
+    }
 
     if ( listen ) {
       tcp_socket.listen_and_accept( c_fsm, c_filt );
@@ -169,6 +236,14 @@ int main( int argc, char** argv )
 
     bidirectional_stream_copy( tcp_socket, tcp_socket.peer_address().to_string() );
     tcp_socket.wait_until_closed();
+    if ( stats_printer ) {
+      stats_printer.reset();
+      cerr << "DEBUG: minnow stats: " << tcp_socket.stats().to_string() << "\n";
+    }
+    if ( trace_file != nullptr ) {
+      trace::dump( trace_file );
+    }
+    print_latency_report( cerr );
   } catch ( const exception& e ) {
     cerr << "Exception: " << e.what() << endl;
     return EXIT_FAILURE;
@@ -0,0 +1,159 @@
+#include "tcp_config.hh"
+#include "tcp_reactor.hh"
+#include "tun.hh"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <span>
+#include <string>
+
+using namespace std;
+
+constexpr const char* TUN_DFLT = "tun144";
+
+namespace {
+void show_usage( const char* argv0, const char* msg )
+{
+  cout << "Usage: " << argv0 << " [options] <port>\n\n"
+       << "   Serve every connection to <port> (on any address routed to the TUN device) from one thread.\n\n"
+       << "   Option                                                          Default\n"
+       << "   --                                                              --\n\n"
+
+       << "   -m <mode>       echo (send back what arrives) or discard        echo\n\n"
+
+       << "   -w <winsz>      Use a window of <winsz> bytes                   " << TCPConfig::DEFAULT_CAPACITY
+       << "\n\n"
+
+       << "   -d <tundev>     Connect to tun <tundev>                         " << TUN_DFLT << "\n"
+       << "   -o              Use checksum and segmentation offloads          (no offloads)\n\n"
+
+       << "   -h              Show this message.\n\n";
+
+  if ( msg != nullptr ) {
+    cout << msg;
+  }
+  cout << endl;
+}
+
+struct Stats
+{
+  uint64_t accepted {};
+  uint64_t closed {};
+  uint64_t bytes_in {};
+  uint64_t bytes_out {};
+};
+
+// echo: send back as much as the outbound stream takes, and finish once the client has
+void echo( TCPReactor::Connection& connection, Stats& stats )
+{
+  Reader& inbound = connection.inbound();
+  while ( inbound.bytes_buffered() > 0 ) {
+    const string_view data = inbound.peek();
+    const size_t written = connection.write( data );
+    stats.bytes_in += written;
+    stats.bytes_out += written;
+    inbound.pop( written );
+    if ( written < data.size() ) {
+      return; // (called again from on_writable)
+    }
+  }
+  if ( inbound.is_finished() ) {
+    connection.close();
+  }
+}
+
+// discard: throw away what arrives, and finish once the client has
+void discard( TCPReactor::Connection& connection, Stats& stats )
+{
+  Reader& inbound = connection.inbound();
+  stats.bytes_in += inbound.bytes_buffered();
+  inbound.pop( inbound.bytes_buffered() );
+  if ( inbound.is_finished() ) {
+    connection.close();
+  }
+}
+} // namespace
+
+int main( int argc, char** argv )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort(); // For sticklers: don't try to access argv[0] if argc <= 0.
+    }
+
+    auto args = span( argv, argc );
+    if ( argc < 2 ) {
+      show_usage( args.front(), "ERROR: required arguments are missing." );
+      return EXIT_FAILURE;
+    }
+
+    TCPConfig config;
+    const char* tundev = TUN_DFLT;
+    bool echo_mode = true;
+    bool offload = false;
+
+    size_t curr = 1;
+    while ( args.size() - curr > 1 ) {
+      if ( strncmp( "-m", args[curr], 3 ) == 0 and curr + 2 < args.size() ) {
+        if ( strcmp( "echo", args[curr + 1] ) != 0 and strcmp( "discard", args[curr + 1] ) != 0 ) {
+          show_usage( args[0], "ERROR: -m takes echo or discard." );
+          return EXIT_FAILURE;
+        }
+        echo_mode = strcmp( "echo", args[curr + 1] ) == 0;
+        curr += 2;
+      } else if ( strncmp( "-w", args[curr], 3 ) == 0 and curr + 2 < args.size() ) {
+        config.recv_capacity = strtol( args[curr + 1], nullptr, 0 );
+        curr += 2;
+      } else if ( strncmp( "-d", args[curr], 3 ) == 0 and curr + 2 < args.size() ) {
+        tundev = args[curr + 1];
+        curr += 2;
+      } else if ( strncmp( "-o", args[curr], 3 ) == 0 ) {
+        offload = true;
+        curr += 1;
+      } else if ( strncmp( "-h", args[curr], 3 ) == 0 ) {
+        show_usage( args[0], nullptr );
+        return EXIT_SUCCESS;
+      } else {
+        show_usage( args[0], string( "ERROR: unrecognized option " + string( args[curr] ) ).c_str() );
+        return EXIT_FAILURE;
+      }
+    }
+    const auto port = static_cast<uint16_t>( strtol( args[curr], nullptr, 0 ) );
+    if ( port == 0 ) {
+      show_usage( args[0], "ERROR: port cannot be zero." );
+      return EXIT_FAILURE;
+    }
+
+    TCPReactor reactor { TCPOverIPv4OverTunFdAdapter { TunFD { tundev, false, offload } } };
+
+    Stats stats;
+    const auto serve = echo_mode ? echo : discard;
+    reactor.listen( port,
+                    config,
+                    { .on_open = [&]( TCPReactor::Connection& ) { ++stats.accepted; },
+                      .on_readable = [&]( TCPReactor::Connection& c ) { serve( c, stats ); },
+                      .on_writable = [&]( TCPReactor::Connection& c ) { serve( c, stats ); },
+                      .on_close = [&]( TCPReactor::Connection& ) { ++stats.closed; } } );
+
+    // report once a second
+    const size_t category = reactor.loop().add_category( "report" );
+    function<void()> report = [&] {
+      cerr << "DEBUG: " << reactor.size() << " connections (" << stats.accepted << " accepted, " << stats.closed
+           << " closed), " << stats.bytes_in << " bytes in, " << stats.bytes_out << " bytes out.\n";
+      reactor.loop().add_timer( category, EventLoop::Clock::now() + chrono::seconds( 1 ), report );
+    };
+    reactor.loop().add_timer( category, EventLoop::Clock::now() + chrono::seconds( 1 ), report );
+
+    cerr << "DEBUG: serving port " << port << " on " << tundev << " (" << ( echo_mode ? "echo" : "discard" )
+         << ").\n";
+    reactor.run();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,130 @@
+#include "trace.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <span>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+void show_usage( const char* argv0, const char* msg )
+{
+  cout << "Usage: " << argv0 << " [options] <dump>\n\n"
+       << "   Print the events in a trace dump (written by trace::dump()), in the order they happened.\n\n"
+       << "   -j              Print Chrome trace JSON (for chrome://tracing or ui.perfetto.dev) instead of text\n"
+       << "   -h              Show this message.\n\n";
+
+  if ( msg != nullptr ) {
+    cout << msg;
+  }
+  cout << endl;
+}
+
+// A record, with the thread that recorded it
+struct Event
+{
+  uint32_t thread;
+  trace::Record record;
+};
+
+// Escape a string for JSON (the fields are addresses and numbers, but be safe)
+string json_string( const string_view str )
+{
+  string ret = "\"";
+  for ( const char c : str ) {
+    if ( c == '"' or c == '\\' ) {
+      ret += '\\';
+    }
+    ret += c;
+  }
+  return ret + "\"";
+}
+
+void print_text( const vector<Event>& events, const trace::Dump& dump )
+{
+  cout << fixed << setprecision( 3 );
+  for ( const auto& [thread, record] : events ) {
+    const double us = static_cast<double>( record.tsc - dump.first_tsc ) * dump.ns_per_tick / 1000;
+    cout << setw( 14 ) << us << " us  thread " << thread << "  " << left << setw( 17 )
+         << trace::name( record.event ) << right;
+    for ( const auto& [field, value] : trace::fields( record ) ) {
+      cout << " " << field << "=" << value;
+    }
+    cout << "\n";
+  }
+}
+
+void print_json( const vector<Event>& events, const trace::Dump& dump )
+{
+  cout << fixed << setprecision( 3 ) << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  for ( const auto& [thread, record] : events ) {
+    const double us = static_cast<double>( record.tsc - dump.first_tsc ) * dump.ns_per_tick / 1000;
+    cout << ( first ? "\n" : ",\n" ) << "{\"name\":" << json_string( trace::name( record.event ) )
+         << ",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,\"tid\":" << thread << ",\"ts\":" << us << ",\"args\":{";
+    bool first_field = true;
+    for ( const auto& [field, value] : trace::fields( record ) ) {
+      cout << ( first_field ? "" : "," ) << json_string( field ) << ":" << json_string( value );
+      first_field = false;
+    }
+    cout << "}}";
+    first = false;
+  }
+  cout << "\n]}\n";
+}
+} // namespace
+
+int main( int argc, char** argv )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort(); // For sticklers: don't try to access argv[0] if argc <= 0.
+    }
+
+    auto args = span( argv, argc );
+    bool json = false;
+    size_t curr = 1;
+    while ( curr < args.size() and args[curr][0] == '-' ) {
+      if ( strncmp( "-j", args[curr], 3 ) == 0 ) {
+        json = true;
+      } else if ( strncmp( "-h", args[curr], 3 ) == 0 ) {
+        show_usage( args[0], nullptr );
+        return EXIT_SUCCESS;
+      } else {
+        show_usage( args[0], string( "ERROR: unrecognized option " + string( args[curr] ) ).c_str() );
+        return EXIT_FAILURE;
+      }
+      ++curr;
+    }
+    if ( curr + 1 != args.size() ) {
+      show_usage( args[0], "ERROR: expected one dump file." );
+      return EXIT_FAILURE;
+    }
+
+    const trace::Dump dump = trace::read_dump( args[curr] );
+    vector<Event> events;
+    for ( const auto& [thread, records] : dump.threads ) {
+      for ( const auto& record : records ) {
+        events.push_back( { thread, record } );
+      }
+    }
+    ranges::stable_sort( events, {}, []( const Event& e ) { return e.record.tsc; } );
+
+    if ( json ) {
+      print_json( events, dump );
+    } else {
+      print_text( events, dump );
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -1,5 +1,7 @@
-#include "socket.hh"
-#include "tacp minnow socket"
+#include "async_tcp.hh"
+#include "tcp_reactor.hh"
+#include "tun.hh"
+
 #include <cstdlib>
 #include <iostream>
 #include <span>
@@ -7,10 +9,9 @@
 
 using namespace std;
 
-void get_URL( const string& host, const string& path )
+Task<> get_URL( AsyncTCP& tcp, const string host, const string path )
 {
-   TCPSocket socket;
-        socket.connect(Address(host, "http"));
+        AsyncTCP::Socket socket = co_await tcp.connect(Address(host, "http"));
 
         // 构造并发送 HTTP GET 请求
         std::string request = "GET " + path + " HTTP/1.1\r\n";
@@ -18,19 +19,13 @@ void get_URL( const string& host, const string& path )
         request += "Connection: close\r\n";
         request += "\r\n";
 
-        socket.write(request);
+        co_await socket.write(request);
 
-        // 读取并输出响应
-        string readtext;
-        while (!socket.eof()) {
-            
-            socket.read(readtext);
+        // 读取并输出响应（读到空串说明对方已关闭）
+        for (string readtext = co_await socket.read(); !readtext.empty(); readtext = co_await socket.read()) {
             cout << readtext;
         }
         socket.close();
-
-  cerr << "Function called: get_URL(" << host << ", " << path << ")\n";
-  cerr << "Warning: get_URL() has not been implemented yet.\n";
 }
 
 int main( int argc, char* argv[] )
@@ -55,8 +50,15 @@ int main( int argc, char* argv[] )
     const string host { args[1] };
     const string path { args[2] };
 
-    // Call the student-written function.
-    get_URL( host, path );
+    // Call the student-written function: the fetch runs as a coroutine on the reactor's thread, over the
+    // CS144 TCP implementation on tun144 (as CS144TCPSocket does).
+    TCPReactor reactor { TCPOverIPv4OverTunFdAdapter { TunFD { "tun144" } } };
+    TCPConfig tcp_config;
+    tcp_config.rt_timeout = 100;
+    AsyncTCP tcp { reactor, Address { "169.254.144.9" }, tcp_config };
+
+    tcp.spawn( get_URL( tcp, host, path ) );
+    tcp.run();
   } catch ( const exception& e ) {
     cerr << e.what() << "\n";
     return EXIT_FAILURE;
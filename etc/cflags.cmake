@@ -6,3 +6,15 @@ set(SANITIZING_FLAGS -fno-sanitize-recover=all -fsanitize=undefined -fsanitize=a
 # ask for more warnings from the compiler
 set (CMAKE_BASE_CXX_FLAGS "${CMAKE_CXX_FLAGS}")
 set (CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -Wall -Wpedantic -Wextra -Weffc++ -Werror -Wshadow -Wpointer-arith -Wcast-qual -Wformat=2 -Wno-unqualified-std-cast-call -Wno-non-virtual-dtor")
+
+# tracepoints (see util/trace.hh); configure with -DMINNOW_TRACE=OFF to compile them out
+option (MINNOW_TRACE "Record events at the TCP/IP stack's tracepoints" ON)
+if (MINNOW_TRACE)
+  add_compile_definitions (MINNOW_TRACE)
+endif ()
+
+# latency probes (see util/latency.hh); configure with -DMINNOW_LATENCY=ON to time the hot paths
+option (MINNOW_LATENCY "Record latency histograms at the TCP/IP stack's hot paths" OFF)
+if (MINNOW_LATENCY)
+  add_compile_definitions (MINNOW_LATENCY)
+endif ()
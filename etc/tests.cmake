@@ -58,6 +58,20 @@ ttest(net_interface)
 
 ttest(router)
 
+ttest(tun_multi_queue)
+ttest(tcp_demux)
+ttest(netem_adapter)
+ttest(tcp_stats)
+ttest(trace)
+ttest(pcapng)
+ttest(latency)
+ttest(benchmark)
+ttest(perf_counters)
+ttest(packet_pool)
+ttest(packet_buffer)
+ttest(ipv4_fragments)
+ttest(path_mtu)
+
 add_custom_target (check0 COMMAND ${CMAKE_CTEST_COMMAND} --output-on-failure --stop-on-failure --timeout 12 -R 'webget|^byte_stream_')
 
 add_custom_target (check_webget COMMAND ${CMAKE_CTEST_COMMAND} --output-on-failure --timeout 12 -R 'webget')
@@ -76,6 +90,15 @@ add_custom_target (check6 COMMAND ${CMAKE_CTEST_COMMAND} --output-on-failure --s
 
 add_custom_target (speed COMMAND ${CMAKE_CTEST_COMMAND} --output-on-failure --timeout 12 -R '_speed_test')
 
+# The benchmark suite (tests/benchmarks.cc): `benchmark_baseline` saves its results, and after a change,
+# `benchmark_check` runs it again and fails if any benchmark regressed against them
+set (BENCHMARK_BASELINE "${CMAKE_BINARY_DIR}/benchmarks.baseline.json"
+  CACHE FILEPATH "Benchmark results to compare against")
+add_custom_target (benchmark_baseline COMMAND benchmarks -j "${BENCHMARK_BASELINE}")
+add_custom_target (benchmark_check
+  COMMAND benchmarks -j "${CMAKE_BINARY_DIR}/benchmarks.json"
+  COMMAND benchmark_compare "${BENCHMARK_BASELINE}" "${CMAKE_BINARY_DIR}/benchmarks.json")
+
 set(compile_name_opt "compile with optimization")
 add_test(NAME ${compile_name_opt}
   COMMAND "${CMAKE_COMMAND}" --build "${CMAKE_BINARY_DIR}" -t speed_testing)
@@ -90,3 +113,11 @@ set_tests_properties(${compile_name_opt} PROPERTIES FIXTURES_SETUP compile_opt)
 
 stest(byte_stream_speed_test)
 stest(reassembler_speed_test)
+stest(tcp_speed_test)
+stest(net_interface_speed_test)
+stest(eventloop_speed_test)
+stest(stream_copy_speed_test)
+stest(adapter_batch_speed_test)
+stest(tun_offload_speed_test)
+stest(tcp_reactor_speed_test)
+stest(async_tcp_speed_test)
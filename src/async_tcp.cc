@@ -0,0 +1,193 @@
+#include "async_tcp.hh"
+
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+namespace {
+// local ports are taken from the range Linux uses for ephemeral ports
+constexpr uint16_t FIRST_PORT = 32768;
+constexpr uint16_t LAST_PORT = 60999;
+} // namespace
+
+AsyncTCP::AsyncTCP( TCPReactor& reactor, const Address& local_address, const TCPConfig& config )
+  : reactor_( reactor )
+  , local_address_( local_address.ipv4_numeric() )
+  , config_( config )
+  , next_port_( static_cast<uint16_t>( uniform_int_distribution<uint16_t> { FIRST_PORT, LAST_PORT }( rng_ ) ) )
+{}
+
+Task<AsyncTCP::Socket> AsyncTCP::connect( const Address remote )
+{
+  TCPConfig config = config_;
+  config.isn = Wrap32 { static_cast<uint32_t>( rng_() ) };
+
+  auto state = make_shared<State>();
+  state->connection = &reactor_.connect( config, free_tuple( remote ), handlers( state ) );
+  co_await OpenAwaiter { *state };
+
+  if ( not state->opened ) {
+    throw runtime_error( "AsyncTCP: could not connect to " + remote.to_string() );
+  }
+  co_return Socket { move( state ) };
+}
+
+void AsyncTCP::spawn( Task<> task )
+{
+  ++running_;
+  run_detached( move( task ) );
+}
+
+void AsyncTCP::run()
+{
+  if ( running_ > 0 and not error_ ) {
+    reactor_.run();
+  }
+  if ( error_ ) {
+    rethrow_exception( exchange( error_, nullptr ) );
+  }
+}
+
+AsyncTCP::Detached AsyncTCP::run_detached( Task<> task )
+{
+  try {
+    co_await task;
+  } catch ( ... ) {
+    if ( not error_ ) {
+      error_ = current_exception();
+    }
+  }
+
+  if ( --running_ == 0 or error_ ) {
+    reactor_.stop();
+  }
+}
+
+FourTuple AsyncTCP::free_tuple( const Address& remote )
+{
+  FourTuple tuple {
+    .local_address = local_address_, .remote_address = remote.ipv4_numeric(), .remote_port = remote.port() };
+  for ( uint32_t tries = 0; tries <= LAST_PORT - FIRST_PORT; ++tries ) {
+    tuple.local_port = next_port_;
+    next_port_ = next_port_ == LAST_PORT ? FIRST_PORT : next_port_ + 1;
+    if ( not reactor_.contains( tuple ) ) {
+      return tuple;
+    }
+  }
+  throw runtime_error( "AsyncTCP: no free local port to connect to " + remote.to_string() );
+}
+
+//! \details Each callback resumes the task waiting for what it reports. The task runs until it next suspends
+//! (or finishes) before the callback returns, so it sees the connection exactly as the reactor left it.
+TCPReactor::Handlers AsyncTCP::handlers( const shared_ptr<State>& state )
+{
+  return {
+    .on_open =
+      [state]( TCPReactor::Connection& ) {
+        state->opened = true;
+        if ( state->opener ) {
+          exchange( state->opener, {} ).resume();
+        }
+      },
+    .on_readable =
+      [state]( TCPReactor::Connection& connection ) {
+        if ( state->reader ) {
+          exchange( state->reader, {} ).resume();
+        } else if ( state->orphaned ) {
+          connection.inbound().pop( connection.inbound().bytes_buffered() );
+        }
+      },
+    .on_writable =
+      [state]( TCPReactor::Connection& ) {
+        if ( state->writer and state->write_some() ) {
+          exchange( state->writer, {} ).resume();
+        }
+      },
+    .on_close =
+      [state]( TCPReactor::Connection& ) {
+        state->connection = nullptr;
+        for ( auto* task : { &state->opener, &state->reader, &state->writer } ) {
+          if ( *task ) {
+            exchange( *task, {} ).resume();
+          }
+        }
+      },
+  };
+}
+
+bool AsyncTCP::State::write_some()
+{
+  unwritten.remove_prefix( connection->write( unwritten ) );
+  return unwritten.empty();
+}
+
+AsyncTCP::Socket& AsyncTCP::Socket::operator=( Socket&& other ) noexcept
+{
+  Socket old { move( other ) };
+  swap( state_, old.state_ );
+  return *this;
+}
+
+AsyncTCP::Socket::~Socket()
+{
+  if ( state_ ) {
+    state_->orphaned = true;
+    if ( state_->connection ) {
+      Reader& inbound = state_->connection->inbound();
+      inbound.pop( inbound.bytes_buffered() );
+    }
+    close();
+  }
+}
+
+bool AsyncTCP::Socket::ReadAwaiter::await_ready() const
+{
+  if ( state.connection == nullptr ) {
+    return true;
+  }
+  const Reader& inbound = state.connection->inbound();
+  return inbound.bytes_buffered() > 0 or inbound.is_finished() or inbound.has_error();
+}
+
+string AsyncTCP::Socket::ReadAwaiter::await_resume()
+{
+  string data;
+  if ( state.connection != nullptr and not state.connection->inbound().has_error() ) {
+    Reader& inbound = state.connection->inbound();
+    ::read( inbound, inbound.bytes_buffered(), data );
+  }
+  return data;
+}
+
+bool AsyncTCP::Socket::WriteAwaiter::await_ready()
+{
+  state.unwritten = data;
+  return state.connection == nullptr or state.write_some();
+}
+
+void AsyncTCP::Socket::WriteAwaiter::await_resume()
+{
+  if ( not state.unwritten.empty() ) {
+    throw runtime_error( "AsyncTCP: connection closed before the write finished" );
+  }
+}
+
+void AsyncTCP::Socket::close()
+{
+  if ( state_->connection ) {
+    state_->connection->close();
+  }
+}
+
+void AsyncTCP::Socket::abort()
+{
+  if ( state_->connection ) {
+    state_->connection->abort();
+  }
+}
+
+bool AsyncTCP::Socket::eof() const
+{
+  return state_->connection == nullptr or state_->connection->inbound().is_finished();
+}
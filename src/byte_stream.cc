@@ -1,4 +1,5 @@
 #include "byte_stream.hh"
+#include "packet_pool.hh"
 
 using namespace std;
 
@@ -70,7 +71,9 @@ void Reader::pop( uint64_t len )
 string Reader::read( uint64_t len )
 {
   size_t pop_lenth = min(len, buffut.size());
-  string s = buffut.substr(0, pop_lenth);
+  if (pop_lenth == 0) return {};
+  string s = packet_pool::take_string(); // 复用回收的缓冲区
+  s.assign( buffut, 0, pop_lenth );
   pop( len );
   return s;
 }
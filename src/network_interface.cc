@@ -1,8 +1,7 @@
-#include <iostream>
-
 #include "arp_message.hh"
 #include "exception.hh"
 #include "network_interface.hh"
+#include "trace.hh"
 
 using namespace std;
 
@@ -17,8 +16,12 @@ NetworkInterface::NetworkInterface( string_view name,
   , ethernet_address_( ethernet_address )
   , ip_address_( ip_address )
 {
-  cerr << "DEBUG: Network interface has Ethernet address " << to_string( ethernet_address ) << " and IP address "
-       << ip_address.ip() << "\n";
+  MINNOW_TRACEPOINT( trace::Event::InterfaceAdded,
+                     0,
+                     ip_address.ipv4_numeric(),
+                     ethernet_address[0] << 8U | ethernet_address[1],
+                     static_cast<uint32_t>( ethernet_address[2] ) << 24U | ethernet_address[3] << 16U
+                       | ethernet_address[4] << 8U | ethernet_address[5] );
 }
 
 //! \param[in] dgram the IPv4 datagram to be sent
@@ -27,69 +30,125 @@ NetworkInterface::NetworkInterface( string_view name,
 //! can be converted to a uint32_t (raw 32-bit IP address) by using the Address::ipv4_numeric() method.
 void NetworkInterface::send_datagram( const InternetDatagram& dgram, const Address& next_hop )
 {
+  send_datagram( InternetDatagram( dgram ), next_hop ); // 唯一的一次载荷复制
+}
+
+//! \param[in] dgram the IPv4 datagram to be sent; its payload buffers are moved into the frame, not copied
+//! \param[in] next_hop the IP address of the interface to send it to
+void NetworkInterface::send_datagram( InternetDatagram&& dgram, const Address& next_hop )
+{
+  // 超过 MTU 的数据报先分片，每个分片再单独发送；设置了 DF 的只能丢弃
+  if ( _mtu != 0 and IPv4Header::LENGTH + dgram.payload_size() > _mtu ) {
+    vector<InternetDatagram> fragments;
+    if ( not fragment_datagram( dgram, _mtu, fragments ) ) {
+      ++_num_too_big;
+      return;
+    }
+    for ( auto& fragment : fragments ) {
+      send_datagram( move( fragment ), next_hop );
+    }
+    return;
+  }
+
   const uint32_t next_hop_ip = next_hop.ipv4_numeric();
   auto it = _add_cache.find(next_hop_ip);
   if (it != _add_cache.end()) {
-    Serializer serializer;
-    dgram.serialize(serializer);
-    vector<std::string> serialized_data = serializer.output();
-    _frames_out.emplace(send_datagram((*it).second.first, EthernetHeader::TYPE_IPv4, serialized_data ));
+    it->second.used = true;
+    _frames_out.emplace(
+      send_datagram( it->second.ethernet_address, EthernetHeader::TYPE_IPv4, dgram.release_serialized() ) );
     send_outgoing_frames();
   }
   else {
     auto it1 = _addr_request_time.find(next_hop_ip);
     if (it1 == _addr_request_time.end() || _current_time - (*it1).second > 5000)   {  //5s以上会重新发送ARP
-      ARPMessage msg;
-      msg.sender_ethernet_address = ethernet_address_;
-      msg.sender_ip_address = ip_address_.ipv4_numeric();
-      msg.target_ip_address = next_hop_ip;
-      msg.opcode = ARPMessage::OPCODE_REQUEST;
-      Serializer serializer;
-      msg.serialize(serializer);
-      vector<std::string> serialized_data = serializer.output();
-      _frames_out.emplace(send_datagram(ETHERNET_BROADCAST, EthernetHeader::TYPE_ARP, serialized_data)) ;
-      send_outgoing_frames();
+      send_arp_request( next_hop_ip, ETHERNET_BROADCAST );
       if (it1 == _addr_request_time.end()) {_addr_request_time.emplace(next_hop_ip, _current_time);}
       else {(*it1).second = _current_time;}     
     }
-    _waiting_dgrams.emplace_back(make_pair(next_hop_ip, dgram));
+    ++_num_arp_stalls;
+    [[maybe_unused]] const size_t depth = enqueue_waiting( next_hop_ip, dgram.release_serialized() );
+    MINNOW_TRACEPOINT( trace::Event::ARPMiss, 0, next_hop_ip, depth );
+  }
+}
+
+// dst 为广播地址时是普通的 ARP 查询；为已知地址时是单播的刷新探测
+void NetworkInterface::send_arp_request( const uint32_t target_ip, const EthernetAddress& dst )
+{
+  ARPMessage msg;
+  msg.sender_ethernet_address = ethernet_address_;
+  msg.sender_ip_address = ip_address_.ipv4_numeric();
+  msg.target_ip_address = target_ip;
+  msg.opcode = ARPMessage::OPCODE_REQUEST;
+  _frames_out.emplace( send_datagram( dst, EthernetHeader::TYPE_ARP, serialize( msg ) ) );
+  send_outgoing_frames();
+}
+
+void NetworkInterface::set_pending_limit( const size_t max_datagrams_per_next_hop, const PendingDropPolicy policy )
+{
+  _pending_limit = max_datagrams_per_next_hop;
+  _pending_policy = policy;
+}
+
+// 每个下一跳有自己的有界队列，满了按照丢弃策略处理；返回该下一跳排队的数据报数
+size_t NetworkInterface::enqueue_waiting( const uint32_t next_hop_ip, vector<string>&& serialized_dgram )
+{
+  const auto it = _waiting_dgrams.try_emplace( next_hop_ip ).first;
+  auto& waiting = it->second;
+  if ( waiting.size() >= _pending_limit ) {
+    ++_num_dropped_dgrams;
+    if ( _pending_policy == PendingDropPolicy::DropNewest or waiting.empty() ) {
+      if ( waiting.empty() ) {
+        _waiting_dgrams.erase( it ); // 不留下空队列
+        return 0;
+      }
+      return waiting.size();
+    }
+    waiting.pop_front();
+    --_num_waiting_dgrams;
   }
+  waiting.push_back( move( serialized_dgram ) );
+  ++_num_waiting_dgrams;
+  return waiting.size();
 }
 
-EthernetFrame NetworkInterface::send_datagram(EthernetAddress dst, uint16_t type, const vector<std::string> payload) {
+// 封装只是在前面加上 14 字节的以太网首部，载荷缓冲区直接移动进帧里
+EthernetFrame NetworkInterface::send_datagram(EthernetAddress dst, uint16_t type, vector<std::string> payload) {
   EthernetFrame frame;
   frame.header.src = ethernet_address_;
   frame.header.dst = dst;
-  frame.payload = payload;
+  frame.payload = move( payload );
   frame.header.type = type;
   return frame;
 }
 
 //! \param[in] frame the incoming Ethernet frame
 void NetworkInterface::recv_frame( const EthernetFrame& frame )
+{
+  auto &header = frame.header;
+  if (header.dst == ethernet_address_ || header.dst == ETHERNET_BROADCAST) {
+    recv_frame( EthernetFrame( frame ) );
+  }
+}
+
+//! \param[in] frame the incoming Ethernet frame; its payload buffers are handed to the parsed datagram
+void NetworkInterface::recv_frame( EthernetFrame&& frame )
 {
   auto &header = frame.header;
   if (header.dst == ethernet_address_ || header.dst == ETHERNET_BROADCAST) {
     if (header.type == EthernetHeader::TYPE_IPv4) {
       InternetDatagram dgram;
-      Parser parser(frame.payload);
+      Parser parser(move(frame.payload));
       dgram.parse(parser) ;    
       if (!parser.has_error()) {
-        datagrams_received_.emplace(dgram);
+        datagrams_received_.emplace(move(dgram));
       }
     }
     else if (header.type == EthernetHeader::TYPE_ARP) {
       ARPMessage asg;
-      Parser parser(frame.payload);
+      Parser parser(move(frame.payload));
       asg.parse(parser) ;   
       if (parser.has_error()) return;
-      if (_add_cache.find(asg.sender_ip_address) == _add_cache.end()) {
-        _add_cache[asg.sender_ip_address] = {asg.sender_ethernet_address, _current_time};
-      }
-      else {
-        _add_cache[asg.sender_ip_address].first = asg.sender_ethernet_address;
-        _add_cache[asg.sender_ip_address].second = _current_time;
-      }
+      learn_mapping( asg.sender_ip_address, asg.sender_ethernet_address );
       auto it1 = _addr_request_time.find(asg.sender_ip_address);
       if (it1 != _addr_request_time.end()) {
         _addr_request_time.erase(it1);
@@ -102,29 +161,30 @@ void NetworkInterface::recv_frame( const EthernetFrame& frame )
         reply_msg.target_ethernet_address = asg.sender_ethernet_address;
         reply_msg.target_ip_address = asg.sender_ip_address;
         reply_msg.opcode = ARPMessage::OPCODE_REPLY;
-        Serializer serializer;
-        reply_msg.serialize(serializer);
-        vector<std::string> serialized_data = serializer.output();
-        _frames_out.emplace(send_datagram(asg.sender_ethernet_address, EthernetHeader::TYPE_ARP, serialized_data));
+        _frames_out.emplace(send_datagram(asg.sender_ethernet_address, EthernetHeader::TYPE_ARP, serialize(reply_msg)));
         send_outgoing_frames();
       }
     }
   }
 }
 
-void NetworkInterface::try_send_waiting(uint32_t new_ip) {
-  for (auto it = _waiting_dgrams.begin(); it != _waiting_dgrams.end();) {
-    if ((*it).first == new_ip) {
-      Serializer serializer;
-      (*it).second.serialize(serializer);
-      vector<std::string> serialized_data = serializer.output();
-      _frames_out.emplace(send_datagram(_add_cache[new_ip].first, EthernetHeader::TYPE_IPv4, serialized_data));
-      send_outgoing_frames();
-      it = _waiting_dgrams.erase(it); // 正确地移除已发送的数据报文
-    } else {
-      ++it;
-    }
+// 只发送等待这个下一跳的数据报，O(k)
+void NetworkInterface::try_send_waiting( uint32_t new_ip )
+{
+  auto it = _waiting_dgrams.find( new_ip );
+  if ( it == _waiting_dgrams.end() ) {
+    return;
   }
+
+  auto& entry = _add_cache.at( new_ip );
+  entry.used = true;
+  const EthernetAddress dst = entry.ethernet_address;
+  for ( auto& serialized_dgram : it->second ) {
+    _frames_out.emplace( send_datagram( dst, EthernetHeader::TYPE_IPv4, move( serialized_dgram ) ) );
+  }
+  _num_waiting_dgrams -= it->second.size();
+  _waiting_dgrams.erase( it );
+  send_outgoing_frames();
 }
 
 
@@ -134,6 +194,7 @@ void NetworkInterface::send_outgoing_frames() {
         _frames_out.pop(); // 移除已取出的帧
 
        port_->transmit(*this, frame);
+       packet_pool::recycle( move( frame.payload ) ); // 发送完后缓冲区回收，供下一个帧的首部使用
     }
 }
 
@@ -142,13 +203,45 @@ void NetworkInterface::tick( const size_t ms_since_last_tick )
 {
   _current_time += ms_since_last_tick;
   remove_expired_cache();
+  refresh_cache();
 }
 
-void NetworkInterface::remove_expired_cache() {
-  for (auto it = _add_cache.begin();it != _add_cache.end();) {
-    if ( _current_time - (*it).second.second > 30000)  it = _add_cache.erase(it);
-    else ++it;
+void NetworkInterface::learn_mapping( const uint32_t ip, const EthernetAddress& ethernet_address )
+{
+  _add_cache[ip] = { ethernet_address, _current_time, false, false };
+  _cache_expiry.emplace( _current_time + ARP_ENTRY_TTL_MS, ip );
+  _cache_refresh.emplace( _current_time + ARP_REFRESH_AFTER_MS, ip );
+}
+
+// 只检查队首已经到期的条目，O(expired)
+void NetworkInterface::remove_expired_cache()
+{
+  while ( not _cache_expiry.empty() and _cache_expiry.front().first < _current_time ) {
+    const auto [deadline, ip] = _cache_expiry.front();
+    _cache_expiry.pop();
+
+    auto it = _add_cache.find( ip );
+    if ( it != _add_cache.end() and it->second.learned_time + ARP_ENTRY_TTL_MS == deadline ) {
+      _add_cache.erase( it );
+    }
   }
 }
 
+// 在条目过期前，对仍在使用的映射发送单播 ARP 请求，让稳定的流不会因为 ARP 而阻塞
+void NetworkInterface::refresh_cache()
+{
+  while ( not _cache_refresh.empty() and _cache_refresh.front().first <= _current_time ) {
+    const auto [deadline, ip] = _cache_refresh.front();
+    _cache_refresh.pop();
 
+    auto it = _add_cache.find( ip );
+    if ( it == _add_cache.end() or it->second.learned_time + ARP_REFRESH_AFTER_MS != deadline ) {
+      continue; // expired, or re-learned since this refresh was scheduled
+    }
+    if ( not it->second.used or it->second.refresh_sent ) {
+      continue; // idle since it was learned (let it lapse), or already being refreshed
+    }
+    it->second.refresh_sent = true;
+    send_arp_request( ip, it->second.ethernet_address );
+  }
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <deque>
 #include <queue>
 #include <vector>
 #include <utility> // For std::pair
@@ -7,6 +8,8 @@
 #include "address.hh"
 #include "ethernet_frame.hh"
 #include "ipv4_datagram.hh"
+#include "ipv4_fragments.hh"
+#include "packet_pool.hh"
 using namespace std;
 //连接IP(因特网层，或网络层)和以太网(网络接入层，或链路层)的“网络接口”。
 
@@ -29,6 +32,21 @@ public:
     virtual ~OutputPort() = default;
   };
 
+  // What to do with a datagram that arrives for a next hop whose pending queue is already full
+  enum class PendingDropPolicy
+  {
+    DropNewest, // discard the datagram that just arrived (tail drop)
+    DropOldest  // discard the datagram that has been waiting longest (head drop)
+  };
+
+  // Default number of datagrams held per unresolved next hop (matches Linux's unres_qlen)
+  static constexpr size_t DEFAULT_PENDING_LIMIT = 101;
+
+  // How long a learned ARP mapping stays valid, in milliseconds
+  static constexpr size_t ARP_ENTRY_TTL_MS = 30000;
+  // How long after learning a mapping that is in use we re-ARP for it, so it never lapses under a live flow
+  static constexpr size_t ARP_REFRESH_AFTER_MS = 25000;
+
 // Construct a network interface with given Ethernet (network-access-layer) and IP (internet-layer)
 // addresses
 // 用给定的以太网(网络访问层)和IP(因特网层)地址构造一个网络接口
@@ -43,12 +61,16 @@ public:
   //发送一个封装在以太网帧中的因特网数据报(如果它知道以太网的目的地址)。需要使用[ARP](\ref rfc::rfc826)
   //来查找下一跳的以太网目的地址。发送是通过在帧上调用' transmit() '(一个成员变量)来完成的。
   void send_datagram( const InternetDatagram& dgram, const Address& next_hop );
+  // Same, but takes over the datagram's payload buffers instead of copying them (e.g. when forwarding)
+  void send_datagram( InternetDatagram&& dgram, const Address& next_hop );
 
   // Receives an Ethernet frame and responds appropriately.
   // If type is IPv4, pushes the datagram to the datagrams_in queue.
   // If type is ARP request, learn a mapping from the "sender" fields, and send an ARP reply.
   // If type is ARP reply, learn a mapping from the "sender" fields.
   void recv_frame( const EthernetFrame& frame );   //EthernetFrame& frame，以太网包（包含一个头部和数据负载）
+  // Same, but the received datagram takes over the frame's payload buffers instead of copying them
+  void recv_frame( EthernetFrame&& frame );
 
   //当时间流逝时周期性调用
   // Called periodically when time elapses
@@ -58,11 +80,27 @@ public:
   const std::string& name() const { return name_; }
   const OutputPort& output() const { return *port_; }
   OutputPort& output() { return *port_; }
-  std::queue<InternetDatagram>& datagrams_received() { return datagrams_received_; }
-  EthernetFrame send_datagram(EthernetAddress dst, uint16_t type, const vector<std::string> payload);
+  PooledQueue<InternetDatagram>& datagrams_received() { return datagrams_received_; }
+  EthernetFrame send_datagram(EthernetAddress dst, uint16_t type, vector<std::string> payload);
   void remove_expired_cache();
   void try_send_waiting(uint32_t new_ip);
   void send_outgoing_frames();
+
+  // Bound the number of datagrams queued for each next hop that is waiting on ARP
+  void set_pending_limit( size_t max_datagrams_per_next_hop, PendingDropPolicy policy );
+  // How many datagrams are waiting on ARP (across all next hops)?
+  size_t datagrams_pending() const { return _num_waiting_dgrams; }
+  // How many datagrams have been discarded because their next hop's pending queue was full?
+  size_t datagrams_dropped() const { return _num_dropped_dgrams; }
+  // How many datagrams had to wait for an ARP reply because their next hop was not in the cache?
+  size_t arp_stalls() const { return _num_arp_stalls; }
+
+  // Fragment datagrams larger than `mtu` bytes before sending them (0: no limit, the default)
+  void set_mtu( size_t mtu ) { _mtu = mtu; }
+  size_t mtu() const { return _mtu; }
+  // How many datagrams were larger than the MTU and couldn't be fragmented (DF set), and so were discarded?
+  size_t datagrams_too_big() const { return _num_too_big; }
+
 private:
   // Human-readable name of the interface
   std::string name_;//人可读的接口名称
@@ -78,10 +116,35 @@ private:
   Address ip_address_;//ip地址
 
   // Datagrams that have been received
-  std::queue<InternetDatagram> datagrams_received_ {}; //已经收到的数据报文
-  unordered_map<uint32_t, pair<EthernetAddress, size_t>> _add_cache{};
-  queue<EthernetFrame> _frames_out{};
+  PooledQueue<InternetDatagram> datagrams_received_ {}; //已经收到的数据报文（节点从 packet_pool 回收）
+  // A learned IP-to-Ethernet mapping
+  struct ArpEntry
+  {
+    EthernetAddress ethernet_address {};
+    size_t learned_time {}; // when the mapping was (re-)learned
+    bool used {};           // has a datagram been sent using it since it was learned?
+    bool refresh_sent {};   // has a refresh request gone out since it was learned?
+  };
+  unordered_map<uint32_t, ArpEntry> _add_cache{};
+  // (deadline, IP) pairs in deadline order: every entry lives for the same TTL, so learning order is expiry
+  // order and a FIFO suffices. Superseded pairs are skipped when they reach the front.
+  queue<pair<size_t, uint32_t>> _cache_expiry{};
+  queue<pair<size_t, uint32_t>> _cache_refresh{};
+  size_t _num_arp_stalls { 0 };
+  void learn_mapping( uint32_t ip, const EthernetAddress& ethernet_address );
+  void refresh_cache();
+  void send_arp_request( uint32_t target_ip, const EthernetAddress& dst );
+  PooledQueue<EthernetFrame> _frames_out{};
   size_t _current_time {0};
   unordered_map<uint32_t, size_t> _addr_request_time{};
-  vector<pair<uint32_t, InternetDatagram>> _waiting_dgrams{};
+  // Datagrams waiting for an ARP reply (already serialized, so releasing them is only a move), keyed by next-hop
+  // IP address
+  unordered_map<uint32_t, deque<vector<std::string>>> _waiting_dgrams{};
+  size_t _pending_limit { DEFAULT_PENDING_LIMIT };
+  PendingDropPolicy _pending_policy { PendingDropPolicy::DropNewest };
+  size_t _num_waiting_dgrams { 0 };
+  size_t _num_dropped_dgrams { 0 };
+  size_t _mtu { 0 };
+  size_t _num_too_big { 0 };
+  size_t enqueue_waiting( uint32_t next_hop_ip, vector<std::string>&& serialized_dgram );
 };
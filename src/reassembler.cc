@@ -1,8 +1,10 @@
 #include "reassembler.hh"
+#include "latency.hh"
 using namespace std;
 unordered_set<char> shabi;
 void Reassembler::insert( uint64_t first_index, string data, bool is_last_substring )
 {
+  MINNOW_LATENCY_SCOPE( "Reassembler::insert" );
  
   if (is_last_substring) {
     end_index = first_index + data.size();
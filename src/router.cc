@@ -1,6 +1,7 @@
+#include "latency.hh"
 #include "router.hh"
+#include "trace.hh"
 
-#include <iostream>
 #include <limits>
 
 using namespace std;
@@ -16,9 +17,11 @@ void Router::add_route( const uint32_t route_prefix,
                         const optional<Address> next_hop,
                         const size_t interface_num )
 {
-  cerr << "DEBUG: adding route " << Address::from_ipv4_numeric( route_prefix ).ip() << "/"
-       << static_cast<int>( prefix_length ) << " => " << ( next_hop.has_value() ? next_hop->ip() : "(direct)" )
-       << " on interface " << interface_num << "\n";
+  MINNOW_TRACEPOINT( trace::Event::RouteAdded,
+                     interface_num,
+                     route_prefix,
+                     prefix_length,
+                     next_hop.has_value() ? next_hop->ipv4_numeric() : 0 );
   uint32_t route_round = route_prefix & get_mask(prefix_length);  //得到网络地址
   auto iter = _routing_table.find(route_round);
   if (iter == _routing_table.end() || iter->second.prefix_length < prefix_length) {
@@ -32,9 +35,12 @@ void Router::route()
 {
   for (auto& interfaces_ptr : _interfaces) {
     while (!(interfaces_ptr->datagrams_received().empty())) {
-      auto dgram = interfaces_ptr->datagrams_received().front();
+      MINNOW_LATENCY_SCOPE( "Router::route (per datagram)" );
+      // 把数据报移出队列，转发时载荷缓冲区一路移动，不做复制
+      auto dgram = move( interfaces_ptr->datagrams_received().front() );
+      interfaces_ptr->datagrams_received().pop();
       uint32_t target_ip = dgram.header.dst;
-      if (dgram.header.ttl <= 1) return;
+      if (dgram.header.ttl <= 1) continue;
       bool routed = false;
 
       for (uint8_t pre_len = 32; pre_len <= 32; --pre_len) {
@@ -46,20 +52,18 @@ void Router::route()
           RouteItem item = iter->second;
 
           if (item.next_hop.has_value()) {
-            interfaces_ptr->send_datagram(dgram, item.next_hop.value());
+            interfaces_ptr->send_datagram(move(dgram), item.next_hop.value());
           } else {
-            interfaces_ptr->send_datagram(dgram, Address::from_ipv4_numeric(dgram.header.dst));
+            interfaces_ptr->send_datagram(move(dgram), Address::from_ipv4_numeric(target_ip));
           }
 
-          interfaces_ptr->datagrams_received().pop();
           routed = true;
           break;
         }
       }
 
       if (!routed) {
-        cerr << "DEBUG: No route found for datagram with destination IP " << Address::from_ipv4_numeric(dgram.header.dst).ip() << "\n";
-        interfaces_ptr->datagrams_received().pop();
+        MINNOW_TRACEPOINT( trace::Event::RouteMiss, 0, dgram.header.dst );
       }
     }
   }
@@ -0,0 +1,264 @@
+#include "tcp_demux.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+uint64_t timestamp_ms()
+{
+  return chrono::duration_cast<chrono::milliseconds>( chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+// orders the timer heap so that the earliest deadline is on top
+constexpr auto later = []( const auto& a, const auto& b ) { return a.deadline > b.deadline; };
+} // namespace
+
+TCPDemux::TCPDemux( TCPOverIPv4OverTunFdAdapter&& adapter ) : adapter_( move( adapter ) ) {}
+
+void TCPDemux::listen( const uint16_t port, const TCPConfig& config, const size_t backlog )
+{
+  if ( not listeners_.try_emplace( port, Listener { .config = config, .backlog = backlog } ).second ) {
+    throw runtime_error( "TCPDemux: already listening on port " + to_string( port ) );
+  }
+}
+
+void TCPDemux::stop_listening( const uint16_t port )
+{
+  auto listener = listeners_.find( port );
+  if ( listener == listeners_.end() ) {
+    return;
+  }
+
+  vector<FourTuple> unaccepted { listener->second.established.begin(), listener->second.established.end() };
+  for ( const auto& [tuple, connection] : connections_ ) {
+    if ( connection.pending and tuple.local_port == port ) {
+      unaccepted.push_back( tuple );
+    }
+  }
+  for ( const auto& tuple : unaccepted ) {
+    erase( tuple );
+  }
+  listeners_.erase( listener );
+}
+
+optional<FourTuple> TCPDemux::accept( const uint16_t port )
+{
+  auto listener = listeners_.find( port );
+  if ( listener == listeners_.end() or listener->second.established.empty() ) {
+    return {};
+  }
+  const FourTuple tuple = listener->second.established.front();
+  listener->second.established.pop_front();
+  return tuple;
+}
+
+void TCPDemux::connect( const TCPConfig& config, const FourTuple& tuple )
+{
+  const auto [it, inserted]
+    = connections_.try_emplace( tuple, Connection { TCPPeer { config }, config.isn, false, timestamp_ms() } );
+  if ( not inserted ) {
+    throw runtime_error( "TCPDemux: connection already exists" );
+  }
+  it->second.peer.push( transmit_ );
+  flush( tuple, it->second );
+}
+
+TCPPeer& TCPDemux::peer( const FourTuple& tuple )
+{
+  return connections_.at( tuple ).peer;
+}
+
+void TCPDemux::reset( const FourTuple& tuple )
+{
+  TCPPeer& peer = connections_.at( tuple ).peer;
+  if ( not peer.active() ) {
+    return;
+  }
+
+  TCPMessage rst { peer.sender().make_empty_message(), peer.receiver().send() };
+  rst.sender.RST = true;
+  adapter_.write_batch( { &rst, 1 }, tuple );
+  peer.outbound_writer().set_error();
+  peer.inbound_reader().set_error();
+}
+
+void TCPDemux::erase( const FourTuple& tuple )
+{
+  const auto connection = connections_.find( tuple );
+  if ( connection == connections_.end() ) {
+    return;
+  }
+
+  reset( tuple );
+
+  if ( auto listener = listeners_.find( tuple.local_port ); listener != listeners_.end() ) {
+    if ( connection->second.pending ) {
+      --listener->second.pending;
+    } else {
+      std::erase( listener->second.established, tuple ); // (if not yet accepted; bounded by the backlog)
+    }
+  }
+  connections_.erase( connection ); // (its timer heap entry, if any, is skipped when it comes up)
+}
+
+//! \details A run of segments for the same connection (as bulk transfers produce) is delivered in one call, so
+//! that the connection replies to all of them at once.
+void TCPDemux::receive( vector<FourTuple>& ready )
+{
+  inbound_.clear();
+  adapter_.read_batch( inbound_ );
+
+  const uint64_t now = timestamp_ms();
+  size_t begin = 0;
+  while ( begin < inbound_.size() ) {
+    const FourTuple tuple = inbound_[begin].first;
+    delivery_.clear();
+    size_t end = begin;
+    for ( ; end < inbound_.size() and inbound_[end].first == tuple; ++end ) {
+      delivery_.push_back( move( inbound_[end].second ) );
+    }
+    deliver( tuple, now, ready );
+    begin = end;
+  }
+}
+
+void TCPDemux::deliver( const FourTuple& tuple, const uint64_t now, vector<FourTuple>& ready )
+{
+  auto it = connections_.find( tuple );
+  Connection* connection = it == connections_.end() ? accept_syn( tuple, delivery_.front(), now ) : &it->second;
+  if ( connection == nullptr ) {
+    return;
+  }
+
+  // does this complete the handshake of a connection to a listening port?
+  bool handshake_done = false;
+  if ( connection->pending ) {
+    for ( const auto& msg : delivery_ ) {
+      handshake_done |= not msg.sender.RST and msg.receiver.ackno == connection->isn + 1;
+    }
+  }
+
+  catch_up( *connection, now );
+  connection->peer.receive( delivery_, transmit_ );
+  // (the peer's window may have opened)
+  connection->peer.push( transmit_ );
+  flush( tuple, *connection );
+
+  if ( handshake_done and connection->peer.active() ) {
+    Listener& listener = listeners_.at( tuple.local_port );
+    connection->pending = false;
+    --listener.pending;
+    listener.established.push_back( tuple );
+  }
+
+  if ( ready.empty() or ready.back() != tuple ) {
+    ready.push_back( tuple );
+  }
+}
+
+TCPDemux::Connection* TCPDemux::accept_syn( const FourTuple& tuple, const TCPMessage& syn, const uint64_t now )
+{
+  if ( not syn.sender.SYN or syn.sender.RST or syn.receiver.ackno ) {
+    return nullptr;
+  }
+
+  auto listener = listeners_.find( tuple.local_port );
+  if ( listener == listeners_.end() ) {
+    return nullptr;
+  }
+
+  // like a full kernel backlog, drop the SYN (the client will retry)
+  Listener& l = listener->second;
+  if ( l.pending + l.established.size() >= l.backlog ) {
+    return nullptr;
+  }
+
+  TCPConfig config = l.config;
+  config.isn = Wrap32 { static_cast<uint32_t>( rng_() ) };
+  ++l.pending;
+  return &connections_.try_emplace( tuple, Connection { TCPPeer { config }, config.isn, true, now } )
+            .first->second;
+}
+
+void TCPDemux::push( const FourTuple& tuple )
+{
+  Connection& connection = connections_.at( tuple );
+  catch_up( connection, timestamp_ms() );
+  connection.peer.push( transmit_ );
+  flush( tuple, connection );
+}
+
+void TCPDemux::tick( vector<FourTuple>& ready )
+{
+  const uint64_t now = timestamp_ms();
+  while ( not timers_.empty() and timers_.front().deadline <= now ) {
+    pop_heap( timers_.begin(), timers_.end(), later );
+    const TimerEntry entry = timers_.back();
+    timers_.pop_back();
+
+    auto it = connections_.find( entry.tuple );
+    if ( it == connections_.end() or it->second.deadline != entry.deadline ) {
+      continue; // stale
+    }
+    Connection& connection = it->second;
+    connection.deadline.reset();
+    catch_up( connection, now );
+    flush( entry.tuple, connection );
+
+    if ( connection.pending and not connection.peer.active() ) {
+      --listeners_.at( entry.tuple.local_port ).pending;
+      connections_.erase( it );
+    } else if ( not connection.pending and ( ready.empty() or ready.back() != entry.tuple ) ) {
+      ready.push_back( entry.tuple );
+    }
+  }
+}
+
+optional<uint64_t> TCPDemux::ms_until_next_tick()
+{
+  // drop stale entries, so that they don't wake anyone up
+  while ( not timers_.empty() ) {
+    const TimerEntry& entry = timers_.front();
+    auto it = connections_.find( entry.tuple );
+    if ( it != connections_.end() and it->second.deadline == entry.deadline ) {
+      const uint64_t now = timestamp_ms();
+      return entry.deadline > now ? entry.deadline - now : 0;
+    }
+    pop_heap( timers_.begin(), timers_.end(), later );
+    timers_.pop_back();
+  }
+  return {};
+}
+
+void TCPDemux::catch_up( Connection& connection, const uint64_t now )
+{
+  if ( now > connection.last_tick ) {
+    connection.peer.tick( now - connection.last_tick, transmit_ );
+    connection.last_tick = now;
+  }
+}
+
+void TCPDemux::flush( const FourTuple& tuple, Connection& connection )
+{
+  if ( not outbound_.empty() ) {
+    adapter_.write_batch( outbound_, tuple );
+    outbound_.clear();
+  }
+
+  optional<uint64_t> deadline;
+  if ( connection.peer.active() ) {
+    if ( const auto ms = connection.peer.ms_until_next_tick() ) {
+      deadline = connection.last_tick + *ms;
+    }
+  }
+  if ( deadline != connection.deadline ) {
+    connection.deadline = deadline;
+    if ( deadline ) {
+      timers_.push_back( { *deadline, tuple } );
+      push_heap( timers_.begin(), timers_.end(), later );
+    }
+  }
+}
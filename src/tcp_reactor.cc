@@ -0,0 +1,171 @@
+#include "tcp_reactor.hh"
+
+#include "exception.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <sys/eventfd.h>
+#include <utility>
+
+using namespace std;
+
+TCPReactor::TCPReactor( TCPOverIPv4OverTunFdAdapter&& adapter, const EventLoop::Backend backend )
+  : demux_( move( adapter ) )
+  , loop_( backend )
+  , stop_event_( CheckSystemCall( "eventfd", ::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) )
+{
+  tick_category_ = loop_.add_category( "TCPReactor: tick connections" );
+
+  loop_.add_rule( "TCPReactor: receive TCP segments from the network", demux_.fd(), Direction::In, [this] {
+    ready_.clear();
+    demux_.receive( ready_ );
+    dispatch();
+  } );
+
+  loop_.add_rule( "TCPReactor: stop", stop_event_, Direction::In, [this] {
+    string buffer( sizeof( uint64_t ), 0 );
+    stop_event_.read( buffer );
+  } );
+}
+
+void TCPReactor::listen( const uint16_t port,
+                         const TCPConfig& config,
+                         const Handlers& handlers,
+                         const size_t backlog )
+{
+  demux_.listen( port, config, backlog );
+  listeners_.insert_or_assign( port, handlers );
+}
+
+TCPReactor::Connection& TCPReactor::connect( const TCPConfig& config, const FourTuple& tuple, Handlers handlers )
+{
+  demux_.connect( config, tuple );
+  return connections_.emplace( tuple, Connection { *this, tuple, demux_.peer( tuple ), move( handlers ) } )
+    .first->second;
+}
+
+void TCPReactor::run()
+{
+  while ( not stopped_ ) {
+    schedule_tick();
+    loop_.wait_next_event( -1 );
+
+    // connections aborted from outside a callback
+    for ( const auto& tuple : aborted_ ) {
+      if ( auto it = connections_.find( tuple ); it != connections_.end() ) {
+        dispatch( it->second );
+      }
+    }
+    aborted_.clear();
+  }
+  stopped_ = false;
+}
+
+void TCPReactor::stop()
+{
+  stopped_ = true;
+  const uint64_t one = 1;
+  stop_event_.write( { reinterpret_cast<const char*>( &one ), sizeof( one ) } ); // NOLINT(*-reinterpret-cast)
+}
+
+void TCPReactor::dispatch()
+{
+  for ( const auto& [port, handlers] : listeners_ ) {
+    while ( const auto tuple = demux_.accept( port ) ) {
+      connections_.emplace( *tuple, Connection { *this, *tuple, demux_.peer( *tuple ), handlers } );
+      ready_.push_back( *tuple );
+    }
+  }
+
+  for ( const auto& tuple : ready_ ) {
+    if ( auto it = connections_.find( tuple ); it != connections_.end() ) {
+      dispatch( it->second );
+    }
+  }
+}
+
+void TCPReactor::dispatch( Connection& connection )
+{
+  TCPPeer& peer = connection.peer_;
+
+  if ( not connection.open_ and peer.has_ackno() and peer.active() ) {
+    connection.open_ = true;
+    connection.handlers_.on_open( connection );
+  }
+
+  if ( connection.open_ ) {
+    const Reader& inbound = peer.inbound_reader();
+    if ( inbound.bytes_buffered() > 0 or ( inbound.is_finished() and not connection.eof_reported_ ) ) {
+      connection.eof_reported_ = inbound.is_finished();
+      connection.handlers_.on_readable( connection );
+    }
+
+    if ( connection.want_writable_ and peer.outbound_writer().available_capacity() > 0 ) {
+      connection.want_writable_ = false;
+      connection.handlers_.on_writable( connection );
+    }
+  }
+
+  if ( not peer.active() ) {
+    const FourTuple tuple = connection.tuple_;
+    connection.handlers_.on_close( connection );
+    demux_.erase( tuple );
+    connections_.erase( tuple );
+  }
+}
+
+void TCPReactor::schedule_tick()
+{
+  optional<EventLoop::Clock::time_point> deadline;
+  if ( const auto ms = demux_.ms_until_next_tick() ) {
+    deadline = chrono::floor<chrono::milliseconds>( EventLoop::Clock::now() ) + chrono::milliseconds( *ms );
+  }
+
+  if ( deadline == tick_deadline_ ) {
+    return;
+  }
+  if ( tick_timer_ ) {
+    tick_timer_->cancel();
+    tick_timer_.reset();
+  }
+  tick_deadline_ = deadline;
+
+  if ( deadline ) {
+    tick_timer_ = loop_.add_timer( tick_category_, *deadline, [this] {
+      tick_timer_.reset();
+      tick_deadline_.reset();
+      ready_.clear();
+      demux_.tick( ready_ );
+      dispatch();
+    } );
+  }
+}
+
+size_t TCPReactor::Connection::write( const string_view data )
+{
+  Writer& outbound = peer_.outbound_writer();
+  const size_t length = min<size_t>( data.size(), outbound.available_capacity() );
+  if ( length > 0 ) {
+    outbound.push( string( data.substr( 0, length ) ) );
+    reactor_.demux_.push( tuple_ );
+  }
+  want_writable_ |= length < data.size();
+  return length;
+}
+
+void TCPReactor::Connection::close()
+{
+  if ( not peer_.outbound_writer().is_closed() ) {
+    peer_.outbound_writer().close();
+    reactor_.demux_.push( tuple_ );
+  }
+}
+
+//! \details The connection is closed (and forgotten) after the current callback returns, or, if abort() was called
+//! from elsewhere, once the EventLoop next wakes up.
+void TCPReactor::Connection::abort()
+{
+  reactor_.demux_.reset( tuple_ );
+  reactor_.aborted_.push_back( tuple_ );
+}
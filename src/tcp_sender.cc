@@ -1,4 +1,5 @@
 #include "tcp_sender.hh"
+#include "latency.hh"
 #include "tcp_config.hh"
 using namespace std;
 
@@ -28,6 +29,7 @@ using namespace std;
 
 void TCPSender::push( const TransmitFunction& transmit )
 {
+  MINNOW_LATENCY_SCOPE( "TCPSender::push" );
   uint16_t  remain_window_size = _window_size != 0 ? _window_size : 1;
   if (_window_size < sequence_numbers_in_flight()) {
     return;
@@ -44,9 +46,19 @@ void TCPSender::push( const TransmitFunction& transmit )
       _syn_sent = true;
     }
     seg.seqno = Wrap32::wrap(_next_seqno, isn_);
-    string seg_data = input_.reader().read(min(seg_size, static_cast<uint16_t> (TCPConfig::MAX_PAYLOAD_SIZE)));
+    // 有数据足够填满一个探测段时，这个段就作为探测段发送
+    size_t payload_limit = max_payload_size();
+    bool probe = false;
+    if ( _prober and not seg.SYN ) {
+      const auto probe_size = _prober->next_probe();
+      if ( probe_size and seg_size >= *probe_size and input_.reader().bytes_buffered() >= *probe_size ) {
+        payload_limit = *probe_size;
+        probe = true;
+      }
+    }
+    string seg_data = input_.reader().read( min<size_t>( seg_size, payload_limit ) );
     seg_size -= seg_data.size();
-    seg.payload =  seg_data;
+    seg.payload = move( seg_data );
     if (!_fin_sent && input_.eof() &&seg_size > 0) {
       seg_size -= 1;
       seg.FIN = 1;
@@ -54,10 +66,12 @@ void TCPSender::push( const TransmitFunction& transmit )
     }
     seg_size = seg.sequence_length();
     if (seg_size == 0) break;
-    _segments_out.emplace(seg);
     transmit(seg);
-    _RTO_buf.push_back(seg);
+    _RTO_buf.push_back( move( seg ) );
     _next_seqno += seg_size;
+    if ( probe ) {
+      _prober->probe_sent( _next_seqno );
+    }
     remain_window_size -= seg_size;
     if (!_timer.active()) {
       _timer.start(_RTO_ms);
@@ -75,11 +89,16 @@ TCPSenderMessage TCPSender::make_empty_message() const
 
 void TCPSender::receive( const TCPReceiverMessage& msg )
 {
+  MINNOW_LATENCY_SCOPE( "TCPSender::receive" );
   _window_size = msg.window_size;
   uint64_t ack_seqno = Wrap32(msg.ackno.value_or(Wrap32{0})).unwrap(isn_, _next_seqno);
   if (ack_seqno > _next_seqno) return;
+  if ( _prober and msg.ackno ) {
+    _prober->acknowledged( ack_seqno );
+  }
   for (auto it = _RTO_buf.begin(); it != _RTO_buf.end();) {
     if (it->seqno.unwrap(isn_, _next_seqno) + it->sequence_length() < ack_seqno) {
+      packet_pool::recycle( move( it->payload ) ); // 确认后载荷缓冲区回收
       it = _RTO_buf.erase(it);
       _RTO_ms = initial_RTO_ms_;
       _timer.start(_RTO_ms); 
@@ -97,9 +116,31 @@ void TCPSender::tick( uint64_t ms_since_last_tick, const TransmitFunction& trans
   if (_timer.active()) {
     _timer.update(ms_since_last_tick);
   }
+  if ( _prober ) {
+    _prober->tick( ms_since_last_tick );
+  }
+  if ( _timer.expired() and _prober and not _RTO_buf.empty() ) {
+    const auto& front = _RTO_buf.front();
+    const uint64_t front_end = front.seqno.unwrap( isn_, _next_seqno ) + front.sequence_length();
+    if ( _prober->is_probe( front_end ) ) {
+      // 探测段丢失不代表拥塞：记录后按当前段长度拆开重传，RTO 不加倍
+      _prober->probe_lost();
+      const size_t pieces = split_front( _prober->payload_size() );
+      for ( size_t i = 0; i < pieces; ++i ) {
+        transmit( _RTO_buf[i] );
+      }
+      _timer.start( _RTO_ms );
+      return;
+    }
+    const size_t base = _prober->base_payload();
+    if ( _retransmission_number >= BLACK_HOLE_RETRANSMISSIONS and _prober->payload_size() > base
+         and front.payload.size() > base ) {
+      _prober->black_hole(); // 大段一直丢失：路径 MTU 可能变小了，退回基础长度
+    }
+    split_front( _prober->payload_size() );
+  }
   if (_timer.expired()) {
     transmit(_RTO_buf.front());
-    _segments_out.emplace(_RTO_buf.front()) ;
     if (_window_size > 0) {
       _retransmission_number++;
       _RTO_ms *= 2;
@@ -108,6 +149,34 @@ void TCPSender::tick( uint64_t ms_since_last_tick, const TransmitFunction& trans
   }
 }
 
+size_t TCPSender::max_payload_size() const
+{
+  return _prober ? _prober->payload_size() : TCPConfig::MAX_PAYLOAD_SIZE;
+}
+
+size_t TCPSender::split_front( const size_t max_payload )
+{
+  if ( _RTO_buf.empty() or _RTO_buf.front().payload.size() <= max_payload ) {
+    return 1;
+  }
+  TCPSenderMessage whole = move( _RTO_buf.front() );
+  _RTO_buf.pop_front();
+
+  // 从后往前放回队首，SYN 留在第一段，FIN 留在最后一段
+  const size_t pieces = ( whole.payload.size() + max_payload - 1 ) / max_payload;
+  for ( size_t i = pieces; i-- > 0; ) {
+    TCPSenderMessage piece;
+    const size_t offset = i * max_payload;
+    piece.SYN = whole.SYN and i == 0;
+    piece.FIN = whole.FIN and i + 1 == pieces;
+    piece.RST = whole.RST;
+    piece.seqno = whole.seqno + static_cast<uint32_t>( ( i > 0 ? whole.SYN : 0 ) + offset );
+    piece.payload = whole.payload.substr( offset, max_payload );
+    _RTO_buf.push_front( move( piece ) );
+  }
+  return pieces;
+}
+
 uint64_t TCPSender::sequence_numbers_in_flight() const
 {
   uint64_t res = 0;
@@ -122,12 +191,23 @@ uint64_t TCPSender::consecutive_retransmissions() const
   return _retransmission_number;
 }
 
+optional<uint64_t> TCPSender::ms_until_timeout() const
+{
+  //计时器没有运行时不会重传
+  if (!_timer.active()) {
+    return nullopt;
+  }
+  return _timer.remaining();
+}
+
 
 
 void Timer::start (uint64_t timeout) {
   _timeout = timeout;
   _current_time = 0; 
   _active = true;
+  //重新计时，清除上一次的超时状态
+  _expored = false;
 }
 
 void Timer::update (uint64_t time_elapsed) {
@@ -140,6 +220,14 @@ void Timer::update (uint64_t time_elapsed) {
   }
 }
 
+uint64_t Timer::remaining () const {
+  //经过的时间超过_timeout才算超时
+  if (_expored || _current_time > _timeout) {
+    return 0;
+  }
+  return _timeout - _current_time + 1;
+}
+
 void Timer::reset () {
   _current_time = 0;
   _active = false;
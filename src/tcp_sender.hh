@@ -2,6 +2,8 @@
 
 #include "byte_stream.hh"
 #include "tcp_receiver_message.hh"
+#include "packet_pool.hh"
+#include "path_mtu.hh"
 #include "tcp_sender_message.hh"
 
 #include <cstdint>
@@ -22,6 +24,8 @@ class Timer {
     void reset();
     bool active() const{return _active;}
     bool expired() const {return _active && _expored;}
+    //距离超时还有多少毫秒
+    uint64_t remaining() const;
   private:
     bool _active = false;
     bool _expored =false;
@@ -54,18 +58,26 @@ public:
   void tick( uint64_t ms_since_last_tick, const TransmitFunction& transmit );
 
   // Accessors
-  uint64_t sequence_numbers_in_flight() const;  // How many sequence numbers are outstanding?
-  uint64_t consecutive_retransmissions() const; // How many consecutive *re*transmissions have happened?
+  uint64_t sequence_numbers_in_flight() const;      // How many sequence numbers are outstanding?
+  uint64_t consecutive_retransmissions() const;     // How many consecutive *re*transmissions have happened?
+  std::optional<uint64_t> ms_until_timeout() const; // How long until tick() retransmits (if it would)?
   Writer& writer() { return input_.writer(); }
   const Writer& writer() const { return input_.writer(); }
 
   // Access input stream reader, but const-only (can't read from outside)
   const Reader& reader() const { return input_.reader(); }
 
+  // 用探测段寻找更大的段长度（PLPMTUD，RFC 4821），不依赖 ICMP
+  void enable_mtu_probing( const PathMTUConfig& config ) { _prober.emplace( config ); }
+  // The largest payload the sender puts in a segment now (MAX_PAYLOAD_SIZE unless probing found more)
+  size_t max_payload_size() const;
+  const std::optional<PathMTUProber>& prober() const { return _prober; }
+  // 大段连续重传这么多次后，认为路径 MTU 变小了（黑洞检测）
+  static constexpr uint64_t BLACK_HOLE_RETRANSMISSIONS = 2;
+
 private:
   // Variables initialized in constructor
-  queue<TCPSenderMessage> _segments_out{};
-  deque<TCPSenderMessage> _RTO_buf{};
+  PooledDeque<TCPSenderMessage> _RTO_buf{}; // 节点从 packet_pool 回收
   Timer _timer{};
   ByteStream input_;
   Wrap32 isn_;
@@ -78,5 +90,8 @@ private:
   bool _syn_sent = false;
   bool _fin_sent = false;
   uint64_t zero_index = 0;
+  std::optional<PathMTUProber> _prober{};
+  // 超时重传时把过长的队首段（丢失的探测段等）拆成小段，返回段数
+  size_t split_front( size_t max_payload );
 };
 
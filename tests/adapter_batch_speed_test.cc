@@ -0,0 +1,119 @@
+#include "tcp_over_udp.hh"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+UDPSocket make_bound_socket()
+{
+  UDPSocket sock;
+  sock.bind( Address { "127.0.0.1", 0 } );
+  sock.set_blocking( false );
+  return sock;
+}
+} // namespace
+
+// One TCPOverUDPSocketAdapter sends full-sized segments to another over loopback, either one at a time
+// (write/read) or in batches (write_batch/read_batch, i.e. sendmmsg/recvmmsg)
+void speed_test( const size_t batch_size, const size_t num_segments )
+{
+  UDPSocket sender_sock = make_bound_socket();
+  UDPSocket receiver_sock = make_bound_socket();
+  const Address sender_address = sender_sock.local_address();
+  const Address receiver_address = receiver_sock.local_address();
+
+  TCPOverUDPSocketAdapter sender { move( sender_sock ) };
+  TCPOverUDPSocketAdapter receiver { move( receiver_sock ) };
+  sender.config_mut().source = sender_address;
+  sender.config_mut().destination = receiver_address;
+  receiver.config_mut().source = receiver_address;
+  receiver.config_mut().destination = sender_address;
+
+  vector<TCPMessage> batch( batch_size );
+  for ( auto& msg : batch ) {
+    msg.sender.payload = string( TCPConfig::MAX_PAYLOAD_SIZE, 'x' );
+  }
+
+  // the receiver connects to its peer when it first writes
+  receiver.write( {} );
+  if ( not sender.read() ) {
+    throw runtime_error( "adapter lost the initial segment" );
+  }
+
+  vector<TCPMessage> received;
+  size_t bytes_received = 0;
+  const auto start_syscalls = sender.fd().syscall_count() + receiver.fd().syscall_count();
+  const auto start_time = steady_clock::now();
+  for ( size_t sent = 0; sent < num_segments; sent += batch_size ) {
+    if ( batch_size == 1 ) {
+      sender.write( batch.front() );
+    } else {
+      sender.write_batch( batch );
+    }
+
+    for ( size_t got = 0; got < batch_size; ) {
+      received.clear();
+      if ( batch_size == 1 ) {
+        if ( auto msg = receiver.read() ) {
+          received.push_back( move( *msg ) );
+        }
+      } else {
+        receiver.read_batch( received );
+      }
+      if ( received.empty() ) {
+        throw runtime_error( "adapter lost a segment" );
+      }
+      for ( const auto& msg : received ) {
+        bytes_received += msg.sender.payload.size();
+      }
+      got += received.size();
+    }
+  }
+  const auto stop_time = steady_clock::now();
+
+  if ( bytes_received != num_segments * TCPConfig::MAX_PAYLOAD_SIZE ) {
+    throw runtime_error( "adapter corrupted a segment" );
+  }
+
+  const auto syscalls = sender.fd().syscall_count() + receiver.fd().syscall_count() - start_syscalls;
+  const auto megabytes = static_cast<double>( bytes_received ) / 1e6;
+  const auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
+  const double gigabits_per_second = static_cast<double>( bytes_received ) * 8.0 / test_duration.count() / 1e9;
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "TCPOverUDPSocketAdapter with batches of " << setw( 2 ) << batch_size << ": " << fixed
+       << setprecision( 1 ) << static_cast<double>( syscalls ) / megabytes << " system calls per MB, "
+       << setprecision( 2 ) << gigabits_per_second << " Gbit/s.\n";
+
+  debug_output << "             TCPOverUDPSocketAdapter (batch " << batch_size << "): " << fixed << setprecision( 2 )
+               << gigabits_per_second << " Gbit/s\n";
+}
+
+void program_body()
+{
+  constexpr size_t num_segments = 1 << 18;
+
+  speed_test( 1, num_segments );
+  speed_test( 8, num_segments );
+  speed_test( TCPOverUDPSocketAdapter::kMaxBatch, num_segments );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
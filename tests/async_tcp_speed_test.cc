@@ -0,0 +1,160 @@
+#include "async_tcp.hh"
+#include "exception.hh"
+#include "socket.hh"
+#include "tcp_reactor.hh"
+#include "tun.hh"
+#include "tun_test_harness.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <poll.h>
+#include <thread>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+constexpr const char* DEVICE = "async144";
+const Address server_address { "10.145.0.1", 80 };
+const Address client_address { "10.145.0.2" };
+constexpr uint64_t FETCHES = 2000;
+
+const string request = "GET / HTTP/1.1\r\nHost: 10.145.0.1\r\nConnection: close\r\n\r\n";
+const string response = "HTTP/1.1 200 OK\r\nContent-Length: 13\r\nConnection: close\r\n\r\nHello, world\n";
+
+// The kernel serves `fetches` requests, one connection each, then returns
+void serve( TCPSocket& listener, const uint64_t fetches, const atomic<bool>& give_up )
+{
+  for ( uint64_t served = 0; served < fetches; ) {
+    pollfd pfd { listener.fd_num(), POLLIN, 0 };
+    CheckSystemCall( "poll", ::poll( &pfd, 1, 100 ) );
+    if ( give_up ) {
+      return;
+    }
+    if ( not( pfd.revents & POLLIN ) ) {
+      continue;
+    }
+
+    TCPSocket connection = listener.accept();
+    connection.set_blocking( true );
+    string received;
+    string buffer;
+    while ( received.find( "\r\n\r\n" ) == string::npos and not connection.eof() ) {
+      connection.read( buffer );
+      received += buffer;
+    }
+    if ( received != request ) {
+      throw runtime_error( "server got \"" + received + "\"" );
+    }
+    connection.write( response );
+    ++served;
+  }
+}
+
+struct Load
+{
+  uint64_t remaining = FETCHES;
+  uint64_t fetched {};
+};
+
+Task<> flow( AsyncTCP& tcp, Load& load )
+{
+  while ( load.remaining > 0 ) {
+    --load.remaining;
+    AsyncTCP::Socket socket = co_await tcp.connect( server_address );
+    co_await socket.write( request );
+    string reply;
+    for ( string data = co_await socket.read(); not data.empty(); data = co_await socket.read() ) {
+      reply += data;
+    }
+    if ( reply != response ) {
+      throw runtime_error( "client got \"" + reply + "\"" );
+    }
+    ++load.fetched;
+  }
+}
+
+// Fetch FETCHES times from the kernel's server, with `flows` fetches in flight; returns fetches/s
+double fetches_per_second( TCPReactor& reactor, TCPSocket& listener, const uint64_t flows )
+{
+  atomic<bool> give_up = false;
+  exception_ptr server_error;
+  thread kernel_side( [&] {
+    try {
+      serve( listener, FETCHES, give_up );
+    } catch ( ... ) {
+      server_error = current_exception();
+    }
+  } );
+
+  Load load;
+  AsyncTCP tcp { reactor, client_address };
+  const auto start = steady_clock::now();
+  try {
+    for ( uint64_t i = 0; i < flows; ++i ) {
+      tcp.spawn( flow( tcp, load ) );
+    }
+    tcp.run();
+  } catch ( ... ) {
+    give_up = true;
+    kernel_side.join();
+    throw;
+  }
+  const duration<double> elapsed = steady_clock::now() - start;
+
+  kernel_side.join();
+  if ( server_error ) {
+    rethrow_exception( server_error );
+  }
+  if ( load.fetched != FETCHES ) {
+    throw runtime_error( "only " + to_string( load.fetched ) + " of " + to_string( FETCHES )
+                         + " fetches finished" );
+  }
+  return static_cast<double>( FETCHES ) / elapsed.count();
+}
+} // namespace
+
+void program_body()
+{
+  if ( not enter_private_network_namespace() ) {
+    cerr << "Skipping AsyncTCP speed test: needs CAP_NET_ADMIN and /dev/net/tun.\n";
+    return;
+  }
+
+  TCPReactor reactor { TCPOverIPv4OverTunFdAdapter { TunFD { DEVICE } } };
+  configure_interface( DEVICE, server_address.ip(), "255.255.255.0" );
+  set_queue_length( DEVICE, 65536 );
+
+  TCPSocket listener;
+  listener.set_reuseaddr();
+  listener.bind( server_address );
+  listener.listen( 4096 );
+  listener.set_blocking( false );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  for ( const uint64_t flows : { 1, 32, 512 } ) {
+    const double rate = fetches_per_second( reactor, listener, flows );
+    cout << "AsyncTCP with " << setw( 3 ) << flows << " fetches in flight: " << fixed << setprecision( 0 ) << rate
+         << " fetches/s (one connection each).\n";
+    debug_output << "               AsyncTCP: " << fixed << setprecision( 0 ) << rate << " fetches/s with " << flows
+                 << " in flight\n";
+  }
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
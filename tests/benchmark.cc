@@ -0,0 +1,100 @@
+#include "benchmark.hh"
+#include "common.hh"
+
+#include <cstdint>
+#include <sched.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+// Warmup repetitions run but aren't measured, and only the benchmarks that match the filter run
+void run_test()
+{
+  unsigned runs = 0;
+  BenchmarkSuite suite;
+  suite.add( "count \"quoted\"", "item", [&] {
+    ++runs;
+    return uint64_t { 1000 };
+  } );
+  suite.add( "skipped", "item", []() -> uint64_t { throw runtime_error( "the filter should skip this" ); } );
+
+  ostringstream progress;
+  BenchmarkConfig config { .warmup = 2, .repetitions = 5, .filter = "count" };
+  config.cpu = BenchmarkConfig::NO_PINNING;
+  const auto results = suite.run( config, progress );
+  expect( runs == 7, "there should be 2 warmup and 5 measured repetitions, not " + to_string( runs ) );
+  expect( results.size() == 1 and results[0].times_ns.size() == 5 and results[0].items == 1000,
+          "each measured repetition should be recorded" );
+  expect( progress.str().find( "count" ) != string::npos, "the benchmark should be reported" );
+}
+
+// By default the benchmarks run on the first CPU the thread may use, and afterwards it may use them all again
+void pinning_test()
+{
+  cpu_set_t before;
+  sched_getaffinity( 0, sizeof( before ), &before );
+
+  int cpu = -1;
+  BenchmarkSuite suite;
+  suite.add( "where", "item", [&] {
+    cpu = sched_getcpu();
+    return uint64_t { 1 };
+  } );
+  ostringstream progress;
+  suite.run( BenchmarkConfig {}, progress );
+  expect( cpu == BenchmarkConfig {}.pinned_cpu() and CPU_ISSET( cpu, &before ),
+          "the benchmarks should run on the first CPU allowed" );
+
+  cpu_set_t after;
+  sched_getaffinity( 0, sizeof( after ), &after );
+  expect( CPU_EQUAL( &before, &after ), "the thread's affinity should be restored" );
+}
+
+// Results read back from JSON as they were written
+void json_test()
+{
+  const vector<BenchmarkResult> results {
+    { "a \"b\" \\c", "byte", 100, { 1000, 3000, 2000 } },
+    { "d", "datagram", 1, { 5.5 } },
+  };
+  const auto read = benchmarks_from_json( benchmarks_to_json( results, BenchmarkConfig {} ) );
+  expect( read.size() == 2, "both results should be read back" );
+  expect( read[0].name == results[0].name and read[0].unit == "byte" and read[0].items == 100
+            and read[0].times_ns == results[0].times_ns,
+          "the first result should read back as it was" );
+  expect( read[1].times_ns == results[1].times_ns, "fractional times should read back exactly" );
+  expect( read[0].median_ns_per_item() == 20 and read[0].min_ns_per_item() == 10, "the median should be 20 ns" );
+}
+
+// A benchmark regressed only if it is slower by more than the threshold, in every repetition
+void compare_test()
+{
+  const vector<BenchmarkResult> baseline {
+    { "steady", "item", 1, { 100, 101, 99 } },
+    { "slower", "item", 1, { 100, 100, 100 } },
+    { "noisy", "item", 1, { 100, 100, 100 } },
+    { "removed", "item", 1, { 100 } },
+  };
+  const vector<BenchmarkResult> current {
+    { "steady", "item", 1, { 103, 102, 104 } },
+    { "slower", "item", 1, { 120, 121, 119 } },
+    { "noisy", "item", 1, { 130, 90, 140 } },
+    { "added", "item", 1, { 100 } },
+  };
+  const auto comparisons = compare_benchmarks( baseline, current, 0.05 );
+  expect( comparisons.size() == 3, "only benchmarks in both should be compared" );
+  expect( not comparisons[0].regression, "3% slower is within the threshold" );
+  expect( comparisons[1].regression and comparisons[1].change > 0.19 and comparisons[1].change < 0.21,
+          "20% slower is a regression" );
+  expect( not comparisons[2].regression, "a benchmark with a fast repetition is noise, not a regression" );
+}
+} // namespace
+
+int main()
+{
+  return run_tests( { run_test, pinning_test, json_test, compare_test } );
+}
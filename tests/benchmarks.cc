@@ -0,0 +1,396 @@
+#include "arp_message.hh"
+#include "benchmark.hh"
+#include "byte_stream.hh"
+#include "checksum.hh"
+#include "ipv4_datagram.hh"
+#include "ipv4_fragments.hh"
+#include "network_interface.hh"
+#include "reassembler.hh"
+#include "router.hh"
+#include "tcp_receiver.hh"
+#include "tcp_sender.hh"
+#include "wrapping_integers.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+void usage( const char* argv0 )
+{
+  cerr << "Usage: " << argv0 << " [-j FILE] [-w WARMUP] [-r REPETITIONS] [-c CPU] [FILTER]\n\n"
+       << "   -j FILE        write the results to FILE as JSON (compare them with benchmark_compare)\n"
+       << "   -w WARMUP      unmeasured repetitions of each benchmark (default: 2)\n"
+       << "   -r REPETITIONS measured repetitions of each benchmark (default: 10)\n"
+       << "   -c CPU         CPU to pin the benchmarks to, or -1 not to pin (default: the first one allowed)\n"
+       << "   FILTER         run only the benchmarks whose names contain FILTER\n";
+}
+
+// Make sure the compiler can't throw away a result
+template<class T>
+void keep( const T& value )
+{
+  asm volatile( "" : : "r,m"( value ) : "memory" );
+}
+
+string make_data( size_t length )
+{
+  default_random_engine rd { 1370 };
+  uniform_int_distribution<char> ud;
+  string data;
+  for ( size_t i = 0; i < length; ++i ) {
+    data += ud( rd );
+  }
+  return data;
+}
+
+class DiscardPort : public NetworkInterface::OutputPort
+{
+public:
+  uint64_t frames {};
+
+  void transmit( const NetworkInterface& sender [[maybe_unused]], const EthernetFrame& frame ) override
+  {
+    keep( frame.header.type );
+    ++frames;
+  }
+};
+
+EthernetAddress host_ethernet_address( uint32_t n )
+{
+  return { 0x02,
+           0,
+           static_cast<uint8_t>( n >> 24 ),
+           static_cast<uint8_t>( n >> 16 ),
+           static_cast<uint8_t>( n >> 8 ),
+           static_cast<uint8_t>( n ) };
+}
+
+// Tell an interface the Ethernet address of another host, as if the host had answered an ARP request
+void resolve( NetworkInterface& iface, const EthernetAddress& local_eth, uint32_t local_ip, uint32_t remote_ip )
+{
+  ARPMessage arp;
+  arp.opcode = ARPMessage::OPCODE_REPLY;
+  arp.sender_ethernet_address = host_ethernet_address( remote_ip );
+  arp.sender_ip_address = remote_ip;
+  arp.target_ethernet_address = local_eth;
+  arp.target_ip_address = local_ip;
+
+  EthernetFrame frame;
+  frame.header = { local_eth, arp.sender_ethernet_address, EthernetHeader::TYPE_ARP };
+  frame.payload = serialize( arp );
+  iface.recv_frame( frame );
+}
+
+InternetDatagram make_datagram( uint32_t src, uint32_t dst, size_t payload_length )
+{
+  InternetDatagram dgram;
+  dgram.header.src = src;
+  dgram.header.dst = dst;
+  dgram.payload.emplace_back( payload_length, 'x' );
+  dgram.header.len = static_cast<uint64_t>( dgram.header.hlen ) * 4 + payload_length;
+  dgram.header.compute_checksum();
+  return dgram;
+}
+
+constexpr size_t STREAM_BYTES = 1 << 22;
+constexpr size_t SEGMENT_SIZE = 1000;
+constexpr size_t DATAGRAMS = 100'000;
+
+void add_byte_stream( BenchmarkSuite& suite, const string& data )
+{
+  suite.add( "ByteStream push/pop", "byte", [&data] {
+    ByteStream stream { 65536 };
+    for ( size_t i = 0; i < data.size(); i += SEGMENT_SIZE ) {
+      stream.writer().push( data.substr( i, SEGMENT_SIZE ) );
+      while ( stream.reader().bytes_buffered() ) {
+        keep( stream.reader().peek().front() );
+        stream.reader().pop( stream.reader().peek().size() );
+      }
+    }
+    return data.size();
+  } );
+}
+
+void add_reassembler( BenchmarkSuite& suite, const string& data )
+{
+  // every segment arrives twice, overlapping the next, and in a shuffled order within each window
+  auto segments = make_shared<vector<pair<uint64_t, string>>>();
+  for ( size_t i = 0; i < data.size(); i += SEGMENT_SIZE ) {
+    segments->emplace_back( i, data.substr( i, SEGMENT_SIZE * 2 ) );
+  }
+  for ( size_t i = 0; i + 8 <= segments->size(); i += 8 ) {
+    shuffle( segments->begin() + i, segments->begin() + i + 8, default_random_engine { i } );
+  }
+
+  suite.add( "Reassembler insert (reordered)", "byte", [&data, segments] {
+    Reassembler reassembler { ByteStream { SEGMENT_SIZE * 32 } };
+    for ( const auto& [index, payload] : *segments ) {
+      reassembler.insert( index, payload, index + payload.size() >= data.size() );
+      Reader& reader = reassembler.reader();
+      while ( reader.bytes_buffered() ) {
+        reader.pop( reader.peek().size() );
+      }
+    }
+    if ( reassembler.reader().bytes_popped() != data.size() ) {
+      throw runtime_error( "the Reassembler didn't reassemble the stream" );
+    }
+    return data.size();
+  } );
+}
+
+void add_wrap32( BenchmarkSuite& suite )
+{
+  suite.add( "Wrap32 wrap/unwrap", "op", [] {
+    const Wrap32 isn { 0xFFFF0000 };
+    uint64_t checkpoint = 0;
+    for ( uint64_t i = 0; i < 1'000'000; ++i ) {
+      const uint64_t absolute = i * 7919;
+      checkpoint = Wrap32::wrap( absolute, isn ).unwrap( isn, checkpoint );
+    }
+    keep( checkpoint );
+    return uint64_t { 1'000'000 };
+  } );
+}
+
+void add_checksum( BenchmarkSuite& suite, const string& data )
+{
+  suite.add( "InternetChecksum", "byte", [&data] {
+    InternetChecksum checksum;
+    checksum.add( string_view { data } );
+    keep( checksum.value() );
+    return data.size();
+  } );
+}
+
+void add_parser( BenchmarkSuite& suite )
+{
+  const InternetDatagram dgram = make_datagram( 0x0a000001, 0x0a000002, SEGMENT_SIZE );
+  suite.add( "IPv4Datagram serialize", "datagram", [dgram] {
+    for ( size_t i = 0; i < DATAGRAMS; ++i ) {
+      keep( serialize( dgram ).size() );
+    }
+    return DATAGRAMS;
+  } );
+
+  const vector<string> wire { serialize( dgram ) };
+  suite.add( "IPv4Datagram parse", "datagram", [wire] {
+    for ( size_t i = 0; i < DATAGRAMS; ++i ) {
+      InternetDatagram parsed;
+      if ( not parse( parsed, wire ) ) {
+        throw runtime_error( "the datagram didn't parse" );
+      }
+      keep( parsed.header.len );
+    }
+    return DATAGRAMS;
+  } );
+}
+
+// Heavy fragmentation: the largest datagrams, cut to fit an Ethernet MTU (45 fragments each)
+void add_fragments( BenchmarkSuite& suite )
+{
+  constexpr size_t mtu = 1500;
+  constexpr size_t datagrams = 500;
+  InternetDatagram dgram = make_datagram( 0x0a000001, 0x0a000002, UINT16_MAX - IPv4Header::LENGTH );
+  dgram.header.df = false;
+  dgram.header.compute_checksum();
+
+  suite.add( "IPv4 fragment (64 KiB, MTU 1500)", "byte", [dgram] {
+    vector<InternetDatagram> fragments;
+    for ( size_t i = 0; i < datagrams; ++i ) {
+      fragments.clear();
+      if ( not fragment_datagram( dgram, mtu, fragments ) ) {
+        throw runtime_error( "the datagram didn't fragment" );
+      }
+      keep( fragments.size() );
+    }
+    return datagrams * dgram.payload_size();
+  } );
+
+  // the fragments arrive with every other one swapped with its neighbour
+  vector<InternetDatagram> fragments;
+  fragment_datagram( dgram, mtu, fragments );
+  for ( size_t i = 0; i + 1 < fragments.size(); i += 2 ) {
+    swap( fragments[i], fragments[i + 1] );
+  }
+  suite.add( "IPv4 reassemble (64 KiB, reordered)", "byte", [fragments, dgram] {
+    IPv4FragmentReassembler reassembler;
+    for ( size_t i = 0; i < datagrams; ++i ) {
+      optional<InternetDatagram> whole;
+      for ( const auto& fragment : fragments ) {
+        whole = reassembler.add( InternetDatagram { fragment }, i );
+      }
+      if ( not whole or whole->payload_size() != dgram.payload_size() ) {
+        throw runtime_error( "the datagram wasn't reassembled" );
+      }
+    }
+    return datagrams * dgram.payload_size();
+  } );
+}
+
+void add_tcp( BenchmarkSuite& suite, const string& data )
+{
+  // a sender and a receiver, handing each other their messages directly
+  suite.add( "TCPSender to TCPReceiver", "byte", [&data] {
+    TCPSender sender { ByteStream { 65536 }, Wrap32 { 42 }, 1000 };
+    TCPReceiver receiver { Reassembler { ByteStream { 65536 } } };
+    const auto transmit = [&]( const TCPSenderMessage& msg ) { receiver.receive( msg ); };
+
+    size_t written = 0;
+    uint64_t received = 0;
+    for ( unsigned stalls = 0; received < data.size(); ) {
+      const size_t length = min( sender.writer().available_capacity(), data.size() - written );
+      sender.writer().push( data.substr( written, length ) );
+      written += length;
+
+      sender.push( transmit );
+      sender.receive( receiver.send() );
+
+      const uint64_t before = received;
+      while ( receiver.reader().bytes_buffered() ) {
+        received += receiver.reader().peek().size();
+        receiver.reader().pop( receiver.reader().peek().size() );
+      }
+      if ( received == before and ++stalls > 1000 ) {
+        throw runtime_error( "the transfer stalled" );
+      }
+    }
+    return data.size();
+  } );
+}
+
+void add_network_interface( BenchmarkSuite& suite )
+{
+  const EthernetAddress local_eth = host_ethernet_address( 1 );
+  const Address local_ip { "10.0.0.1", 0 };
+  const Address next_hop { "10.0.0.2", 0 };
+  const InternetDatagram dgram = make_datagram( local_ip.ipv4_numeric(), 0xc0a80001, SEGMENT_SIZE );
+
+  suite.add( "NetworkInterface send_datagram", "datagram", [=] {
+    auto port = make_shared<DiscardPort>();
+    NetworkInterface iface { "benchmark", port, local_eth, local_ip };
+    resolve( iface, local_eth, local_ip.ipv4_numeric(), next_hop.ipv4_numeric() );
+    for ( size_t i = 0; i < DATAGRAMS; ++i ) {
+      iface.send_datagram( dgram, next_hop );
+    }
+    if ( port->frames != DATAGRAMS ) {
+      throw runtime_error( "the NetworkInterface didn't send every datagram" );
+    }
+    return DATAGRAMS;
+  } );
+
+  EthernetFrame frame;
+  frame.header = { local_eth, host_ethernet_address( 2 ), EthernetHeader::TYPE_IPv4 };
+  frame.payload = serialize( dgram );
+  suite.add( "NetworkInterface recv_frame", "datagram", [=] {
+    NetworkInterface iface { "benchmark", make_shared<DiscardPort>(), local_eth, local_ip };
+    for ( size_t i = 0; i < DATAGRAMS; ++i ) {
+      iface.recv_frame( frame );
+      iface.datagrams_received().pop();
+    }
+    return DATAGRAMS;
+  } );
+}
+
+void add_router( BenchmarkSuite& suite )
+{
+  // datagrams arrive on one interface, for a network reached through a next hop
+  const EthernetAddress eth0 = host_ethernet_address( 1 );
+  const EthernetAddress eth1 = host_ethernet_address( 2 );
+  const Address ip0 { "10.0.0.1", 0 };
+  const Address ip1 { "10.1.0.1", 0 };
+  const Address gateway { "10.1.0.2", 0 };
+
+  EthernetFrame frame;
+  frame.header = { eth0, host_ethernet_address( 3 ), EthernetHeader::TYPE_IPv4 };
+  frame.payload = serialize( make_datagram( 0x0a000002, 0xc0a80001, SEGMENT_SIZE ) );
+
+  suite.add( "Router route", "datagram", [=] {
+    auto port = make_shared<DiscardPort>();
+    Router router;
+    auto in = make_shared<NetworkInterface>( "in", port, eth0, ip0 );
+    auto out = make_shared<NetworkInterface>( "out", port, eth1, ip1 );
+    router.add_interface( in );
+    router.add_interface( out );
+    router.add_route( 0x0a000000, 24, {}, 0 );
+    router.add_route( 0xc0a80000, 16, gateway, 1 );
+    resolve( *in, eth0, ip0.ipv4_numeric(), gateway.ipv4_numeric() );
+    resolve( *out, eth1, ip1.ipv4_numeric(), gateway.ipv4_numeric() );
+
+    for ( size_t i = 0; i < DATAGRAMS; ++i ) {
+      in->recv_frame( frame );
+      router.route();
+    }
+    if ( port->frames != DATAGRAMS ) {
+      throw runtime_error( "the Router didn't forward every datagram" );
+    }
+    return DATAGRAMS;
+  } );
+}
+} // namespace
+
+int main( int argc, char** argv )
+{
+  try {
+    if ( argc <= 0 ) {
+      abort(); // For sticklers: don't try to access argv[0] if argc <= 0.
+    }
+
+    BenchmarkConfig config;
+    const char* json_file = nullptr;
+    const span<char*> args( argv, argc );
+    for ( int i = 1; i < argc; ++i ) {
+      const string arg { args[i] };
+      if ( ( arg == "-j" or arg == "-w" or arg == "-r" or arg == "-c" ) and i + 1 < argc ) {
+        const char* value = args[++i];
+        if ( arg == "-j" ) {
+          json_file = value;
+        } else if ( arg == "-w" ) {
+          config.warmup = stoul( value );
+        } else if ( arg == "-r" ) {
+          config.repetitions = max( 1UL, stoul( value ) );
+        } else {
+          config.cpu = stoi( value );
+        }
+      } else if ( arg.starts_with( "-" ) ) {
+        usage( args[0] );
+        return EXIT_FAILURE;
+      } else {
+        config.filter = arg;
+      }
+    }
+
+    const string data = make_data( STREAM_BYTES );
+    BenchmarkSuite suite;
+    add_byte_stream( suite, data );
+    add_reassembler( suite, data );
+    add_wrap32( suite );
+    add_checksum( suite, data );
+    add_parser( suite );
+    add_fragments( suite );
+    add_tcp( suite, data );
+    add_network_interface( suite );
+    add_router( suite );
+
+    const vector<BenchmarkResult> results = suite.run( config, cout );
+    if ( json_file ) {
+      ofstream { json_file } << benchmarks_to_json( results, config );
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
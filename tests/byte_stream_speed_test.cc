@@ -1,4 +1,5 @@
 #include "byte_stream.hh"
+#include "perf_counters.hh"
 
 #include <chrono>
 #include <cstddef>
@@ -38,6 +39,8 @@ void speed_test( const size_t input_len,   // NOLINT(bugprone-easily-swappable-p
   string output_data;
   output_data.reserve( data.size() );
 
+  PerfCounters counters;
+  counters.start();
   const auto start_time = steady_clock::now();
   while ( not bs.reader().is_finished() ) {
     if ( split_data.empty() ) {
@@ -62,6 +65,7 @@ void speed_test( const size_t input_len,   // NOLINT(bugprone-easily-swappable-p
   }
 
   const auto stop_time = steady_clock::now();
+  counters.stop();
 
   if ( data != output_data ) {
     throw runtime_error( "Mismatch between data written and read" );
@@ -77,6 +81,7 @@ void speed_test( const size_t input_len,   // NOLINT(bugprone-easily-swappable-p
 
   cout << "ByteStream with capacity=" << capacity << ", write_size=" << write_size << ", read_size=" << read_size
        << " reached " << fixed << setprecision( 2 ) << gigabits_per_second << " Gbit/s.\n";
+  cout << "    " << counters.report( static_cast<double>( input_len ), "byte" ) << "\n";
 
   debug_output << "             ByteStream throughput: " << fixed << setprecision( 2 ) << gigabits_per_second
                << " Gbit/s\n";
@@ -1,5 +1,6 @@
 #include "common.hh"
 
+#include <cstdlib>
 #include <iomanip>
 #include <iostream>
 #include <unistd.h>
@@ -58,3 +59,18 @@ string Printer::with_color( int color_value, string_view str ) const
 
   return ret;
 }
+
+int run_tests( initializer_list<void ( * )()> tests )
+{
+  try {
+    for ( const auto test : tests ) {
+      test();
+    }
+  } catch ( const exception& e ) {
+    cerr << "\n\n\n";
+    cerr << "\033[31;1mError: " << e.what() << "\033[m\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -3,6 +3,7 @@
 #include "conversions.hh"
 #include "exception.hh"
 
+#include <initializer_list>
 #include <memory>
 #include <stdexcept>
 #include <string>
@@ -35,6 +36,17 @@ inline ExpectationViolation::ExpectationViolation( const std::string& property_n
                            + ", but instead it was " + boolstr( actual ) + "." }
 {}
 
+//! Check a condition in a test that doesn't drive a TestHarness
+inline void expect( bool condition, const std::string& what )
+{
+  if ( not condition ) {
+    throw ExpectationViolation { what };
+  }
+}
+
+//! Run a test's parts in order, stopping at (and reporting) the first to throw; returns the status for main()
+int run_tests( std::initializer_list<void ( * )()> tests );
+
 template<class T>
 struct TestStep
 {
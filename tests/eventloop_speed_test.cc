@@ -0,0 +1,287 @@
+#include "eventloop.hh"
+#include "exception.hh"
+#include "latency.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <x86intrin.h>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+size_t allocation_count = 0; // number of calls to operator new
+}
+
+// Count every heap allocation made by the program, so the benchmark can report allocations per event
+void* operator new( size_t size )
+{
+  ++allocation_count;
+  if ( void* ptr = malloc( size ) ) { // NOLINT(*-no-malloc)
+    return ptr;
+  }
+  throw bad_alloc {};
+}
+
+void operator delete( void* ptr ) noexcept
+{
+  free( ptr ); // NOLINT(*-no-malloc)
+}
+
+void operator delete( void* ptr, size_t size [[maybe_unused]] ) noexcept
+{
+  free( ptr ); // NOLINT(*-no-malloc)
+}
+
+namespace {
+FileDescriptor make_eventfd()
+{
+  return FileDescriptor { CheckSystemCall( "eventfd", ::eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) };
+}
+
+// Raise the soft fd limit as far as allowed and return how many idle fds the benchmark can afford
+size_t available_idle_fds( const size_t wanted, const size_t reserved )
+{
+  rlimit limit {};
+  CheckSystemCall( "getrlimit", ::getrlimit( RLIMIT_NOFILE, &limit ) );
+  limit.rlim_cur = limit.rlim_max;
+  CheckSystemCall( "setrlimit", ::setrlimit( RLIMIT_NOFILE, &limit ) );
+
+  if ( limit.rlim_cur <= reserved ) {
+    return 0;
+  }
+  return min( wanted, static_cast<size_t>( limit.rlim_cur ) - reserved );
+}
+
+string backend_name( EventLoop::Backend backend, EventLoop::Trigger trigger )
+{
+  if ( backend == EventLoop::Backend::Poll ) {
+    return "poll";
+  }
+  if ( backend == EventLoop::Backend::IOUring ) {
+    return "io_uring";
+  }
+  return trigger == EventLoop::Trigger::Level ? "epoll (level)" : "epoll (edge)";
+}
+} // namespace
+
+// Many registered rules, few of them ready: each active eventfd is always readable (its callback consumes the
+// counter and bumps it again), while the idle eventfds never become readable.
+void speed_test( const EventLoop::Backend backend, // NOLINT(bugprone-easily-swappable-parameters)
+                 const EventLoop::Trigger trigger,
+                 const size_t num_idle,
+                 const size_t num_active,
+                 const size_t num_callbacks )
+{
+  EventLoop loop { backend, trigger };
+  const size_t category = loop.add_category( "eventfd" );
+
+  vector<FileDescriptor> idle;
+  vector<FileDescriptor> active;
+  vector<EventLoop::RuleHandle> rules;
+  idle.reserve( num_idle );
+  active.reserve( num_active );
+
+  size_t callbacks = 0;
+  string buffer( sizeof( uint64_t ), 0 );
+  const uint64_t one = 1;
+  const string_view increment { reinterpret_cast<const char*>( &one ), // NOLINT(*-reinterpret-cast)
+                                sizeof( one ) };
+
+  for ( size_t i = 0; i < num_idle; ++i ) {
+    idle.push_back( make_eventfd() );
+    rules.push_back( loop.add_rule( category, idle.back(), EventLoop::Direction::In, [] {
+      throw runtime_error( "idle eventfd became readable" );
+    } ) );
+  }
+
+  for ( size_t i = 0; i < num_active; ++i ) {
+    active.push_back( make_eventfd() );
+    active.back().write( increment );
+    auto& fd = active.back();
+    rules.push_back( loop.add_rule( category, fd, EventLoop::Direction::In, [&callbacks, &buffer, &increment, &fd] {
+      buffer.resize( sizeof( uint64_t ) );
+      fd.read( buffer );
+      fd.write( increment );
+      ++callbacks;
+    } ) );
+  }
+
+  size_t wakeups = 0;
+  const auto start_time = steady_clock::now();
+  while ( callbacks < num_callbacks ) {
+    if ( loop.wait_next_event( -1 ) != EventLoop::Result::Success ) {
+      throw runtime_error( "EventLoop stopped serving ready rules" );
+    }
+    ++wakeups;
+  }
+  const auto stop_time = steady_clock::now();
+
+  // once every rule is cancelled, the loop must report that there is nothing left to do
+  for ( auto& rule : rules ) {
+    rule.cancel();
+  }
+  // (epoll notices cancelled rules that are not ready once a call times out, so allow it one extra call)
+  if ( loop.wait_next_event( 0 ) != EventLoop::Result::Exit
+       and loop.wait_next_event( 0 ) != EventLoop::Result::Exit ) {
+    throw runtime_error( "EventLoop did not exit after all rules were cancelled" );
+  }
+
+  const auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
+  const double nanoseconds_per_callback = test_duration.count() * 1e9 / static_cast<double>( callbacks );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "EventLoop " << setw( 13 ) << left << backend_name( backend, trigger ) << right << " with " << num_idle
+       << " idle and " << num_active << " active fds: " << fixed << setprecision( 0 ) << nanoseconds_per_callback
+       << " ns/callback, " << setprecision( 1 ) << static_cast<double>( callbacks ) / static_cast<double>( wakeups )
+       << " callbacks/wakeup.\n";
+
+  debug_output << "             EventLoop " << backend_name( backend, trigger ) << ": " << fixed
+               << setprecision( 0 ) << nanoseconds_per_callback << " ns/callback\n";
+}
+
+// Per-dispatch overhead, in the shape of TCPMinnowSocket's loop: a few rules on a few fds, one of them ready
+void dispatch_test( const EventLoop::Backend backend, const size_t num_dispatches )
+{
+  EventLoop loop { backend };
+
+  FileDescriptor ready_fd = make_eventfd();
+  FileDescriptor idle_fd = make_eventfd();
+  const uint64_t one = 1;
+  const string_view increment { reinterpret_cast<const char*>( &one ), // NOLINT(*-reinterpret-cast)
+                                sizeof( one ) };
+  ready_fd.write( increment );
+
+  size_t callbacks = 0;
+  string buffer;
+  bool never = false;
+  loop.add_rule( "idle reader", idle_fd, EventLoop::Direction::In, [] {} );
+  loop.add_rule( "uninterested writer", idle_fd, EventLoop::Direction::Out, [] {}, [&] { return never; } );
+  loop.add_rule( "uninterested reader", ready_fd, EventLoop::Direction::Out, [] {}, [&] { return never; } );
+  loop.add_rule( "ready reader", ready_fd, EventLoop::Direction::In, [&] {
+    buffer.resize( sizeof( uint64_t ) );
+    ready_fd.read( buffer );
+    ready_fd.write( increment );
+    ++callbacks;
+  } );
+
+  const auto start_allocations = allocation_count;
+  const auto start_cycles = __rdtsc();
+  const auto start_time = steady_clock::now();
+  for ( size_t i = 0; i < num_dispatches; ++i ) {
+    loop.wait_next_event( -1 );
+  }
+  const auto stop_time = steady_clock::now();
+  const auto cycles = __rdtsc() - start_cycles;
+  const auto allocations = allocation_count - start_allocations;
+
+  if ( callbacks != num_dispatches ) {
+    throw runtime_error( "EventLoop did not dispatch the ready rule on every call" );
+  }
+
+  const auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
+  const auto dispatches = static_cast<double>( num_dispatches );
+  cout << "EventLoop " << setw( 13 ) << left << backend_name( backend, EventLoop::Trigger::Level ) << right
+       << " dispatch: " << fixed << setprecision( 0 ) << static_cast<double>( cycles ) / dispatches
+       << " cycles/event (" << test_duration.count() * 1e9 / dispatches << " ns), " << setprecision( 2 )
+       << static_cast<double>( allocations ) / dispatches << " allocations/event.\n";
+}
+
+// Timer accuracy: timers fire in deadline order, cancelled timers never fire, and the loop sleeps until the next
+// deadline rather than waking up early (there is an idle fd rule, as in TCPMinnowSocket's loop)
+void timer_test( const EventLoop::Backend backend, const size_t num_timers )
+{
+  EventLoop loop { backend };
+  const size_t category = loop.add_category( "timer" );
+
+  FileDescriptor idle_fd = make_eventfd();
+  bool done = false;
+  loop.add_rule( "idle reader", idle_fd, EventLoop::Direction::In, [] {}, [&] { return not done; } );
+
+  const auto start_time = EventLoop::Clock::now();
+  vector<EventLoop::Clock::time_point> deadlines;
+  for ( size_t i = 0; i < num_timers; ++i ) {
+    // deliberately added out of order
+    deadlines.push_back( start_time + milliseconds( 1 + ( i * 37 ) % num_timers ) );
+  }
+
+  vector<EventLoop::Clock::duration> lateness;
+  EventLoop::Clock::time_point last_deadline {};
+  for ( const auto& deadline : deadlines ) {
+    loop.add_timer( category, deadline, [&, deadline] {
+      const auto now = EventLoop::Clock::now();
+      if ( now < deadline or deadline < last_deadline ) {
+        throw runtime_error( "timer fired early or out of order" );
+      }
+      last_deadline = deadline;
+      lateness.push_back( now - deadline );
+      done = lateness.size() == deadlines.size();
+    } );
+  }
+  auto cancelled = loop.add_timer( category, start_time + milliseconds( num_timers / 2 ), [] {
+    throw runtime_error( "cancelled timer fired" );
+  } );
+  cancelled.cancel();
+
+  // (epoll only notices that the idle rule lost interest once a call times out, so don't wait forever)
+  size_t wakeups = 0;
+  while ( loop.wait_next_event( 1000 ) != EventLoop::Result::Exit ) {
+    ++wakeups;
+  }
+
+  if ( lateness.size() != num_timers ) {
+    throw runtime_error( "EventLoop exited before all timers fired" );
+  }
+
+  const auto max_lateness = *max_element( lateness.begin(), lateness.end() );
+  EventLoop::Clock::duration total_lateness {};
+  for ( const auto& x : lateness ) {
+    total_lateness += x;
+  }
+
+  cout << "EventLoop " << setw( 13 ) << left << backend_name( backend, EventLoop::Trigger::Level ) << right
+       << " timers: " << num_timers << " timers in " << wakeups << " wakeups, mean lateness " << fixed
+       << setprecision( 0 ) << duration_cast<duration<double, micro>>( total_lateness ).count() / num_timers
+       << " us, max " << duration_cast<duration<double, micro>>( max_lateness ).count() << " us.\n";
+}
+
+void program_body()
+{
+  dispatch_test( EventLoop::Backend::Poll, 200000 );
+  dispatch_test( EventLoop::Backend::Epoll, 200000 );
+  dispatch_test( EventLoop::Backend::IOUring, 200000 );
+
+  timer_test( EventLoop::Backend::Poll, 100 );
+  timer_test( EventLoop::Backend::Epoll, 100 );
+  timer_test( EventLoop::Backend::IOUring, 100 );
+
+  constexpr size_t num_active = 100;
+  const size_t num_idle = available_idle_fds( 10000, num_active + 100 );
+
+  // poll(2) scans every registered fd per wakeup and serves one rule, so it gets far fewer callbacks
+  speed_test( EventLoop::Backend::Poll, EventLoop::Trigger::Level, num_idle, num_active, 1000 );
+  speed_test( EventLoop::Backend::Epoll, EventLoop::Trigger::Level, num_idle, num_active, 1000000 );
+  speed_test( EventLoop::Backend::Epoll, EventLoop::Trigger::Edge, num_idle, num_active, 1000000 );
+}
+
+int main()
+{
+  try {
+    program_body();
+    print_latency_report( cout );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,266 @@
+#include "arp_message.hh"
+#include "common.hh"
+#include "ipv4_fragments.hh"
+#include "network_interface.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+InternetDatagram make_datagram( const size_t payload_length, const uint16_t id = 1 )
+{
+  InternetDatagram dgram;
+  dgram.header.src = 0x0a000001;
+  dgram.header.dst = 0x0a000002;
+  dgram.header.id = id;
+  dgram.header.df = false;
+  string payload( payload_length, 0 );
+  for ( size_t i = 0; i < payload_length; ++i ) {
+    payload[i] = static_cast<char>( i * 7 );
+  }
+  dgram.payload.push_back( move( payload ) );
+  dgram.header.len = IPv4Header::LENGTH + payload_length;
+  dgram.header.compute_checksum();
+  return dgram;
+}
+
+string payload_of( const InternetDatagram& dgram )
+{
+  string ret;
+  for ( const auto& buffer : dgram.payload ) {
+    ret += buffer;
+  }
+  return ret;
+}
+
+// Each fragment fits, carries its part at the right offset, and has a valid header
+void fragment_test()
+{
+  const InternetDatagram dgram = make_datagram( 3000 );
+  vector<InternetDatagram> fragments;
+  expect( fragment_datagram( dgram, 1500, fragments ), "the datagram should fragment" );
+  expect( fragments.size() == 3, "3000 bytes should take three fragments at MTU 1500" );
+
+  string joined;
+  for ( size_t i = 0; i < fragments.size(); ++i ) {
+    const auto& header = fragments[i].header;
+    expect( header.len <= 1500 and header.len == IPv4Header::LENGTH + fragments[i].payload_size(),
+            "each fragment should fit, and its length should be right" );
+    expect( header.offset * 8UL == joined.size(), "each fragment should be at its offset" );
+    expect( header.mf == ( i + 1 < fragments.size() ), "all but the last fragment should have MF set" );
+    expect( header.id == dgram.header.id, "the fragments should keep the identification" );
+
+    InternetDatagram reparsed;
+    expect( parse( reparsed, serialize( fragments[i] ) ), "each fragment's header should be valid" );
+    joined += payload_of( fragments[i] );
+  }
+  expect( joined == payload_of( dgram ), "the fragments should hold the whole payload" );
+
+  fragments.clear();
+  expect( fragment_datagram( dgram, 4000, fragments ) and fragments.size() == 1, "a datagram that fits is kept" );
+
+  InternetDatagram dont_fragment = dgram;
+  dont_fragment.header.df = true;
+  fragments.clear();
+  expect( not fragment_datagram( dont_fragment, 1500, fragments ) and fragments.empty(),
+          "a datagram with DF set should not fragment" );
+  expect( not fragment_datagram( dgram, 24, fragments ), "an MTU with no room for 8 bytes should not work" );
+}
+
+// Fragments in any order make the original datagram
+void reassemble_test()
+{
+  const InternetDatagram dgram = make_datagram( 5000 );
+  vector<InternetDatagram> fragments;
+  fragment_datagram( dgram, 576, fragments );
+  reverse( fragments.begin(), fragments.end() );
+
+  IPv4FragmentReassembler reassembler;
+  optional<InternetDatagram> whole;
+  for ( auto& fragment : fragments ) {
+    expect( not whole, "the datagram should not be complete before its last fragment" );
+    whole = reassembler.add( move( fragment ), 0 );
+  }
+  expect( whole.has_value(), "the datagram should be complete" );
+  expect( payload_of( *whole ) == payload_of( dgram ), "the payload should be put back together" );
+  expect( whole->header.len == dgram.header.len and not whole->header.mf and whole->header.offset == 0,
+          "the header should be the whole datagram's" );
+  InternetDatagram reparsed;
+  expect( parse( reparsed, serialize( *whole ) ), "the header's checksum should be valid" );
+  expect( reassembler.datagrams_pending() == 0 and reassembler.memory_used() == 0, "nothing should be held" );
+  expect( reassembler.stats().reassembled == 1, "the datagram should be counted" );
+
+  InternetDatagram plain = make_datagram( 100 );
+  expect( reassembler.add( move( plain ), 0 )->payload_size() == 100, "a datagram that isn't a fragment passes" );
+}
+
+// Duplicates are harmless; overlaps follow the policy
+void overlap_test()
+{
+  const InternetDatagram dgram = make_datagram( 2000 );
+  vector<InternetDatagram> fragments;
+  fragment_datagram( dgram, 1020, fragments ); // 1000 + 1000
+
+  {
+    IPv4FragmentReassembler reassembler;
+    reassembler.add( InternetDatagram { fragments[0] }, 0 );
+    reassembler.add( InternetDatagram { fragments[0] }, 0 );
+    expect( reassembler.add( InternetDatagram { fragments[1] }, 0 ).has_value(), "a duplicate should be ignored" );
+    expect( reassembler.stats().overlaps == 0, "a duplicate is not an overlap" );
+  }
+
+  // a fragment that covers the first one's second half with different bytes
+  InternetDatagram overlapping = fragments[0];
+  overlapping.header.offset = 496 / 8;
+  overlapping.payload = { string( 496, 'z' ) };
+
+  {
+    IPv4FragmentReassembler reassembler;
+    reassembler.add( InternetDatagram { fragments[0] }, 0 );
+    reassembler.add( InternetDatagram { overlapping }, 0 );
+    expect( reassembler.stats().overlaps == 1 and reassembler.datagrams_pending() == 0,
+            "by default, an overlap should discard the datagram" );
+    expect( not reassembler.add( InternetDatagram { fragments[1] }, 0 ), "the datagram should not complete" );
+  }
+
+  for ( const auto policy : { FragmentOverlapPolicy::FirstWins, FragmentOverlapPolicy::LastWins } ) {
+    IPv4FragmentReassembler reassembler { { .overlap = policy } };
+    reassembler.add( InternetDatagram { fragments[0] }, 0 );
+    reassembler.add( InternetDatagram { overlapping }, 0 );
+    const auto whole = reassembler.add( InternetDatagram { fragments[1] }, 0 );
+    expect( whole.has_value(), "the datagram should complete despite the overlap" );
+    const string payload = payload_of( *whole );
+    const bool first_won = payload == payload_of( dgram );
+    expect( first_won == ( policy == FragmentOverlapPolicy::FirstWins ), "the policy should pick the bytes" );
+    if ( policy == FragmentOverlapPolicy::LastWins ) {
+      expect( payload.substr( 496, 496 ) == string( 496, 'z' ), "the later bytes should win" );
+    }
+  }
+}
+
+// Incomplete datagrams are bounded in time and in memory, and inconsistent fragments are refused
+void limits_test()
+{
+  vector<InternetDatagram> a;
+  vector<InternetDatagram> b;
+  fragment_datagram( make_datagram( 3000, 1 ), 1500, a );
+  fragment_datagram( make_datagram( 3000, 2 ), 1500, b );
+
+  IPv4FragmentReassembler reassembler { { .timeout_ms = 1000, .memory_limit = 4000 } };
+  reassembler.add( InternetDatagram { a[0] }, 0 );
+  reassembler.add( InternetDatagram { b[0] }, 500 );
+  expect( reassembler.datagrams_pending() == 2, "both datagrams should be held" );
+  reassembler.add( InternetDatagram { b[2] }, 600 );
+  expect( reassembler.stats().evicted == 1 and reassembler.datagrams_pending() == 1,
+          "the oldest datagram should make room" );
+  expect( reassembler.memory_used() <= 4000, "the memory limit should hold" );
+
+  reassembler.expire( 1499 );
+  expect( reassembler.datagrams_pending() == 1, "the datagram should not time out early" );
+  reassembler.expire( 1500 );
+  expect( reassembler.stats().timed_out == 1 and reassembler.datagrams_pending() == 0,
+          "the datagram should time out" );
+  expect( reassembler.memory_used() == 0, "its memory should be released" );
+
+  InternetDatagram ragged = a[0];
+  ragged.payload = { string( 1001, 'x' ) };
+  reassembler.add( move( ragged ), 2000 );
+  expect( reassembler.stats().malformed == 1, "only the last fragment may have a length that isn't 8n" );
+}
+
+// A flood of first fragments, each of a different datagram, stays under the memory limit, bookkeeping included
+void flood_test()
+{
+  constexpr size_t LIMIT = 64 * 1024;
+  constexpr uint32_t FRAGMENTS = 100000;
+  IPv4FragmentReassembler reassembler { { .timeout_ms = 30000, .memory_limit = LIMIT } };
+  for ( uint32_t i = 0; i < FRAGMENTS; ++i ) {
+    InternetDatagram fragment = make_datagram( 8, static_cast<uint16_t>( i ) );
+    fragment.header.src += i >> 16U;
+    fragment.header.mf = true;
+    fragment.header.compute_checksum();
+    reassembler.add( move( fragment ), i / 1000 );
+  }
+  expect( reassembler.memory_used() <= LIMIT, "the memory limit should hold" );
+  expect( reassembler.datagrams_pending() > 0 and reassembler.datagrams_pending() < LIMIT / 64,
+          "each incomplete datagram should count more than its bytes, not "
+            + to_string( reassembler.datagrams_pending() ) );
+  expect( reassembler.stats().evicted == FRAGMENTS - reassembler.datagrams_pending(),
+          "the oldest datagrams should make room for the newest" );
+
+  vector<InternetDatagram> fragments;
+  fragment_datagram( make_datagram( 3000, 7 ), 1500, fragments );
+  optional<InternetDatagram> whole;
+  for ( auto& fragment : fragments ) {
+    fragment.header.src = 0x0b000001; // (a source the flood didn't use)
+    whole = reassembler.add( move( fragment ), FRAGMENTS / 1000 );
+  }
+  expect( whole.has_value() and whole->payload_size() == 3000, "a datagram should still be reassembled" );
+  expect( reassembler.memory_used() <= LIMIT, "the memory limit should still hold" );
+}
+
+class CapturePort : public NetworkInterface::OutputPort
+{
+public:
+  vector<EthernetFrame> frames {};
+
+  void transmit( const NetworkInterface& sender [[maybe_unused]], const EthernetFrame& frame ) override
+  {
+    frames.push_back( frame );
+  }
+};
+
+// A NetworkInterface with an MTU sends fragments that reassemble to the datagram
+void network_interface_test()
+{
+  const EthernetAddress local_eth { 2, 0, 0, 0, 0, 1 };
+  const Address local_ip { "10.0.0.1", 0 };
+  const Address next_hop { "10.0.0.2", 0 };
+  auto port = make_shared<CapturePort>();
+  NetworkInterface iface { "mtu", port, local_eth, local_ip };
+  iface.set_mtu( 576 );
+
+  ARPMessage arp;
+  arp.opcode = ARPMessage::OPCODE_REPLY;
+  arp.sender_ethernet_address = { 2, 0, 0, 0, 0, 2 };
+  arp.sender_ip_address = next_hop.ipv4_numeric();
+  arp.target_ethernet_address = local_eth;
+  arp.target_ip_address = local_ip.ipv4_numeric();
+  EthernetFrame reply;
+  reply.header = { local_eth, arp.sender_ethernet_address, EthernetHeader::TYPE_ARP };
+  reply.payload = serialize( arp );
+  iface.recv_frame( reply );
+
+  const InternetDatagram dgram = make_datagram( 2000 );
+  iface.send_datagram( dgram, next_hop );
+  expect( port->frames.size() == 4, "2000 bytes should take four fragments at MTU 576" );
+
+  IPv4FragmentReassembler reassembler;
+  optional<InternetDatagram> whole;
+  for ( auto& frame : port->frames ) {
+    InternetDatagram fragment;
+    expect( parse( fragment, frame.payload ), "each fragment should parse" );
+    expect( fragment.header.len <= 576, "each fragment should fit the MTU" );
+    whole = reassembler.add( move( fragment ), 0 );
+  }
+  expect( whole and payload_of( *whole ) == payload_of( dgram ), "the fragments should reassemble" );
+
+  InternetDatagram dont_fragment = dgram;
+  dont_fragment.header.df = true;
+  dont_fragment.header.compute_checksum();
+  iface.send_datagram( dont_fragment, next_hop );
+  expect( port->frames.size() == 4 and iface.datagrams_too_big() == 1, "a DF datagram that's too big is dropped" );
+}
+} // namespace
+
+int main()
+{
+  return run_tests(
+    { fragment_test, reassemble_test, overlap_test, limits_test, flood_test, network_interface_test } );
+}
@@ -0,0 +1,105 @@
+#include "common.hh"
+#include "latency.hh"
+#include "reassembler.hh"
+
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+// Every value falls in a bucket whose bounds hold it, and the buckets tile the whole range in order
+void bucket_test()
+{
+  for ( size_t b = 0; b + 1 < LatencyHistogram::BUCKETS; ++b ) {
+    expect( LatencyHistogram::highest( b ) + 1 == LatencyHistogram::lowest( b + 1 ),
+            "bucket " + to_string( b ) + " should end where the next begins" );
+  }
+  expect( LatencyHistogram::highest( LatencyHistogram::BUCKETS - 1 ) == UINT64_MAX,
+          "the last bucket should end at the largest value" );
+
+  for ( const uint64_t value : { 0UL, 1UL, 31UL, 32UL, 33UL, 1000UL, 123456789UL, UINT64_MAX } ) {
+    const size_t b = LatencyHistogram::bucket( value );
+    expect( LatencyHistogram::lowest( b ) <= value and value <= LatencyHistogram::highest( b ),
+            to_string( value ) + " should be within its bucket" );
+    const uint64_t width = LatencyHistogram::highest( b ) - LatencyHistogram::lowest( b );
+    expect( width <= value / LatencyHistogram::SUB_BUCKETS, to_string( value ) + "'s bucket should be narrow" );
+  }
+}
+
+// Percentiles are within a bucket's width of the exact values
+void percentile_test()
+{
+  LatencyHistogram h;
+  for ( uint64_t i = 1; i <= 10000; ++i ) {
+    h.record( i * 100 );
+  }
+  expect( h.count() == 10000 and h.min() == 100 and h.max() == 1'000'000, "count and extremes should be exact" );
+  expect( h.mean() == 500050, "the mean should be exact" );
+
+  const auto near = []( uint64_t value, uint64_t exact ) { return value >= exact and value <= exact * 33 / 32; };
+  expect( near( h.percentile( 50 ), 500'000 ), "p50 is " + to_string( h.percentile( 50 ) ) );
+  expect( near( h.percentile( 99 ), 990'000 ), "p99 is " + to_string( h.percentile( 99 ) ) );
+  expect( near( h.percentile( 99.9 ), 999'000 ), "p99.9 is " + to_string( h.percentile( 99.9 ) ) );
+  expect( h.percentile( 100 ) == 1'000'000, "p100 should be the maximum" );
+
+  LatencyHistogram other;
+  other.record( 5, 3 );
+  h.merge( other );
+  expect( h.count() == 10003 and h.min() == 5 and h.percentile( 0.01 ) == 5, "merging should add the counts" );
+}
+
+// Each thread records into its own histogram, and the probe merges them
+void probe_test()
+{
+  LatencyProbe probe { "test probe" };
+  vector<thread> threads;
+  for ( uint64_t t = 0; t < 4; ++t ) {
+    threads.emplace_back( [&probe, t] {
+      for ( uint64_t i = 0; i < 1000; ++i ) {
+        probe.record( 1000 * ( t + 1 ) );
+      }
+    } );
+  }
+  for ( auto& t : threads ) {
+    t.join();
+  }
+  probe.record( 7 );
+
+  const LatencyHistogram h = probe.histogram();
+  expect( h.count() == 4001, "every thread's values should be counted" );
+  expect( h.min() == 7 and h.max() == 4000, "the extremes should be every thread's" );
+  expect( h.percentile( 50 ) >= 2000 and h.percentile( 50 ) < 2100, "the threads' values should be merged" );
+
+  ostringstream report;
+  print_latency_report( report );
+  expect( report.str().find( "test probe" ) != string::npos, "the report should include the probe" );
+}
+
+// With MINNOW_LATENCY, the hot paths are timed
+void reassembler_test()
+{
+#ifdef MINNOW_LATENCY
+  Reassembler reassembler { ByteStream { 100 } };
+  reassembler.insert( 0, "abc", false );
+  reassembler.insert( 3, "def", true );
+
+  for ( const LatencyProbe* probe : LatencyProbe::all() ) {
+    if ( probe->name() == "Reassembler::insert" ) {
+      expect( probe->histogram().count() == 2, "each insert should be timed" );
+      return;
+    }
+  }
+  throw runtime_error( "Reassembler::insert should have a probe" );
+#endif
+}
+} // namespace
+
+int main()
+{
+  return run_tests( { bucket_test, percentile_test, probe_test, reassembler_test } );
+}
@@ -320,6 +320,63 @@ int main()
         serialize( make_arp( ARPMessage::OPCODE_REQUEST, local_eth, "10.0.0.1", {}, "10.0.0.5" ) ) ) } );
       test.execute( ExpectNoFrame {} );
     }
+
+    {
+      const EthernetAddress local_eth = random_private_ethernet_address();
+      const EthernetAddress target_eth = random_private_ethernet_address();
+      NetworkInterfaceTestHarness test {
+        "mappings in use are refreshed before they expire", local_eth, Address( "4.3.2.1", 0 ) };
+
+      const auto arp_request = make_arp( ARPMessage::OPCODE_REQUEST, local_eth, "4.3.2.1", {}, "192.168.0.1" );
+      const auto arp_reply = make_frame( target_eth,
+                                         local_eth,
+                                         EthernetHeader::TYPE_ARP, // NOLINTNEXTLINE(*-suspicious-*)
+                                         serialize( make_arp( ARPMessage::OPCODE_REPLY,
+                                                              target_eth,
+                                                              "192.168.0.1",
+                                                              local_eth,
+                                                              "4.3.2.1" ) ) );
+
+      const auto datagram = make_datagram( "5.6.7.8", "13.12.11.10" );
+      test.execute( SendDatagram { datagram, Address( "192.168.0.1", 0 ) } );
+      test.execute( ExpectFrame {
+        make_frame( local_eth, ETHERNET_BROADCAST, EthernetHeader::TYPE_ARP, serialize( arp_request ) ) } );
+      test.execute( ReceiveFrame { arp_reply, {} } );
+      test.execute(
+        ExpectFrame { make_frame( local_eth, target_eth, EthernetHeader::TYPE_IPv4, serialize( datagram ) ) } );
+      test.execute( ExpectArpStalls { 1 } );
+
+      // a steady flow: one datagram every 5 seconds for a minute
+      for ( int i = 0; i < 12; i++ ) {
+        test.execute( Tick { 5000 } );
+
+        // just before the mapping would lapse, the interface asks the known host directly
+        if ( i == 4 or i == 9 ) {
+          test.execute( ExpectFrame {
+            make_frame( local_eth, target_eth, EthernetHeader::TYPE_ARP, serialize( arp_request ) ) } );
+          test.execute( ExpectNoFrame {} );
+          test.execute( ReceiveFrame { arp_reply, {} } );
+        }
+
+        test.execute( SendDatagram { datagram, Address( "192.168.0.1", 0 ) } );
+        test.execute(
+          ExpectFrame { make_frame( local_eth, target_eth, EthernetHeader::TYPE_IPv4, serialize( datagram ) ) } );
+        test.execute( ExpectNoFrame {} );
+      }
+
+      // the flow never had to wait for ARP again
+      test.execute( ExpectArpStalls { 1 } );
+
+      // a mapping that is not used after it is learned is not refreshed, and lapses
+      test.execute( ReceiveFrame { arp_reply, {} } );
+      test.execute( Tick { 26000 } );
+      test.execute( ExpectNoFrame {} );
+      test.execute( Tick { 5000 } );
+      test.execute( SendDatagram { datagram, Address( "192.168.0.1", 0 ) } );
+      test.execute( ExpectFrame {
+        make_frame( local_eth, ETHERNET_BROADCAST, EthernetHeader::TYPE_ARP, serialize( arp_request ) ) } );
+      test.execute( ExpectArpStalls { 2 } );
+    }
   } catch ( const exception& e ) {
     cerr << e.what() << endl;
     return EXIT_FAILURE;
@@ -0,0 +1,256 @@
+#include "arp_message.hh"
+#include "network_interface.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+size_t allocation_count = 0; // number of calls to operator new
+}
+
+// Count every heap allocation made by the program, so the benchmark can report allocations per datagram
+void* operator new( size_t size )
+{
+  ++allocation_count;
+  if ( void* ptr = malloc( size ) ) { // NOLINT(*-no-malloc)
+    return ptr;
+  }
+  throw bad_alloc {};
+}
+
+void operator delete( void* ptr ) noexcept
+{
+  free( ptr ); // NOLINT(*-no-malloc)
+}
+
+void operator delete( void* ptr, size_t size [[maybe_unused]] ) noexcept
+{
+  free( ptr ); // NOLINT(*-no-malloc)
+}
+
+namespace {
+class CountingPort : public NetworkInterface::OutputPort
+{
+public:
+  size_t arp_frames {};
+  size_t ipv4_frames {};
+
+  void transmit( const NetworkInterface& sender [[maybe_unused]], const EthernetFrame& frame ) override
+  {
+    if ( frame.header.type == EthernetHeader::TYPE_ARP ) {
+      ++arp_frames;
+    } else {
+      ++ipv4_frames;
+    }
+  }
+};
+
+EthernetAddress host_ethernet_address( uint32_t n )
+{
+  return { 0x02,
+           0,
+           static_cast<uint8_t>( n >> 24 ),
+           static_cast<uint8_t>( n >> 16 ),
+           static_cast<uint8_t>( n >> 8 ),
+           static_cast<uint8_t>( n ) };
+}
+
+EthernetFrame make_arp_reply( const EthernetAddress& local_eth, uint32_t local_ip, uint32_t remote_ip )
+{
+  ARPMessage arp;
+  arp.opcode = ARPMessage::OPCODE_REPLY;
+  arp.sender_ethernet_address = host_ethernet_address( remote_ip );
+  arp.sender_ip_address = remote_ip;
+  arp.target_ethernet_address = local_eth;
+  arp.target_ip_address = local_ip;
+
+  EthernetFrame frame;
+  frame.header.src = arp.sender_ethernet_address;
+  frame.header.dst = local_eth;
+  frame.header.type = EthernetHeader::TYPE_ARP;
+  frame.payload = serialize( arp );
+  return frame;
+}
+
+InternetDatagram make_datagram( const Address& src, const Address& dst )
+{
+  InternetDatagram dgram;
+  dgram.header.src = src.ipv4_numeric();
+  dgram.header.dst = dst.ipv4_numeric();
+  dgram.payload.emplace_back( 1000, 'x' );
+  dgram.header.len = static_cast<uint64_t>( dgram.header.hlen ) * 4 + dgram.payload.front().size();
+  dgram.header.compute_checksum();
+  return dgram;
+}
+
+double allocations_per_datagram( size_t allocations, size_t datagrams )
+{
+  return static_cast<double>( allocations ) / static_cast<double>( datagrams );
+}
+} // namespace
+
+void speed_test( const size_t num_next_hops,         // NOLINT(bugprone-easily-swappable-parameters)
+                 const size_t datagrams_per_next_hop ) // NOLINT(bugprone-easily-swappable-parameters)
+{
+  const EthernetAddress local_eth = host_ethernet_address( 1 );
+  const Address local_ip { "10.0.0.1", 0 };
+  const uint32_t first_next_hop = Address { "10.1.0.0", 0 }.ipv4_numeric();
+
+  auto port = make_shared<CountingPort>();
+  NetworkInterface iface { "speed", port, local_eth, local_ip };
+
+  const InternetDatagram dgram = make_datagram( local_ip, Address { "192.168.0.1", 0 } );
+
+  // Pre-build the ARP replies so that only the interface's own work is timed
+  vector<EthernetFrame> replies;
+  replies.reserve( num_next_hops );
+  for ( size_t i = 0; i < num_next_hops; ++i ) {
+    replies.push_back( make_arp_reply( local_eth, local_ip.ipv4_numeric(), first_next_hop + i ) );
+  }
+
+  const auto start_allocations = allocation_count;
+  const auto start_time = steady_clock::now();
+
+  // Every next hop is unresolved at once: interleave datagrams across all of them
+  for ( size_t round = 0; round < datagrams_per_next_hop; ++round ) {
+    for ( size_t i = 0; i < num_next_hops; ++i ) {
+      iface.send_datagram( dgram, Address::from_ipv4_numeric( first_next_hop + i ) );
+    }
+  }
+
+  if ( iface.datagrams_pending() != num_next_hops * datagrams_per_next_hop ) {
+    throw runtime_error( "NetworkInterface did not queue every datagram waiting on ARP" );
+  }
+
+  for ( const auto& reply : replies ) {
+    iface.recv_frame( reply );
+  }
+
+  const auto stop_time = steady_clock::now();
+  const auto allocations = allocation_count - start_allocations;
+
+  if ( port->arp_frames != num_next_hops ) {
+    throw runtime_error( "NetworkInterface sent an unexpected number of ARP requests" );
+  }
+
+  if ( port->ipv4_frames != num_next_hops * datagrams_per_next_hop or iface.datagrams_pending() != 0 ) {
+    throw runtime_error( "NetworkInterface did not release every datagram after ARP replies" );
+  }
+
+  const auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
+  const auto datagrams_per_second = static_cast<double>( port->ipv4_frames ) / test_duration.count();
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "NetworkInterface with " << num_next_hops << " unresolved next hops (" << datagrams_per_next_hop
+       << " datagrams each) reached " << fixed << setprecision( 2 ) << datagrams_per_second / 1e6
+       << " Mdatagrams/s (" << allocations_per_datagram( allocations, port->ipv4_frames )
+       << " allocations/datagram).\n";
+
+  debug_output << "             NetworkInterface throughput: " << fixed << setprecision( 2 )
+               << datagrams_per_second / 1e6 << " Mdatagrams/s\n";
+
+  if ( datagrams_per_second < 1e5 ) {
+    throw runtime_error( "NetworkInterface did not meet minimum speed of 0.1 Mdatagrams/s." );
+  }
+}
+
+// Steady state: every next hop is resolved. Measures plain transmit (from a const datagram, which must be copied
+// once), transmit of a datagram the caller hands over, and forwarding a received frame out another interface. Each
+// is run once unmeasured first, to warm packet_pool; after that, the owned and forwarded paths must not allocate.
+void transmit_test( const size_t num_datagrams )
+{
+  const EthernetAddress local_eth = host_ethernet_address( 1 );
+  const Address local_ip { "10.0.0.1", 0 };
+  const Address next_hop { "10.0.0.2", 0 };
+
+  auto port = make_shared<CountingPort>();
+  NetworkInterface iface { "transmit", port, local_eth, local_ip };
+  NetworkInterface upstream { "upstream", port, host_ethernet_address( 3 ), Address { "10.9.0.1", 0 } };
+  iface.recv_frame( make_arp_reply( local_eth, local_ip.ipv4_numeric(), next_hop.ipv4_numeric() ) );
+
+  const InternetDatagram dgram = make_datagram( local_ip, Address { "192.168.0.1", 0 } );
+
+  // Pre-build the inputs (for the warmup and the measured run) so that only the interfaces' own allocations are
+  // counted
+  vector<InternetDatagram> owned_dgrams( 2 * num_datagrams, dgram );
+  vector<EthernetFrame> inbound_frames;
+  inbound_frames.reserve( 2 * num_datagrams );
+  for ( size_t i = 0; i < 2 * num_datagrams; ++i ) {
+    EthernetFrame frame;
+    frame.header = { host_ethernet_address( 3 ), host_ethernet_address( 4 ), EthernetHeader::TYPE_IPv4 };
+    frame.payload = serialize( dgram );
+    inbound_frames.push_back( move( frame ) );
+  }
+
+  auto measure = [&]( const string& name, auto&& body, bool must_not_allocate ) {
+    for ( size_t i = 0; i < num_datagrams; ++i ) {
+      body( i );
+    }
+
+    port->ipv4_frames = 0;
+    const auto start_allocations = allocation_count;
+    const auto start_time = steady_clock::now();
+    for ( size_t i = num_datagrams; i < 2 * num_datagrams; ++i ) {
+      body( i );
+    }
+    const auto stop_time = steady_clock::now();
+    const auto allocations = allocation_count - start_allocations;
+
+    if ( port->ipv4_frames != num_datagrams ) {
+      throw runtime_error( "NetworkInterface did not transmit every datagram (" + name + ")" );
+    }
+
+    const auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
+    cout << "NetworkInterface " << name << " reached " << fixed << setprecision( 2 )
+         << static_cast<double>( num_datagrams ) / test_duration.count() / 1e6 << " Mdatagrams/s ("
+         << allocations_per_datagram( allocations, num_datagrams ) << " allocations/datagram).\n";
+
+    if ( must_not_allocate and allocations != 0 ) {
+      throw runtime_error( "NetworkInterface " + name + " allocated " + to_string( allocations )
+                           + " times in steady state (should be 0)" );
+    }
+  };
+
+  measure( "transmit (const datagram)", [&]( size_t ) { iface.send_datagram( dgram, next_hop ); }, false );
+  measure(
+    "transmit (owned datagram)",
+    [&]( size_t i ) { iface.send_datagram( move( owned_dgrams[i] ), next_hop ); },
+    true );
+  measure(
+    "forward",
+    [&]( size_t i ) {
+      upstream.recv_frame( move( inbound_frames[i] ) );
+      iface.send_datagram( move( upstream.datagrams_received().front() ), next_hop );
+      upstream.datagrams_received().pop();
+    },
+    true );
+}
+
+void program_body()
+{
+  speed_test( 4096, 16 );
+  transmit_test( 100000 );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
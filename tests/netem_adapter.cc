@@ -0,0 +1,155 @@
+#include "common.hh"
+#include "loopback_adapter.hh"
+#include "netem_adapter.hh"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+using Path = NetemAdapter<LoopbackAdapter>;
+
+// A path from one end of a loopback link, and the other end, where its segments come out
+struct Harness
+{
+  Path path;
+  LoopbackAdapter far_end;
+
+  explicit Harness( const NetemConfig& config )
+    : Harness( LoopbackAdapter::make_pair( 100'000 ), config )
+  {}
+
+  Harness( pair<LoopbackAdapter, LoopbackAdapter>&& ends, const NetemConfig& config )
+    : path( move( ends.first ), config ), far_end( move( ends.second ) )
+  {}
+
+  // Send segments numbered [first, first + count) with `payload_size` bytes each
+  void send( uint32_t first, uint32_t count, size_t payload_size = 0 )
+  {
+    for ( uint32_t i = first; i < first + count; ++i ) {
+      TCPMessage msg;
+      msg.sender.seqno = Wrap32 { i };
+      msg.sender.payload = string( payload_size, 'x' );
+      path.write( msg );
+    }
+  }
+
+  // The numbers of the segments that have come out since the last call
+  vector<uint32_t> arrived()
+  {
+    vector<TCPMessage> segs;
+    while ( far_end.pending() > 0 ) {
+      far_end.read_batch( segs );
+    }
+    vector<uint32_t> numbers;
+    for ( const auto& seg : segs ) {
+      numbers.push_back( seg.sender.seqno.raw_value_ );
+    }
+    return numbers;
+  }
+};
+
+void expect_count( size_t expected, size_t actual, const string& what )
+{
+  expect( expected == actual,
+          what + ": expected " + to_string( expected ) + " segments, but there were " + to_string( actual ) );
+}
+
+// A segment takes exactly the configured delay
+void delay_test()
+{
+  Harness h { NetemConfig { .delay_ms = 100, .seed = 1 } };
+  h.send( 0, 3 );
+  expect( h.path.ms_until_next_tick() == 100, "ms_until_next_tick() should be the delay" );
+  h.path.tick( 99 );
+  expect_count( 0, h.arrived().size(), "before the delay" );
+  h.path.tick( 1 );
+  expect( h.arrived() == vector<uint32_t> { 0, 1, 2 }, "segments should arrive, in order, after the delay" );
+  expect( not h.path.ms_until_next_tick(), "nothing should be left on its way" );
+}
+
+// The link carries rate_bps: 1000-byte segments at 1 Mbit/s leave 8 ms apart
+void rate_test()
+{
+  Harness h { NetemConfig { .delay_ms = 10, .rate_bps = 1'000'000, .seed = 1 } };
+  h.send( 0, 10, 1000 - NetemConfig::HEADER_SIZE );
+  h.path.tick( 17 );
+  expect_count( 0, h.arrived().size(), "before the first segment is serialized and delayed" );
+  h.path.tick( 1 );
+  expect_count( 1, h.arrived().size(), "after 8 ms on the link and 10 ms of delay" );
+  h.path.tick( 71 );
+  expect_count( 8, h.arrived().size(), "79 ms after the first was sent" );
+  h.path.tick( 1 );
+  expect_count( 1, h.arrived().size(), "when the tenth has been serialized and delayed" );
+}
+
+// A full queue drops what is written to it
+void queue_limit_test()
+{
+  Harness h { NetemConfig { .delay_ms = 5, .queue_limit = 4, .seed = 1 } };
+  h.send( 0, 10 );
+  expect_count( 4, h.path.queued(), "queued with a limit of 4" );
+  expect( h.path.dropped() == 6, "the 6 segments past the limit should be dropped" );
+  h.path.tick( 5 );
+  expect( h.arrived() == vector<uint32_t> { 0, 1, 2, 3 }, "the first 4 segments should arrive" );
+}
+
+// Jitter varies the delay but never reorders
+void jitter_test()
+{
+  Harness h { NetemConfig { .delay_ms = 50, .jitter_ms = 40, .seed = 1 } };
+  vector<uint32_t> arrivals;
+  for ( uint32_t ms = 0; ms < 1000; ++ms ) {
+    h.send( ms, 1 );
+    h.path.tick( 1 );
+    for ( const auto n : h.arrived() ) {
+      arrivals.push_back( n );
+    }
+  }
+  h.path.tick( 100 );
+  for ( const auto n : h.arrived() ) {
+    arrivals.push_back( n );
+  }
+  expect_count( 1000, arrivals.size(), "with jitter" );
+  for ( uint32_t i = 0; i < arrivals.size(); ++i ) {
+    expect( arrivals[i] == i, "jitter reordered segment " + to_string( i ) );
+  }
+}
+
+// Reordered segments skip the delay; duplicated ones arrive twice; lost ones not at all, at about the given rate
+void random_test()
+{
+  Harness reorder { NetemConfig { .delay_ms = 10, .reorder_rate = UINT16_MAX / 4, .seed = 2 } };
+  reorder.send( 0, 1000 );
+  reorder.path.tick( 0 );
+  const size_t early = reorder.arrived().size();
+  expect( early > 200 and early < 300, "about a quarter should skip the delay, not " + to_string( early ) );
+  reorder.path.tick( 10 );
+  expect_count( 1000 - early, reorder.arrived().size(), "the rest, after the delay" );
+
+  Harness duplicate { NetemConfig { .queue_limit = 2000, .duplicate_rate = UINT16_MAX / 2, .seed = 3 } };
+  duplicate.send( 0, 1000 );
+  duplicate.path.tick( 0 );
+  const size_t copies = duplicate.arrived().size();
+  expect( copies > 1450 and copies < 1550, "about half should be duplicated, not " + to_string( copies - 1000 ) );
+
+  // the same seed makes the same choices
+  vector<uint32_t> previous;
+  for ( int run = 0; run < 2; ++run ) {
+    Harness loss { NetemConfig { .queue_limit = 10000, .loss_rate = UINT16_MAX / 10, .seed = 4 } };
+    loss.send( 0, 10000 );
+    loss.path.tick( 0 );
+    const vector<uint32_t> kept = loss.arrived();
+    expect( kept.size() > 8800 and kept.size() < 9200, "about a tenth should be lost" );
+    expect( run == 0 or kept == previous, "the same seed should lose the same segments" );
+    previous = kept;
+  }
+}
+} // namespace
+
+int main()
+{
+  return run_tests( { delay_test, rate_test, queue_limit_test, jitter_test, random_test } );
+}
@@ -137,6 +137,13 @@ struct ExpectNoFrame : public Expectation<InterfaceAndOutput>
   }
 };
 
+struct ExpectArpStalls : public ConstExpectNumber<InterfaceAndOutput, size_t>
+{
+  using ConstExpectNumber::ConstExpectNumber;
+  std::string name() const override { return "arp_stalls"; }
+  size_t value( const InterfaceAndOutput& interface ) const override { return interface.first.arp_stalls(); }
+};
+
 struct Tick : public Action<InterfaceAndOutput>
 {
   size_t _ms;
@@ -0,0 +1,132 @@
+#include "common.hh"
+#include "ethernet_frame.hh"
+#include "ipv4_datagram.hh"
+#include "packet_buffer.hh"
+#include "parser.hh"
+#include "tcp_segment.hh"
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+// Headers go into the headroom, in front of the payload, without moving it
+void headroom_test()
+{
+  PacketBuffer buffer { 8, 16 };
+  expect( buffer.empty() and buffer.headroom() == 8 and buffer.tailroom() == 16, "a new buffer should be empty" );
+
+  buffer.append( "payload" );
+  const char* payload = buffer.view().data();
+  buffer.prepend( "hdr" );
+  buffer.prepend( "eth" );
+  expect( buffer.view() == "ethhdrpayload", "the headers should be in front" );
+  expect( buffer.view().data() + 6 == payload, "prepending into the headroom should not move the payload" );
+  expect( buffer.headroom() == 2, "the headers should have used the headroom" );
+
+  buffer.prepend( "more than two" );
+  expect( buffer.view() == "more than twoethhdrpayload", "prepending past the headroom should grow the storage" );
+  expect( buffer.headroom() >= 13, "growing should leave headroom for more headers" );
+
+  buffer.remove_prefix( 13 );
+  buffer.remove_suffix( 7 );
+  expect( buffer.view() == "ethhdr", "stripping should narrow the buffer" );
+  expect( buffer.headroom() >= 13 and buffer.tailroom() >= 7,
+          "stripped bytes should become headroom and tailroom" );
+}
+
+// Copies and slices share storage until one of them is written to
+void sharing_test()
+{
+  PacketBuffer buffer { string { "0123456789" } };
+  const PacketBuffer slice = buffer.slice( 2, 5 );
+  expect( slice.view() == "23456", "a slice should see its part of the buffer" );
+  expect( slice.view().data() == buffer.view().data() + 2, "a slice should not copy" );
+  expect( buffer.shared() and slice.shared(), "the storage should be shared" );
+
+  buffer.data()[2] = 'x';
+  expect( buffer.view() == "01x3456789", "the written buffer should change" );
+  expect( slice.view() == "23456", "writing should not change the slice" );
+  expect( not buffer.shared(), "writing should have copied the storage" );
+
+  bool threw = false;
+  try {
+    slice.slice( 3, 3 );
+  } catch ( const out_of_range& ) {
+    threw = true;
+  }
+  expect( threw, "slicing past the end should throw" );
+}
+
+// Releasing the only reference hands over the storage; a shared one is copied
+void release_test()
+{
+  string bytes( 100, 'x' );
+  const char* memory = bytes.data();
+  PacketBuffer buffer { move( bytes ) };
+  buffer.remove_suffix( 10 );
+
+  size_t offset = 0;
+  buffer.remove_prefix( 20 );
+  const string released = buffer.release( offset );
+  expect( released.data() == memory and offset == 20 and released.size() == 90,
+          "the storage should be handed over" );
+  expect( buffer.empty(), "a released buffer should be empty" );
+
+  PacketBuffer shared { string( 100, 'y' ) };
+  const PacketBuffer other = shared;
+  const string copy = shared.release();
+  expect( copy == string( 100, 'y' ) and other.size() == 100, "a shared buffer should be copied" );
+}
+
+// A TCP segment wrapped by IPv4 and Ethernet headers in the headroom, and parsed back without copying the payload
+void layers_test()
+{
+  TCPSegment seg;
+  seg.udinfo.src_port = 1234;
+  seg.udinfo.dst_port = 80;
+  seg.message.sender.SYN = true;
+  seg.message.sender.seqno = Wrap32 { 5 };
+
+  IPv4Header ip;
+  ip.proto = IPv4Header::PROTO_TCP;
+  ip.len = IPv4Header::LENGTH + 20 + 4;
+  ip.src = 0x0a000001;
+  ip.dst = 0x0a000002;
+  ip.compute_checksum();
+
+  const EthernetHeader eth { { 1, 2, 3, 4, 5, 6 }, { 6, 5, 4, 3, 2, 1 }, EthernetHeader::TYPE_IPv4 };
+
+  PacketBuffer buffer { EthernetHeader::LENGTH + IPv4Header::LENGTH + 20, 4 };
+  buffer.append( "data" );
+  prepend_serialized( buffer, seg );
+  prepend_serialized( buffer, ip );
+  prepend_serialized( buffer, eth );
+  expect( buffer.headroom() == 0 and buffer.tailroom() == 0, "every header should have gone into the headroom" );
+  expect( buffer.size() == EthernetHeader::LENGTH + IPv4Header::LENGTH + 20 + 4, "the frame should be complete" );
+  const char* storage = buffer.view().data() - buffer.headroom();
+
+  EthernetFrame frame;
+  expect( parse( frame, move( buffer ) ), "the frame should parse" );
+  expect( frame.header.type == EthernetHeader::TYPE_IPv4, "the Ethernet header should parse" );
+
+  IPv4Datagram dgram;
+  expect( parse( dgram, move( frame.payload ) ), "the datagram should parse" );
+  expect( dgram.header.src == ip.src and dgram.header.dst == ip.dst, "the IPv4 header should parse" );
+
+  TCPSegment parsed;
+  expect( parse( parsed, move( dgram.payload ), optional<uint32_t> {} ), "the segment should parse" );
+  expect( parsed.message.sender.SYN and parsed.message.sender.seqno == Wrap32 { 5 },
+          "the TCP header should parse" );
+  expect( parsed.message.sender.payload == "data", "the payload should parse" );
+  expect( parsed.message.sender.payload.data() == storage, "the payload should still be in the buffer's storage" );
+}
+} // namespace
+
+int main()
+{
+  return run_tests( { headroom_test, sharing_test, release_test, layers_test } );
+}
@@ -0,0 +1,111 @@
+#include "common.hh"
+#include "packet_pool.hh"
+#include "parser.hh"
+
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+// A recycled string comes back empty, with its memory
+void string_test()
+{
+  string buffer( 1000, 'x' );
+  const char* memory = buffer.data();
+  packet_pool::recycle( move( buffer ) );
+  expect( packet_pool::strings_available() == 1, "the string should be kept" );
+
+  const string taken = packet_pool::take_string();
+  expect( taken.empty(), "a taken string should be empty" );
+  expect( taken.data() == memory, "a taken string should reuse the recycled one's memory" );
+  expect( packet_pool::strings_available() == 0, "the string should have been handed out" );
+
+  packet_pool::recycle( string { "short" } );
+  packet_pool::recycle( string( 1 << 20, 'x' ) );
+  expect( packet_pool::strings_available() == 0, "short and huge strings should not be kept" );
+  expect( packet_pool::take_string().capacity() == string {}.capacity(), "an empty pool should give a new string" );
+}
+
+// A recycled vector of buffers is kept along with each of its buffers, and the freelists are bounded
+void buffers_test()
+{
+  vector<string> buffers { string( 100, 'a' ), string( 200, 'b' ) };
+  packet_pool::recycle( move( buffers ) );
+  expect( packet_pool::buffers_available() == 1, "the vector should be kept" );
+  expect( packet_pool::strings_available() == 2, "its strings should be kept" );
+
+  const auto taken = packet_pool::take_buffers();
+  expect( taken.empty() and taken.capacity() >= 2, "a taken vector should be empty, with its capacity" );
+
+  for ( size_t i = 0; i < 10000; ++i ) {
+    packet_pool::recycle( string( 100, 'x' ) );
+  }
+  expect( packet_pool::strings_available() < 10000, "the freelist of strings should be bounded" );
+  while ( packet_pool::strings_available() ) {
+    packet_pool::take_string();
+  }
+
+  for ( size_t i = 0; i < 1000; ++i ) {
+    packet_pool::recycle( string( 65000, 'x' ) );
+  }
+  expect( packet_pool::strings_available() < 1000
+            and packet_pool::string_bytes_available() <= packet_pool::MAX_STRING_BYTES,
+          "the memory the freelist of strings keeps should be bounded" );
+  while ( packet_pool::strings_available() ) {
+    packet_pool::take_string();
+  }
+  expect( packet_pool::string_bytes_available() == 0, "an empty freelist should hold no memory" );
+}
+
+// Queue nodes are reused, and memory freed on another thread is simply kept there
+void allocator_test()
+{
+  PooledQueue<vector<string>> queue;
+  for ( size_t i = 0; i < 1000; ++i ) {
+    queue.push( { string( 100, 'x' ) } );
+    queue.pop();
+  }
+  expect( queue.empty(), "the queue should be empty" );
+
+  void* block = packet_pool::allocate_block( 100 );
+  packet_pool::deallocate_block( block, 100 );
+  expect( packet_pool::allocate_block( 100 ) == block, "a freed block should be handed out again" );
+  packet_pool::deallocate_block( block, 100 );
+
+  void* elsewhere = packet_pool::allocate_block( 100 );
+  thread { [elsewhere] { packet_pool::deallocate_block( elsewhere, 100 ); } }.join();
+
+  void* large = packet_pool::allocate_block( 100000 );
+  packet_pool::deallocate_block( large, 100000 );
+}
+
+// Parsing takes over the buffers of a moved vector, and serializing draws on (and refills) the pool
+void parser_test()
+{
+  vector<string> buffers { string( "\x01\x02\x03\x04" ), string( 100, 'p' ) };
+  const char* payload_memory = buffers[1].data();
+
+  Parser parser { move( buffers ) };
+  uint32_t value {};
+  parser.integer( value );
+  vector<string> rest;
+  parser.all_remaining( rest );
+  expect( value == 0x01020304, "the integer should parse" );
+  expect( rest.size() == 1 and rest[0].data() == payload_memory, "the payload should be moved, not copied" );
+
+  packet_pool::recycle( string( 64, 'h' ) );
+  Serializer serializer;
+  serializer.integer( uint32_t { 7 } );
+  const auto output = serializer.release();
+  expect( output.size() == 1 and output[0].size() == 4, "the integer should serialize" );
+  expect( output[0].capacity() >= 64, "the serializer should have used the recycled string" );
+}
+} // namespace
+
+int main()
+{
+  return run_tests( { string_test, buffers_test, allocator_test, parser_test } );
+}
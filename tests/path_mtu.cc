@@ -0,0 +1,191 @@
+#include "common.hh"
+#include "path_mtu.hh"
+#include "tcp_sender.hh"
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace {
+// Answer a prober's probes as a path that carries payloads of up to `path_payload` bytes would
+void run_search( PathMTUProber& prober, const size_t path_payload, const unsigned max_probes )
+{
+  uint64_t end = 0;
+  for ( unsigned probes = 0; probes < 100; ++probes ) {
+    const auto size = prober.next_probe();
+    if ( not size ) {
+      return;
+    }
+    end += *size;
+    prober.probe_sent( end );
+    expect( prober.is_probe( end ), "the probe just sent is the one in flight" );
+    if ( *size <= path_payload ) {
+      prober.acknowledged( end );
+    } else {
+      prober.probe_lost();
+      for ( unsigned retry = 1; retry < max_probes; ++retry ) {
+        expect( prober.next_probe() == size, "a lost probe is tried again at the same size" );
+        end += *size;
+        prober.probe_sent( end );
+        prober.probe_lost();
+      }
+    }
+  }
+  throw runtime_error( "the search never ended" );
+}
+
+void prober_test()
+{
+  const PathMTUConfig config;
+
+  {
+    PathMTUProber prober { config };
+    expect( prober.payload_size() == config.base_payload, "a prober starts from the base size" );
+    expect( not prober.learned(), "the size a prober starts from isn't learned" );
+    expect( prober.next_probe() == config.max_payload, "the first probe is of the largest size" );
+    run_search( prober, config.max_payload, config.max_probes );
+    expect( prober.payload_size() == config.max_payload, "the largest size is found at once" );
+    expect( prober.learned(), "an acknowledged probe teaches the size" );
+    expect( not prober.searching() and not prober.next_probe(), "the search ends there" );
+
+    prober.black_hole();
+    expect( prober.payload_size() == config.base_payload, "a black hole falls back to the base size" );
+    expect( prober.next_probe() == 1230, "after a black hole, the search halves the interval" );
+  }
+
+  {
+    PathMTUProber prober { config };
+    run_search( prober, 1330, config.max_probes );
+    expect( prober.payload_size() <= 1330 and prober.payload_size() + config.resolution > 1330,
+            "the search ends within the resolution of the path's size, not past it: "
+              + to_string( prober.payload_size() ) );
+    expect( not prober.searching(), "the search ends" );
+
+    prober.tick( config.raise_interval_ms - 1 );
+    expect( not prober.next_probe(), "a finished search waits" );
+    prober.tick( 1 );
+    expect( prober.next_probe() == config.max_payload, "a search begins again after the raise interval" );
+  }
+
+  {
+    PathMTUConfig seeded = config;
+    seeded.initial_payload = 1400;
+    expect( PathMTUProber { seeded }.payload_size() == 1400, "a prober starts from a size learned before" );
+    expect( not PathMTUProber { seeded }.learned(), "a size learned before isn't learned again" );
+    PathMTUProber prober { seeded };
+    prober.black_hole();
+    expect( prober.learned(), "a black hole teaches the size" );
+    seeded.initial_payload = 9000;
+    expect( PathMTUProber { seeded }.payload_size() == config.max_payload, "a learned size is clamped" );
+  }
+
+  {
+    PathMTUProber prober { config };
+    prober.probe_sent( 2000 );
+    prober.acknowledged( 1999 );
+    expect( prober.payload_size() == config.base_payload, "a probe that is partly acknowledged hasn't worked" );
+    expect( not prober.learned(), "a probe that is partly acknowledged teaches nothing" );
+    prober.acknowledged( 2000 );
+    expect( prober.payload_size() == config.max_payload, "an acknowledged probe raises the size" );
+  }
+}
+
+void cache_test()
+{
+  PathMTUCache cache;
+  expect( not cache.lookup( 0x0a000001, 0 ), "an empty cache knows nothing" );
+  cache.update( 0x0a000001, 1400, 1000 );
+  expect( cache.lookup( 0x0a000001, 1000 + PathMTUCache::ENTRY_TTL_MS - 1 ) == 1400, "an entry is found" );
+  expect( not cache.lookup( 0x0a000002, 1000 ), "entries are per destination" );
+  expect( not cache.lookup( 0x0a000001, 1000 + PathMTUCache::ENTRY_TTL_MS ), "entries expire" );
+}
+
+struct Sent
+{
+  vector<TCPSenderMessage> segments {};
+
+  TCPSender::TransmitFunction transmit()
+  {
+    return [this]( const TCPSenderMessage& msg ) { segments.push_back( msg ); };
+  }
+};
+
+TCPSender make_sender( const PathMTUConfig& config, Sent& sent )
+{
+  TCPSender sender { ByteStream { 20000 }, Wrap32 { 0 }, 1000 };
+  sender.enable_mtu_probing( config );
+  sender.push( sent.transmit() ); // SYN
+  sender.receive( { Wrap32 { 1 }, 10000, false } );
+  sent.segments.clear();
+  return sender;
+}
+
+void sender_test()
+{
+  const PathMTUConfig config;
+
+  {
+    Sent sent;
+    TCPSender sender = make_sender( config, sent );
+    sender.writer().push( string( 4000, 'x' ) );
+    sender.push( sent.transmit() );
+    expect( sent.segments.size() == 4 and sent.segments[0].payload.size() == config.max_payload,
+            "the first segment is a probe of the largest size" );
+    for ( size_t i = 1; i < sent.segments.size(); ++i ) {
+      expect( sent.segments[i].payload.size() <= config.base_payload, "the rest are of the base size" );
+    }
+
+    sender.receive( { Wrap32 { 1 + 1460 }, 10000, false } );
+    expect( sender.max_payload_size() == config.max_payload, "an acknowledged probe raises the segment size" );
+  }
+
+  {
+    // (acknowledging the first byte puts the probe at the front of what is outstanding)
+    Sent sent;
+    TCPSender sender = make_sender( config, sent );
+    sender.writer().push( string( 4000, 'x' ) );
+    sender.push( sent.transmit() );
+    sender.receive( { Wrap32 { 2 }, 10000, false } );
+    const auto timeout = sender.ms_until_timeout();
+    expect( timeout.has_value(), "the timer runs" );
+    sent.segments.clear();
+
+    sender.tick( *timeout, sent.transmit() );
+    expect( sent.segments.size() == 2 and sent.segments[0].payload.size() == config.base_payload
+              and sent.segments[1].payload.size() == 460 and sent.segments[1].seqno == Wrap32 { 1001 },
+            "a lost probe is sent again in segments of the current size" );
+    expect( sender.consecutive_retransmissions() == 0 and sender.ms_until_timeout() == timeout,
+            "a lost probe doesn't back the timer off" );
+    expect( sender.max_payload_size() == config.base_payload, "a lost probe doesn't raise the size" );
+  }
+
+  {
+    // a path that stops carrying segments of the size it carried before
+    PathMTUConfig learned = config;
+    learned.initial_payload = config.max_payload;
+    Sent sent;
+    TCPSender sender = make_sender( learned, sent );
+    sender.writer().push( string( 3000, 'x' ) );
+    sender.push( sent.transmit() );
+    expect( sent.segments.size() == 3 and sent.segments[0].payload.size() == config.max_payload,
+            "segments are of the size learned before" );
+    sender.receive( { Wrap32 { 2 }, 10000, false } );
+
+    for ( uint64_t i = 0; i <= TCPSender::BLACK_HOLE_RETRANSMISSIONS; ++i ) {
+      sent.segments.clear();
+      sender.tick( *sender.ms_until_timeout(), sent.transmit() );
+      expect( sent.segments.size() == 1, "one segment is retransmitted" );
+    }
+    expect( sender.max_payload_size() == config.base_payload, "a black hole falls back to the base size" );
+    expect( sent.segments.back().payload.size() == config.base_payload, "and the segment is split" );
+  }
+}
+} // namespace
+
+int main()
+{
+  return run_tests( { prober_test, cache_test, sender_test } );
+}
@@ -0,0 +1,272 @@
+#include "capture_tap.hh"
+#include "common.hh"
+#include "ipv4_datagram.hh"
+#include "network_interface.hh"
+#include "pcapng.hh"
+#include "tcp_over_ip.hh"
+#include "tun_test_harness.hh"
+#include "tuntap_adapter.hh"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace {
+const string DIRECTORY = "/tmp/minnow_pcapng_test." + to_string( getpid() );
+
+uint32_t word( const string& bytes, size_t offset )
+{
+  uint32_t value = 0;
+  memcpy( &value, bytes.data() + offset, sizeof( value ) );
+  return value;
+}
+
+// A pcapng block, and for a packet block, its lengths and data
+struct Block
+{
+  uint32_t type;
+  string body;
+
+  uint32_t captured_length() const { return word( body, 12 ); }
+  uint32_t original_length() const { return word( body, 16 ); }
+  string data() const { return body.substr( 20, captured_length() ); }
+};
+
+// The blocks of a pcapng file, checking that they fit together
+vector<Block> read_blocks( const string& path )
+{
+  ifstream file { path, ios::binary };
+  const string contents { istreambuf_iterator<char>( file ), istreambuf_iterator<char>() };
+
+  vector<Block> blocks;
+  for ( size_t offset = 0; offset < contents.size(); ) {
+    expect( offset + 12 <= contents.size(), "a block is truncated" );
+    const uint32_t length = word( contents, offset + 4 );
+    expect( length % 4 == 0 and offset + length <= contents.size(), "a block has a bad length" );
+    expect( word( contents, offset + length - 4 ) == length, "a block's trailing length doesn't match" );
+    blocks.push_back( { word( contents, offset ), contents.substr( offset + 8, length - 12 ) } );
+    offset += length;
+  }
+  expect( blocks.size() >= 2 and blocks[0].type == 0x0A0D0D0A and blocks[1].type == 1,
+          "a file should start with a section header and an interface description" );
+  return blocks;
+}
+
+uint16_t link_type( const vector<Block>& blocks )
+{
+  return static_cast<uint16_t>( word( blocks.at( 1 ).body, 0 ) );
+}
+
+// Carries frames to the interface on the other end, when deliver() is called
+class Wire : public NetworkInterface::OutputPort
+{
+  vector<EthernetFrame> frames_ {};
+
+public:
+  weak_ptr<NetworkInterface> other {};
+
+  void transmit( const NetworkInterface& sender [[maybe_unused]], const EthernetFrame& frame ) override
+  {
+    frames_.push_back( frame );
+  }
+
+  // Deliver the frames in flight; returns whether there were any
+  bool deliver()
+  {
+    vector<EthernetFrame> frames = move( frames_ );
+    frames_.clear();
+    for ( const auto& frame : frames ) {
+      other.lock()->recv_frame( frame );
+    }
+    return not frames.empty();
+  }
+};
+
+// Two interfaces on a wire, with both ports tapped into one capture: a datagram, and the ARP exchange before it
+void output_port_test()
+{
+  const string path = DIRECTORY + "/wire.pcapng";
+  auto writer = make_shared<PcapngWriter>( PcapngConfig { .path = path }, PcapngWriter::LinkType::Ethernet );
+  auto wire_to_b = make_shared<Wire>();
+  auto wire_to_a = make_shared<Wire>();
+  auto a = make_shared<NetworkInterface>( "a",
+                                          make_shared<CaptureOutputPort>( wire_to_b, writer ),
+                                          EthernetAddress { 2, 0, 0, 0, 0, 1 },
+                                          Address( "10.0.0.1", 0 ) );
+  auto b = make_shared<NetworkInterface>( "b",
+                                          make_shared<CaptureOutputPort>( wire_to_a, writer ),
+                                          EthernetAddress { 2, 0, 0, 0, 0, 2 },
+                                          Address( "10.0.0.2", 0 ) );
+  wire_to_b->other = b;
+  wire_to_a->other = a;
+
+  InternetDatagram dgram;
+  dgram.header.src = Address( "10.0.0.1", 0 ).ipv4_numeric();
+  dgram.header.dst = Address( "10.0.0.2", 0 ).ipv4_numeric();
+  dgram.payload.emplace_back( "hello" );
+  dgram.header.len = IPv4Header::LENGTH + 5;
+  dgram.header.compute_checksum();
+  a->send_datagram( dgram, Address( "10.0.0.2", 0 ) );
+  while ( wire_to_b->deliver() or wire_to_a->deliver() ) {}
+  writer->flush();
+
+  const vector<Block> blocks = read_blocks( path );
+  expect( link_type( blocks ) == 1, "the link type should be Ethernet" );
+  expect( blocks.size() == 5, "there should be 3 packets, not " + to_string( blocks.size() - 2 ) );
+  const auto ethertype = []( const Block& block ) {
+    EthernetHeader header;
+    expect( parse( header, vector<string> { block.data() } ), "a captured packet should be an Ethernet frame" );
+    return header.type;
+  };
+  expect( ethertype( blocks[2] ) == EthernetHeader::TYPE_ARP and ethertype( blocks[3] ) == EthernetHeader::TYPE_ARP,
+          "the ARP request and reply should come first" );
+  expect( ethertype( blocks[4] ) == EthernetHeader::TYPE_IPv4, "then the datagram" );
+  expect( blocks[4].original_length() == EthernetHeader::LENGTH + IPv4Header::LENGTH + 5
+            and blocks[4].data().ends_with( "hello" ),
+          "the datagram should be captured whole" );
+}
+
+// A packet longer than the snaplen is truncated, and keeps its original length
+void snaplen_test()
+{
+  const string path = DIRECTORY + "/snaplen.pcapng";
+  {
+    PcapngWriter writer { PcapngConfig { .path = path, .snaplen = 64 }, PcapngWriter::LinkType::IPv4 };
+    const vector<string> packet { string( 600, 'a' ), string( 400, 'b' ) };
+    writer.capture( packet );
+  }
+
+  const vector<Block> blocks = read_blocks( path );
+  expect( blocks.size() == 3, "there should be one packet" );
+  expect( blocks[2].captured_length() == 64 and blocks[2].original_length() == 1000,
+          "the packet should be truncated to the snaplen" );
+  expect( blocks[2].data() == string( 64, 'a' ), "the packet's first bytes should be kept" );
+}
+
+// Rotation starts a new (complete) file once one is full, and reuses the oldest after ring_files
+void rotation_test()
+{
+  const string path = DIRECTORY + "/ring.pcapng";
+  {
+    PcapngWriter writer { PcapngConfig { .path = path, .rotate_bytes = 1000, .ring_files = 3 },
+                          PcapngWriter::LinkType::IPv4 };
+    for ( int i = 0; i < 100; ++i ) {
+      writer.capture( vector<string> { string( 100, static_cast<char>( i ) ) } );
+    }
+  }
+
+  for ( int i = 0; i < 3; ++i ) {
+    const string file = path + "." + to_string( i );
+    expect( filesystem::file_size( file ) < 1000 + 132, file + " should be rotated once it reaches 1000 bytes" );
+    expect( read_blocks( file ).size() > 2, file + " should have packets" );
+  }
+  expect( not filesystem::exists( path + ".3" ), "the oldest file should be reused after 3" );
+}
+
+// Packets that can't be written because the next file can't be opened are counted as dropped
+void rotation_failure_test()
+{
+  const string directory = DIRECTORY + "/gone";
+  filesystem::create_directory( directory );
+  PcapngWriter writer { PcapngConfig { .path = directory + "/ring.pcapng", .rotate_bytes = 1000 },
+                        PcapngWriter::LinkType::IPv4 };
+  for ( int i = 0; i < 5; ++i ) {
+    writer.capture( vector<string> { string( 100, 'x' ) } );
+  }
+  writer.flush();
+  expect( writer.captured() == 5 and writer.dropped() == 0, "the first file should take the first packets" );
+
+  filesystem::remove_all( directory );
+  for ( int i = 0; i < 20; ++i ) {
+    writer.capture( vector<string> { string( 100, 'x' ) } );
+  }
+  writer.flush();
+  expect( writer.dropped() > 0, "packets after a failed rotation should be dropped" );
+  expect( writer.captured() + writer.dropped() == 25, "every packet should be either captured or dropped" );
+}
+
+// Datagrams written to and read from a TUN device, with and without offloads, are captured as they cross it
+void adapter_test( const string& device, const bool vnet_header )
+{
+  const string path = DIRECTORY + "/" + device + ".pcapng";
+  string written;
+  {
+    TunFD tun { device, false, vnet_header };
+    configure_interface( device, "10.145.0.1", "255.255.255.0" );
+
+    TCPOverIPv4OverTunFdAdapter adapter { move( tun ) };
+    adapter.config_mut().source = Address( "10.145.0.2", 1234 );
+    adapter.config_mut().destination = Address( "10.145.0.1", 80 );
+    CaptureAdapter capture {
+      move( adapter ),
+      make_shared<PcapngWriter>( PcapngConfig { .path = path }, PcapngWriter::LinkType::IPv4 ) };
+
+    // a SYN to a closed port, which the kernel answers with a RST
+    TCPMessage msg;
+    msg.sender.SYN = true;
+    msg.sender.seqno = Wrap32 { 1000 };
+    capture.write( msg );
+    for ( const auto& piece : serialize( capture.adapter().wrap_tcp_in_ip( msg ) ) ) {
+      written += piece;
+    }
+
+    pollfd readable { capture.fd().fd_num(), POLLIN, 0 };
+    expect( poll( &readable, 1, 1000 ) == 1, "the kernel should answer the SYN" );
+    vector<TCPMessage> segs;
+    capture.read_batch( segs );
+    expect( segs.size() == 1 and segs.front().sender.RST, "the answer should be a RST" );
+  }
+
+  const vector<Block> blocks = read_blocks( path );
+  expect( link_type( blocks ) == 228, "the link type should be IPv4" );
+  // the kernel may send traffic of its own (e.g. IPv6 router solicitations) on a new device; skip past it
+  vector<pair<IPv4Datagram, string>> segments;
+  for ( size_t i = 2; i < blocks.size(); ++i ) {
+    IPv4Datagram dgram;
+    if ( parse( dgram, vector<string> { blocks[i].data() } ) and dgram.header.proto == IPv4Header::PROTO_TCP ) {
+      segments.emplace_back( move( dgram ), blocks[i].data() );
+    }
+  }
+  expect( segments.size() == 2, "the SYN and the RST should be captured" );
+
+  const auto source
+    = []( const IPv4Datagram& dgram ) { return Address::from_ipv4_numeric( dgram.header.src ).ip(); };
+  expect( source( segments[0].first ) == "10.145.0.2", "the written segment should come from us" );
+  expect( source( segments[1].first ) == "10.145.0.1", "the segment read should come from the kernel" );
+  if ( not vnet_header ) {
+    expect( segments[0].second == written, "the capture should hold the bytes written" );
+  }
+}
+
+void adapter_tests()
+{
+  if ( not enter_private_network_namespace() ) {
+    cerr << "Skipping the TUN adapter capture test: needs CAP_NET_ADMIN and /dev/net/tun.\n";
+    return;
+  }
+  adapter_test( "cap144", false );
+  adapter_test( "capv144", true );
+}
+} // namespace
+
+int main()
+{
+  filesystem::create_directory( DIRECTORY );
+  const int status
+    = run_tests( { output_port_test, snaplen_test, rotation_test, rotation_failure_test, adapter_tests } );
+  filesystem::remove_all( DIRECTORY );
+  return status;
+}
@@ -0,0 +1,59 @@
+#include "common.hh"
+#include "perf_counters.hh"
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+namespace {
+// Counts a loop's instructions if the counters are permitted, and says why not if they aren't
+void count_test()
+{
+  PerfCounters counters;
+  counters.start();
+  uint64_t sum = 0;
+  for ( uint64_t i = 0; i < 1'000'000; ++i ) {
+    sum += i;
+    asm volatile( "" : "+r"( sum ) ); // (so the loop isn't folded away)
+  }
+  counters.stop();
+  const PerfCounters::Reading reading = counters.read();
+
+  if ( not counters.available() ) {
+    expect( not counters.unavailable_reason().empty(), "missing counters should come with a reason" );
+    expect( counters.report( 1, "item" ).starts_with( "no hardware counters" ), "the report should say so" );
+    cerr << "(" << counters.unavailable_reason() << ": only checked that the counters degrade gracefully)\n";
+    return;
+  }
+
+  const auto instructions = reading[PerfCounters::Counter::Instructions];
+  if ( instructions ) {
+    expect( *instructions >= 1'000'000, "the loop should count at least one instruction per iteration" );
+    expect( counters.report( 1'000'000, "iteration" ).find( "instructions/iteration" ) != string::npos,
+            "the report should give instructions per iteration" );
+  }
+
+  // counting stopped: a second read should give the same counts
+  expect( counters.read().counts == reading.counts, "stopped counters should not change" );
+}
+
+void reading_test()
+{
+  PerfCounters::Reading reading;
+  expect( reading.per( 1, "byte" ) == "no hardware counters", "an empty reading should say so" );
+
+  reading.counts.at( 0 ) = 2000;
+  reading.counts.at( 1 ) = 3000;
+  reading.counts.at( 4 ) = 10;
+  expect( reading.per( 1000, "byte" )
+            == "2.00 cycles/byte, 3.00 instructions/byte (IPC 1.50), 0.0100 branch-misses/byte",
+          "the rates should be per byte, not " + reading.per( 1000, "byte" ) );
+}
+} // namespace
+
+int main()
+{
+  return run_tests( { count_test, reading_test } );
+}
@@ -1,3 +1,5 @@
+#include "latency.hh"
+#include "perf_counters.hh"
 #include "reassembler.hh"
 
 #include <algorithm>
@@ -41,6 +43,8 @@ void speed_test( const size_t num_chunks,   // NOLINT(bugprone-easily-swappable-
   string output_data;
   output_data.reserve( data.size() );
 
+  PerfCounters counters;
+  counters.start();
   const auto start_time = steady_clock::now();
   while ( not split_data.empty() ) {
     auto& next = split_data.front();
@@ -54,6 +58,7 @@ void speed_test( const size_t num_chunks,   // NOLINT(bugprone-easily-swappable-
   }
 
   const auto stop_time = steady_clock::now();
+  counters.stop();
 
   if ( not reassembler.reader().is_finished() ) {
     throw runtime_error( "Reassembler did not close ByteStream when finished" );
@@ -73,6 +78,7 @@ void speed_test( const size_t num_chunks,   // NOLINT(bugprone-easily-swappable-
 
   cout << "Reassembler to ByteStream with capacity=" << capacity << " reached " << fixed << setprecision( 2 )
        << gigabits_per_second << " Gbit/s.\n";
+  cout << "    " << counters.report( static_cast<double>( num_chunks * capacity ), "byte" ) << "\n";
 
   debug_output << "             Reassembler throughput: " << fixed << setprecision( 2 ) << gigabits_per_second
                << " Gbit/s\n";
@@ -91,6 +97,7 @@ int main()
 {
   try {
     program_body();
+    print_latency_report( cout );
   } catch ( const exception& e ) {
     cerr << "Exception: " << e.what() << "\n";
     return EXIT_FAILURE;
@@ -0,0 +1,142 @@
+#include "bidirectional_stream_copy.hh"
+#include "exception.hh"
+
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+pair<FileDescriptor, FileDescriptor> make_pipe()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "pipe2", ::pipe2( fds.data(), O_CLOEXEC ) );
+  return { FileDescriptor { fds[0] }, FileDescriptor { fds[1] } };
+}
+
+pair<LocalStreamSocket, LocalStreamSocket> make_socket_pair()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", ::socketpair( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds.data() ) );
+  return { LocalStreamSocket { FileDescriptor { fds[0] } }, LocalStreamSocket { FileDescriptor { fds[1] } } };
+}
+
+string backend_name( EventLoop::Backend backend )
+{
+  switch ( backend ) {
+    case EventLoop::Backend::Epoll:
+      return "epoll";
+    case EventLoop::Backend::IOUring:
+      return "io_uring";
+    default:
+      return "poll";
+  }
+}
+} // namespace
+
+// The bidirectional_stream_copy workload (as used by tcp_native): an input pipe is copied into a socket, whose
+// peer echoes everything back, and the socket is copied to an output pipe.
+void speed_test( const EventLoop::Backend backend, const size_t num_bytes )
+{
+  auto [input_read, input_write] = make_pipe();
+  auto [output_read, output_write] = make_pipe();
+  auto [socket, peer] = make_socket_pair();
+
+  const string chunk( 65536, 'x' );
+
+  thread producer( [&, input = move( input_write )]() mutable {
+    for ( size_t sent = 0; sent < num_bytes; sent += chunk.size() ) {
+      for ( size_t written = 0; written < chunk.size(); ) {
+        written += input.write( string_view( chunk ).substr( written ) );
+      }
+    }
+  } );
+
+  thread echo( [&] {
+    string buffer;
+    while ( true ) {
+      buffer.clear();
+      peer.read( buffer );
+      if ( peer.eof() ) {
+        break;
+      }
+      for ( size_t written = 0; written < buffer.size(); ) {
+        written += peer.write( string_view( buffer ).substr( written ) );
+      }
+    }
+    peer.shutdown( SHUT_WR );
+  } );
+
+  size_t received = 0;
+  thread consumer( [&] {
+    string buffer;
+    while ( true ) {
+      buffer.clear();
+      output_read.read( buffer );
+      if ( output_read.eof() ) {
+        break;
+      }
+      received += buffer.size();
+    }
+  } );
+
+  const auto start_time = steady_clock::now();
+  EventLoop loop { backend };
+  bidirectional_stream_copy( loop, socket, input_read, output_write, "echo" );
+  const auto stop_time = steady_clock::now();
+
+  producer.join();
+  echo.join();
+  consumer.join();
+
+  if ( received != num_bytes ) {
+    throw runtime_error( "stream copy lost data: " + to_string( received ) + " of " + to_string( num_bytes )
+                         + " bytes arrived" );
+  }
+
+  const uint64_t syscalls = loop.syscall_count() + input_read.syscall_count() + output_write.syscall_count()
+                            + socket.syscall_count();
+
+  const auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
+  const double gigabits_per_second = static_cast<double>( num_bytes ) * 8.0 / test_duration.count() / 1e9;
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "bidirectional_stream_copy with " << setw( 8 ) << left << backend_name( loop.backend() ) << right
+       << " moved " << num_bytes / 1048576 << " MiB each way at " << fixed << setprecision( 2 )
+       << gigabits_per_second << " Gbit/s using " << syscalls << " system calls (" << loop.syscall_count() << " waiting, "
+       << syscalls - loop.syscall_count() << " reading/writing).\n";
+
+  debug_output << "             bidirectional_stream_copy (" << backend_name( loop.backend() ) << "): " << fixed
+               << setprecision( 2 ) << gigabits_per_second << " Gbit/s\n";
+}
+
+void program_body()
+{
+  constexpr size_t num_bytes = 256 * 1048576;
+
+  speed_test( EventLoop::Backend::Poll, num_bytes );
+  speed_test( EventLoop::Backend::Epoll, num_bytes );
+  speed_test( EventLoop::Backend::IOUring, num_bytes );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
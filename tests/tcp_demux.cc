@@ -0,0 +1,248 @@
+#include "exception.hh"
+#include "socket.hh"
+#include "tcp_demux.hh"
+#include "tun.hh"
+#include "tun_test_harness.hh"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <poll.h>
+#include <thread>
+#include <unordered_map>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+constexpr const char* DEVICE = "demux144";
+constexpr uint16_t LISTEN_PORT = 8080;
+constexpr uint16_t CLOSED_PORT = 8081;
+constexpr size_t NUM_CLIENTS = 100;
+
+string request_from( uint16_t port )
+{
+  return "hello from port " + to_string( port );
+}
+
+string reply_to( const string& request )
+{
+  return "echo: " + request;
+}
+} // namespace
+
+// Many kernel clients connect to one listening port through one TUN device. Each connection is accepted once,
+// gets only its own client's bytes, and its reply reaches only that client. A SYN to a port that is not
+// listening creates no connection.
+void demux_test()
+{
+  TCPDemux demux { TCPOverIPv4OverTunFdAdapter { TunFD { DEVICE } } };
+  configure_interface( DEVICE, "10.144.0.1", "255.255.255.0" );
+
+  TCPConfig config;
+  config.rt_timeout = 100;
+  demux.listen( LISTEN_PORT, config );
+
+  // the kernel side: start every connection, then send each request and read each reply
+  vector<TCPSocket> clients( NUM_CLIENTS );
+  map<uint16_t, string> replies;
+  atomic<bool> clients_done = false;
+  const Address server { "10.144.0.2", LISTEN_PORT };
+  for ( auto& client : clients ) {
+    client.set_blocking( false );
+    if ( ::connect( client.fd_num(), server.raw(), server.size() ) == 0 or errno != EINPROGRESS ) {
+      throw unix_error( "connect" );
+    }
+  }
+  TCPSocket stray;
+  stray.set_blocking( false );
+  const Address closed { "10.144.0.2", CLOSED_PORT };
+  if ( ::connect( stray.fd_num(), closed.raw(), closed.size() ) == 0 or errno != EINPROGRESS ) {
+    throw unix_error( "connect" );
+  }
+
+  thread kernel_side( [&] {
+    try {
+      for ( auto& client : clients ) {
+        client.set_blocking( true );
+        client.write( request_from( client.local_address().port() ) ); // (waits for the handshake)
+        client.shutdown( SHUT_WR );
+      }
+      for ( auto& client : clients ) {
+        string& reply = replies[client.local_address().port()];
+        string buffer;
+        while ( not client.eof() ) {
+          client.read( buffer );
+          reply += buffer;
+        }
+      }
+    } catch ( const exception& e ) {
+      cerr << "Kernel side: " << e.what() << "\n";
+    }
+    clients_done = true;
+  } );
+
+  // our side: one loop serves every connection
+  unordered_map<FourTuple, string, FourTupleHash> requests;
+  unordered_map<FourTuple, bool, FourTupleHash> replied;
+  const auto serve = [&] {
+    vector<FourTuple> ready;
+    const auto deadline = steady_clock::now() + seconds( 8 );
+    while ( not clients_done and steady_clock::now() < deadline ) {
+      pollfd pfd { demux.fd().fd_num(), POLLIN, 0 };
+      const auto timeout = min<uint64_t>( demux.ms_until_next_tick().value_or( 10 ), 10 );
+      CheckSystemCall( "poll", ::poll( &pfd, 1, static_cast<int>( timeout ) ) );
+
+      ready.clear();
+      demux.receive( ready );
+      demux.tick( ready );
+      while ( const auto tuple = demux.accept( LISTEN_PORT ) ) {
+        if ( requests.contains( *tuple ) ) {
+          throw runtime_error( "a connection was accepted twice" );
+        }
+        requests[*tuple];
+        ready.push_back( *tuple );
+      }
+
+      for ( const auto& tuple : ready ) {
+        if ( tuple.local_port != LISTEN_PORT ) {
+          throw runtime_error( "a segment to a closed port reached a connection" );
+        }
+        if ( not requests.contains( tuple ) or replied[tuple] ) {
+          continue;
+        }
+        Reader& inbound = demux.peer( tuple ).inbound_reader();
+        while ( inbound.bytes_buffered() ) {
+          requests[tuple] += inbound.peek();
+          inbound.pop( inbound.peek().size() );
+        }
+        if ( inbound.is_finished() ) {
+          Writer& outbound = demux.peer( tuple ).outbound_writer();
+          outbound.push( reply_to( requests[tuple] ) );
+          outbound.close();
+          demux.push( tuple );
+          replied[tuple] = true;
+        }
+      }
+    }
+  };
+
+  const auto stop_kernel_side = [&] {
+    if ( not clients_done ) {
+      for ( auto& client : clients ) {
+        client.shutdown( SHUT_RDWR ); // unblock the kernel side
+      }
+    }
+    kernel_side.join();
+  };
+  try {
+    serve();
+  } catch ( ... ) {
+    stop_kernel_side();
+    throw;
+  }
+  stop_kernel_side();
+
+  if ( requests.size() != NUM_CLIENTS ) {
+    throw runtime_error( "accepted " + to_string( requests.size() ) + " of " + to_string( NUM_CLIENTS )
+                         + " connections" );
+  }
+  for ( const auto& [tuple, request] : requests ) {
+    if ( request != request_from( tuple.remote_port ) ) {
+      throw runtime_error( "connection from port " + to_string( tuple.remote_port ) + " received \"" + request
+                           + "\"" );
+    }
+  }
+  for ( const auto& [port, reply] : replies ) {
+    if ( reply != reply_to( request_from( port ) ) ) {
+      throw runtime_error( "client on port " + to_string( port ) + " received \"" + reply + "\"" );
+    }
+  }
+  if ( replies.size() != NUM_CLIENTS ) {
+    throw runtime_error( "only " + to_string( replies.size() ) + " clients received a reply" );
+  }
+}
+
+// A connection that has been handshaken but not yet accepted, and is then erased, leaves the accept queue: it is
+// not accepted later, and it no longer takes up a place in the backlog.
+void erase_test()
+{
+  constexpr const char* device = "demuxe144";
+  TCPDemux demux { TCPOverIPv4OverTunFdAdapter { TunFD { device } } };
+  configure_interface( device, "10.146.0.1", "255.255.255.0" );
+  demux.listen( LISTEN_PORT, TCPConfig {}, 1 );
+
+  const Address server { "10.146.0.2", LISTEN_PORT };
+  const auto start_client = [&]( TCPSocket& client ) {
+    client.set_blocking( false );
+    if ( ::connect( client.fd_num(), server.raw(), server.size() ) == 0 or errno != EINPROGRESS ) {
+      throw unix_error( "connect" );
+    }
+    return FourTuple { .local_address = server.ipv4_numeric(),
+                       .remote_address = client.local_address().ipv4_numeric(),
+                       .local_port = LISTEN_PORT,
+                       .remote_port = client.local_address().port() };
+  };
+  // serve the connections until `done` holds
+  const auto serve_until = [&]( const auto& done ) {
+    vector<FourTuple> ready;
+    const auto deadline = steady_clock::now() + seconds( 5 );
+    while ( not done() ) {
+      if ( steady_clock::now() > deadline ) {
+        throw runtime_error( "timed out" );
+      }
+      pollfd pfd { demux.fd().fd_num(), POLLIN, 0 };
+      CheckSystemCall( "poll", ::poll( &pfd, 1, 10 ) );
+      ready.clear();
+      demux.receive( ready );
+      demux.tick( ready );
+    }
+  };
+
+  // the first client's bytes reach its connection once the handshake is done, which puts it in the accept queue
+  TCPSocket first;
+  const FourTuple first_tuple = start_client( first );
+  bool written = false;
+  serve_until( [&] {
+    pollfd pfd { first.fd_num(), POLLOUT, 0 };
+    if ( not written and CheckSystemCall( "poll", ::poll( &pfd, 1, 0 ) ) == 1 ) {
+      first.write( "hello" );
+      written = true;
+    }
+    return demux.contains( first_tuple ) and demux.peer( first_tuple ).inbound_reader().bytes_buffered() > 0;
+  } );
+
+  demux.erase( first_tuple );
+  if ( demux.accept( LISTEN_PORT ) ) {
+    throw runtime_error( "an erased connection was accepted" );
+  }
+
+  // with a backlog of one, the next connection is refused if the erased one still holds its place
+  TCPSocket second;
+  const FourTuple second_tuple = start_client( second );
+  optional<FourTuple> accepted;
+  serve_until( [&] { return ( accepted = demux.accept( LISTEN_PORT ) ).has_value(); } );
+  if ( *accepted != second_tuple or not demux.contains( *accepted ) ) {
+    throw runtime_error( "the connection accepted after an erase isn't the one that was made" );
+  }
+}
+
+int main()
+{
+  try {
+    if ( not enter_private_network_namespace() ) {
+      cerr << "Skipping TCP demultiplexer test: needs CAP_NET_ADMIN and /dev/net/tun.\n";
+      return EXIT_SUCCESS;
+    }
+    erase_test();
+    demux_test();
+  } catch ( const exception& e ) {
+    cerr << "\n\n\n";
+    cerr << "\033[31;1mError: " << e.what() << "\033[m\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,172 @@
+#include "exception.hh"
+#include "latency.hh"
+#include "socket.hh"
+#include "tcp_reactor.hh"
+#include "tun.hh"
+#include "tun_test_harness.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <poll.h>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+constexpr const char* DEVICE = "reactor144";
+const Address server_address { "10.144.0.2", 7 };
+constexpr size_t WAVE = 200; // connections started at once
+const string ping = "ping";
+
+// Resident memory of the process, in bytes
+uint64_t resident_bytes()
+{
+  ifstream statm { "/proc/self/statm" };
+  uint64_t size = 0;
+  uint64_t resident = 0;
+  statm >> size >> resident;
+  return resident * static_cast<uint64_t>( sysconf( _SC_PAGESIZE ) );
+}
+
+// Raise the soft fd limit as far as allowed and return how many connections the kernel side can afford
+size_t available_connections( const size_t wanted, const size_t reserved )
+{
+  rlimit limit {};
+  CheckSystemCall( "getrlimit", ::getrlimit( RLIMIT_NOFILE, &limit ) );
+  limit.rlim_cur = limit.rlim_max;
+  CheckSystemCall( "setrlimit", ::setrlimit( RLIMIT_NOFILE, &limit ) );
+  return limit.rlim_cur <= reserved ? 0 : min( wanted, static_cast<size_t>( limit.rlim_cur ) - reserved );
+}
+
+struct Result
+{
+  duration<double> time;   // to open every connection and echo a ping on it
+  size_t open_connections; // connections the reactor held at the end
+  uint64_t memory;         // growth in resident memory, with every connection open
+};
+
+// The kernel opens `num_connections` connections to the reactor's echo server, in waves, and pings each once;
+// all of them stay open until the end.
+Result open_connections( TCPReactor& reactor, const size_t num_connections )
+{
+  vector<TCPSocket> clients;
+  clients.reserve( num_connections );
+  atomic<bool> failed = false;
+
+  const uint64_t start_memory = resident_bytes();
+  uint64_t end_memory = 0;
+  const auto start_time = steady_clock::now();
+  steady_clock::time_point stop_time;
+
+  thread kernel_side( [&] {
+    try {
+      for ( size_t begin = 0; begin < num_connections; begin += WAVE ) {
+        const size_t end = min( num_connections, begin + WAVE );
+        for ( size_t i = begin; i < end; ++i ) {
+          auto& client = clients.emplace_back();
+          client.set_blocking( false );
+          if ( ::connect( client.fd_num(), server_address.raw(), server_address.size() ) == 0
+               or errno != EINPROGRESS ) {
+            throw unix_error( "connect" );
+          }
+        }
+        for ( size_t i = begin; i < end; ++i ) {
+          clients[i].set_blocking( true );
+          clients[i].write( ping ); // (waits for the handshake)
+        }
+        string reply;
+        for ( size_t i = begin; i < end; ++i ) {
+          clients[i].read( reply );
+          if ( reply != ping ) {
+            throw runtime_error( "connection " + to_string( i ) + " echoed \"" + reply + "\"" );
+          }
+        }
+      }
+      stop_time = steady_clock::now();
+      end_memory = resident_bytes();
+    } catch ( const exception& e ) {
+      cerr << "Kernel side: " << e.what() << "\n";
+      failed = true;
+    }
+    reactor.stop();
+  } );
+
+  reactor.run();
+  kernel_side.join();
+  if ( failed ) {
+    throw runtime_error( "the kernel side failed" );
+  }
+
+  return { stop_time - start_time, reactor.size(), end_memory - start_memory };
+}
+} // namespace
+
+void program_body()
+{
+  if ( not enter_private_network_namespace() ) {
+    cerr << "Skipping TCPReactor speed test: needs CAP_NET_ADMIN and /dev/net/tun.\n";
+    return;
+  }
+  const size_t num_connections = available_connections( 10000, 100 );
+
+  TCPReactor reactor { TCPOverIPv4OverTunFdAdapter { TunFD { DEVICE } } };
+  configure_interface( DEVICE, "10.144.0.1", "255.255.255.0" );
+  set_queue_length( DEVICE, 65536 );
+
+  // echo
+  const auto echo = [&]( TCPReactor::Connection& connection ) {
+    Reader& inbound = connection.inbound();
+    while ( inbound.bytes_buffered() > 0 ) {
+      const size_t written = connection.write( inbound.peek() );
+      inbound.pop( written );
+      if ( written == 0 ) {
+        return;
+      }
+    }
+    if ( inbound.is_finished() ) {
+      connection.close();
+    }
+  };
+  reactor.listen( server_address.port(), TCPConfig {}, { .on_readable = echo, .on_writable = echo } );
+
+  const Result result = open_connections( reactor, num_connections );
+  if ( result.open_connections != num_connections ) {
+    throw runtime_error( "the reactor holds " + to_string( result.open_connections ) + " of "
+                         + to_string( num_connections ) + " connections" );
+  }
+
+  const double connections_per_second = static_cast<double>( num_connections ) / result.time.count();
+  const double bytes_per_connection
+    = static_cast<double>( result.memory ) / static_cast<double>( num_connections );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "TCPReactor with " << num_connections << " open connections: " << fixed << setprecision( 0 )
+       << connections_per_second << " connections/s (connect and echo), " << bytes_per_connection
+       << " bytes of memory per connection.\n";
+
+  debug_output << "             TCPReactor: " << fixed << setprecision( 0 ) << connections_per_second
+               << " connections/s, " << bytes_per_connection << " bytes/connection\n";
+}
+
+int main()
+{
+  try {
+    program_body();
+    print_latency_report( cout );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,259 @@
+#include "latency.hh"
+#include "loopback_adapter.hh"
+#include "netem_adapter.hh"
+#include "perf_counters.hh"
+#include "tcp_config.hh"
+#include "tcp_peer.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+// CPU time used by the process so far
+duration<double> cpu_time()
+{
+  timespec ts {};
+  clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &ts );
+  return seconds( ts.tv_sec ) + nanoseconds( ts.tv_nsec );
+}
+
+// One TCPPeer and its end of the link
+template<class AdapterT>
+struct Endpoint
+{
+  TCPPeer peer;
+  AdapterT adapter;
+  vector<TCPMessage> inbound {};
+  vector<TCPMessage> outbound {};
+  uint64_t segments_sent {};
+
+  TCPPeer::TransmitFunction transmit = [this]( TCPMessage msg ) { outbound.push_back( move( msg ) ); };
+
+  Endpoint( const TCPConfig& config, AdapterT&& end ) : peer( config ), adapter( move( end ) ) {}
+  Endpoint( const Endpoint& other ) = delete;
+  Endpoint& operator=( const Endpoint& other ) = delete;
+
+  // Deliver what has arrived, then send what the peer queued; returns whether anything happened
+  bool step()
+  {
+    inbound.clear();
+    adapter.read_batch( inbound );
+    if ( not inbound.empty() ) {
+      peer.receive( inbound, transmit );
+    }
+    peer.push( transmit );
+    return flush() or not inbound.empty();
+  }
+
+  bool flush()
+  {
+    if ( outbound.empty() ) {
+      return false;
+    }
+    adapter.write_batch( outbound );
+    segments_sent += outbound.size();
+    outbound.clear();
+    return true;
+  }
+};
+
+string make_data( const size_t input_len )
+{
+  default_random_engine rd { 1103 };
+  uniform_int_distribution<char> ud;
+  string ret;
+  for ( size_t i = 0; i < input_len; ++i ) {
+    ret += ud( rd );
+  }
+  return ret;
+}
+
+// Send `data` from client to server, in writes of `write_size`, until the last byte arrives (the stream is left
+// open: this measures bulk transfer, not the closing handshake). Whenever nothing can move, `wait()` lets time pass
+// and returns how much did.
+template<class AdapterT, class WaitT>
+string transfer( Endpoint<AdapterT>& client, Endpoint<AdapterT>& server, const string& data, size_t write_size,
+                 WaitT&& wait )
+{
+  string received;
+  received.reserve( data.size() );
+  size_t written = 0;
+  uint64_t waited_ms = 0;
+
+  client.peer.push( client.transmit ); // (the SYN)
+  client.flush();
+  while ( received.size() < data.size() ) {
+    Writer& outbound = client.peer.outbound_writer();
+    while ( written < data.size() and outbound.available_capacity() > 0 ) {
+      const size_t length = min( { write_size, data.size() - written, outbound.available_capacity() } );
+      outbound.push( data.substr( written, length ) );
+      written += length;
+    }
+
+    bool progress = client.step();
+    progress |= server.step();
+
+    Reader& inbound = server.peer.inbound_reader();
+    while ( inbound.bytes_buffered() > 0 ) {
+      received += inbound.peek();
+      inbound.pop( inbound.peek().size() );
+    }
+
+    if ( not progress ) {
+      waited_ms += wait();
+      if ( waited_ms > 600'000 ) {
+        throw runtime_error( "the transfer stalled" );
+      }
+    }
+  }
+  return received;
+}
+
+void speed_test( const size_t input_len, const size_t write_size, const bool serialize )
+{
+  const string data = make_data( input_len );
+
+  auto [client_end, server_end] = LoopbackAdapter::make_pair( 4096, serialize );
+  TCPConfig client_config;
+  TCPConfig server_config;
+  server_config.isn = Wrap32 { 42 };
+  Endpoint<LoopbackAdapter> client { client_config, move( client_end ) };
+  Endpoint<LoopbackAdapter> server { server_config, move( server_end ) };
+
+  uint64_t virtual_ms = 0; // time that passed while nothing could move
+
+  PerfCounters counters;
+  counters.start();
+  const auto start_time = steady_clock::now();
+  const auto start_cpu = cpu_time();
+
+  const string received = transfer( client, server, data, write_size, [&] {
+    // stalled (a segment was lost, or the window is closed): let the retransmission timer fire
+    const uint64_t ms = client.peer.ms_until_next_tick().value_or( 1 );
+    virtual_ms += ms;
+    client.peer.tick( ms, client.transmit );
+    client.flush();
+    return ms;
+  } );
+
+  const auto stop_cpu = cpu_time();
+  const auto stop_time = steady_clock::now();
+  counters.stop();
+
+  if ( received != data ) {
+    throw runtime_error( "Mismatch between data sent and received" );
+  }
+
+  const auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
+  const double gigabits_per_second = 8 * static_cast<double>( input_len ) / test_duration.count() / 1e9;
+  const uint64_t segments = client.segments_sent + server.segments_sent;
+  const double segments_per_second = static_cast<double>( segments ) / test_duration.count();
+  const duration<double> cpu = stop_cpu - start_cpu;
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "TCPPeer to TCPPeer over a loopback link" << ( serialize ? " (serializing segments)" : "" ) << ", "
+       << input_len << " bytes in writes of " << write_size << ": " << fixed << setprecision( 2 )
+       << gigabits_per_second << " Gbit/s, " << setprecision( 0 ) << segments_per_second << " segments/s ("
+       << segments << " segments), " << setprecision( 3 ) << cpu.count() << " s of CPU time, "
+       << virtual_ms << " ms of timeouts.\n";
+  cout << "    " << counters.report( static_cast<double>( input_len ), "byte" ) << "\n";
+  if ( counters.available() ) {
+    cout << "    " << counters.report( static_cast<double>( segments ), "segment" ) << "\n";
+  }
+
+  debug_output << "   TCPPeer" << ( serialize ? "+wire" : "     " ) << " goodput: " << fixed << setprecision( 2 )
+               << gigabits_per_second << " Gbit/s, " << setprecision( 0 ) << segments_per_second
+               << " segments/s\n";
+
+  if ( gigabits_per_second < 0.05 ) {
+    throw runtime_error( "TCPPeer did not meet minimum speed of 0.05 Gbit/s." );
+  }
+}
+
+// The same transfer over an emulated path (in each direction), in emulated time: the goodput is what the path and
+// TCPPeer's window allow, not what the CPU does
+void emulated_path_test( const size_t input_len, const NetemConfig& path )
+{
+  using Path = NetemAdapter<LoopbackAdapter>;
+  const string data = make_data( input_len );
+
+  auto [client_end, server_end] = LoopbackAdapter::make_pair( 100'000 );
+  TCPConfig client_config;
+  TCPConfig server_config;
+  server_config.isn = Wrap32 { 42 };
+  Endpoint<Path> client { client_config, Path { move( client_end ), path } };
+  Endpoint<Path> server { server_config, Path { move( server_end ), path } };
+
+  uint64_t emulated_ms = 0;
+  const auto start_time = steady_clock::now();
+
+  const string received = transfer( client, server, data, 4000, [&] {
+    // let time pass until the next segment arrives or a timer fires
+    optional<uint64_t> next = client.peer.ms_until_next_tick();
+    for ( const auto ms : { server.peer.ms_until_next_tick(),
+                            client.adapter.ms_until_next_tick(),
+                            server.adapter.ms_until_next_tick() } ) {
+      if ( ms and ( not next or *ms < *next ) ) {
+        next = ms;
+      }
+    }
+    const uint64_t ms = max<uint64_t>( next.value_or( 1 ), 1 );
+    emulated_ms += ms;
+    client.adapter.tick( ms );
+    server.adapter.tick( ms );
+    client.peer.tick( ms, client.transmit );
+    server.peer.tick( ms, server.transmit );
+    client.flush();
+    server.flush();
+    return ms;
+  } );
+
+  const duration<double> test_duration = steady_clock::now() - start_time;
+
+  if ( received != data ) {
+    throw runtime_error( "Mismatch between data sent and received over the emulated path" );
+  }
+
+  const double megabits_per_second
+    = 8 * static_cast<double>( input_len ) / static_cast<double>( emulated_ms ) / 1e3;
+  cout << "TCPPeer to TCPPeer over an emulated " << path.rate_bps / 1'000'000 << " Mbit/s path with "
+       << 2 * path.delay_ms << " ms RTT, " << input_len << " bytes: " << fixed << setprecision( 2 )
+       << megabits_per_second << " Mbit/s in " << emulated_ms << " ms of emulated time (" << setprecision( 3 )
+       << test_duration.count() << " s of real time, " << client.adapter.dropped() + server.adapter.dropped()
+       << " segments dropped).\n";
+}
+} // namespace
+
+void program_body()
+{
+  speed_test( 1e7, 4000, false );
+  speed_test( 1e7, 4000, true );
+  emulated_path_test( 1e6, NetemConfig { .delay_ms = 50, .rate_bps = 1'000'000'000, .seed = 1 } );
+}
+
+int main()
+{
+  try {
+    program_body();
+    print_latency_report( cout );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,175 @@
+#include "common.hh"
+#include "seqlock.hh"
+#include "tcp_config.hh"
+#include "tcp_peer.hh"
+#include "tcp_stats.hh"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+// Two TCPPeers, and the segments each has sent that the other hasn't received yet
+struct Link
+{
+  TCPPeer client;
+  TCPPeer server;
+  vector<TCPMessage> to_server {};
+  vector<TCPMessage> to_client {};
+
+  TCPPeer::TransmitFunction client_transmit = [this]( TCPMessage msg ) { to_server.push_back( move( msg ) ); };
+  TCPPeer::TransmitFunction server_transmit = [this]( TCPMessage msg ) { to_client.push_back( move( msg ) ); };
+
+  explicit Link( const TCPConfig& server_config = {} ) : client( TCPConfig {} ), server( server_config ) {}
+  Link( const Link& other ) = delete;
+  Link& operator=( const Link& other ) = delete;
+
+  // Deliver the segments in flight (in both directions), and let the peers send what they have to
+  void exchange()
+  {
+    vector<TCPMessage> segs = move( to_server );
+    to_server.clear();
+    if ( not segs.empty() ) {
+      server.receive( segs, server_transmit );
+    }
+    segs = move( to_client );
+    to_client.clear();
+    if ( not segs.empty() ) {
+      client.receive( segs, client_transmit );
+    }
+    client.push( client_transmit );
+    server.push( server_transmit );
+  }
+
+  // Open the connection
+  void connect()
+  {
+    client.push( client_transmit );
+    for ( int i = 0; i < 4; ++i ) {
+      exchange();
+    }
+    expect( client.has_ackno() and server.has_ackno(), "the connection should be open" );
+  }
+};
+
+// A lost SYN is retransmitted after the RTO, which then doubles
+void retransmission_test()
+{
+  Link link;
+  link.client.push( link.client_transmit );
+  expect( link.to_server.size() == 1, "the client should send a SYN" );
+  link.to_server.clear();
+
+  link.client.tick( TCPConfig::TIMEOUT_DFLT + 1, link.client_transmit );
+  expect( link.to_server.size() == 1 and link.to_server.front().sender.SYN, "the SYN should be retransmitted" );
+
+  const TCPStats stats = link.client.stats();
+  expect( stats.segments_sent == 2, "two segments should have been sent" );
+  expect( stats.retransmissions == 1, "one of them a retransmission" );
+  expect( stats.sequence_numbers_in_flight == 1, "the SYN should still be in flight" );
+  expect( stats.rto_ms == 2 * TCPConfig::TIMEOUT_DFLT, "the RTO should have doubled" );
+}
+
+// Segments after a lost one arrive out of order, and wait in the reassembler; a copy of one already received is
+// a duplicate
+void reorder_test()
+{
+  Link link;
+  link.connect();
+  const TCPStats before = link.server.stats();
+
+  link.client.outbound_writer().push( string( 10 * TCPConfig::MAX_PAYLOAD_SIZE, 'x' ) );
+  link.client.push( link.client_transmit );
+  expect( link.to_server.size() == 10, "the data should fill 10 segments" );
+
+  // lose the third segment
+  const TCPMessage first = link.to_server.front();
+  link.to_server.erase( link.to_server.begin() + 2 );
+  link.exchange();
+
+  TCPStats stats = link.server.stats();
+  expect( stats.segments_received - before.segments_received == 9, "9 segments should have arrived" );
+  expect( stats.bytes_received - before.bytes_received == 9 * TCPConfig::MAX_PAYLOAD_SIZE,
+          "9 segments' worth of data should have arrived" );
+  expect( stats.out_of_order_segments == 7, "the 7 after the lost one should be out of order, not "
+                                              + to_string( stats.out_of_order_segments ) );
+  expect( stats.reassembler_bytes_pending == 7 * TCPConfig::MAX_PAYLOAD_SIZE,
+          "the 7 out-of-order segments should be waiting in the reassembler" );
+  expect( stats.duplicate_segments == 0, "nothing should be a duplicate yet" );
+
+  link.to_server.push_back( first );
+  link.exchange();
+  stats = link.server.stats();
+  expect( stats.duplicate_segments == 1, "the copy of the first segment should be a duplicate" );
+
+  expect( link.client.stats().bytes_sent == 10 * TCPConfig::MAX_PAYLOAD_SIZE, "the client sent the data once" );
+}
+
+// Each time the peer's advertised window closes counts once, however long it stays closed
+void zero_window_test()
+{
+  Link link;
+  link.connect();
+
+  const auto advertise = [&]( uint16_t window_size ) {
+    TCPMessage msg { link.server.sender().make_empty_message(), link.server.receiver().send() };
+    msg.receiver.window_size = window_size;
+    link.to_client.push_back( msg );
+    link.exchange();
+    return link.client.stats();
+  };
+
+  expect( advertise( 0 ).zero_window_events == 1, "the window should have closed once" );
+  expect( advertise( 0 ).zero_window_events == 1, "the window should still have closed once" );
+  expect( advertise( 1000 ).send_window == 1000, "the window should have opened" );
+  const TCPStats stats = advertise( 0 );
+  expect( stats.zero_window_events == 2 and stats.send_window == 0, "the window should have closed again" );
+}
+
+// A reader never sees a snapshot that is half one store and half another
+void seqlock_test()
+{
+  using Words = array<uint64_t, sizeof( TCPStats ) / sizeof( uint64_t )>;
+  constexpr uint64_t STORES = 200'000;
+
+  SeqLock<TCPStats> lock;
+  thread writer { [&] {
+    for ( uint64_t i = 1; i <= STORES; ++i ) {
+      Words words;
+      words.fill( i );
+      TCPStats stats;
+      memcpy( static_cast<void*>( &stats ), words.data(), sizeof( stats ) );
+      lock.store( stats );
+    }
+  } };
+
+  uint64_t last = 0;
+  while ( last < STORES ) {
+    const TCPStats stats = lock.load();
+    Words words {};
+    memcpy( words.data(), &stats, sizeof( stats ) );
+    if ( ranges::any_of( words, [&]( uint64_t w ) { return w != words.front(); } ) ) {
+      writer.join();
+      throw runtime_error( "a snapshot was torn" );
+    }
+    if ( words.front() < last ) {
+      writer.join();
+      throw runtime_error( "a snapshot went back in time" );
+    }
+    last = words.front();
+  }
+  writer.join();
+}
+} // namespace
+
+int main()
+{
+  return run_tests( { retransmission_test, reorder_test, zero_window_test, seqlock_test } );
+}
@@ -0,0 +1,94 @@
+#include "common.hh"
+#include "tcp_config.hh"
+#include "tcp_peer.hh"
+#include "trace.hh"
+
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+namespace {
+// A full ring keeps the latest records, oldest first
+void ring_test()
+{
+  trace::Ring ring { 7 };
+  for ( uint32_t i = 0; i < trace::Ring::CAPACITY + 10; ++i ) {
+    ring.record( { i, trace::Event::RouteMiss, 0, i, 0, 0 } );
+  }
+  const vector<trace::Record> records = ring.snapshot();
+  expect( ring.written() == trace::Ring::CAPACITY + 10, "every record should be counted" );
+  expect( records.size() == trace::Ring::CAPACITY, "the ring should hold CAPACITY records" );
+  expect( records.front().a == 10 and records.back().a == trace::Ring::CAPACITY + 9,
+          "the ring should hold the latest records, oldest first" );
+}
+
+// Each thread records into its own ring, and a dump reads back as it was recorded
+void dump_test()
+{
+  const uint32_t address = 0x0a000001; // 10.0.0.1
+  trace::record( trace::Event::ARPMiss, 0, address, 3 );
+  thread other { [&] { trace::record( trace::Event::RouteMiss, 0, address ); } };
+  other.join();
+  trace::record( trace::Event::RouteAdded, 2, address, 24, 0 );
+
+  const string path = "/tmp/minnow_trace_test." + to_string( getpid() );
+  trace::dump( path );
+  const trace::Dump dump = trace::read_dump( path );
+  remove( path.c_str() );
+
+  expect( dump.threads.size() >= 2, "both threads' rings should be in the dump" );
+  expect( dump.ns_per_tick > 0, "the dump should say how long a tick is" );
+
+  const auto ring_of = [&]( uint32_t thread ) {
+    for ( const auto& [t, records] : dump.threads ) {
+      if ( t == thread ) {
+        return records;
+      }
+    }
+    throw runtime_error( "no ring for thread " + to_string( thread ) );
+  };
+  const vector<trace::Record> mine = ring_of( trace::this_thread_ring().thread() );
+  expect( mine.size() >= 2, "this thread's records should be in the dump" );
+  const trace::Record arp = mine.at( mine.size() - 2 );
+  const trace::Record route = mine.back();
+  expect( arp.event == trace::Event::ARPMiss and route.event == trace::Event::RouteAdded,
+          "this thread's records should be in the order recorded" );
+  expect( arp.tsc <= route.tsc, "timestamps should not go backwards" );
+
+  const auto fields = trace::fields( route );
+  expect( fields.size() == 3 and fields[0].second == "10.0.0.1/24" and fields[1].second == "(direct)"
+            and fields[2].second == "2",
+          "the route's fields should decode" );
+  expect( trace::name( arp.event ) == "arp-miss", "the event should be named" );
+}
+
+// A TCPPeer records the segments it sends and receives
+void tcp_peer_test()
+{
+#ifdef MINNOW_TRACE
+  trace::Ring& ring = trace::this_thread_ring();
+  const uint64_t before = ring.written();
+
+  TCPPeer client { TCPConfig {} };
+  vector<TCPMessage> sent;
+  client.push( [&]( TCPMessage msg ) { sent.push_back( move( msg ) ); } );
+  expect( ring.written() == before + 1, "sending the SYN should record one event" );
+
+  const trace::Record syn = ring.snapshot().back();
+  expect( syn.event == trace::Event::SegmentSent and syn.flags == trace::SYN
+            and syn.a == TCPConfig {}.isn.raw_value_ and syn.b == 1,
+          "the SYN should be recorded as sent" );
+#endif
+}
+} // namespace
+
+int main()
+{
+  return run_tests( { ring_test, dump_test, tcp_peer_test } );
+}
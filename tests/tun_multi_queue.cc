@@ -0,0 +1,135 @@
+#include "address.hh"
+#include "exception.hh"
+#include "ipv4_datagram.hh"
+#include "socket.hh"
+#include "tun.hh"
+#include "tun_test_harness.hh"
+
+#include <algorithm>
+#include <iostream>
+#include <netinet/in.h>
+#include <optional>
+#include <poll.h>
+
+using namespace std;
+
+namespace {
+constexpr const char* DEVICE = "mq144";
+constexpr size_t NUM_QUEUES = 4;
+constexpr size_t FLOWS_PER_QUEUE = 8;
+
+// The connection a datagram the kernel sent to the device belongs to, from our (the device's) end
+optional<FourTuple> flow_of( const string& datagram )
+{
+  InternetDatagram dgram;
+  if ( not parse( dgram, vector<string> { datagram } ) ) {
+    return {};
+  }
+  if ( dgram.header.proto != IPv4Header::PROTO_TCP and dgram.header.proto != IPPROTO_UDP ) {
+    return {};
+  }
+
+  string payload;
+  for ( const auto& x : dgram.payload ) {
+    payload += x;
+  }
+  if ( payload.size() < 4 ) {
+    return {};
+  }
+  const auto port_at = [&]( size_t offset ) {
+    return static_cast<uint16_t>( static_cast<uint8_t>( payload[offset] ) << 8
+                                  | static_cast<uint8_t>( payload[offset + 1] ) );
+  };
+  return FourTuple { dgram.header.dst, dgram.header.src, port_at( 2 ), port_at( 0 ) };
+}
+} // namespace
+
+// Every flow reaches the queue that queue_for() predicts, for TCP and UDP alike, and a worker on each queue
+// sees exactly the flows assigned to it.
+void multi_queue_test()
+{
+  TunQueues queues { DEVICE, NUM_QUEUES };
+  if ( not queues.steered() ) {
+    throw runtime_error( "could not install the steering program" );
+  }
+  configure_interface( DEVICE, "10.144.0.1", "255.255.255.0" );
+
+  const Address kernel_address { "10.144.0.1", 0 };
+  const Address our_address { "10.144.0.2", 0 };
+
+  // each flow's local port is picked to land on a given queue
+  vector<vector<FourTuple>> expected( NUM_QUEUES );
+  vector<UDPSocket> udp_senders;
+  vector<TCPSocket> tcp_senders;
+  for ( size_t index = 0; index < NUM_QUEUES; ++index ) {
+    for ( size_t i = 0; i < FLOWS_PER_QUEUE; ++i ) {
+      const auto remote_port = static_cast<uint16_t>( 40000 + index * FLOWS_PER_QUEUE + i );
+      const uint16_t local_port = queues.local_port_for(
+        our_address.ipv4_numeric(), kernel_address.ipv4_numeric(), remote_port, index );
+      expected[index].push_back(
+        { our_address.ipv4_numeric(), kernel_address.ipv4_numeric(), local_port, remote_port } );
+
+      if ( i % 2 == 0 ) {
+        auto& sender = udp_senders.emplace_back();
+        sender.bind( Address { "10.144.0.1", remote_port } );
+        sender.sendto( Address { "10.144.0.2", local_port }, "hello" );
+      } else {
+        // a non-blocking connect() sends one SYN
+        auto& sender = tcp_senders.emplace_back();
+        sender.set_blocking( false );
+        sender.bind( Address { "10.144.0.1", remote_port } );
+        const Address destination { "10.144.0.2", local_port };
+        if ( ::connect( sender.fd_num(), destination.raw(), destination.size() ) == 0 or errno != EINPROGRESS ) {
+          throw unix_error( "connect" );
+        }
+      }
+    }
+  }
+
+  vector<vector<FourTuple>> received( NUM_QUEUES );
+  queues.run( [&]( size_t index, TunFD& queue ) {
+    pollfd pfd { queue.fd_num(), POLLIN, 0 };
+    string datagram;
+    while ( received[index].size() < FLOWS_PER_QUEUE
+            and CheckSystemCall( "poll", ::poll( &pfd, 1, 1000 ) ) > 0 ) {
+      queue.read( datagram );
+      const auto flow = flow_of( datagram );
+      if ( flow and flow->remote_address == kernel_address.ipv4_numeric()
+           and find( received[index].begin(), received[index].end(), *flow ) == received[index].end() ) {
+        received[index].push_back( *flow );
+      }
+    }
+  } );
+
+  for ( size_t index = 0; index < NUM_QUEUES; ++index ) {
+    for ( const auto& flow : received[index] ) {
+      if ( queues.queue_for( flow ) != index ) {
+        throw runtime_error( "queue " + to_string( index ) + " received a flow that belongs to queue "
+                             + to_string( queues.queue_for( flow ) ) );
+      }
+    }
+    for ( const auto& flow : expected[index] ) {
+      if ( find( received[index].begin(), received[index].end(), flow ) == received[index].end() ) {
+        throw runtime_error( "queue " + to_string( index ) + " did not receive flow to local port "
+                             + to_string( flow.local_port ) );
+      }
+    }
+  }
+}
+
+int main()
+{
+  try {
+    if ( not enter_private_network_namespace() ) {
+      cerr << "Skipping multi-queue TUN test: needs CAP_NET_ADMIN and /dev/net/tun.\n";
+      return EXIT_SUCCESS;
+    }
+    multi_queue_test();
+  } catch ( const exception& e ) {
+    cerr << "\n\n\n";
+    cerr << "\033[31;1mError: " << e.what() << "\033[m\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
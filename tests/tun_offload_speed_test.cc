@@ -0,0 +1,294 @@
+#include "exception.hh"
+#include "socket.hh"
+#include "tun.hh"
+#include "tun_test_harness.hh"
+#include "tuntap_adapter.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <poll.h>
+#include <thread>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+constexpr const char* DEVICE = "offload144";
+const Address kernel_address { "10.144.0.1", 9090 };
+const Wrap32 our_isn { 1000 };
+constexpr uint16_t window = UINT16_MAX;
+
+char pattern( uint64_t index )
+{
+  return static_cast<char>( 'a' + index % 26 );
+}
+
+// Wait (up to a second) for the adapter to have something to read
+bool readable( TCPOverIPv4OverTunFdAdapter& adapter )
+{
+  pollfd pfd { adapter.fd().fd_num(), POLLIN, 0 };
+  return CheckSystemCall( "poll", ::poll( &pfd, 1, 1000 ) ) > 0;
+}
+
+// Read segments until one satisfies `wanted`
+TCPMessage wait_for( TCPOverIPv4OverTunFdAdapter& adapter, const auto& wanted )
+{
+  vector<TCPMessage> segs;
+  while ( readable( adapter ) ) {
+    segs.clear();
+    adapter.read_batch( segs );
+    for ( auto& seg : segs ) {
+      if ( wanted( seg ) ) {
+        return seg;
+      }
+    }
+  }
+  throw runtime_error( "timed out waiting for the kernel" );
+}
+
+TCPMessage message( Wrap32 seqno, Wrap32 ackno, string payload = {} )
+{
+  return { .sender = { .seqno = seqno, .SYN = false, .payload = move( payload ), .FIN = false, .RST = false },
+           .receiver = { .ackno = ackno, .window_size = window, .RST = false } };
+}
+
+struct Result
+{
+  duration<double> time;
+  uint64_t datagrams; // datagrams moved through the TUN device, in the direction of the data
+  uint64_t syscalls;  // reads and writes on the TUN device
+};
+
+// We send `num_bytes` to a kernel TCP socket, in segments of TCPConfig::MAX_PAYLOAD_SIZE, within the window the
+// kernel advertises (with fast retransmit, and go-back-N on a timeout)
+Result send_to_kernel( TCPOverIPv4OverTunFdAdapter& adapter, const uint64_t num_bytes )
+{
+  TCPSocket listener;
+  listener.set_reuseaddr();
+  // room for a full window of small segments, so the kernel does not prune its receive queue
+  const int receive_buffer = 4 * 1048576;
+  CheckSystemCall(
+    "setsockopt",
+    ::setsockopt( listener.fd_num(), SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof( receive_buffer ) ) );
+  listener.bind( kernel_address );
+  listener.listen();
+
+  uint64_t received = 0;
+  bool corrupted = false;
+  thread reader( [&] {
+    TCPSocket connection = listener.accept();
+    string buffer;
+    while ( not connection.eof() ) {
+      buffer.clear();
+      connection.read( buffer );
+      for ( const char c : buffer ) {
+        corrupted |= c != pattern( received++ );
+      }
+    }
+  } );
+
+  adapter.write( { .sender = { .seqno = our_isn, .SYN = true, .payload = {}, .FIN = false, .RST = false },
+                   .receiver = { .ackno = {}, .window_size = window, .RST = false } } );
+  const TCPMessage syn_ack = wait_for( adapter, []( const TCPMessage& seg ) { return seg.sender.SYN; } );
+  const Wrap32 ackno = syn_ack.sender.seqno + 1;
+
+  const auto start_time = steady_clock::now();
+  const auto start_writes = adapter.fd().write_count();
+  const auto start_syscalls = adapter.fd().syscall_count();
+
+  uint64_t next = 0;
+  uint64_t acked = 0;
+  uint64_t peer_window = syn_ack.receiver.window_size;
+  uint64_t duplicate_acks = 0;
+  vector<TCPMessage> segs;
+  while ( acked < num_bytes ) {
+    segs.clear();
+    while ( next < num_bytes and next < acked + peer_window ) {
+      const Wrap32 seqno = Wrap32::wrap( next + 1, our_isn );
+      string payload( min( { TCPConfig::MAX_PAYLOAD_SIZE, num_bytes - next, acked + peer_window - next } ), 0 );
+      for ( auto& c : payload ) {
+        c = pattern( next++ );
+      }
+      segs.push_back( message( seqno, ackno, move( payload ) ) );
+    }
+    adapter.write_batch( segs );
+
+    if ( not readable( adapter ) ) {
+      next = acked; // go back N
+      continue;
+    }
+    segs.clear();
+    adapter.read_batch( segs );
+    for ( const auto& seg : segs ) {
+      if ( not seg.receiver.ackno ) {
+        continue;
+      }
+      const uint64_t ack = seg.receiver.ackno->unwrap( our_isn, acked ) - 1;
+      duplicate_acks = ack == acked ? duplicate_acks + 1 : 0;
+      acked = max( acked, ack );
+      peer_window = seg.receiver.window_size;
+    }
+
+    if ( duplicate_acks >= 3 and acked < next ) {
+      // fast retransmit of the one missing segment
+      string payload( min( TCPConfig::MAX_PAYLOAD_SIZE, next - acked ), 0 );
+      for ( uint64_t i = 0; i < payload.size(); ++i ) {
+        payload[i] = pattern( acked + i );
+      }
+      adapter.write( message( Wrap32::wrap( acked + 1, our_isn ), ackno, move( payload ) ) );
+      duplicate_acks = 0;
+    }
+  }
+  const auto stop_time = steady_clock::now();
+
+  auto fin = message( Wrap32::wrap( num_bytes + 1, our_isn ), ackno );
+  fin.sender.FIN = true;
+  adapter.write( fin );
+  reader.join();
+
+  if ( corrupted ) {
+    throw runtime_error( "the kernel received corrupted data" );
+  }
+  if ( received != num_bytes ) {
+    throw runtime_error( "the kernel received " + to_string( received ) + " of " + to_string( num_bytes )
+                         + " bytes" );
+  }
+  return { stop_time - start_time,
+           adapter.fd().write_count() - start_writes,
+           adapter.fd().syscall_count() - start_syscalls };
+}
+
+// A kernel TCP socket sends us `num_bytes`, which we acknowledge once per batch of segments read
+Result receive_from_kernel( TCPOverIPv4OverTunFdAdapter& adapter, const uint64_t num_bytes )
+{
+  adapter.set_listening( true );
+
+  TCPSocket sender;
+  sender.set_blocking( false );
+  const Address& our_address = adapter.config().source;
+  if ( ::connect( sender.fd_num(), our_address.raw(), our_address.size() ) == 0 or errno != EINPROGRESS ) {
+    throw unix_error( "connect" );
+  }
+
+  const TCPMessage syn = wait_for( adapter, []( const TCPMessage& seg ) { return seg.sender.SYN; } );
+  const Wrap32 peer_isn = syn.sender.seqno;
+  auto syn_ack = message( our_isn, peer_isn + 1 );
+  syn_ack.sender.SYN = true;
+  adapter.write( syn_ack );
+
+  thread writer( [&] {
+    sender.set_blocking( true );
+    string chunk( 65536, 0 );
+    for ( uint64_t sent = 0; sent < num_bytes; ) {
+      const auto length = min<uint64_t>( chunk.size(), num_bytes - sent );
+      for ( uint64_t i = 0; i < length; ++i ) {
+        chunk[i] = pattern( sent + i );
+      }
+      for ( uint64_t written = 0; written < length; ) {
+        written += sender.write( string_view( chunk ).substr( written, length - written ) );
+      }
+      sent += length;
+    }
+  } );
+
+  const auto start_time = steady_clock::now();
+  const auto start_reads = adapter.fd().read_count();
+  const auto start_syscalls = adapter.fd().syscall_count();
+
+  uint64_t received = 0;
+  vector<TCPMessage> segs;
+  while ( received < num_bytes ) {
+    if ( not readable( adapter ) ) {
+      throw runtime_error( "timed out waiting for data from the kernel" );
+    }
+    segs.clear();
+    adapter.read_batch( segs );
+    for ( const auto& seg : segs ) {
+      // accept only the next bytes in order (the kernel retransmits anything else)
+      if ( seg.sender.payload.empty() or seg.sender.seqno.unwrap( peer_isn, received ) != received + 1 ) {
+        continue;
+      }
+      for ( const char c : seg.sender.payload ) {
+        if ( c != pattern( received++ ) ) {
+          throw runtime_error( "we received corrupted data" );
+        }
+      }
+    }
+    adapter.write( message( our_isn + 1, Wrap32::wrap( received + 1, peer_isn ) ) );
+  }
+  const auto stop_time = steady_clock::now();
+  writer.join();
+
+  return { stop_time - start_time,
+           adapter.fd().read_count() - start_reads,
+           adapter.fd().syscall_count() - start_syscalls };
+}
+
+void report( const string& direction, const bool offload, const uint64_t num_bytes, const Result& result )
+{
+  const double megabytes = static_cast<double>( num_bytes ) / 1048576;
+  const double gigabits_per_second = static_cast<double>( num_bytes ) * 8.0 / result.time.count() / 1e9;
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "TUN " << direction << ( offload ? " with offloads:    " : " without offloads: " ) << fixed
+       << setprecision( 2 ) << gigabits_per_second << " Gbit/s, " << setprecision( 1 )
+       << static_cast<double>( result.datagrams ) / megabytes << " datagrams/MiB, "
+       << static_cast<double>( result.syscalls ) / megabytes << " syscalls/MiB.\n";
+
+  debug_output << "             TUN " << direction << ( offload ? " (offloads): " : ": " ) << fixed
+               << setprecision( 2 ) << gigabits_per_second << " Gbit/s\n";
+}
+
+void speed_test( const bool offload, const uint64_t num_bytes )
+{
+  const auto make_adapter = [&] {
+    // a device that is not persistent disappears with its last fd, so each adapter gets a fresh one
+    TCPOverIPv4OverTunFdAdapter adapter { TunFD { DEVICE, false, offload } };
+    configure_interface( DEVICE, "10.144.0.1", "255.255.255.0" );
+    // (and a port of its own: the kernel may still be closing the previous connection)
+    static uint16_t port = 40000;
+    adapter.config_mut().source = Address { "10.144.0.2", port++ };
+    adapter.config_mut().destination = kernel_address;
+    return adapter;
+  };
+
+  {
+    auto adapter = make_adapter();
+    report( "send   ", offload, num_bytes, send_to_kernel( adapter, num_bytes ) );
+  }
+  {
+    auto adapter = make_adapter();
+    report( "receive", offload, num_bytes, receive_from_kernel( adapter, num_bytes ) );
+  }
+}
+} // namespace
+
+void program_body()
+{
+  if ( not enter_private_network_namespace() ) {
+    cerr << "Skipping TUN offload speed test: needs CAP_NET_ADMIN and /dev/net/tun.\n";
+    return;
+  }
+
+  constexpr uint64_t num_bytes = 64 * 1048576;
+  speed_test( false, num_bytes );
+  speed_test( true, num_bytes );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "exception.hh"
+#include "socket.hh"
+
+#include <arpa/inet.h>
+#include <cstring>
+#include <linux/if.h>
+#include <netinet/in.h>
+#include <sched.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+// Move the process into a private network namespace, so test devices (and their addresses) stay away from the
+// host. Returns false if that, or opening TUN devices, is not allowed.
+inline bool enter_private_network_namespace()
+{
+  return ::unshare( CLONE_NEWNET ) == 0 and ::access( "/dev/net/tun", R_OK | W_OK ) == 0;
+}
+
+// Give a device an address and bring it up, as `ip addr add` and `ip link set up` would
+inline void configure_interface( const std::string& device, const std::string& address, const std::string& netmask )
+{
+  UDPSocket control;
+  ifreq request {};
+  strncpy( static_cast<char*>( request.ifr_name ), device.c_str(), IFNAMSIZ - 1 );
+
+  const auto set_address = [&]( unsigned long command, const std::string& value ) {
+    sockaddr_in sin {};
+    sin.sin_family = AF_INET;
+    CheckSystemCall( "inet_pton", inet_pton( AF_INET, value.c_str(), &sin.sin_addr ) );
+    memcpy( &request.ifr_addr, &sin, sizeof( sin ) );
+    CheckSystemCall( "ioctl", ioctl( control.fd_num(), command, &request ) );
+  };
+  set_address( SIOCSIFADDR, address );
+  set_address( SIOCSIFNETMASK, netmask );
+
+  CheckSystemCall( "ioctl", ioctl( control.fd_num(), SIOCGIFFLAGS, &request ) );
+  request.ifr_flags = static_cast<int16_t>( request.ifr_flags | IFF_UP );
+  CheckSystemCall( "ioctl", ioctl( control.fd_num(), SIOCSIFFLAGS, &request ) );
+}
+
+// Let a device queue `length` datagrams before dropping them, as `ip link set txqueuelen` would (the default of
+// 500 overflows when thousands of connections send at once)
+inline void set_queue_length( const std::string& device, const int length )
+{
+  UDPSocket control;
+  ifreq request {};
+  strncpy( static_cast<char*>( request.ifr_name ), device.c_str(), IFNAMSIZ - 1 );
+  request.ifr_qlen = length;
+  CheckSystemCall( "ioctl", ioctl( control.fd_num(), SIOCSIFTXQLEN, &request ) );
+}
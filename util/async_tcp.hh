@@ -0,0 +1,158 @@
+#pragma once
+
+#include "address.hh"
+#include "four_tuple.hh"
+#include "random.hh"
+#include "task.hh"
+#include "tcp_config.hh"
+#include "tcp_reactor.hh"
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+
+//! Client TCP connections as coroutines, on one thread
+//! \details AsyncTCP runs Tasks on a TCPReactor's thread. A task opens connections with `co_await connect()`,
+//! and reads and writes them with `co_await socket.read()` and `co_await socket.write()`; where a blocking
+//! TCPSocket would block, the task suspends instead, and the reactor resumes it from the callback that would
+//! have unblocked it. A suspended task costs its coroutine frame, not a thread or a stack, so thousands of them
+//! can be in progress at once.
+//!
+//! \code
+//!   Task<> fetch( AsyncTCP& tcp, Address server ) {
+//!     AsyncTCP::Socket socket = co_await tcp.connect( server );
+//!     co_await socket.write( "GET / HTTP/1.1\r\n..." );
+//!     for ( std::string data = co_await socket.read(); not data.empty(); data = co_await socket.read() ) { ... }
+//!   }
+//!   AsyncTCP tcp { reactor, Address { "169.254.144.9" } };
+//!   tcp.spawn( fetch( tcp, server ) );
+//!   tcp.run();
+//! \endcode
+class AsyncTCP
+{
+  //! What a Socket shares with its connection's callbacks (which outlive the Socket until the connection closes)
+  struct State
+  {
+    TCPReactor::Connection* connection {}; //!< null once the connection has closed
+    std::coroutine_handle<> opener {};     //!< the task waiting in connect()
+    std::coroutine_handle<> reader {};     //!< the task waiting in read()
+    std::coroutine_handle<> writer {};     //!< the task waiting in write()
+    std::string_view unwritten {};         //!< what the waiting write() has left to write
+    bool opened {};
+    bool orphaned {}; //!< the Socket is gone; discard what arrives until the connection closes
+
+    State() = default;
+    State( const State& other ) = delete;
+    State& operator=( const State& other ) = delete;
+
+    //! Write as much of `unwritten` as fits; returns whether it is all written
+    bool write_some();
+  };
+
+public:
+  //! A connection, as a task sees it. Destroying (or close()ing) a Socket finishes its outbound stream; the
+  //! connection closes once the peer finishes too.
+  class Socket
+  {
+    std::shared_ptr<State> state_;
+
+  public:
+    explicit Socket( std::shared_ptr<State> state ) : state_( std::move( state ) ) {}
+    Socket( Socket&& other ) noexcept = default;
+    Socket& operator=( Socket&& other ) noexcept;
+    Socket( const Socket& other ) = delete;
+    Socket& operator=( const Socket& other ) = delete;
+    ~Socket();
+
+    //! co_await read() returns the bytes that have arrived, waiting for some if there are none. An empty string
+    //! means the peer has finished its stream (or the connection was reset).
+    struct ReadAwaiter
+    {
+      State& state;
+      bool await_ready() const;
+      void await_suspend( std::coroutine_handle<> task ) { state.reader = task; }
+      std::string await_resume();
+    };
+    ReadAwaiter read() { return { *state_ }; }
+
+    //! co_await write( data ) returns once all of `data` is in the outbound stream, waiting for room if need be
+    //! (`data` must stay valid until then). Throws if the connection closes first.
+    struct WriteAwaiter
+    {
+      State& state;
+      std::string_view data;
+      bool await_ready();
+      void await_suspend( std::coroutine_handle<> task ) { state.writer = task; }
+      void await_resume();
+    };
+    WriteAwaiter write( std::string_view data ) { return { *state_, data }; }
+
+    //! Finish the outbound stream
+    void close();
+
+    //! Reset the connection
+    void abort();
+
+    //! Has the peer finished its stream (or the connection closed)?
+    bool eof() const;
+  };
+
+  //! Open connections through `reactor` from `local_address`, with `config` (a fresh ISN for each)
+  AsyncTCP( TCPReactor& reactor, const Address& local_address, const TCPConfig& config = {} );
+
+  //! Connect to `remote`, from the next free local port; throws if the connection is refused or times out
+  Task<Socket> connect( Address remote );
+
+  //! Start a task; it runs until it first suspends, and then from the reactor's callbacks
+  void spawn( Task<> task );
+
+  //! Run the reactor until every spawned task has finished; rethrows the first exception a task threw
+  void run();
+
+  //! Number of spawned tasks that have not finished
+  size_t running() const { return running_; }
+
+private:
+  //! The coroutine that runs a spawned task; it frees itself when done
+  struct Detached
+  {
+    struct promise_type
+    {
+      Detached get_return_object() { return {}; }
+      std::suspend_never initial_suspend() noexcept { return {}; }
+      std::suspend_never final_suspend() noexcept { return {}; }
+      void return_void() {}
+      void unhandled_exception() { std::terminate(); } // (run_detached catches everything)
+    };
+  };
+
+  TCPReactor& reactor_;
+  uint32_t local_address_;
+  TCPConfig config_;
+  std::default_random_engine rng_ { get_random_engine() }; //!< for ISNs and the first local port
+  uint16_t next_port_;                                       //!< where the search for a free local port starts
+  size_t running_ {};
+  std::exception_ptr error_ {};
+
+  //! co_await OpenAwaiter waits for the handshake to finish (or fail)
+  struct OpenAwaiter
+  {
+    State& state;
+    bool await_ready() const { return state.opened or state.connection == nullptr; }
+    void await_suspend( std::coroutine_handle<> task ) { state.opener = task; }
+    void await_resume() const {}
+  };
+
+  //! The reactor callbacks of a connection
+  static TCPReactor::Handlers handlers( const std::shared_ptr<State>& state );
+
+  //! A 4-tuple from the local address to `remote` that no connection is using
+  FourTuple free_tuple( const Address& remote );
+
+  Detached run_detached( Task<> task );
+};
@@ -0,0 +1,297 @@
+#include "benchmark.hh"
+#include "exception.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <charconv>
+#include <iomanip>
+#include <map>
+#include <sched.h>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+double median( vector<double> values )
+{
+  if ( values.empty() ) {
+    return 0;
+  }
+  sort( values.begin(), values.end() );
+  const size_t middle = values.size() / 2;
+  return values.size() % 2 ? values[middle] : ( values[middle - 1] + values[middle] ) / 2;
+}
+
+// Pins the calling thread to a CPU (unless it is BenchmarkConfig::NO_PINNING), and unpins it when destroyed
+class CPUPin
+{
+  cpu_set_t original_ {};
+  bool pinned_ {};
+
+public:
+  explicit CPUPin( const int cpu )
+  {
+    if ( cpu < 0 ) {
+      return;
+    }
+    CheckSystemCall( "sched_getaffinity", sched_getaffinity( 0, sizeof( original_ ), &original_ ) );
+    cpu_set_t cpus;
+    CPU_ZERO( &cpus );
+    CPU_SET( cpu, &cpus );
+    CheckSystemCall( "sched_setaffinity", sched_setaffinity( 0, sizeof( cpus ), &cpus ) );
+    pinned_ = true;
+  }
+
+  ~CPUPin()
+  {
+    if ( pinned_ ) {
+      sched_setaffinity( 0, sizeof( original_ ), &original_ ); // (nothing to do if it fails)
+    }
+  }
+
+  CPUPin( const CPUPin& other ) = delete;
+  CPUPin& operator=( const CPUPin& other ) = delete;
+};
+
+string json_string( string_view s )
+{
+  string out = "\"";
+  for ( const char c : s ) {
+    if ( c == '"' or c == '\\' ) {
+      out += '\\';
+    }
+    out += c;
+  }
+  return out + "\"";
+}
+
+// Just enough JSON to read back what benchmarks_to_json() writes: objects, arrays, strings and numbers
+struct JSONValue
+{
+  string string_value {};
+  double number {};
+  vector<JSONValue> array {};
+  map<string, JSONValue, less<>> object {};
+
+  const JSONValue& at( string_view key ) const
+  {
+    const auto it = object.find( key );
+    if ( it == object.end() ) {
+      throw runtime_error( "benchmark results: missing \"" + string( key ) + "\"" );
+    }
+    return it->second;
+  }
+};
+
+class JSONParser
+{
+  string_view in_;
+
+  [[noreturn]] void fail( const string& what ) const
+  {
+    throw runtime_error( "benchmark results: " + what + " at \"" + string( in_.substr( 0, 20 ) ) + "\"" );
+  }
+
+  void skip_space()
+  {
+    while ( not in_.empty() and ( in_.front() == ' ' or in_.front() == '\n' or in_.front() == '\t' ) ) {
+      in_.remove_prefix( 1 );
+    }
+  }
+
+  void expect( char c )
+  {
+    skip_space();
+    if ( in_.empty() or in_.front() != c ) {
+      fail( string( "expected '" ) + c + "'" );
+    }
+    in_.remove_prefix( 1 );
+  }
+
+  bool next_is( char c )
+  {
+    skip_space();
+    return not in_.empty() and in_.front() == c;
+  }
+
+  string parse_string()
+  {
+    expect( '"' );
+    string out;
+    while ( not in_.empty() and in_.front() != '"' ) {
+      if ( in_.front() == '\\' ) {
+        in_.remove_prefix( 1 );
+      }
+      if ( not in_.empty() ) {
+        out += in_.front();
+        in_.remove_prefix( 1 );
+      }
+    }
+    expect( '"' );
+    return out;
+  }
+
+public:
+  explicit JSONParser( string_view in ) : in_( in ) {}
+
+  JSONValue parse()
+  {
+    JSONValue value;
+    if ( next_is( '{' ) ) {
+      expect( '{' );
+      while ( not next_is( '}' ) ) {
+        string key = parse_string();
+        expect( ':' );
+        value.object.emplace( move( key ), parse() );
+        if ( not next_is( '}' ) ) {
+          expect( ',' );
+        }
+      }
+      expect( '}' );
+    } else if ( next_is( '[' ) ) {
+      expect( '[' );
+      while ( not next_is( ']' ) ) {
+        value.array.push_back( parse() );
+        if ( not next_is( ']' ) ) {
+          expect( ',' );
+        }
+      }
+      expect( ']' );
+    } else if ( next_is( '"' ) ) {
+      value.string_value = parse_string();
+    } else {
+      const auto [end, error] = from_chars( in_.data(), in_.data() + in_.size(), value.number );
+      if ( error != errc {} ) {
+        fail( "expected a value" );
+      }
+      in_.remove_prefix( end - in_.data() );
+    }
+    return value;
+  }
+};
+} // namespace
+
+double BenchmarkResult::median_ns_per_item() const
+{
+  return median( times_ns ) / static_cast<double>( max<uint64_t>( items, 1 ) );
+}
+
+double BenchmarkResult::min_ns_per_item() const
+{
+  const auto fastest = min_element( times_ns.begin(), times_ns.end() );
+  return fastest == times_ns.end() ? 0 : *fastest / static_cast<double>( max<uint64_t>( items, 1 ) );
+}
+
+int BenchmarkConfig::pinned_cpu() const
+{
+  if ( cpu != FIRST_ALLOWED_CPU ) {
+    return cpu;
+  }
+  cpu_set_t allowed;
+  CheckSystemCall( "sched_getaffinity", sched_getaffinity( 0, sizeof( allowed ), &allowed ) );
+  for ( int i = 0; i < CPU_SETSIZE; ++i ) {
+    if ( CPU_ISSET( i, &allowed ) ) {
+      return i;
+    }
+  }
+  return NO_PINNING;
+}
+
+void BenchmarkSuite::add( string name, string unit, Body body )
+{
+  benchmarks_.push_back( { move( name ), move( unit ), move( body ) } );
+}
+
+vector<BenchmarkResult> BenchmarkSuite::run( const BenchmarkConfig& config, ostream& progress ) const
+{
+  const CPUPin pin { config.pinned_cpu() };
+
+  vector<BenchmarkResult> results;
+  for ( const auto& benchmark : benchmarks_ ) {
+    if ( benchmark.name.find( config.filter ) == string::npos ) {
+      continue;
+    }
+
+    BenchmarkResult result { benchmark.name, benchmark.unit };
+    for ( unsigned i = 0; i < config.warmup; ++i ) {
+      benchmark.body();
+    }
+    for ( unsigned i = 0; i < config.repetitions; ++i ) {
+      const auto start = steady_clock::now();
+      const uint64_t items = benchmark.body();
+      const auto stop = steady_clock::now();
+      if ( i > 0 and items != result.items ) {
+        throw runtime_error( "benchmark \"" + benchmark.name + "\" processed a different number of items" );
+      }
+      result.items = items;
+      result.times_ns.push_back( duration<double, nano>( stop - start ).count() );
+    }
+
+    progress << left << setw( 40 ) << result.name << right << fixed << setprecision( 2 ) << setw( 12 )
+             << result.median_ns_per_item() << " ns/" << result.unit << setprecision( 3 ) << setw( 12 )
+             << result.items_per_second() / 1e6 << " M" << result.unit << "s/s\n";
+    results.push_back( move( result ) );
+  }
+  return results;
+}
+
+string benchmarks_to_json( const vector<BenchmarkResult>& results, const BenchmarkConfig& config )
+{
+  ostringstream out;
+  out << setprecision( 17 );
+  out << "{\n  \"config\": { \"warmup\": " << config.warmup << ", \"repetitions\": " << config.repetitions
+      << ", \"cpu\": " << config.pinned_cpu() << " },\n  \"benchmarks\": [";
+  for ( size_t i = 0; i < results.size(); ++i ) {
+    const auto& result = results[i];
+    out << ( i ? "," : "" ) << "\n    { \"name\": " << json_string( result.name )
+        << ", \"unit\": " << json_string( result.unit ) << ", \"items\": " << result.items
+        << ", \"median_ns_per_item\": " << result.median_ns_per_item()
+        << ", \"items_per_second\": " << result.items_per_second() << ", \"times_ns\": [";
+    for ( size_t j = 0; j < result.times_ns.size(); ++j ) {
+      out << ( j ? ", " : "" ) << result.times_ns[j];
+    }
+    out << "] }";
+  }
+  out << "\n  ]\n}\n";
+  return out.str();
+}
+
+vector<BenchmarkResult> benchmarks_from_json( string_view json )
+{
+  const JSONValue root = JSONParser { json }.parse();
+  vector<BenchmarkResult> results;
+  for ( const auto& benchmark : root.at( "benchmarks" ).array ) {
+    BenchmarkResult result { benchmark.at( "name" ).string_value,
+                             benchmark.at( "unit" ).string_value,
+                             static_cast<uint64_t>( benchmark.at( "items" ).number ) };
+    for ( const auto& time : benchmark.at( "times_ns" ).array ) {
+      result.times_ns.push_back( time.number );
+    }
+    results.push_back( move( result ) );
+  }
+  return results;
+}
+
+vector<BenchmarkComparison> compare_benchmarks( const vector<BenchmarkResult>& baseline,
+                                                const vector<BenchmarkResult>& current,
+                                                const double threshold )
+{
+  vector<BenchmarkComparison> comparisons;
+  for ( const auto& now : current ) {
+    const auto before = find_if(
+      baseline.begin(), baseline.end(), [&]( const BenchmarkResult& result ) { return result.name == now.name; } );
+    if ( before == baseline.end() ) {
+      continue;
+    }
+
+    BenchmarkComparison comparison { now.name, before->median_ns_per_item(), now.median_ns_per_item() };
+    comparison.change = comparison.current_ns_per_item / comparison.baseline_ns_per_item - 1;
+    comparison.regression
+      = comparison.change > threshold and now.min_ns_per_item() > comparison.baseline_ns_per_item;
+    comparisons.push_back( move( comparison ) );
+  }
+  return comparisons;
+}
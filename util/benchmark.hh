@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//! How a BenchmarkSuite runs its benchmarks
+struct BenchmarkConfig
+{
+  unsigned warmup = 2;         //!< repetitions run first and not measured (to warm the caches and the allocator)
+  unsigned repetitions = 10;   //!< repetitions measured
+  int cpu = FIRST_ALLOWED_CPU; //!< CPU to pin the benchmarks to while they run (or one of the below)
+  std::string filter {};       //!< run only the benchmarks whose names contain this
+
+  static constexpr int NO_PINNING = -1;        //!< `cpu`: don't pin
+  static constexpr int FIRST_ALLOWED_CPU = -2; //!< `cpu`: the first CPU in the process's affinity mask
+
+  //! The CPU that `cpu` stands for, or NO_PINNING
+  int pinned_cpu() const;
+};
+
+//! The measurements of one benchmark
+struct BenchmarkResult
+{
+  std::string name;
+  std::string unit;              //!< what the benchmark counts, e.g. "byte" or "datagram"
+  uint64_t items {};             //!< items processed by each repetition
+  std::vector<double> times_ns {}; //!< time taken by each repetition
+
+  double median_ns_per_item() const;
+  double min_ns_per_item() const;
+  double items_per_second() const { return 1e9 / median_ns_per_item(); } //!< at the median
+};
+
+//! \brief A set of named benchmarks, run with warmup and repetitions on a pinned CPU
+//! \details A benchmark's body runs one repetition and returns the number of items it processed; anything it
+//! needs that shouldn't be timed is set up before add(), in what the body captures.
+class BenchmarkSuite
+{
+public:
+  using Body = std::function<uint64_t()>;
+
+  void add( std::string name, std::string unit, Body body );
+
+  //! Run the benchmarks that match the config's filter, printing a line for each to `progress` (the calling
+  //! thread is pinned to the config's CPU meanwhile, then may run where it could before)
+  std::vector<BenchmarkResult> run( const BenchmarkConfig& config, std::ostream& progress ) const;
+
+private:
+  struct Benchmark
+  {
+    std::string name;
+    std::string unit;
+    Body body;
+  };
+
+  std::vector<Benchmark> benchmarks_ {};
+};
+
+//! Results as JSON (the config, and for each benchmark its name, unit, items, and the time of each repetition)
+std::string benchmarks_to_json( const std::vector<BenchmarkResult>& results, const BenchmarkConfig& config );
+
+//! Results read back from benchmarks_to_json()
+std::vector<BenchmarkResult> benchmarks_from_json( std::string_view json );
+
+//! One benchmark, as run now and in a baseline
+struct BenchmarkComparison
+{
+  std::string name;
+  double baseline_ns_per_item {}; //!< median
+  double current_ns_per_item {};  //!< median
+  double change {};               //!< current / baseline - 1 (positive is slower)
+  bool regression {};
+};
+
+//! \brief Compare results with a baseline, benchmark by benchmark (those in only one of them are skipped)
+//! \details A benchmark regressed if its median time per item is more than `threshold` (e.g. 0.05 for 5%) slower
+//! than the baseline's median, and even its fastest repetition is slower than the baseline's median (so that one
+//! noisy repetition isn't enough).
+std::vector<BenchmarkComparison> compare_benchmarks( const std::vector<BenchmarkResult>& baseline,
+                                                     const std::vector<BenchmarkResult>& current,
+                                                     double threshold );
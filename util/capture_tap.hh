@@ -0,0 +1,76 @@
+#pragma once
+
+#include "network_interface.hh"
+#include "parser.hh"
+#include "pcapng.hh"
+#include "tcp_over_ip.hh"
+#include "tcp_segment.hh"
+
+#include <memory>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+//! \brief An OutputPort that captures every frame a NetworkInterface sends, then passes it to another port
+//! \details Wrap the port given to a NetworkInterface (in a test topology, or a Router's) to see exactly what
+//! the interface sent, ARP included; the writer's link type should be PcapngWriter::LinkType::Ethernet. One
+//! writer may be shared by several ports, to capture them all in one file.
+class CaptureOutputPort : public NetworkInterface::OutputPort
+{
+  std::shared_ptr<NetworkInterface::OutputPort> port_;
+  std::shared_ptr<PcapngWriter> writer_;
+
+public:
+  CaptureOutputPort( std::shared_ptr<NetworkInterface::OutputPort> port, std::shared_ptr<PcapngWriter> writer )
+    : port_( std::move( port ) ), writer_( std::move( writer ) )
+  {}
+
+  void transmit( const NetworkInterface& sender, const EthernetFrame& frame ) override
+  {
+    writer_->capture( serialize( frame.header ), frame.payload );
+    port_->transmit( sender, frame );
+  }
+
+  NetworkInterface::OutputPort& port() { return *port_; } //!< the port that frames are passed to
+};
+
+//! \brief An adapter that captures the IPv4 datagrams read from and written to a TCP-over-IPv4 adapter
+//! \details The adapter (e.g. TCPOverIPv4OverTunFdAdapter) hands the writer the bytes it actually reads and
+//! writes, so capturing costs one copy into the writer's buffer: nothing is wrapped or serialized again. The
+//! writer's link type should be PcapngWriter::LinkType::IPv4.
+template<class AdapterT>
+  requires requires( AdapterT adapter, std::shared_ptr<PcapngWriter> writer ) { adapter.set_capture( writer ); }
+class CaptureAdapter
+{
+  AdapterT adapter_;
+
+public:
+  CaptureAdapter( AdapterT&& adapter, std::shared_ptr<PcapngWriter> writer ) : adapter_( std::move( adapter ) )
+  {
+    adapter_.set_capture( std::move( writer ) );
+  }
+
+  std::optional<TCPMessage> read() { return adapter_.read(); }
+  void write( const TCPMessage& seg ) { adapter_.write( seg ); }
+  void read_batch( std::vector<TCPMessage>& segs ) { adapter_.read_batch( segs ); }
+  void write_batch( std::span<const TCPMessage> segs ) { adapter_.write_batch( segs ); }
+
+  void tick( const size_t ms_since_last_tick )
+  {
+    if constexpr ( requires { adapter_.tick( ms_since_last_tick ); } ) {
+      adapter_.tick( ms_since_last_tick );
+    }
+  }
+
+  //! \name
+  //! Passthrough functions to the underlying AdapterT instance
+
+  //!@{
+  FileDescriptor& fd() { return adapter_.fd(); }
+  void set_listening( const bool l ) { adapter_.set_listening( l ); }
+  const FdAdapterConfig& config() const { return adapter_.config(); }
+  FdAdapterConfig& config_mut() { return adapter_.config_mut(); }
+  AdapterT& adapter() { return adapter_; }
+  //!@}
+};
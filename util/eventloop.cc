@@ -1,13 +1,123 @@
 #include "eventloop.hh"
 #include "exception.hh"
+#include "latency.hh"
 #include "socket.hh"
 
+#include <algorithm>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <span>
+#include <sys/stat.h>
+#include <thread>
 
 using namespace std;
 
+namespace {
+constexpr size_t uring_read_buffers = 32;
+constexpr size_t uring_read_buffer_size = 65536;
+constexpr uint64_t uring_cancel_user_data = numeric_limits<uint64_t>::max();
+
+// orders the timer heap so that the earliest deadline is on top
+constexpr auto later = []( const auto& a, const auto& b ) { return a.deadline > b.deadline; };
+
+// Whether the fd's data is consumed with read(2) (a byte stream, pipe, TUN device...), as opposed to recvfrom(2) on
+// a datagram socket or accept(2) on a listening socket, which must not be read ahead of the callback.
+bool reads_with_read( const FileDescriptor& fd )
+{
+  struct stat st {};
+  CheckSystemCall( "fstat", ::fstat( fd.fd_num(), &st ) );
+  if ( not S_ISSOCK( st.st_mode ) ) {
+    return true;
+  }
+
+  int type = 0;
+  int listening = 0;
+  socklen_t optlen = sizeof( type );
+  CheckSystemCall( "getsockopt", ::getsockopt( fd.fd_num(), SOL_SOCKET, SO_TYPE, &type, &optlen ) );
+  optlen = sizeof( listening );
+  CheckSystemCall( "getsockopt", ::getsockopt( fd.fd_num(), SOL_SOCKET, SO_ACCEPTCONN, &listening, &optlen ) );
+  return type == SOCK_STREAM and not listening;
+}
+
+// Run a rule's callback (timing it, with MINNOW_LATENCY)
+template<class CallbackT>
+void run( CallbackT& callback )
+{
+  MINNOW_LATENCY_SCOPE( "EventLoop callback" );
+  callback();
+}
+} // namespace
+
+EventLoop::EventLoop( const Backend backend, const Trigger trigger ) : _backend( backend ), _trigger( trigger )
+{
+  _rule_categories.reserve( 64 );
+
+  if ( _backend == Backend::IOUring and not IOUring::available() ) {
+    _backend = Backend::Poll;
+  }
+
+  if ( _backend == Backend::Epoll ) {
+    _epoll_fd.emplace( CheckSystemCall( "epoll_create1", ::epoll_create1( EPOLL_CLOEXEC ) ) );
+    _epoll_events.resize( 256 );
+  }
+
+  if ( _backend == Backend::IOUring ) {
+    _ring.emplace( 256 );
+    _uring_buffers.resize( uring_read_buffers, string( uring_read_buffer_size, 0 ) );
+
+    vector<iovec> iovecs;
+    for ( auto& buffer : _uring_buffers ) {
+      iovecs.push_back( { buffer.data(), buffer.size() } );
+    }
+    _ring->register_buffers( iovecs ); // if this fails, reads still go through the ring, just not "fixed"
+
+    for ( size_t i = uring_read_buffers; i > 0; --i ) {
+      _uring_free_buffers.push_back( static_cast<uint16_t>( i - 1 ) );
+    }
+  }
+}
+
+EventLoop::~EventLoop()
+{
+  if ( not _ring ) {
+    return;
+  }
+
+  // the kernel may still write into our buffers until every outstanding request has completed
+  try {
+    size_t outstanding = 0;
+    for ( size_t i = 0; i < _uring_ops.size(); ++i ) {
+      if ( _uring_ops[i].fd ) {
+        _ring->prepare_cancel( i, uring_cancel_user_data );
+        ++outstanding;
+      }
+    }
+
+    while ( outstanding > 0 ) {
+      _ring->submit_and_wait( 1, -1 );
+      io_uring_cqe cqe {};
+      while ( _ring->pop_completion( cqe ) ) {
+        if ( cqe.user_data != uring_cancel_user_data ) {
+          if ( FDRule* rule = _fd_rules.find( _uring_ops.at( cqe.user_data ).rule ) ) {
+            rule->cancel_requested = true;
+          }
+          uring_complete( cqe, _uring_ready );
+          --outstanding;
+        }
+      }
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception destructing EventLoop: " << e.what() << "\n";
+  }
+}
+
+uint64_t EventLoop::syscall_count() const
+{
+  return _syscalls + ( _ring ? _ring->syscall_count() : 0 );
+}
+
 unsigned int EventLoop::FDRule::service_count() const
 {
   return direction == Direction::In ? fd.read_count() : fd.write_count();
@@ -32,124 +142,315 @@ EventLoop::FDRule::FDRule( BasicRule&& base,
                            Direction s_direction,
                            CallbackT s_cancel,
                            CallbackT s_error )
-  : BasicRule( base )
+  : BasicRule( move( base ) )
   , fd( move( s_fd ) )
   , direction( s_direction )
   , cancel( move( s_cancel ) )
   , error( move( s_error ) )
 {}
 
+EventLoop::TimerRule::TimerRule( size_t s_category_id, Clock::time_point s_deadline, CallbackT s_callback )
+  : category_id( s_category_id ), deadline( s_deadline ), callback( move( s_callback ) )
+{}
+
 EventLoop::RuleHandle EventLoop::add_rule( size_t category_id,
                                            FileDescriptor& fd,
                                            Direction direction,
-                                           const CallbackT& callback,
-                                           const InterestT& interest,
-                                           const CallbackT& cancel, // NOLINT(*-easily-swappable-*)
-                                           const CallbackT& error )
+                                           CallbackT callback,
+                                           InterestT interest,
+                                           CallbackT cancel, // NOLINT(*-easily-swappable-*)
+                                           CallbackT error )
 {
   if ( category_id >= _rule_categories.size() ) {
     throw out_of_range( "bad category_id" );
   }
 
-  _fd_rules.emplace_back( make_shared<FDRule>(
-    BasicRule { category_id, interest, callback }, fd.duplicate(), direction, cancel, error ) );
+  // a registration left behind by an fd number that has since been closed and reused is stale
+  if ( _backend == Backend::Epoll ) {
+    const auto existing = _epoll_registrations.find( fd.fd_num() );
+    if ( existing != _epoll_registrations.end()
+         and _fd_rules.find( existing->second.rules.front() )->fd.closed() ) {
+      const auto stale = existing->second.rules;
+      for ( const auto& stale_id : stale ) {
+        epoll_remove( stale_id, true );
+      }
+    }
+  }
+
+  const RuleId id = _fd_rules.emplace( BasicRule { category_id, move( interest ), move( callback ) },
+                                       fd.duplicate(),
+                                       direction,
+                                       move( cancel ),
+                                       move( error ) );
+
+  if ( _backend != Backend::Epoll ) {
+    _fd_rules.at( id.index )->prefetch
+      = _backend == Backend::IOUring and direction == Direction::In and reads_with_read( fd );
+    return { _registry, id, RuleKind::FD };
+  }
+
+  auto& registration = _epoll_registrations[fd.fd_num()];
+  if ( registration.rules.empty() ) {
+    ++_syscalls;
+    epoll_event ev {};
+    ev.data.fd = fd.fd_num();
+    CheckSystemCall( "epoll_ctl", ::epoll_ctl( _epoll_fd->fd_num(), EPOLL_CTL_ADD, fd.fd_num(), &ev ) );
+  }
+  registration.rules.push_back( id );
+  epoll_update( fd.fd_num(), registration );
 
-  return RuleHandle { _fd_rules.back() };
+  // new rules start out pending: their interest is evaluated on the next call to wait_next_event
+  _epoll_pending.push_back( id );
+
+  return { _registry, id, RuleKind::FD };
 }
 
-EventLoop::RuleHandle EventLoop::add_rule( const size_t category_id,
-                                           const CallbackT& callback,
-                                           const InterestT& interest )
+EventLoop::RuleHandle EventLoop::add_rule( const size_t category_id, CallbackT callback, InterestT interest )
 {
   if ( category_id >= _rule_categories.size() ) {
     throw out_of_range( "bad category_id" );
   }
 
-  _non_fd_rules.emplace_back( make_shared<BasicRule>( category_id, interest, callback ) );
+  return { _registry, _non_fd_rules.emplace( category_id, move( interest ), move( callback ) ), RuleKind::NonFD };
+}
 
-  return RuleHandle { _non_fd_rules.back() };
+EventLoop::RuleHandle EventLoop::add_timer( const size_t category_id,
+                                            const Clock::time_point deadline,
+                                            CallbackT callback )
+{
+  if ( category_id >= _rule_categories.size() ) {
+    throw out_of_range( "bad category_id" );
+  }
+
+  const RuleId id = _timers.emplace( category_id, deadline, move( callback ) );
+  _timer_heap.push_back( { deadline, id } );
+  push_heap( _timer_heap.begin(), _timer_heap.end(), later );
+  return { _registry, id, RuleKind::Timer };
 }
 
 void EventLoop::RuleHandle::cancel()
 {
-  const shared_ptr<BasicRule> rule_shared_ptr = rule_weak_ptr_.lock();
-  if ( rule_shared_ptr ) {
-    rule_shared_ptr->cancel_requested = true;
+  const shared_ptr<Registry> registry = registry_.lock();
+  if ( not registry ) {
+    return;
+  }
+
+  switch ( kind_ ) {
+    case RuleKind::FD:
+      if ( BasicRule* rule = registry->fd_rules.find( id_ ) ) {
+        rule->cancel_requested = true;
+      }
+      break;
+    case RuleKind::NonFD:
+      if ( BasicRule* rule = registry->non_fd_rules.find( id_ ) ) {
+        rule->cancel_requested = true;
+      }
+      break;
+    case RuleKind::Timer:
+      if ( TimerRule* timer = registry->timers.find( id_ ) ) {
+        timer->cancel_requested = true;
+      }
+      break;
   }
 }
 
-// NOLINTBEGIN(*-cognitive-complexity)
-// NOLINTBEGIN(*-signed-bitwise)
-EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
+bool EventLoop::serve_non_fd_rules()
 {
-  // first, handle the non-file-descriptor-related rules
-  {
-    for ( auto it = _non_fd_rules.begin(); it != _non_fd_rules.end(); ) {
-      auto& this_rule = **it;
-      bool rule_fired = false;
+  for ( uint32_t index = 0; index < _non_fd_rules.slot_count(); ++index ) {
+    BasicRule* rule = _non_fd_rules.at( index );
+    if ( not rule ) {
+      continue;
+    }
+    auto& this_rule = *rule;
+    bool rule_fired = false;
 
-      if ( this_rule.cancel_requested ) {
-        it = _non_fd_rules.erase( it );
-        continue;
+    if ( this_rule.cancel_requested ) {
+      _non_fd_rules.erase( index );
+      continue;
+    }
+
+    uint8_t iterations = 0;
+    while ( this_rule.interest() ) {
+      if ( iterations++ >= 128 ) {
+        throw runtime_error( "EventLoop: busy wait detected: rule \""
+                             + _rule_categories.at( this_rule.category_id ).name + "\" is still interested after "
+                             + to_string( iterations ) + " iterations" );
       }
 
-      uint8_t iterations = 0;
-      while ( this_rule.interest() ) {
-        if ( iterations++ >= 128 ) {
-          throw runtime_error( "EventLoop: busy wait detected: rule \""
-                               + _rule_categories.at( this_rule.category_id ).name + "\" is still interested after "
-                               + to_string( iterations ) + " iterations" );
-        }
+      rule_fired = true;
+      run( this_rule.callback );
+    }
 
-        rule_fired = true;
-        this_rule.callback();
-      }
+    if ( rule_fired ) {
+      return true; /* only serve one rule on each iteration */
+    }
+  }
 
-      if ( rule_fired ) {
-        return Result::Success; /* only serve one rule on each iteration */
-      }
+  return false;
+}
 
-      ++it;
+// Run every timer whose deadline has passed, earliest first; returns true if any ran
+bool EventLoop::serve_timers()
+{
+  bool fired = false;
+  const auto now = Clock::now();
+  while ( not _timer_heap.empty() and _timer_heap.front().deadline <= now ) {
+    pop_heap( _timer_heap.begin(), _timer_heap.end(), later );
+    const RuleId id = _timer_heap.back().id;
+    _timer_heap.pop_back();
+
+    TimerRule* timer = _timers.find( id );
+    if ( not timer ) {
+      continue;
     }
+    if ( not timer->cancel_requested ) {
+      run( timer->callback );
+      fired = true;
+    }
+    _timers.erase( id.index );
+  }
+
+  return fired;
+}
+
+// The earliest deadline of a timer that has not been cancelled, if any
+optional<EventLoop::Clock::time_point> EventLoop::next_timer_deadline()
+{
+  while ( not _timer_heap.empty() ) {
+    const RuleId id = _timer_heap.front().id;
+    const TimerRule* timer = _timers.find( id );
+    if ( timer and not timer->cancel_requested ) {
+      return timer->deadline;
+    }
+
+    pop_heap( _timer_heap.begin(), _timer_heap.end(), later );
+    _timer_heap.pop_back();
+    if ( timer ) {
+      _timers.erase( id.index );
+    }
+  }
+
+  return nullopt;
+}
+
+void EventLoop::report_fd_error( const FDRule& rule ) const
+{
+  /* see if fd is a socket */
+  int socket_error = 0;
+  socklen_t optlen = sizeof( socket_error );
+  const int ret = getsockopt( rule.fd.fd_num(), SOL_SOCKET, SO_ERROR, &socket_error, &optlen );
+  if ( ret == -1 and errno == ENOTSOCK ) {
+    cerr << "error on polled file descriptor for rule \"" << _rule_categories.at( rule.category_id ).name << "\"\n";
+  } else if ( ret == -1 ) {
+    throw unix_error( "getsockopt" );
+  } else if ( optlen != sizeof( socket_error ) ) {
+    throw runtime_error( "unexpected length from getsockopt: " + to_string( optlen ) );
+  } else if ( socket_error ) {
+    cerr << "error on polled socket for rule \"" << _rule_categories.at( rule.category_id ).name
+         << "\": " << strerror( socket_error ) << "\n";
+  }
+}
+
+// Remove a rule (Backend::Poll and Backend::IOUring), optionally calling its cancel() callback first
+void EventLoop::remove_fd_rule( const uint32_t index, const bool call_cancel )
+{
+  if ( call_cancel ) {
+    _fd_rules.at( index )->cancel();
+  }
+  _fd_rules.erase( index );
+}
+
+EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
+{
+  // first, handle the non-file-descriptor-related rules
+  if ( serve_non_fd_rules() ) {
+    return Result::Success;
+  }
+
+  // then any timers that are due
+  if ( serve_timers() ) {
+    return Result::Success;
+  }
+
+  // don't sleep past the next timer
+  const auto next_timer = next_timer_deadline();
+  int wait_ms = timeout_ms;
+  if ( next_timer ) {
+    const auto until_timer = chrono::ceil<chrono::milliseconds>( *next_timer - Clock::now() ).count();
+    const int timer_ms = static_cast<int>( clamp<int64_t>( until_timer, 0, numeric_limits<int>::max() ) );
+    wait_ms = timeout_ms < 0 ? timer_ms : min( timeout_ms, timer_ms );
+  }
+
+  Result result {};
+  switch ( _backend ) {
+    case Backend::Epoll:
+      result = wait_next_event_epoll( wait_ms );
+      break;
+    case Backend::IOUring:
+      result = wait_next_event_uring( wait_ms );
+      break;
+    default:
+      result = wait_next_event_poll( wait_ms );
+  }
+
+  if ( not next_timer ) {
+    return result;
+  }
+
+  if ( result == Result::Exit ) {
+    // no file descriptors left to wait on, only timers
+    const auto wake
+      = timeout_ms < 0 ? *next_timer : min( *next_timer, Clock::now() + chrono::milliseconds( timeout_ms ) );
+    this_thread::sleep_until( wake );
+    result = Result::Timeout;
   }
 
-  // now the file-descriptor-related rules. poll any "interested" file descriptors
-  vector<pollfd> pollfds {};
-  pollfds.reserve( _fd_rules.size() );
+  return serve_timers() ? Result::Success : result;
+}
+
+// NOLINTBEGIN(*-cognitive-complexity)
+// NOLINTBEGIN(*-signed-bitwise)
+EventLoop::Result EventLoop::wait_next_event_poll( const int timeout_ms )
+{
+  // poll any "interested" file descriptors
+  _pollfds.clear();
+  _poll_rules.clear();
   bool something_to_poll = false;
 
   // set up the pollfd for each rule
-  for ( auto it = _fd_rules.begin(); it != _fd_rules.end(); ) { // NOTE: it gets erased or incremented in loop body
-    auto& this_rule = **it;
+  for ( uint32_t index = 0; index < _fd_rules.slot_count(); ++index ) {
+    FDRule* rule = _fd_rules.at( index );
+    if ( not rule ) {
+      continue;
+    }
+    auto& this_rule = *rule;
 
     if ( this_rule.cancel_requested ) {
       //      this_rule.cancel();
       //      if rule is cancelled externally, no need to call the cancellation callback
       //      this makes it easier to cancel rules and delete captured objects right away
-      it = _fd_rules.erase( it );
+      remove_fd_rule( index, false );
       continue;
     }
 
     if ( this_rule.direction == Direction::In && this_rule.fd.eof() ) {
       // no more reading on this rule, it's reached eof
-      this_rule.cancel();
-      it = _fd_rules.erase( it );
+      remove_fd_rule( index, true );
       continue;
     }
 
     if ( this_rule.fd.closed() ) {
-      this_rule.cancel();
-      it = _fd_rules.erase( it );
+      remove_fd_rule( index, true );
       continue;
     }
 
     if ( this_rule.interest() ) {
-      pollfds.push_back( { this_rule.fd.fd_num(), static_cast<int16_t>( this_rule.direction ), 0 } );
+      _pollfds.push_back( { this_rule.fd.fd_num(), static_cast<int16_t>( this_rule.direction ), 0 } );
       something_to_poll = true;
     } else {
-      pollfds.push_back( { this_rule.fd.fd_num(), 0, 0 } ); // placeholder --- we still want errors
+      _pollfds.push_back( { this_rule.fd.fd_num(), 0, 0 } ); // placeholder --- we still want errors
     }
-    ++it;
+    _poll_rules.push_back( index );
   }
 
   // quit if there is nothing left to poll
@@ -158,36 +459,22 @@ EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
   }
 
   // call poll -- wait until one of the fds satisfies one of the rules (writeable/readable)
-  if ( 0 == CheckSystemCall( "poll", ::poll( pollfds.data(), pollfds.size(), timeout_ms ) ) ) {
+  ++_syscalls;
+  if ( 0 == CheckSystemCall( "poll", ::poll( _pollfds.data(), _pollfds.size(), timeout_ms ) ) ) {
     return Result::Timeout;
   }
 
   // go through the poll results
-  for ( auto [it, idx] = make_pair( _fd_rules.begin(), static_cast<size_t>( 0 ) ); it != _fd_rules.end(); ++idx ) {
-    const auto& this_pollfd = pollfds.at( idx );
-    auto& this_rule = **it;
+  for ( size_t idx = 0; idx < _pollfds.size(); ++idx ) {
+    const auto& this_pollfd = _pollfds[idx];
+    const uint32_t index = _poll_rules[idx];
+    auto& this_rule = *_fd_rules.at( index );
 
     const auto poll_error = static_cast<bool>( this_pollfd.revents & ( POLLERR | POLLNVAL ) );
     if ( poll_error ) {
-      /* see if fd is a socket */
-      int socket_error = 0;
-      socklen_t optlen = sizeof( socket_error );
-      const int ret = getsockopt( this_rule.fd.fd_num(), SOL_SOCKET, SO_ERROR, &socket_error, &optlen );
-      if ( ret == -1 and errno == ENOTSOCK ) {
-        cerr << "error on polled file descriptor for rule \"" << _rule_categories.at( this_rule.category_id ).name
-             << "\"\n";
-      } else if ( ret == -1 ) {
-        throw unix_error( "getsockopt" );
-      } else if ( optlen != sizeof( socket_error ) ) {
-        throw runtime_error( "unexpected length from getsockopt: " + to_string( optlen ) );
-      } else if ( socket_error ) {
-        cerr << "error on polled socket for rule \"" << _rule_categories.at( this_rule.category_id ).name
-             << "\": " << strerror( socket_error ) << "\n";
-      }
-
+      report_fd_error( this_rule );
       this_rule.error();
-      this_rule.cancel();
-      it = _fd_rules.erase( it );
+      remove_fd_rule( index, true );
       continue;
     }
 
@@ -198,15 +485,14 @@ EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
       //   - if it was POLLIN and nothing is readable, no more will ever be readable
       //   - if it was POLLOUT, it will not be writable again
       // additionally, consider FD defunct if rule will only query for Direction::Out
-      this_rule.cancel();
-      it = _fd_rules.erase( it );
+      remove_fd_rule( index, true );
       continue;
     }
 
     if ( poll_ready ) {
       // we only want to call callback if revents includes the event we asked for
       const auto count_before = this_rule.service_count();
-      this_rule.callback();
+      run( this_rule.callback );
 
       if ( count_before == this_rule.service_count() and ( not this_rule.fd.closed() ) and this_rule.interest() ) {
         throw runtime_error( "EventLoop: busy wait detected: rule \""
@@ -216,8 +502,466 @@ EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
 
       return Result::Success; /* only serve one rule on each iteration */
     }
+  }
+
+  return Result::Success;
+}
+
+// Bring the kernel's event mask for one fd in line with its rules. Level-triggered registrations ask only for the
+// directions of rules that are waiting; edge-triggered registrations ask for every direction, once.
+void EventLoop::epoll_update( const int fd_num, EpollRegistration& registration )
+{
+  uint32_t events = 0;
+  for ( const auto& id : registration.rules ) {
+    const FDRule& rule = *_fd_rules.find( id );
+    if ( _trigger == Trigger::Edge or rule.waiting ) {
+      events |= static_cast<uint32_t>( rule.direction );
+    }
+  }
+  if ( _trigger == Trigger::Edge ) {
+    events |= EPOLLET;
+  }
+
+  if ( events != registration.events ) {
+    ++_syscalls;
+    epoll_event ev {};
+    ev.events = events;
+    ev.data.fd = fd_num;
+    CheckSystemCall( "epoll_ctl", ::epoll_ctl( _epoll_fd->fd_num(), EPOLL_CTL_MOD, fd_num, &ev ) );
+    registration.events = events;
+  }
+}
+
+void EventLoop::epoll_set_waiting( FDRule& rule, const bool waiting )
+{
+  if ( rule.waiting == waiting ) {
+    return;
+  }
+
+  rule.waiting = waiting;
+  waiting ? ++_epoll_waiting : --_epoll_waiting;
+
+  if ( _trigger == Trigger::Level ) {
+    epoll_update( rule.fd.fd_num(), _epoll_registrations.at( rule.fd.fd_num() ) );
+  }
+}
+
+// Forget a rule, optionally calling its cancel() callback first. Ids of removed rules left in _epoll_pending or
+// _epoll_serve are stale, and skipped.
+void EventLoop::epoll_remove( const RuleId id, const bool call_cancel )
+{
+  FDRule* rule = _fd_rules.find( id );
+  if ( not rule ) {
+    return;
+  }
+
+  if ( call_cancel ) {
+    rule->cancel();
+  }
+
+  const int fd_num = rule->fd.fd_num();
+  const bool fd_closed = rule->fd.closed();
+  if ( rule->waiting ) {
+    --_epoll_waiting;
+  }
+  _fd_rules.erase( id.index );
+
+  const auto reg_it = _epoll_registrations.find( fd_num );
+  if ( reg_it == _epoll_registrations.end() ) {
+    return;
+  }
+  auto& rules = reg_it->second.rules;
+  erase_if( rules, [&]( const RuleId& other ) { return other.index == id.index; } );
+
+  if ( not rules.empty() ) {
+    epoll_update( fd_num, reg_it->second );
+    return;
+  }
+
+  // the kernel drops closed fds from the interest list on its own
+  if ( not fd_closed ) {
+    ++_syscalls;
+    CheckSystemCall( "epoll_ctl", ::epoll_ctl( _epoll_fd->fd_num(), EPOLL_CTL_DEL, fd_num, nullptr ) );
+  }
+  _epoll_registrations.erase( reg_it );
+}
+
+void EventLoop::epoll_serve( const RuleId id )
+{
+  FDRule* rule = _fd_rules.find( id );
+  if ( not rule or rule->cancel_requested ) {
+    return;
+  }
+  auto& this_rule = *rule;
+
+  if ( not this_rule.interest() ) {
+    // park it until it is interested again (an edge-triggered rule keeps its readiness)
+    epoll_set_waiting( this_rule, false );
+    _epoll_pending.push_back( id );
+    return;
+  }
+
+  const auto count_before = this_rule.service_count();
+  run( this_rule.callback );
+
+  if ( this_rule.cancel_requested ) {
+    return;
+  }
+
+  if ( this_rule.fd.closed() or ( this_rule.direction == Direction::In and this_rule.fd.eof() ) ) {
+    epoll_remove( id, true );
+    return;
+  }
+
+  const bool made_progress = count_before != this_rule.service_count();
+
+  if ( _trigger == Trigger::Edge ) {
+    if ( not made_progress ) {
+      // the callback hit EAGAIN (or chose not to touch the fd): wait for the next edge
+      this_rule.ready = false;
+      epoll_set_waiting( this_rule, true );
+    } else {
+      // there may be more to do; look at it again on the next call without sleeping
+      epoll_set_waiting( this_rule, false );
+      _epoll_pending.push_back( id );
+    }
+    return;
+  }
+
+  if ( not made_progress and this_rule.interest() ) {
+    throw runtime_error( "EventLoop: busy wait detected: rule \""
+                         + _rule_categories.at( this_rule.category_id ).name
+                         + "\" did not read/write fd and is still interested" );
+  }
+}
+
+// On timeout, catch up on rules that were cancelled, lost interest, or had their fd closed while nothing fired.
+// Returns true if any rule is still waiting on the kernel.
+bool EventLoop::epoll_sweep_uninterested()
+{
+  _epoll_scratch.clear();
+  for ( const auto& [fd_num, registration] : _epoll_registrations ) {
+    for ( const auto& id : registration.rules ) {
+      if ( _fd_rules.find( id )->waiting ) {
+        _epoll_scratch.push_back( id );
+      }
+    }
+  }
+
+  for ( const auto& id : _epoll_scratch ) {
+    FDRule* rule = _fd_rules.find( id );
+    if ( not rule ) {
+      continue;
+    }
+    if ( rule->cancel_requested ) {
+      epoll_remove( id, false );
+    } else if ( rule->fd.closed() or ( rule->direction == Direction::In and rule->fd.eof() ) ) {
+      epoll_remove( id, true );
+    } else if ( not rule->interest() ) {
+      epoll_set_waiting( *rule, false );
+      _epoll_pending.push_back( id );
+    }
+  }
+
+  return _epoll_waiting > 0;
+}
+
+EventLoop::Result EventLoop::wait_next_event_epoll( const int timeout_ms )
+{
+  // re-check the rules that are not waiting on the kernel: new, uninterested, or (edge-triggered) still ready
+  _epoll_scratch.clear();
+  _epoll_scratch.swap( _epoll_pending );
+  _epoll_serve.clear();
+  for ( const auto& id : _epoll_scratch ) {
+    FDRule* rule = _fd_rules.find( id );
+    if ( not rule ) {
+      continue; // already removed
+    }
+
+    if ( rule->cancel_requested ) {
+      epoll_remove( id, false );
+      continue;
+    }
+
+    if ( rule->fd.closed() or ( rule->direction == Direction::In and rule->fd.eof() ) ) {
+      epoll_remove( id, true );
+      continue;
+    }
+
+    if ( not rule->interest() ) {
+      _epoll_pending.push_back( id );
+    } else if ( rule->ready ) {
+      _epoll_serve.push_back( id );
+    } else {
+      epoll_set_waiting( *rule, true );
+    }
+  }
+
+  // quit if there is nothing left to wait for
+  if ( _epoll_serve.empty() and _epoll_waiting == 0 ) {
+    return Result::Exit;
+  }
+
+  // don't sleep if there is already work to do
+  ++_syscalls;
+  const int num_events = CheckSystemCall(
+    "epoll_wait",
+    ::epoll_wait( _epoll_fd->fd_num(),
+                  _epoll_events.data(),
+                  static_cast<int>( _epoll_events.size() ),
+                  _epoll_serve.empty() ? timeout_ms : 0 ) );
+
+  if ( num_events == 0 and _epoll_serve.empty() ) {
+    return epoll_sweep_uninterested() ? Result::Timeout : Result::Exit;
+  }
+
+  // go through the ready fds
+  for ( const auto& event : span( _epoll_events.data(), num_events ) ) {
+    const auto reg_it = _epoll_registrations.find( event.data.fd );
+    if ( reg_it == _epoll_registrations.end() ) {
+      continue;
+    }
+
+    // copy: removing rules modifies the registration
+    _epoll_scratch.assign( reg_it->second.rules.begin(), reg_it->second.rules.end() );
+
+    if ( event.events & EPOLLERR ) {
+      report_fd_error( *_fd_rules.find( _epoll_scratch.front() ) );
+      for ( const auto& id : _epoll_scratch ) {
+        if ( FDRule* rule = _fd_rules.find( id ) ) {
+          rule->error();
+          epoll_remove( id, true );
+        }
+      }
+      continue;
+    }
+
+    for ( const auto& id : _epoll_scratch ) {
+      FDRule* rule = _fd_rules.find( id );
+      if ( not rule ) {
+        continue;
+      }
+
+      if ( rule->cancel_requested ) {
+        epoll_remove( id, false );
+        continue;
+      }
+
+      const auto direction = static_cast<uint32_t>( rule->direction );
+      const bool asked = _trigger == Trigger::Edge or rule->waiting;
+      const bool ready = asked and static_cast<bool>( event.events & direction );
+
+      // see wait_next_event_poll(): a hangup is final for writers, and for readers with nothing left to read
+      if ( ( event.events & EPOLLHUP ) and ( ( asked and not ready ) or rule->direction == Direction::Out ) ) {
+        epoll_remove( id, true );
+        continue;
+      }
+
+      if ( not ready ) {
+        continue;
+      }
+
+      rule->ready = _trigger == Trigger::Edge;
+      if ( rule->waiting ) {
+        _epoll_serve.push_back( id );
+      } // else a parked rule (edge-triggered) picks up its readiness when it is next interested
+    }
+  }
+
+  if ( static_cast<size_t>( num_events ) == _epoll_events.size() ) {
+    _epoll_events.resize( _epoll_events.size() * 2 );
+  }
+
+  // serve every ready rule
+  for ( size_t i = 0; i < _epoll_serve.size(); ++i ) {
+    epoll_serve( _epoll_serve[i] );
+  }
+  _epoll_serve.clear();
+
+  return Result::Success;
+}
+
+uint32_t EventLoop::uring_new_op( const RuleId id, FDRule& rule, const int buffer )
+{
+  uint32_t slot = _uring_ops.size();
+  if ( _uring_free_ops.empty() ) {
+    _uring_ops.emplace_back();
+  } else {
+    slot = _uring_free_ops.back();
+    _uring_free_ops.pop_back();
+  }
+
+  _uring_ops[slot].rule = id;
+  _uring_ops[slot].fd.emplace( rule.fd.duplicate() );
+  _uring_ops[slot].buffer = buffer;
+  rule.in_flight = true;
+  return slot;
+}
+
+void EventLoop::uring_submit( const RuleId id, FDRule& rule )
+{
+  if ( not rule.prefetch ) {
+    _ring->prepare_poll( rule.fd.fd_num(), static_cast<uint32_t>( rule.direction ), uring_new_op( id, rule, -1 ) );
+    return;
+  }
+
+  // one read per fd at a time, so completions can't reorder the data
+  const auto fd_num = static_cast<size_t>( rule.fd.fd_num() );
+  if ( fd_num >= _uring_reading.size() ) {
+    _uring_reading.resize( fd_num + 1 );
+  }
+  if ( _uring_reading[fd_num] or _uring_free_buffers.empty() ) {
+    return;
+  }
+
+  const uint16_t buffer = _uring_free_buffers.back();
+  _uring_free_buffers.pop_back();
+
+  _ring->prepare_read( rule.fd.fd_num(), _uring_buffers.at( buffer ), buffer, uring_new_op( id, rule, buffer ) );
+  _uring_reading[fd_num] = true;
+}
+
+// Retire one completed request. Read data always goes to the FileDescriptor, even if the rule is gone, so that
+// nothing read from the fd is lost. Rules that can now make progress are appended to `ready`.
+void EventLoop::uring_complete( const io_uring_cqe& cqe, vector<RuleId>& ready )
+{
+  auto& op = _uring_ops.at( cqe.user_data );
+  const RuleId id = op.rule;
+  FileDescriptor fd = move( *op.fd );
+  const int buffer = op.buffer;
+  op.fd.reset();
+  _uring_free_ops.push_back( static_cast<uint32_t>( cqe.user_data ) );
+
+  FDRule* rule = _fd_rules.find( id );
+  if ( rule ) {
+    rule->in_flight = false;
+  }
+  const bool live = rule and not rule->cancel_requested;
+
+  if ( buffer >= 0 ) {
+    _uring_reading[fd.fd_num()] = false;
+    _uring_free_buffers.push_back( static_cast<uint16_t>( buffer ) );
+
+    if ( cqe.res >= 0 ) {
+      fd.supply_read( string_view { _uring_buffers.at( buffer ) }.substr( 0, cqe.res ) );
+      if ( live ) {
+        ready.push_back( id );
+      }
+      return;
+    }
+
+    if ( cqe.res == -EAGAIN and live ) {
+      // this kernel won't wait for data on a non-blocking fd: wait for readability, then read synchronously
+      _ring->prepare_poll( fd.fd_num(), POLLIN, uring_new_op( id, *rule, -1 ) );
+      return;
+    }
+  }
+
+  if ( not live or cqe.res == -ECANCELED or cqe.res == -EINTR ) {
+    return;
+  }
+
+  if ( cqe.res < 0 ) {
+    cerr << "error on file descriptor for rule \"" << _rule_categories.at( rule->category_id ).name
+         << "\": " << strerror( -cqe.res ) << "\n";
+    rule->error();
+    rule->cancel();
+    rule->cancel_requested = true; // drop it without calling cancel() again
+    return;
+  }
+
+  // a completed poll: same treatment of errors and hangups as wait_next_event_poll()
+  const auto revents = static_cast<uint32_t>( cqe.res );
+  if ( revents & ( POLLERR | POLLNVAL ) ) {
+    report_fd_error( *rule );
+    rule->error();
+    rule->cancel();
+    rule->cancel_requested = true;
+    return;
+  }
+
+  const auto poll_ready = static_cast<bool>( revents & ( POLLIN | POLLOUT ) );
+  if ( ( revents & POLLHUP ) and ( not poll_ready or rule->direction == Direction::Out ) ) {
+    rule->cancel();
+    rule->cancel_requested = true;
+    return;
+  }
+
+  if ( poll_ready ) {
+    ready.push_back( id );
+  }
+}
+
+EventLoop::Result EventLoop::wait_next_event_uring( const int timeout_ms )
+{
+  _uring_ready.clear();
+  bool something_to_wait_for = false;
+
+  // submit a read or poll for each interested rule that doesn't already have one
+  for ( uint32_t index = 0; index < _fd_rules.slot_count(); ++index ) {
+    FDRule* rule = _fd_rules.at( index );
+    if ( not rule ) {
+      continue;
+    }
+    auto& this_rule = *rule;
+
+    if ( this_rule.cancel_requested ) {
+      remove_fd_rule( index, false );
+      continue;
+    }
+
+    // data (or EOF) that was already read counts as readable
+    const bool supplied = this_rule.direction == Direction::In and this_rule.fd.has_supplied_read();
+
+    if ( ( this_rule.direction == Direction::In and this_rule.fd.eof() and not supplied )
+         or this_rule.fd.closed() ) {
+      remove_fd_rule( index, true );
+      continue;
+    }
 
-    ++it; // if we got here, it means we didn't call _fd_rules.erase()
+    if ( this_rule.interest() ) {
+      something_to_wait_for = true;
+      if ( supplied ) {
+        _uring_ready.push_back( _fd_rules.id( index ) );
+      } else if ( not this_rule.in_flight ) {
+        uring_submit( _fd_rules.id( index ), this_rule );
+      }
+    }
+  }
+
+  // quit if there is nothing left to wait for
+  if ( not something_to_wait_for ) {
+    return Result::Exit;
+  }
+
+  // one system call submits everything and waits for completions (unless there is already work to do)
+  _ring->submit_and_wait( _uring_ready.empty() ? 1 : 0, timeout_ms );
+
+  io_uring_cqe cqe {};
+  while ( _ring->pop_completion( cqe ) ) {
+    uring_complete( cqe, _uring_ready );
+  }
+
+  if ( _uring_ready.empty() ) {
+    return Result::Timeout;
+  }
+
+  // serve every ready rule
+  for ( size_t i = 0; i < _uring_ready.size(); ++i ) {
+    FDRule* rule = _fd_rules.find( _uring_ready[i] );
+    if ( not rule or rule->cancel_requested or not rule->interest() ) {
+      continue;
+    }
+    auto& this_rule = *rule;
+
+    const auto count_before = this_rule.service_count();
+    run( this_rule.callback );
+
+    if ( count_before == this_rule.service_count() and ( not this_rule.fd.closed() ) and this_rule.interest() ) {
+      throw runtime_error( "EventLoop: busy wait detected: rule \""
+                           + _rule_categories.at( this_rule.category_id ).name
+                           + "\" did not read/write fd and is still interested" );
+    }
   }
 
   return Result::Success;
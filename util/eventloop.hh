@@ -1,13 +1,19 @@
 #pragma once
 
-#include <functional>
-#include <list>
+#include <chrono>
+#include <deque>
 #include <memory>
+#include <optional>
 #include <ostream>
 #include <poll.h>
 #include <string_view>
+#include <sys/epoll.h>
+#include <unordered_map>
+#include <vector>
 
 #include "file_descriptor.hh"
+#include "inline_function.hh"
+#include "io_uring.hh"
 
 //! Waits for events on file descriptors and executes corresponding callbacks.
 class EventLoop
@@ -20,9 +26,37 @@ public:
     Out = POLLOUT //!< Callback will be triggered when Rule::fd is writable.
   };
 
+  //! How the EventLoop waits for file descriptors to become ready.
+  enum class Backend
+  {
+    Poll,   //!< Rebuild a [poll(2)](\ref man2::poll) set from every rule on each call; serve one ready rule.
+    Epoll,  //!< Keep persistent [epoll(7)](\ref man7::epoll) registrations; serve every ready rule per call.
+    IOUring //!< Submit reads (and write-readiness polls) through [io_uring(7)](\ref man7::io_uring) in one batch
+            //!< per call; falls back to Backend::Poll if io_uring is unavailable.
+  };
+
+  //! Readiness notification mode used by Backend::Epoll.
+  enum class Trigger
+  {
+    Level, //!< Registered interest follows each rule's interest(); the kernel re-reports fds that stay ready.
+    Edge   //!< Fixed EPOLLET registrations; readiness is remembered until a callback stops making progress.
+  };
+
+  //! Clock used for timer deadlines
+  using Clock = std::chrono::steady_clock;
+
+  //! Returned by each call to EventLoop::wait_next_event.
+  enum class Result
+  {
+    Success, //!< At least one Rule was triggered.
+    Timeout, //!< No rules were triggered before timeout.
+    Exit     //!< All rules have been canceled or were uninterested; make no further calls to
+             //!< EventLoop::wait_next_event.
+  };
+
 private:
-  using CallbackT = std::function<void( void )>;
-  using InterestT = std::function<bool( void )>;
+  using CallbackT = InlineFunction<void( void )>;
+  using InterestT = InlineFunction<bool( void )>;
 
   struct RuleCategory
   {
@@ -51,33 +85,202 @@ private:
     //! Returns the number of times fd has been read or written, depending on the value of Rule::direction.
     //! \details This function is used internally by EventLoop; you will not need to call it
     unsigned int service_count() const;
+
+    //! Backend::Epoll bookkeeping: a rule is either waiting for the kernel to report its fd (and counted in
+    //! EventLoop::_epoll_waiting), or pending, i.e. its interest() is re-checked on every call.
+    bool waiting {};
+    bool ready {}; //!< Trigger::Edge only: readiness was reported and the callback has not yet exhausted it.
+
+    bool in_flight {}; //!< Backend::IOUring: a read or poll for this rule has been submitted and not completed.
+    bool prefetch {};  //!< Backend::IOUring: read on the callback's behalf (the fd is read with plain read()).
   };
 
-  std::vector<RuleCategory> _rule_categories {};
-  std::list<std::shared_ptr<FDRule>> _fd_rules {};
-  std::list<std::shared_ptr<BasicRule>> _non_fd_rules {};
+  struct TimerRule
+  {
+    size_t category_id;
+    Clock::time_point deadline;
+    CallbackT callback;
+    bool cancel_requested {};
 
-public:
-  EventLoop() { _rule_categories.reserve( 64 ); }
+    TimerRule( size_t s_category_id, Clock::time_point s_deadline, CallbackT s_callback );
+  };
 
-  //! Returned by each call to EventLoop::wait_next_event.
-  enum class Result
+  //! Identifies a rule in a SlotArray; stale once the rule is removed (its slot's generation moves on)
+  struct RuleId
   {
-    Success, //!< At least one Rule was triggered.
-    Timeout, //!< No rules were triggered before timeout.
-    Exit     //!< All rules have been canceled or were uninterested; make no further calls to
-             //!< EventLoop::wait_next_event.
+    uint32_t index {};
+    uint32_t generation {};
   };
 
+  //! Rules are kept in reusable slots: adding a rule only allocates when every slot is taken, and a removed
+  //! rule's slot is recycled. A std::deque keeps rules in place while callbacks add more.
+  template<class RuleT>
+  class SlotArray
+  {
+    struct Slot
+    {
+      std::optional<RuleT> rule {};
+      uint32_t generation {};
+    };
+
+    std::deque<Slot> slots_ {};
+    std::vector<uint32_t> free_ {};
+
+  public:
+    template<typename... Targs>
+    RuleId emplace( Targs&&... Fargs )
+    {
+      if ( free_.empty() ) {
+        free_.push_back( static_cast<uint32_t>( slots_.size() ) );
+        slots_.emplace_back();
+      }
+      const uint32_t index = free_.back();
+      free_.pop_back();
+      slots_[index].rule.emplace( std::forward<Targs>( Fargs )... );
+      return { index, slots_[index].generation };
+    }
+
+    //! Removes a rule. Must not be called while the rule's own callbacks are running.
+    void erase( uint32_t index )
+    {
+      slots_[index].rule.reset();
+      ++slots_[index].generation;
+      free_.push_back( index );
+    }
+
+    //! The rule in slot `index`, or nullptr if the slot is free
+    RuleT* at( uint32_t index ) { return slots_[index].rule ? &*slots_[index].rule : nullptr; }
+
+    //! The rule identified by `id`, or nullptr if it has been removed
+    RuleT* find( RuleId id )
+    {
+      return ( id.index < slots_.size() and slots_[id.index].generation == id.generation ) ? at( id.index )
+                                                                                            : nullptr;
+    }
+
+    RuleId id( uint32_t index ) const { return { index, slots_[index].generation }; }
+
+    //! Number of slots (occupied or not), for iterating with at()
+    uint32_t slot_count() const { return static_cast<uint32_t>( slots_.size() ); }
+  };
+
+  //! The rules, shared (weakly) with RuleHandles so that a handle can outlive its EventLoop
+  struct Registry
+  {
+    SlotArray<FDRule> fd_rules {};
+    SlotArray<BasicRule> non_fd_rules {};
+    SlotArray<TimerRule> timers {};
+  };
+
+  enum class RuleKind
+  {
+    FD,
+    NonFD,
+    Timer
+  };
+
+  //! An entry in the timer heap; entries of cancelled timers are dropped when they reach the top
+  struct TimerEntry
+  {
+    Clock::time_point deadline;
+    RuleId id;
+  };
+
+  //! A read or poll submitted to the ring (Backend::IOUring); the index in _uring_ops is the request's user_data
+  struct UringOp
+  {
+    RuleId rule {};
+    std::optional<FileDescriptor> fd {}; //!< read data is delivered here even if the rule is gone
+    int buffer {};                       //!< index of the registered buffer being read into, or -1 for a poll
+  };
+
+  //! All the rules registered on one file descriptor (Backend::Epoll)
+  struct EpollRegistration
+  {
+    uint32_t events {}; //!< event mask currently registered with the kernel
+    std::vector<RuleId> rules {};
+  };
+
+  std::vector<RuleCategory> _rule_categories {};
+  std::shared_ptr<Registry> _registry { std::make_shared<Registry>() };
+  SlotArray<FDRule>& _fd_rules { _registry->fd_rules };
+  SlotArray<BasicRule>& _non_fd_rules { _registry->non_fd_rules };
+  SlotArray<TimerRule>& _timers { _registry->timers };
+  std::vector<TimerEntry> _timer_heap {}; //!< min-heap by deadline
+
+  Backend _backend;
+  Trigger _trigger;
+
+  std::vector<pollfd> _pollfds {};     //!< reused by each call (Backend::Poll)
+  std::vector<uint32_t> _poll_rules {}; //!< the rule behind each entry of _pollfds
+
+  std::optional<FileDescriptor> _epoll_fd {};
+  std::unordered_map<int, EpollRegistration> _epoll_registrations {};
+  std::vector<RuleId> _epoll_pending {}; //!< rules whose interest() is checked on every call
+  std::vector<RuleId> _epoll_scratch {}; //!< reused by each call
+  std::vector<RuleId> _epoll_serve {};   //!< rules to run in the current call
+  std::vector<epoll_event> _epoll_events {};
+  size_t _epoll_waiting {}; //!< number of rules waiting on the kernel
+
+  std::optional<IOUring> _ring {};
+  std::vector<std::string> _uring_buffers {}; //!< registered with the ring; one per in-flight read
+  std::vector<uint16_t> _uring_free_buffers {};
+  std::vector<UringOp> _uring_ops {};
+  std::vector<uint32_t> _uring_free_ops {};
+  std::vector<bool> _uring_reading {};        //!< by fd number: a read is in flight (one each, to keep order)
+  std::vector<RuleId> _uring_ready {};        //!< reused by each call
+
+  uint64_t _syscalls {}; //!< poll, epoll and io_uring system calls made by the loop itself
+
+  bool serve_non_fd_rules();
+  bool serve_timers();
+  std::optional<Clock::time_point> next_timer_deadline();
+  void report_fd_error( const FDRule& rule ) const;
+  void remove_fd_rule( uint32_t index, bool call_cancel );
+  Result wait_next_event_poll( int timeout_ms );
+  Result wait_next_event_epoll( int timeout_ms );
+  void epoll_update( int fd_num, EpollRegistration& registration );
+  void epoll_set_waiting( FDRule& rule, bool waiting );
+  void epoll_remove( RuleId id, bool call_cancel );
+  void epoll_serve( RuleId id );
+  bool epoll_sweep_uninterested();
+  Result wait_next_event_uring( int timeout_ms );
+  uint32_t uring_new_op( RuleId id, FDRule& rule, int buffer );
+  void uring_submit( RuleId id, FDRule& rule );
+  void uring_complete( const io_uring_cqe& cqe, std::vector<RuleId>& ready );
+
+public:
+  //! \param[in] backend selects poll(2) or epoll(7)
+  //! \param[in] trigger selects level- or edge-triggered notification (Backend::Epoll only)
+  explicit EventLoop( Backend backend = Backend::Poll, Trigger trigger = Trigger::Level );
+  ~EventLoop();
+
+  //! The backend in use (Backend::IOUring falls back to Backend::Poll if io_uring is unavailable)
+  Backend backend() const { return _backend; }
+
+  //! Number of system calls the loop has made to wait for events (poll, epoll_*, io_uring_enter); reads and
+  //! writes made by the rules' callbacks are counted by FileDescriptor::syscall_count()
+  uint64_t syscall_count() const;
+
+  // An EventLoop owns its rules (and possibly a ring shared with the kernel), so it cannot be copied or moved
+  EventLoop( const EventLoop& other ) = delete;
+  EventLoop& operator=( const EventLoop& other ) = delete;
+  EventLoop( EventLoop&& other ) = delete;
+  EventLoop& operator=( EventLoop&& other ) = delete;
+
   size_t add_category( const std::string& name );
 
+  //! Identifies a rule so it can be cancelled later; safe to use (as a no-op) after the rule or the EventLoop
+  //! is gone.
   class RuleHandle
   {
-    std::weak_ptr<BasicRule> rule_weak_ptr_;
+    std::weak_ptr<Registry> registry_;
+    RuleId id_;
+    RuleKind kind_;
 
   public:
-    template<class RuleType>
-    explicit RuleHandle( const std::shared_ptr<RuleType> x ) : rule_weak_ptr_( x )
+    RuleHandle( const std::shared_ptr<Registry>& registry, RuleId id, RuleKind kind )
+      : registry_( registry ), id_( id ), kind_( kind )
     {}
 
     void cancel();
@@ -87,17 +290,33 @@ public:
     size_t category_id,
     FileDescriptor& fd,
     Direction direction,
-    const CallbackT& callback,
-    const InterestT& interest = [] { return true; },
-    const CallbackT& cancel = [] {},
-    const CallbackT& error = [] {} );
+    CallbackT callback,
+    InterestT interest = [] { return true; },
+    CallbackT cancel = [] {},
+    CallbackT error = [] {} );
 
   RuleHandle add_rule(
     size_t category_id,
-    const CallbackT& callback,
-    const InterestT& interest = [] { return true; } );
+    CallbackT callback,
+    InterestT interest = [] { return true; } );
+
+  //! Runs `callback` once, from the first call to wait_next_event that finds `deadline` has passed.
+  //! \details Pending timers limit how long wait_next_event sleeps, and keep it from returning Result::Exit.
+  //! Cancelling the returned handle before the deadline means the callback never runs.
+  RuleHandle add_timer( size_t category_id, Clock::time_point deadline, CallbackT callback );
 
-  //! Calls [poll(2)](\ref man2::poll) and then executes callback for each ready fd.
+  //! Waits for file descriptors to become ready and executes their callbacks.
+  //! \details With Backend::Poll, calls [poll(2)](\ref man2::poll) on every rule and serves one ready rule.
+  //! With Backend::Epoll, calls [epoll_wait(2)](\ref man2::epoll_wait) and serves every ready rule; the work per
+  //! call is proportional to the number of ready (or uninterested) rules, not the number of registered rules.
+  //! A rule that is waiting on the kernel only has its interest() re-evaluated when its fd is reported ready
+  //! or when a call times out, so an uninterested (or cancelled) rule may keep Result::Exit from being reported
+  //! until then.
+  //! With Backend::IOUring, interested Direction::In rules on streams, pipes and devices have a read submitted
+  //! on their behalf; when it completes, the data is handed to the FileDescriptor (see
+  //! FileDescriptor::supply_read) and the callback's read() returns it without another system call. Other rules
+  //! (writers, datagram and listening sockets) wait on a submitted poll. Every ready rule is served per call.
+  //! Due timers are run before waiting, and again after waiting; the wait ends by the next timer's deadline.
   Result wait_next_event( int timeout_ms );
 
   // convenience function to add category and rule at the same time
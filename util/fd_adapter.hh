@@ -21,6 +21,9 @@ protected:
   FdAdapterConfig& config_mutable() { return _cfg; }
 
 public:
+  //! Most datagrams moved by one call to read_batch()
+  static constexpr size_t kMaxBatch = 32;
+
   //! \brief Set the listening flag
   //! \param[in] l is the new value for the flag
   void set_listening( const bool l ) { _listen = l; }
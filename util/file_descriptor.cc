@@ -79,6 +79,41 @@ FileDescriptor FileDescriptor::duplicate() const
   return FileDescriptor { internal_fd_ };
 }
 
+void FileDescriptor::supply_read( string_view data )
+{
+  if ( data.empty() ) {
+    internal_fd_->supplied_eof_ = true;
+  } else {
+    internal_fd_->supplied_.append( data );
+  }
+}
+
+// Copy as much supplied data as fits into `buffer`; returns the number of bytes copied (0 at a supplied EOF)
+size_t FileDescriptor::take_supplied( string& buffer )
+{
+  auto& supplied = internal_fd_->supplied_;
+  if ( not supplied.empty() and buffer.size() >= supplied.size() ) {
+    swap( buffer, supplied ); // everything fits: hand over the string rather than copying it
+    supplied.clear();
+    return buffer.size();
+  }
+  return take_supplied( span<char> { buffer } );
+}
+
+size_t FileDescriptor::take_supplied( span<char> buffer )
+{
+  auto& supplied = internal_fd_->supplied_;
+  const size_t n = min( buffer.size(), supplied.size() );
+  supplied.copy( buffer.data(), n );
+  supplied.erase( 0, n );
+
+  if ( n == 0 and internal_fd_->supplied_eof_ ) {
+    internal_fd_->supplied_eof_ = false;
+    internal_fd_->eof_ = true;
+  }
+  return n;
+}
+
 // buffer is the string to be read into
 void FileDescriptor::read( string& buffer )
 {
@@ -86,6 +121,13 @@ void FileDescriptor::read( string& buffer )
     buffer.resize( kReadBufferSize );
   }
 
+  if ( has_supplied_read() ) {
+    buffer.resize( take_supplied( buffer ) );
+    register_read();
+    return;
+  }
+
+  ++internal_fd_->syscall_count_;
   const ssize_t bytes_read = ::read( fd_num(), buffer.data(), buffer.size() );
   if ( bytes_read < 0 ) {
     if ( internal_fd_->non_blocking_ and ( errno == EAGAIN or errno == EINPROGRESS ) ) {
@@ -117,6 +159,15 @@ void FileDescriptor::read( vector<string>& buffers )
   buffers.back().clear();
   buffers.back().resize( kReadBufferSize );
 
+  if ( has_supplied_read() ) {
+    // fill the buffers in order, as readv() would
+    for ( auto& buf : buffers ) {
+      buf.resize( take_supplied( buf ) );
+    }
+    register_read();
+    return;
+  }
+
   vector<iovec> iovecs;
   iovecs.reserve( buffers.size() );
   size_t total_size = 0;
@@ -125,6 +176,7 @@ void FileDescriptor::read( vector<string>& buffers )
     total_size += x.size();
   }
 
+  ++internal_fd_->syscall_count_;
   const ssize_t bytes_read = ::readv( fd_num(), iovecs.data(), static_cast<int>( iovecs.size() ) );
   if ( bytes_read < 0 ) {
     if ( internal_fd_->non_blocking_ and ( errno == EAGAIN or errno == EINPROGRESS ) ) {
@@ -151,19 +203,46 @@ void FileDescriptor::read( vector<string>& buffers )
   }
 }
 
+size_t FileDescriptor::read( span<char> buffer )
+{
+  if ( has_supplied_read() ) {
+    register_read();
+    return take_supplied( buffer );
+  }
+
+  ++internal_fd_->syscall_count_;
+  const ssize_t bytes_read = ::read( fd_num(), buffer.data(), buffer.size() );
+  if ( bytes_read < 0 ) {
+    if ( internal_fd_->non_blocking_ and ( errno == EAGAIN or errno == EINPROGRESS ) ) {
+      return 0;
+    }
+    throw unix_error { "read" };
+  }
+
+  register_read();
+
+  if ( bytes_read == 0 ) {
+    internal_fd_->eof_ = true;
+  }
+  return bytes_read;
+}
+
 size_t FileDescriptor::write( string_view buffer )
 {
-  return write( vector<string_view> { buffer } );
+  iovec single { const_cast<char*>( buffer.data() ), buffer.size() }; // NOLINT(*-const-cast)
+  return write_iovecs( &single, 1, buffer.size() );
 }
 
 size_t FileDescriptor::write( const vector<std::string>& buffers )
 {
-  vector<string_view> views;
-  views.reserve( buffers.size() );
+  vector<iovec> iovecs;
+  iovecs.reserve( buffers.size() );
+  size_t total_size = 0;
   for ( const auto& x : buffers ) {
-    views.push_back( x );
+    iovecs.push_back( { const_cast<char*>( x.data() ), x.size() } ); // NOLINT(*-const-cast)
+    total_size += x.size();
   }
-  return write( views );
+  return write_iovecs( iovecs.data(), iovecs.size(), total_size );
 }
 
 size_t FileDescriptor::write( const vector<string_view>& buffers )
@@ -175,15 +254,24 @@ size_t FileDescriptor::write( const vector<string_view>& buffers )
     iovecs.push_back( { const_cast<char*>( x.data() ), x.size() } ); // NOLINT(*-const-cast)
     total_size += x.size();
   }
+  return write_iovecs( iovecs.data(), iovecs.size(), total_size );
+}
 
+size_t FileDescriptor::write_iovecs( const iovec* iovecs, const size_t count, const size_t total_size )
+{
+  ++internal_fd_->syscall_count_;
   const ssize_t bytes_written
-    = CheckSystemCall( "writev", ::writev( fd_num(), iovecs.data(), static_cast<int>( iovecs.size() ) ) );
-  register_write();
+    = CheckSystemCall( "writev", ::writev( fd_num(), iovecs, static_cast<int>( count ) ) );
 
   if ( bytes_written == 0 and total_size != 0 ) {
+    if ( internal_fd_->non_blocking_ ) {
+      return 0; // EAGAIN: not writable right now, and not counted as a write
+    }
     throw runtime_error( "write returned 0 given non-empty input buffer" );
   }
 
+  register_write();
+
   if ( bytes_written > static_cast<ssize_t>( total_size ) ) {
     throw runtime_error( "write wrote more than length of input buffer" );
   }
@@ -3,8 +3,13 @@
 #include <cstddef>
 #include <limits>
 #include <memory>
+#include <span>
+#include <string>
+#include <string_view>
 #include <vector>
 
+struct iovec;
+
 // A reference-counted handle to a file descriptor
 class FileDescriptor
 {
@@ -13,12 +18,15 @@ class FileDescriptor
   class FDWrapper
   {
   public:
-    int fd_;                    // The file descriptor number returned by the kernel
-    bool eof_ = false;          // Flag indicating whether FDWrapper::fd_ is at EOF
-    bool closed_ = false;       // Flag indicating whether FDWrapper::fd_ has been closed
-    bool non_blocking_ = false; // Flag indicating whether FDWrapper::fd_ is non-blocking
-    unsigned read_count_ = 0;   // The number of times FDWrapper::fd_ has been read
-    unsigned write_count_ = 0;  // The numberof times FDWrapper::fd_ has been written
+    int fd_;                     // The file descriptor number returned by the kernel
+    bool eof_ = false;           // Flag indicating whether FDWrapper::fd_ is at EOF
+    bool closed_ = false;        // Flag indicating whether FDWrapper::fd_ has been closed
+    bool non_blocking_ = false;  // Flag indicating whether FDWrapper::fd_ is non-blocking
+    unsigned read_count_ = 0;    // The number of times FDWrapper::fd_ has been read
+    unsigned write_count_ = 0;   // The numberof times FDWrapper::fd_ has been written
+    unsigned syscall_count_ = 0; // The number of read/write system calls issued on FDWrapper::fd_
+    std::string supplied_ {};    // Data already read from FDWrapper::fd_ on our behalf (e.g. by io_uring)
+    bool supplied_eof_ = false;  // Whether the read that filled supplied_ reached EOF
 
     // Construct from a file descriptor number returned by the kernel
     explicit FDWrapper( int fd );
@@ -48,8 +56,16 @@ protected:
   static constexpr size_t kReadBufferSize = 16384;
 
   void set_eof() { internal_fd_->eof_ = true; }
-  void register_read() { ++internal_fd_->read_count_; }   // increment read count
-  void register_write() { ++internal_fd_->write_count_; } // increment write count
+  void register_read() { ++internal_fd_->read_count_; }       // increment read count
+  void register_write() { ++internal_fd_->write_count_; }     // increment write count
+  void register_syscall() { ++internal_fd_->syscall_count_; } // count a read/write system call
+
+  // hand out data from supply_read()
+  size_t take_supplied( std::string& buffer );
+  size_t take_supplied( std::span<char> buffer );
+
+  // Write `count` buffers (`total_size` bytes in all) with one system call; shared by the write() overloads
+  size_t write_iovecs( const iovec* iovecs, size_t count, size_t total_size );
 
   template<typename T>
   T CheckSystemCall( std::string_view s_attempt, T return_value ) const;
@@ -65,12 +81,21 @@ public:
   void read( std::string& buffer );
   void read( std::vector<std::string>& buffers );
 
+  // Read into `buffer` without resizing it (e.g. a buffer reused for every datagram); returns the number of
+  // bytes read, which is 0 at EOF or if a non-blocking fd has nothing to read
+  size_t read( std::span<char> buffer );
+
   // Attempt to write a buffer
-  // returns number of bytes written
+  // returns number of bytes written (0 if a non-blocking fd is not currently writable)
   size_t write( std::string_view buffer );
   size_t write( const std::vector<std::string_view>& buffers );
   size_t write( const std::vector<std::string>& buffers );
 
+  // Hand the fd data (or EOF, if `data` is empty) that was read asynchronously; the next read() returns it
+  // before issuing another system call
+  void supply_read( std::string_view data );
+  bool has_supplied_read() const { return not internal_fd_->supplied_.empty() or internal_fd_->supplied_eof_; }
+
   // Close the underlying file descriptor
   void close() { internal_fd_->close(); }
 
@@ -84,11 +109,12 @@ public:
   off_t size() const;
 
   // FDWrapper accessors
-  int fd_num() const { return internal_fd_->fd_; }                        // underlying descriptor number
-  bool eof() const { return internal_fd_->eof_; }                         // EOF flag state
-  bool closed() const { return internal_fd_->closed_; }                   // closed flag state
-  unsigned int read_count() const { return internal_fd_->read_count_; }   // number of reads
-  unsigned int write_count() const { return internal_fd_->write_count_; } // number of writes
+  int fd_num() const { return internal_fd_->fd_; }                            // underlying descriptor number
+  bool eof() const { return internal_fd_->eof_; }                             // EOF flag state
+  bool closed() const { return internal_fd_->closed_; }                       // closed flag state
+  unsigned int read_count() const { return internal_fd_->read_count_; }       // number of reads
+  unsigned int write_count() const { return internal_fd_->write_count_; }     // number of writes
+  unsigned int syscall_count() const { return internal_fd_->syscall_count_; } // number of read/write syscalls
 
   // Copy/move constructor/assignment operators
   // FileDescriptor can be moved, but cannot be copied implicitly (see duplicate())
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+//! The addresses and ports that identify a TCP connection, seen from our end (host byte order)
+struct FourTuple
+{
+  uint32_t local_address {};
+  uint32_t remote_address {};
+  uint16_t local_port {};
+  uint16_t remote_port {};
+
+  bool operator==( const FourTuple& other ) const = default;
+
+  //! A hash that is the same in both directions, so a datagram and its reply hash alike.
+  //! \details TunQueues steers incoming datagrams with the same function (computed in BPF), so keep them in
+  //! step: xor of the addresses and ports, then a multiplicative mix.
+  uint32_t flow_hash() const
+  {
+    uint32_t x = local_address ^ remote_address ^ local_port ^ remote_port;
+    x *= 0x9E3779B1U;
+    return x ^ ( x >> 16 );
+  }
+};
+
+//! Hash a FourTuple (for unordered containers)
+struct FourTupleHash
+{
+  size_t operator()( const FourTuple& tuple ) const { return tuple.flow_hash(); }
+};
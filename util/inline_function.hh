@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+//! A move-only replacement for std::function that stores callables of up to `Capacity` bytes inline.
+//! \details Lambdas that capture a handful of references (the common case for EventLoop rules) are stored in the
+//! object itself, so constructing, moving and calling an InlineFunction never allocates. Larger callables are
+//! kept on the heap, as std::function would.
+template<typename Signature, size_t Capacity = 48>
+class InlineFunction;
+
+template<typename R, typename... Args, size_t Capacity>
+class InlineFunction<R( Args... ), Capacity>
+{
+  enum class Operation
+  {
+    Move,   // move-construct *self from *other, then destroy *other
+    Destroy // destroy *self
+  };
+
+  using InvokeT = R ( * )( void* self, Args&&... args );
+  using ManageT = void ( * )( Operation operation, void* self, void* other );
+
+  alignas( std::max_align_t ) std::byte storage_[Capacity] {}; // NOLINT(*-avoid-c-arrays)
+  InvokeT invoke_ {};
+  ManageT manage_ {};
+
+  template<typename F>
+  static constexpr bool stored_inline = sizeof( F ) <= Capacity and alignof( F ) <= alignof( std::max_align_t )
+                                        and std::is_nothrow_move_constructible_v<F>;
+
+  void reset()
+  {
+    if ( manage_ ) {
+      manage_( Operation::Destroy, storage_, nullptr );
+    }
+    invoke_ = nullptr;
+    manage_ = nullptr;
+  }
+
+  void take( InlineFunction& other ) noexcept
+  {
+    if ( other.manage_ ) {
+      other.manage_( Operation::Move, storage_, other.storage_ );
+    }
+    invoke_ = std::exchange( other.invoke_, nullptr );
+    manage_ = std::exchange( other.manage_, nullptr );
+  }
+
+public:
+  InlineFunction() = default;
+
+  //! Wrap any callable with a compatible signature (implicitly, like std::function)
+  template<typename F>
+  requires( not std::is_same_v<std::decay_t<F>, InlineFunction>
+            and std::is_invocable_r_v<R, std::decay_t<F>&, Args...> )
+  InlineFunction( F&& f ) // NOLINT(*-explicit-*)
+  {
+    using Fn = std::decay_t<F>;
+
+    if constexpr ( stored_inline<Fn> ) {
+      ::new ( storage_ ) Fn( std::forward<F>( f ) );
+      invoke_ = []( void* self, Args&&... args ) -> R {
+        return std::invoke( *static_cast<Fn*>( self ), std::forward<Args>( args )... );
+      };
+      manage_ = []( Operation operation, void* self, void* other ) {
+        if ( operation == Operation::Move ) {
+          ::new ( self ) Fn( std::move( *static_cast<Fn*>( other ) ) );
+          static_cast<Fn*>( other )->~Fn();
+        } else {
+          static_cast<Fn*>( self )->~Fn();
+        }
+      };
+    } else {
+      // too big to store inline: keep the pointer inline instead
+      ::new ( storage_ ) Fn*( new Fn( std::forward<F>( f ) ) );
+      invoke_ = []( void* self, Args&&... args ) -> R {
+        return std::invoke( **static_cast<Fn**>( self ), std::forward<Args>( args )... );
+      };
+      manage_ = []( Operation operation, void* self, void* other ) {
+        if ( operation == Operation::Move ) {
+          *static_cast<Fn**>( self ) = *static_cast<Fn**>( other );
+        } else {
+          delete *static_cast<Fn**>( self ); // NOLINT(*-owning-memory)
+        }
+      };
+    }
+  }
+
+  InlineFunction( InlineFunction&& other ) noexcept { take( other ); }
+
+  InlineFunction& operator=( InlineFunction&& other ) noexcept
+  {
+    if ( this != &other ) {
+      reset();
+      take( other );
+    }
+    return *this;
+  }
+
+  ~InlineFunction() { reset(); }
+
+  // Callables may hold references to state they must not share, so an InlineFunction cannot be copied
+  InlineFunction( const InlineFunction& other ) = delete;
+  InlineFunction& operator=( const InlineFunction& other ) = delete;
+
+  explicit operator bool() const { return invoke_ != nullptr; }
+
+  R operator()( Args... args ) { return invoke_( storage_, std::forward<Args>( args )... ); }
+};
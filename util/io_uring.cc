@@ -0,0 +1,184 @@
+#include "io_uring.hh"
+#include "exception.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <ctime>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+int io_uring_setup( unsigned entries, io_uring_params& params )
+{
+  return static_cast<int>( ::syscall( __NR_io_uring_setup, entries, &params ) ); // NOLINT(*-vararg)
+}
+
+template<typename T>
+T* at_offset( void* base, uint32_t offset )
+{
+  return reinterpret_cast<T*>( static_cast<char*>( base ) + offset ); // NOLINT(*-reinterpret-cast)
+}
+} // namespace
+
+IOUring::IOUring( const unsigned entries )
+  : ring_fd_( CheckSystemCall( "io_uring_setup", io_uring_setup( entries, params_ ) ) )
+{
+  if ( not( params_.features & IORING_FEAT_SINGLE_MMAP ) ) {
+    throw runtime_error( "io_uring: kernel lacks IORING_FEAT_SINGLE_MMAP" );
+  }
+
+  ring_size_ = max( params_.sq_off.array + params_.sq_entries * sizeof( unsigned ),
+                    params_.cq_off.cqes + params_.cq_entries * sizeof( io_uring_cqe ) );
+  ring_ = ::mmap(
+    nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_.fd_num(), IORING_OFF_SQ_RING );
+  if ( ring_ == MAP_FAILED ) {
+    throw unix_error( "mmap io_uring rings" );
+  }
+
+  void* sqes = ::mmap( nullptr,
+                       params_.sq_entries * sizeof( io_uring_sqe ),
+                       PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE,
+                       ring_fd_.fd_num(),
+                       IORING_OFF_SQES );
+  if ( sqes == MAP_FAILED ) {
+    ::munmap( ring_, ring_size_ );
+    throw unix_error( "mmap io_uring sqes" );
+  }
+
+  sqes_ = static_cast<io_uring_sqe*>( sqes );
+  sq_head_ = at_offset<unsigned>( ring_, params_.sq_off.head );
+  sq_tail_ = at_offset<unsigned>( ring_, params_.sq_off.tail );
+  sq_array_ = at_offset<unsigned>( ring_, params_.sq_off.array );
+  cq_head_ = at_offset<unsigned>( ring_, params_.cq_off.head );
+  cq_tail_ = at_offset<unsigned>( ring_, params_.cq_off.tail );
+  cqes_ = at_offset<io_uring_cqe>( ring_, params_.cq_off.cqes );
+  sqe_tail_ = *sq_tail_;
+}
+
+IOUring::~IOUring()
+{
+  ::munmap( sqes_, params_.sq_entries * sizeof( io_uring_sqe ) );
+  ::munmap( ring_, ring_size_ );
+}
+
+bool IOUring::available()
+{
+  static const bool supported = [] {
+    io_uring_params params {};
+    const int fd = io_uring_setup( 1, params );
+    if ( fd < 0 ) {
+      return false;
+    }
+    ::close( fd );
+    return static_cast<bool>( params.features & IORING_FEAT_SINGLE_MMAP );
+  }();
+  return supported;
+}
+
+bool IOUring::register_buffers( const span<const iovec> buffers )
+{
+  buffers_registered_ = ::syscall( __NR_io_uring_register, // NOLINT(*-vararg)
+                                   ring_fd_.fd_num(),
+                                   IORING_REGISTER_BUFFERS,
+                                   buffers.data(),
+                                   static_cast<unsigned>( buffers.size() ) )
+                        == 0;
+  return buffers_registered_;
+}
+
+io_uring_sqe& IOUring::next_sqe()
+{
+  if ( sqe_tail_ - atomic_ref( *sq_head_ ).load( memory_order_acquire ) >= params_.sq_entries ) {
+    submit_and_wait( 0, 0 );
+  }
+
+  const unsigned index = sqe_tail_ & ( params_.sq_entries - 1 );
+  sq_array_[index] = index; // NOLINT(*-pointer-arithmetic)
+  ++sqe_tail_;
+
+  io_uring_sqe& sqe = sqes_[index]; // NOLINT(*-pointer-arithmetic)
+  sqe = {};
+  return sqe;
+}
+
+void IOUring::prepare_read( const int fd,
+                            const span<char> buffer,
+                            const uint16_t buffer_index,
+                            const uint64_t user_data )
+{
+  io_uring_sqe& sqe = next_sqe();
+  sqe.opcode = buffers_registered_ ? IORING_OP_READ_FIXED : IORING_OP_READ;
+  sqe.fd = fd;
+  sqe.addr = reinterpret_cast<uint64_t>( buffer.data() ); // NOLINT(*-reinterpret-cast)
+  sqe.len = static_cast<uint32_t>( buffer.size() );
+  sqe.off = static_cast<uint64_t>( -1 ); // use (and advance) the file position, like read(2)
+  sqe.buf_index = buffer_index;
+  sqe.user_data = user_data;
+}
+
+void IOUring::prepare_poll( const int fd, const uint32_t poll_mask, const uint64_t user_data )
+{
+  io_uring_sqe& sqe = next_sqe();
+  sqe.opcode = IORING_OP_POLL_ADD;
+  sqe.fd = fd;
+  sqe.poll32_events = poll_mask;
+  sqe.user_data = user_data;
+}
+
+void IOUring::prepare_cancel( const uint64_t target, const uint64_t user_data )
+{
+  io_uring_sqe& sqe = next_sqe();
+  sqe.opcode = IORING_OP_ASYNC_CANCEL;
+  sqe.fd = -1;
+  sqe.addr = target;
+  sqe.user_data = user_data;
+}
+
+unsigned IOUring::submit_and_wait( const unsigned wait_nr, const int timeout_ms )
+{
+  atomic_ref( *sq_tail_ ).store( sqe_tail_, memory_order_release );
+  const unsigned to_submit = sqe_tail_ - atomic_ref( *sq_head_ ).load( memory_order_acquire );
+
+  unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+  __kernel_timespec timeout { timeout_ms / 1000, ( timeout_ms % 1000 ) * 1000000L };
+  io_uring_getevents_arg arg {};
+  arg.sigmask_sz = _NSIG / 8;
+  arg.ts = reinterpret_cast<uint64_t>( &timeout ); // NOLINT(*-reinterpret-cast)
+  const bool use_timeout = wait_nr > 0 and timeout_ms >= 0;
+  if ( use_timeout ) {
+    flags |= IORING_ENTER_EXT_ARG;
+  }
+
+  if ( to_submit > 0 or wait_nr > 0 ) {
+    ++syscall_count_;
+    const long ret = ::syscall( __NR_io_uring_enter, // NOLINT(*-vararg)
+                                ring_fd_.fd_num(),
+                                to_submit,
+                                wait_nr,
+                                flags,
+                                use_timeout ? &arg : nullptr,
+                                use_timeout ? sizeof( arg ) : 0 );
+    if ( ret < 0 and errno != ETIME and errno != EINTR ) {
+      throw unix_error( "io_uring_enter" );
+    }
+  }
+
+  return atomic_ref( *cq_tail_ ).load( memory_order_acquire ) - *cq_head_;
+}
+
+bool IOUring::pop_completion( io_uring_cqe& cqe )
+{
+  const unsigned head = *cq_head_;
+  if ( head == atomic_ref( *cq_tail_ ).load( memory_order_acquire ) ) {
+    return false;
+  }
+
+  cqe = cqes_[head & ( params_.cq_entries - 1 )]; // NOLINT(*-pointer-arithmetic)
+  atomic_ref( *cq_head_ ).store( head + 1, memory_order_release );
+  return true;
+}
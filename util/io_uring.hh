@@ -0,0 +1,67 @@
+#pragma once
+
+#include "file_descriptor.hh"
+
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <span>
+#include <sys/uio.h>
+
+//! A minimal [io_uring(7)](\ref man7::io_uring) instance, driven with raw system calls.
+//! \details Submission queue entries are batched in user space and handed to the kernel by the next call to
+//! IOUring::submit_and_wait, which can also wait for completions in the same system call.
+class IOUring
+{
+  io_uring_params params_ {};
+  FileDescriptor ring_fd_;
+
+  void* ring_ {};              // the submission and completion rings (one mapping, IORING_FEAT_SINGLE_MMAP)
+  size_t ring_size_ {};        // size of ring_
+  io_uring_sqe* sqes_ {};      // the submission queue entries
+  unsigned* sq_head_ {};       // advanced by the kernel as it consumes entries
+  unsigned* sq_tail_ {};       // advanced by us to publish entries
+  unsigned* sq_array_ {};      // indirection from ring slot to entry
+  unsigned* cq_head_ {};       // advanced by us as we consume completions
+  unsigned* cq_tail_ {};       // advanced by the kernel to publish completions
+  io_uring_cqe* cqes_ {};      // the completion queue entries
+  unsigned sqe_tail_ {};       // entries handed out by next_sqe(), not yet published
+  bool buffers_registered_ {}; // whether register_buffers() succeeded
+  uint64_t syscall_count_ {};  // number of io_uring_enter calls
+
+public:
+  //! \param[in] entries is the requested size of the submission queue
+  explicit IOUring( unsigned entries );
+  ~IOUring();
+
+  //! Returns true if the kernel supports io_uring (and the process is allowed to use it)
+  static bool available();
+
+  //! Registers fixed buffers for IORING_OP_READ_FIXED; returns false if the kernel refused (e.g. memlock limit)
+  bool register_buffers( std::span<const iovec> buffers );
+  bool buffers_registered() const { return buffers_registered_; }
+
+  //! Returns a zeroed submission queue entry, flushing the queue to the kernel first if it is full
+  io_uring_sqe& next_sqe();
+
+  //! Read into `buffer` (registered buffer `buffer_index`, if buffers are registered)
+  void prepare_read( int fd, std::span<char> buffer, uint16_t buffer_index, uint64_t user_data );
+  //! One-shot [poll(2)](\ref man2::poll) for `poll_mask`
+  void prepare_poll( int fd, uint32_t poll_mask, uint64_t user_data );
+  //! Cancel the request identified by `target`
+  void prepare_cancel( uint64_t target, uint64_t user_data );
+
+  //! Submits all prepared entries and waits for at least `wait_nr` completions, or until `timeout_ms` elapses
+  //! (-1 waits forever). Returns the number of completions available.
+  unsigned submit_and_wait( unsigned wait_nr, int timeout_ms );
+
+  //! Pops the oldest completion into `cqe`; returns false if there is none
+  bool pop_completion( io_uring_cqe& cqe );
+
+  uint64_t syscall_count() const { return syscall_count_; }
+
+  // An IOUring owns memory shared with the kernel, so it cannot be copied or moved
+  IOUring( const IOUring& other ) = delete;
+  IOUring& operator=( const IOUring& other ) = delete;
+  IOUring( IOUring&& other ) = delete;
+  IOUring& operator=( IOUring&& other ) = delete;
+};
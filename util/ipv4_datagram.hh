@@ -13,6 +13,16 @@ struct IPv4Datagram
   IPv4Header header {};
   std::vector<std::string> payload {};
 
+  //! Bytes in the payload buffers (which header.payload_length() should agree with)
+  size_t payload_size() const
+  {
+    size_t size = 0;
+    for ( const auto& x : payload ) {
+      size += x.size();
+    }
+    return size;
+  }
+
   void parse( Parser& parser )
   {
     header.parse( parser );
@@ -26,6 +36,18 @@ struct IPv4Datagram
       serializer.buffer( x );
     }
   }
+
+  //! Serialize the header and move (not copy) the payload buffers in after it; leaves the payload empty
+  std::vector<std::string> release_serialized()
+  {
+    Serializer serializer;
+    header.serialize( serializer );
+    for ( auto& x : payload ) {
+      serializer.buffer( std::move( x ) );
+    }
+    payload.clear();
+    return serializer.release();
+  }
 };
 
 using InternetDatagram = IPv4Datagram;
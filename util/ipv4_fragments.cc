@@ -0,0 +1,260 @@
+#include "ipv4_fragments.hh"
+#include "packet_pool.hh"
+
+#include <algorithm>
+#include <functional>
+
+using namespace std;
+
+namespace {
+constexpr size_t BLOCK_SIZE = 8;                                             // offsets count 8-byte blocks
+constexpr size_t MAX_PAYLOAD = UINT16_MAX - IPv4Header::LENGTH;              // the most a datagram can carry
+
+// Copy `len` bytes of `payload`, starting `pos` bytes in, to `out`
+void copy_payload( const vector<string>& payload, size_t pos, size_t len, char* out )
+{
+  for ( const auto& buffer : payload ) {
+    if ( len == 0 ) {
+      return;
+    }
+    if ( pos >= buffer.size() ) {
+      pos -= buffer.size();
+      continue;
+    }
+    const size_t n = min( len, buffer.size() - pos );
+    out = copy_n( buffer.data() + pos, n, out );
+    pos = 0;
+    len -= n;
+  }
+}
+
+bool test_block( const vector<uint64_t>& blocks, const size_t block )
+{
+  return block / 64 < blocks.size() and ( ( blocks[block / 64] >> ( block % 64 ) ) & 1U );
+}
+} // namespace
+
+bool fragment_datagram( const InternetDatagram& dgram, const size_t mtu, vector<InternetDatagram>& fragments )
+{
+  const size_t size = dgram.payload_size();
+  if ( IPv4Header::LENGTH + size <= mtu ) {
+    fragments.push_back( dgram );
+    return true;
+  }
+
+  const size_t max_chunk = mtu > IPv4Header::LENGTH ? ( mtu - IPv4Header::LENGTH ) / BLOCK_SIZE * BLOCK_SIZE : 0;
+  if ( dgram.header.df or max_chunk == 0 ) {
+    return false;
+  }
+
+  for ( size_t pos = 0; pos < size; pos += max_chunk ) {
+    const size_t chunk = min( max_chunk, size - pos );
+
+    InternetDatagram& fragment = fragments.emplace_back();
+    fragment.header = dgram.header;
+    fragment.header.hlen = IPv4Header::LENGTH / 4;
+    fragment.header.len = IPv4Header::LENGTH + chunk;
+    fragment.header.offset = dgram.header.offset + pos / BLOCK_SIZE; // (the datagram may be a fragment itself)
+    fragment.header.mf = pos + chunk < size or dgram.header.mf;
+    fragment.header.compute_checksum();
+
+    string piece = packet_pool::take_string();
+    piece.resize( chunk );
+    copy_payload( dgram.payload, pos, chunk, piece.data() );
+    fragment.payload = packet_pool::take_buffers();
+    fragment.payload.push_back( move( piece ) );
+  }
+  return true;
+}
+
+size_t IPv4FragmentReassembler::KeyHash::operator()( const Key& key ) const
+{
+  const uint64_t addresses = static_cast<uint64_t>( key.src ) << 32U | key.dst;
+  const uint32_t rest = static_cast<uint32_t>( key.id ) << 8U | key.proto;
+  return hash<uint64_t> {}( addresses ) ^ ( hash<uint32_t> {}( rest ) * 0x9e3779b97f4a7c15ULL );
+}
+
+optional<InternetDatagram> IPv4FragmentReassembler::add( InternetDatagram&& dgram, const uint64_t now_ms )
+{
+  expire( now_ms );
+
+  const IPv4Header& header = dgram.header;
+  if ( not header.mf and header.offset == 0 ) {
+    return move( dgram ); // not a fragment
+  }
+  ++stats_.fragments;
+
+  const size_t size = dgram.payload_size();
+  const size_t begin = static_cast<size_t>( header.offset ) * BLOCK_SIZE;
+  const size_t end = begin + size;
+  if ( size == 0 or end > MAX_PAYLOAD or ( header.mf and size % BLOCK_SIZE ) ) {
+    ++stats_.malformed; // (only the last fragment may end part way through a block)
+    return {};
+  }
+
+  const Key key { header.src, header.dst, header.id, header.proto };
+  auto it = partials_.find( key );
+  if ( it == partials_.end() ) {
+    if ( not make_room( ENTRY_OVERHEAD, key ) ) {
+      ++stats_.evicted;
+      return {};
+    }
+    it = partials_.try_emplace( key ).first;
+    it->second.started_ms = now_ms;
+    deadlines_.emplace_back( now_ms + config_.timeout_ms, key );
+    memory_used_ += ENTRY_OVERHEAD;
+  }
+  Partial& partial = it->second;
+
+  // is the fragment consistent with the datagram's length, if that is known?
+  const bool past_end = partial.total_length and end > *partial.total_length;
+  const bool conflicting_end
+    = not header.mf and ( ( partial.total_length and end != *partial.total_length ) or end < partial.bytes.size() );
+  if ( past_end or conflicting_end ) {
+    ++stats_.malformed;
+    discard( it );
+    return {};
+  }
+
+  // which of its blocks have arrived already?
+  const size_t first_block = begin / BLOCK_SIZE;
+  const size_t last_block = ( end + BLOCK_SIZE - 1 ) / BLOCK_SIZE;
+  size_t already = 0;
+  for ( size_t block = first_block; block < last_block; ++block ) {
+    already += test_block( partial.blocks, block );
+  }
+
+  if ( already > 0 ) {
+    // an exact duplicate (e.g. a fragment duplicated in the network) changes nothing
+    string piece( size, 0 );
+    copy_payload( dgram.payload, 0, size, piece.data() );
+    const bool duplicate = already == last_block - first_block and end <= partial.bytes.size()
+                           and string_view { partial.bytes }.substr( begin, size ) == piece;
+    if ( duplicate ) {
+      return {};
+    }
+    ++stats_.overlaps;
+    if ( config_.overlap == FragmentOverlapPolicy::DropDatagram ) {
+      discard( it );
+      return {};
+    }
+  }
+
+  // the bitmap, like the buffer, grows to the furthest fragment so far
+  const size_t bitmap_words = ( last_block + 63 ) / 64;
+  if ( end > partial.bytes.size() or bitmap_words > partial.blocks.size() ) {
+    const size_t growth = ( end > partial.bytes.size() ? end - partial.bytes.size() : 0 )
+                          + ( bitmap_words > partial.blocks.size() ? bitmap_words - partial.blocks.size() : 0 )
+                              * sizeof( uint64_t );
+    if ( not make_room( growth, key ) ) {
+      ++stats_.evicted;
+      discard( it );
+      return {};
+    }
+    partial.bytes.resize( max( end, partial.bytes.size() ) );
+    partial.blocks.resize( max( bitmap_words, partial.blocks.size() ) );
+    memory_used_ += growth;
+  }
+
+  if ( already > 0 and config_.overlap == FragmentOverlapPolicy::FirstWins ) {
+    // copy only the blocks that are new
+    for ( size_t block = first_block; block < last_block; ++block ) {
+      if ( not test_block( partial.blocks, block ) ) {
+        const size_t pos = block * BLOCK_SIZE;
+        copy_payload( dgram.payload, pos - begin, min( BLOCK_SIZE, end - pos ), partial.bytes.data() + pos );
+      }
+    }
+  } else {
+    copy_payload( dgram.payload, 0, size, partial.bytes.data() + begin );
+  }
+
+  for ( size_t block = first_block; block < last_block; ++block ) {
+    partial.blocks[block / 64] |= uint64_t { 1 } << ( block % 64 );
+  }
+  partial.blocks_received += last_block - first_block - already;
+  if ( begin == 0 ) {
+    partial.first_header = header;
+  }
+  if ( not header.mf ) {
+    partial.total_length = end;
+  }
+
+  // is the datagram complete?
+  if ( not partial.first_header or not partial.total_length
+       or partial.blocks_received != ( *partial.total_length + BLOCK_SIZE - 1 ) / BLOCK_SIZE ) {
+    return {};
+  }
+
+  InternetDatagram whole;
+  whole.header = *partial.first_header;
+  whole.header.hlen = IPv4Header::LENGTH / 4;
+  whole.header.len = IPv4Header::LENGTH + *partial.total_length;
+  whole.header.mf = false;
+  whole.header.offset = 0;
+  whole.header.compute_checksum();
+  whole.payload = packet_pool::take_buffers();
+  memory_used_ -= footprint( partial );
+  whole.payload.push_back( move( partial.bytes ) );
+  partials_.erase( it );
+  ++stats_.reassembled;
+  return whole;
+}
+
+void IPv4FragmentReassembler::expire( const uint64_t now_ms )
+{
+  while ( not deadlines_.empty() and deadlines_.front().first <= now_ms ) {
+    const auto [deadline, key] = deadlines_.front();
+    deadlines_.pop_front();
+
+    const auto it = find_live( deadline, key );
+    if ( it != partials_.end() ) {
+      ++stats_.timed_out;
+      discard( it );
+    }
+  }
+}
+
+// The incomplete datagram that a (deadline, key) pair stands for, unless it has been completed or discarded
+IPv4FragmentReassembler::PartialMap::iterator IPv4FragmentReassembler::find_live( const uint64_t deadline,
+                                                                                  const Key& key )
+{
+  const auto it = partials_.find( key );
+  return it != partials_.end() and it->second.started_ms + config_.timeout_ms == deadline ? it : partials_.end();
+}
+
+size_t IPv4FragmentReassembler::footprint( const Partial& partial )
+{
+  return ENTRY_OVERHEAD + partial.bytes.size() + partial.blocks.size() * sizeof( uint64_t );
+}
+
+void IPv4FragmentReassembler::discard( const PartialMap::iterator it )
+{
+  memory_used_ -= footprint( it->second );
+  partials_.erase( it );
+}
+
+// Discard the oldest incomplete datagrams (but not `keep`) until `bytes` more fit under the limit. The oldest is
+// the one whose deadline is first, so they are found by popping deadlines_, not by searching.
+bool IPv4FragmentReassembler::make_room( const size_t bytes, const Key& keep )
+{
+  optional<pair<uint64_t, Key>> kept; // keep's own deadline, set aside while those behind it are looked at
+  while ( memory_used_ + bytes > config_.memory_limit and not deadlines_.empty() ) {
+    const auto front = deadlines_.front();
+    deadlines_.pop_front();
+
+    const auto it = find_live( front.first, front.second );
+    if ( it == partials_.end() ) {
+      continue; // (already completed or discarded)
+    }
+    if ( front.second == keep ) {
+      kept = front;
+      continue;
+    }
+    ++stats_.evicted;
+    discard( it );
+  }
+  if ( kept ) {
+    deadlines_.push_front( *kept );
+  }
+  return memory_used_ + bytes <= config_.memory_limit;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "ipv4_datagram.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//! Split `dgram` into fragments of at most `mtu` bytes each (header included), appending them to `fragments`.
+//! A datagram that already fits is appended as it is. Returns false, appending nothing, if it doesn't fit and
+//! can't be fragmented: its DF flag is set, or the MTU can't carry a header and 8 bytes of payload.
+bool fragment_datagram( const InternetDatagram& dgram, size_t mtu, std::vector<InternetDatagram>& fragments );
+
+//! What an IPv4FragmentReassembler does when a fragment overlaps data it already holds for the same datagram
+enum class FragmentOverlapPolicy : uint8_t
+{
+  DropDatagram, //!< discard everything held for the datagram (overlaps are only ever made on purpose)
+  FirstWins,    //!< keep the bytes that arrived first
+  LastWins      //!< overwrite them with the new fragment's
+};
+
+//! How an IPv4FragmentReassembler bounds what it holds
+struct FragmentReassemblyConfig
+{
+  uint64_t timeout_ms = 30000;      //!< how long a datagram may take to arrive in full, from its first fragment
+  size_t memory_limit = 4UL << 20U; //!< memory held across all incomplete datagrams; the oldest make room
+  FragmentOverlapPolicy overlap = FragmentOverlapPolicy::DropDatagram;
+};
+
+//! \brief Puts fragmented IPv4 datagrams back together
+//! \details Fragments are grouped by (source, destination, identification, protocol). Each incomplete datagram
+//! has a buffer that fragments are copied into at their offset, and a bitmap of the 8-byte blocks received,
+//! which finds overlaps and completion without keeping the fragments themselves. A datagram whose fragments don't
+//! all arrive in time is discarded, as are the oldest ones when the memory limit would be exceeded.
+class IPv4FragmentReassembler
+{
+public:
+  //! What has happened to the fragments given to the reassembler
+  struct Stats
+  {
+    uint64_t fragments {};   //!< fragments received
+    uint64_t reassembled {}; //!< datagrams completed
+    uint64_t timed_out {};   //!< incomplete datagrams discarded because they took too long
+    uint64_t evicted {};     //!< incomplete datagrams discarded to stay under the memory limit
+    uint64_t overlaps {};    //!< fragments that overlapped data already received (and weren't duplicates)
+    uint64_t malformed {};   //!< fragments discarded as inconsistent (bad length, offset past the end...)
+  };
+
+  IPv4FragmentReassembler() = default;
+  explicit IPv4FragmentReassembler( const FragmentReassemblyConfig& config ) : config_( config ) {}
+
+  //! Take a received datagram. One that isn't a fragment is returned as it is; a fragment is held, and once
+  //! the last missing piece of its datagram arrives, the whole datagram is returned.
+  //! \param[in] now_ms the current time, in milliseconds (from any fixed starting point)
+  std::optional<InternetDatagram> add( InternetDatagram&& dgram, uint64_t now_ms );
+
+  //! Discard the incomplete datagrams that have run out of time (add() does this too)
+  void expire( uint64_t now_ms );
+
+  size_t datagrams_pending() const { return partials_.size(); } //!< incomplete datagrams held
+  size_t memory_used() const { return memory_used_; }          //!< memory held for them, bookkeeping included
+  const Stats& stats() const { return stats_; }
+
+private:
+  struct Key
+  {
+    uint32_t src;
+    uint32_t dst;
+    uint16_t id;
+    uint8_t proto;
+
+    bool operator==( const Key& other ) const = default;
+  };
+
+  struct KeyHash
+  {
+    size_t operator()( const Key& key ) const;
+  };
+
+  // An incomplete datagram
+  struct Partial
+  {
+    uint64_t started_ms {};
+    std::optional<IPv4Header> first_header {}; // the header of the fragment at offset 0, once it has arrived
+    std::optional<size_t> total_length {};     // the payload's length, once the last fragment has arrived
+    std::string bytes {};                      // the payload received so far, each fragment at its offset
+    std::vector<uint64_t> blocks {};           // bitmap of the 8-byte blocks received (up to the furthest one)
+    size_t blocks_received {};
+  };
+
+  using PartialMap = std::unordered_map<Key, Partial, KeyHash>;
+
+  // What an incomplete datagram costs besides its buffer and bitmap: its map node and bucket, and its deadline
+  static constexpr size_t ENTRY_OVERHEAD
+    = sizeof( PartialMap::value_type ) + 2 * sizeof( void* ) + sizeof( std::pair<uint64_t, Key> );
+
+  FragmentReassemblyConfig config_ {};
+  PartialMap partials_ {};
+  // (deadline, key) in deadline order: every datagram gets the same timeout, so a FIFO suffices, and its front is
+  // the oldest datagram. A pair whose datagram was completed or discarded (and maybe begun again) is skipped when
+  // it reaches the front.
+  std::deque<std::pair<uint64_t, Key>> deadlines_ {};
+  size_t memory_used_ {}; // the footprint() of every incomplete datagram
+  Stats stats_ {};
+
+  static size_t footprint( const Partial& partial );
+  PartialMap::iterator find_live( uint64_t deadline, const Key& key );
+  void discard( PartialMap::iterator it );
+  bool make_room( size_t bytes, const Key& keep );
+};
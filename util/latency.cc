@@ -0,0 +1,183 @@
+#include "latency.hh"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <iomanip>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+// Every probe that exists, and the number of probes ever created (which numbers the next one)
+struct Registry
+{
+  mutex lock {};
+  vector<const LatencyProbe*> probes {};
+  size_t created {};
+};
+
+Registry& registry()
+{
+  static Registry registry;
+  return registry;
+}
+
+// Relaxed increments of a counter that only one thread writes
+void add( atomic<uint64_t>& counter, uint64_t n )
+{
+  counter.store( counter.load( memory_order_relaxed ) + n, memory_order_relaxed );
+}
+} // namespace
+
+size_t LatencyHistogram::bucket( const uint64_t value )
+{
+  if ( value < SUB_BUCKETS ) {
+    return value;
+  }
+  const unsigned shift = bit_width( value ) - 1 - SUB_BUCKET_BITS;
+  return ( shift + 1 ) * SUB_BUCKETS + ( value >> shift ) - SUB_BUCKETS;
+}
+
+uint64_t LatencyHistogram::lowest( const size_t bucket )
+{
+  if ( bucket < SUB_BUCKETS ) {
+    return bucket;
+  }
+  const size_t shift = bucket / SUB_BUCKETS - 1;
+  return ( SUB_BUCKETS + bucket % SUB_BUCKETS ) << shift;
+}
+
+uint64_t LatencyHistogram::highest( const size_t bucket )
+{
+  if ( bucket < SUB_BUCKETS ) {
+    return bucket;
+  }
+  const size_t shift = bucket / SUB_BUCKETS - 1;
+  return lowest( bucket ) + ( ( uint64_t { 1 } << shift ) - 1 );
+}
+
+void LatencyHistogram::record( const uint64_t value, const uint64_t count )
+{
+  counts_[bucket( value )] += count;
+  count_ += count;
+  sum_ += value * count;
+  min_ = std::min( min_, value );
+  max_ = std::max( max_, value );
+}
+
+void LatencyHistogram::merge( const LatencyHistogram& other )
+{
+  for ( size_t i = 0; i < BUCKETS; ++i ) {
+    counts_[i] += other.counts_[i];
+  }
+  count_ += other.count_;
+  sum_ += other.sum_;
+  min_ = std::min( min_, other.min_ );
+  max_ = std::max( max_, other.max_ );
+}
+
+uint64_t LatencyHistogram::percentile( const double percent ) const
+{
+  const auto exact_rank = static_cast<uint64_t>( ceil( percent / 100 * static_cast<double>( count_ ) ) );
+  const uint64_t rank = std::max<uint64_t>( 1, exact_rank );
+  uint64_t seen = 0;
+  for ( size_t i = 0; i < BUCKETS; ++i ) {
+    seen += counts_[i];
+    if ( seen >= rank ) {
+      return std::min( highest( i ), max_ );
+    }
+  }
+  return max_;
+}
+
+LatencyProbe::LatencyProbe( string name ) : name_( move( name ) ), id_()
+{
+  Registry& reg = registry();
+  const lock_guard lock { reg.lock };
+  id_ = reg.created++;
+  reg.probes.push_back( this );
+}
+
+LatencyProbe::~LatencyProbe()
+{
+  Registry& reg = registry();
+  const lock_guard lock { reg.lock };
+  erase( reg.probes, this );
+}
+
+LatencyProbe::Shard& LatencyProbe::this_thread_shard()
+{
+  // each thread's shards, indexed by probe id (a probe's shards live as long as the probe)
+  thread_local vector<Shard*> shards;
+  if ( id_ >= shards.size() ) {
+    shards.resize( id_ + 1 );
+  }
+  if ( not shards[id_] ) {
+    const lock_guard lock { mutex_ };
+    shards_.push_back( make_unique<Shard>() );
+    shards[id_] = shards_.back().get();
+  }
+  return *shards[id_];
+}
+
+void LatencyProbe::record( const uint64_t ns )
+{
+  Shard& shard = this_thread_shard();
+  add( shard.counts[LatencyHistogram::bucket( ns )], 1 );
+  add( shard.sum, ns );
+  if ( ns < shard.min.load( memory_order_relaxed ) ) {
+    shard.min.store( ns, memory_order_relaxed );
+  }
+  if ( ns > shard.max.load( memory_order_relaxed ) ) {
+    shard.max.store( ns, memory_order_relaxed );
+  }
+}
+
+LatencyHistogram LatencyProbe::histogram() const
+{
+  LatencyHistogram merged;
+  const lock_guard lock { mutex_ };
+  for ( const auto& shard : shards_ ) {
+    for ( size_t i = 0; i < LatencyHistogram::BUCKETS; ++i ) {
+      const uint64_t n = shard->counts[i].load( memory_order_relaxed );
+      merged.counts_[i] += n;
+      merged.count_ += n;
+    }
+    merged.sum_ += shard->sum.load( memory_order_relaxed );
+    merged.min_ = min( merged.min_, shard->min.load( memory_order_relaxed ) );
+    merged.max_ = max( merged.max_, shard->max.load( memory_order_relaxed ) );
+  }
+  return merged;
+}
+
+vector<const LatencyProbe*> LatencyProbe::all()
+{
+  Registry& reg = registry();
+  const lock_guard lock { reg.lock };
+  return reg.probes;
+}
+
+LatencyTimer::~LatencyTimer()
+{
+  probe_.record( duration_cast<nanoseconds>( steady_clock::now() - start_ ).count() );
+}
+
+void print_latency_report( ostream& out )
+{
+  bool header = false;
+  for ( const LatencyProbe* probe : LatencyProbe::all() ) {
+    const LatencyHistogram h = probe->histogram();
+    if ( h.count() == 0 ) {
+      continue;
+    }
+    if ( not header ) {
+      out << left << setw( 32 ) << "latency (ns)" << right << setw( 12 ) << "count" << setw( 10 ) << "mean"
+          << setw( 10 ) << "p50" << setw( 10 ) << "p99" << setw( 10 ) << "p99.9" << setw( 12 ) << "max" << "\n";
+      header = true;
+    }
+    out << left << setw( 32 ) << probe->name() << right << setw( 12 ) << h.count() << setw( 10 ) << fixed
+        << setprecision( 0 ) << h.mean() << setw( 10 ) << h.percentile( 50 ) << setw( 10 ) << h.percentile( 99 )
+        << setw( 10 ) << h.percentile( 99.9 ) << setw( 12 ) << h.max() << "\n";
+  }
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//! \brief A histogram of latencies (in nanoseconds), in fixed memory, as in HdrHistogram
+//! \details Values below 2^SUB_BUCKET_BITS are counted exactly; above, each power of two is split into
+//! 2^SUB_BUCKET_BITS equal buckets, so a value is known to within 1/32 (about 3%) however large it is. Every
+//! uint64_t value has a bucket, so nothing is ever out of range, and recording is a few shifts and an add.
+class LatencyHistogram
+{
+public:
+  static constexpr unsigned SUB_BUCKET_BITS = 5;
+  static constexpr uint64_t SUB_BUCKETS = uint64_t { 1 } << SUB_BUCKET_BITS;
+  static constexpr size_t BUCKETS = ( 64 - SUB_BUCKET_BITS + 1 ) * SUB_BUCKETS;
+
+  //! The bucket that counts `value`
+  static size_t bucket( uint64_t value );
+
+  //! The smallest and largest values counted by a bucket
+  static uint64_t lowest( size_t bucket );
+  static uint64_t highest( size_t bucket );
+
+  void record( uint64_t value, uint64_t count = 1 );
+
+  //! Add the counts of another histogram into this one
+  void merge( const LatencyHistogram& other );
+
+  uint64_t count() const { return count_; }
+  uint64_t min() const { return count_ ? min_ : 0; }
+  uint64_t max() const { return max_; }
+  double mean() const { return count_ ? static_cast<double>( sum_ ) / static_cast<double>( count_ ) : 0; }
+
+  //! The value below which `percent` of the values fall (the highest value in that value's bucket, capped at max())
+  uint64_t percentile( double percent ) const;
+
+  uint64_t count_in( size_t bucket ) const { return counts_[bucket]; }
+
+private:
+  friend class LatencyProbe; // (which merges its threads' counters in directly)
+
+  std::array<uint64_t, BUCKETS> counts_ {};
+  uint64_t count_ {};
+  uint64_t sum_ {};
+  uint64_t min_ { UINT64_MAX };
+  uint64_t max_ {};
+};
+
+//! \brief A named place where latencies are measured, e.g. "Reassembler::insert"
+//! \details Each thread records into a histogram of its own, without a lock, and histogram() merges them all when
+//! asked (reading while threads are still recording is safe, but may miss their latest values). Probes register
+//! themselves on construction, so all() can report on every probe in the program.
+class LatencyProbe
+{
+public:
+  explicit LatencyProbe( std::string name );
+  ~LatencyProbe();
+
+  LatencyProbe( const LatencyProbe& other ) = delete;
+  LatencyProbe& operator=( const LatencyProbe& other ) = delete;
+
+  //! Record a latency in the calling thread's histogram
+  void record( uint64_t ns );
+
+  //! Every thread's histogram, merged
+  LatencyHistogram histogram() const;
+
+  const std::string& name() const { return name_; }
+
+  //! Every probe that exists now, in the order they were created
+  static std::vector<const LatencyProbe*> all();
+
+private:
+  //! One thread's histogram; written only by that thread, so each counter is a relaxed load and store
+  struct Shard
+  {
+    std::array<std::atomic<uint64_t>, LatencyHistogram::BUCKETS> counts {};
+    std::atomic<uint64_t> sum {};
+    std::atomic<uint64_t> min { UINT64_MAX };
+    std::atomic<uint64_t> max {};
+  };
+
+  std::string name_;
+  size_t id_; //!< index of this probe in each thread's table of shards
+
+  mutable std::mutex mutex_ {};
+  std::vector<std::unique_ptr<Shard>> shards_ {};
+
+  Shard& this_thread_shard();
+};
+
+//! Records the time from its construction to its destruction in a LatencyProbe
+class LatencyTimer
+{
+  LatencyProbe& probe_;
+  std::chrono::steady_clock::time_point start_ { std::chrono::steady_clock::now() };
+
+public:
+  explicit LatencyTimer( LatencyProbe& probe ) : probe_( probe ) {}
+  ~LatencyTimer();
+
+  LatencyTimer( const LatencyTimer& other ) = delete;
+  LatencyTimer& operator=( const LatencyTimer& other ) = delete;
+};
+
+//! Print a table of count, mean and percentiles (p50, p99, p99.9, max) for every probe that has recorded anything
+void print_latency_report( std::ostream& out );
+
+//! Time the rest of the enclosing scope, under the probe called `name`. Compiles to nothing unless MINNOW_LATENCY
+//! is defined (configure with `-DMINNOW_LATENCY=ON` to measure).
+#ifdef MINNOW_LATENCY
+#define MINNOW_LATENCY_SCOPE( name )                                                                               \
+  static LatencyProbe minnow_latency_probe_ { name };                                                              \
+  const LatencyTimer minnow_latency_timer_ { minnow_latency_probe_ }
+#else
+#define MINNOW_LATENCY_SCOPE( name ) static_cast<void>( 0 )
+#endif
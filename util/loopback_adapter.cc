@@ -0,0 +1,77 @@
+#include "loopback_adapter.hh"
+
+#include "parser.hh"
+
+using namespace std;
+
+bool SegmentRing::push( const TCPMessage& msg )
+{
+  if ( size_ == slots_.size() ) {
+    ++dropped_;
+    return false;
+  }
+  slots_[( head_ + size_ ) % slots_.size()] = msg;
+  ++size_;
+  return true;
+}
+
+optional<TCPMessage> SegmentRing::pop()
+{
+  if ( size_ == 0 ) {
+    return {};
+  }
+  TCPMessage msg = move( slots_[head_] );
+  head_ = ( head_ + 1 ) % slots_.size();
+  --size_;
+  return msg;
+}
+
+pair<LoopbackAdapter, LoopbackAdapter> LoopbackAdapter::make_pair( const size_t queue_length, const bool serialize )
+{
+  auto link = make_shared<Link>(
+    Link { .rings = { SegmentRing { queue_length }, SegmentRing { queue_length } }, .serialize = serialize } );
+  return { LoopbackAdapter { link, 0 }, LoopbackAdapter { link, 1 } };
+}
+
+optional<TCPMessage> LoopbackAdapter::carry( TCPMessage msg ) const
+{
+  if ( not link_->serialize ) {
+    return msg;
+  }
+
+  TCPSegment seg { .message = move( msg ) };
+  seg.compute_checksum( 0 );
+  TCPSegment received;
+  if ( not parse( received, ::serialize( seg ), 0 ) ) {
+    return {};
+  }
+  return move( received.message );
+}
+
+optional<TCPMessage> LoopbackAdapter::read()
+{
+  auto msg = link_->rings[1 - side_].pop();
+  return msg ? carry( move( *msg ) ) : nullopt;
+}
+
+void LoopbackAdapter::write( const TCPMessage& seg )
+{
+  link_->rings[side_].push( seg );
+}
+
+void LoopbackAdapter::read_batch( vector<TCPMessage>& segs )
+{
+  SegmentRing& ring = link_->rings[1 - side_];
+  for ( size_t i = 0; i < FdAdapterBase::kMaxBatch and not ring.empty(); ++i ) {
+    if ( auto msg = carry( move( *ring.pop() ) ) ) {
+      segs.push_back( move( *msg ) );
+    }
+  }
+}
+
+void LoopbackAdapter::write_batch( const span<const TCPMessage> segs )
+{
+  for ( const auto& seg : segs ) {
+    link_->rings[side_].push( seg );
+  }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "fd_adapter.hh"
+#include "tcp_segment.hh"
+#include "tuntap_adapter.hh"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+//! A one-way queue of TCP segments with room for a fixed number of them
+//! \details Like a device's transmit queue, a full ring drops what is written to it. The slots are allocated once;
+//! a segment is copied in when written and moved out when read, as a device copies a datagram once.
+class SegmentRing
+{
+  std::vector<TCPMessage> slots_;
+  size_t head_ {}; //!< the oldest segment
+  size_t size_ {};
+  uint64_t dropped_ {};
+
+public:
+  explicit SegmentRing( size_t capacity ) : slots_( capacity ) {}
+
+  //! Append a segment, or drop it (returning false) if the ring is full
+  bool push( const TCPMessage& msg );
+
+  //! Remove the oldest segment, if any
+  std::optional<TCPMessage> pop();
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  //! Number of segments dropped because the ring was full
+  uint64_t dropped() const { return dropped_; }
+};
+
+//! \brief One end of an in-memory link between two TCPPeers in the same process
+//! \details Segments written at one end are read at the other, in order, through a SegmentRing in each direction;
+//! no device, socket or system call is involved, so the link measures (and tests) TCP alone. With `serialize`,
+//! each segment is also serialized to the wire format (with its checksum) and parsed back, as it would be on its
+//! way through a real link. The adapter has no file descriptor: whoever runs the peers polls read_batch().
+class LoopbackAdapter
+{
+  struct Link
+  {
+    std::array<SegmentRing, 2> rings;
+    bool serialize;
+  };
+
+  std::shared_ptr<Link> link_;
+  size_t side_; //!< this end writes to link_->rings[side_] and reads from the other ring
+
+  LoopbackAdapter( std::shared_ptr<Link> link, size_t side ) : link_( std::move( link ) ), side_( side ) {}
+
+  //! The segment as it would arrive after a trip over the wire (if the link serializes), or nothing if it didn't
+  //! survive the trip
+  std::optional<TCPMessage> carry( TCPMessage msg ) const;
+
+public:
+  //! Make the two ends of a link, each direction of which queues up to `queue_length` segments
+  static std::pair<LoopbackAdapter, LoopbackAdapter> make_pair( size_t queue_length = 4096,
+                                                               bool serialize = false );
+
+  //! Read the oldest segment sent from the other end, if any
+  std::optional<TCPMessage> read();
+
+  //! Send a segment to the other end (dropped if the queue is full)
+  void write( const TCPMessage& seg );
+
+  //! Read up to FdAdapterBase::kMaxBatch segments, appending them to `segs`
+  void read_batch( std::vector<TCPMessage>& segs );
+
+  //! Send segments to the other end
+  void write_batch( std::span<const TCPMessage> segs );
+
+  //! Number of segments waiting to be read at this end
+  size_t pending() const { return link_->rings[1 - side_].size(); }
+
+  //! Number of segments sent from this end that were dropped because the queue was full
+  uint64_t dropped() const { return link_->rings[side_].dropped(); }
+};
+
+static_assert( TCPDatagramAdapter<LoopbackAdapter> );
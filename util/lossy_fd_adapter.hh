@@ -5,9 +5,12 @@
 #include "tcp_config.hh"
 #include "tcp_segment.hh"
 
+#include <algorithm>
 #include <optional>
 #include <random>
+#include <span>
 #include <utility>
+#include <vector>
 
 //! An adapter class that adds random dropping behavior to an FD adapter
 template<typename AdapterT>
@@ -20,6 +23,9 @@ private:
   //! The underlying FD adapter
   AdapterT _adapter;
 
+  //! The segments of a batch that survive _should_drop() (reused by each call to write_batch)
+  std::vector<TCPMessage> _kept {};
+
   //! \brief Determine whether or not to drop a given read or write
   //! \param[in] uplink is `true` to use the uplink loss probability, else use the downlink loss probability
   //! \returns `true` if the segment should be dropped
@@ -59,6 +65,31 @@ public:
     return _adapter.write( seg );
   }
 
+  //! \brief Read a batch from the underlying AdapterT instance, potentially dropping each segment read
+  //! \param[out] segs has the segments that were not dropped appended to it
+  void read_batch( std::vector<TCPMessage>& segs )
+  {
+    const auto first = static_cast<std::ptrdiff_t>( segs.size() );
+    _adapter.read_batch( segs );
+    const auto dropped = std::remove_if( segs.begin() + first, segs.end(), [&]( const TCPMessage& ) {
+      return _should_drop( false );
+    } );
+    segs.erase( dropped, segs.end() );
+  }
+
+  //! \brief Write a batch to the underlying AdapterT instance, potentially dropping each segment to be written
+  //! \param[in] segs are the segments to either write or drop
+  void write_batch( std::span<const TCPMessage> segs )
+  {
+    _kept.clear();
+    for ( const auto& seg : segs ) {
+      if ( not _should_drop( true ) ) {
+        _kept.push_back( seg );
+      }
+    }
+    _adapter.write_batch( _kept );
+  }
+
   //! \name
   //! Passthrough functions to the underlying AdapterT instance
 
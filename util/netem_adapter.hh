@@ -0,0 +1,176 @@
+#pragma once
+
+#include "fd_adapter.hh"
+#include "file_descriptor.hh"
+#include "random.hh"
+#include "tcp_config.hh"
+#include "tcp_segment.hh"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <span>
+#include <utility>
+#include <vector>
+
+//! What a NetemAdapter does to the segments written through it (the rates are out of UINT16_MAX, as in
+//! FdAdapterConfig)
+struct NetemConfig
+{
+  uint64_t delay_ms = 0;           //!< one-way delay
+  uint64_t jitter_ms = 0;          //!< each segment's delay varies uniformly by up to this much either way
+  uint64_t rate_bps = 0;           //!< bandwidth of the link in bits per second (0: unlimited)
+  size_t queue_limit = 1000;       //!< segments held at once (waiting for the link, or in flight); more are dropped
+  uint16_t loss_rate = 0;          //!< chance of dropping a segment
+  uint16_t reorder_rate = 0;       //!< chance of sending a segment with no delay, ahead of those already waiting
+  uint16_t duplicate_rate = 0;     //!< chance of sending a segment twice
+  std::optional<uint64_t> seed {}; //!< for the random choices (by default, a random seed)
+
+  //! Bytes a segment occupies on the link (its payload and a 40-byte IPv4 and TCP header)
+  static constexpr size_t HEADER_SIZE = 40;
+};
+
+//! \brief An adapter that emulates a network path in front of another adapter, like Linux's netem qdisc
+//! \details Segments written to the adapter wait in an emulated queue: each is serialized onto a link of
+//! NetemConfig::rate_bps (after the segments ahead of it), then takes NetemConfig::delay_ms (plus jitter) to
+//! cross it, and is written to the underlying adapter once that time has passed. Time is whatever tick() says it
+//! is, so a test can run a 100 ms, 1 Gbit/s path in less than real time and get the same result every time from
+//! the same seed. Jitter never reorders segments (as with netem, a segment waits for the one ahead of it); only
+//! NetemConfig::reorder_rate does. Reads pass straight through: to emulate both directions, wrap both ends.
+template<class AdapterT>
+class NetemAdapter
+{
+  //! A segment on its way, in the heap of segments by departure time (ties leave in the order written)
+  struct InFlight
+  {
+    uint64_t departure_ns;
+    uint64_t order;
+    TCPMessage msg;
+  };
+
+  static constexpr auto later = []( const InFlight& a, const InFlight& b ) {
+    return a.departure_ns != b.departure_ns ? a.departure_ns > b.departure_ns : a.order > b.order;
+  };
+
+  AdapterT adapter_;
+  NetemConfig config_;
+  std::default_random_engine rng_;
+
+  uint64_t now_ns_ {};             //!< emulated time, advanced by tick()
+  uint64_t link_free_ns_ {};       //!< when the link has finished serializing the segments queued so far
+  uint64_t last_arrival_ns_ {};    //!< departure of the latest segment sent in order (jitter doesn't overtake it)
+  uint64_t order_ {};
+  std::vector<InFlight> queue_ {}; //!< min-heap by departure
+  std::vector<TCPMessage> due_ {}; //!< reused by tick()
+  uint64_t dropped_ {};
+
+  bool chance( const uint16_t rate ) { return rate != 0 and static_cast<uint16_t>( rng_() ) < rate; }
+
+  //! Put a segment on the emulated path
+  void enqueue( const TCPMessage& seg )
+  {
+    if ( chance( config_.loss_rate ) or queue_.size() >= config_.queue_limit ) {
+      ++dropped_;
+      return;
+    }
+
+    uint64_t departure_ns = now_ns_;
+    if ( not chance( config_.reorder_rate ) ) {
+      if ( config_.rate_bps != 0 ) {
+        const uint64_t bits = 8 * ( seg.sender.payload.size() + NetemConfig::HEADER_SIZE );
+        link_free_ns_ = std::max( link_free_ns_, now_ns_ ) + bits * 1'000'000'000 / config_.rate_bps;
+        departure_ns = link_free_ns_;
+      }
+
+      int64_t delay_ns = static_cast<int64_t>( config_.delay_ms * 1'000'000 );
+      if ( config_.jitter_ms != 0 ) {
+        const auto jitter_ns = static_cast<int64_t>( config_.jitter_ms * 1'000'000 );
+        delay_ns += std::uniform_int_distribution<int64_t> { -jitter_ns, jitter_ns }( rng_ );
+      }
+      departure_ns = std::max( departure_ns + static_cast<uint64_t>( std::max<int64_t>( delay_ns, 0 ) ),
+                               last_arrival_ns_ );
+      last_arrival_ns_ = departure_ns;
+    }
+
+    queue_.push_back( { departure_ns, order_++, seg } );
+    std::push_heap( queue_.begin(), queue_.end(), later );
+  }
+
+public:
+  //! Construct around an adapter, with the path's characteristics
+  NetemAdapter( AdapterT&& adapter, const NetemConfig& config )
+    : adapter_( std::move( adapter ) )
+    , config_( config )
+    , rng_( config.seed ? std::default_random_engine( *config.seed ) : get_random_engine() )
+  {}
+
+  //! Send a segment down the emulated path
+  void write( const TCPMessage& seg )
+  {
+    enqueue( seg );
+    if ( chance( config_.duplicate_rate ) ) {
+      enqueue( seg );
+    }
+  }
+
+  //! Send segments down the emulated path
+  void write_batch( std::span<const TCPMessage> segs )
+  {
+    for ( const auto& seg : segs ) {
+      write( seg );
+    }
+  }
+
+  //! Advance emulated time, and write the segments whose time has come to the underlying adapter
+  void tick( const size_t ms_since_last_tick )
+  {
+    now_ns_ += ms_since_last_tick * 1'000'000;
+    due_.clear();
+    while ( not queue_.empty() and queue_.front().departure_ns <= now_ns_ ) {
+      std::pop_heap( queue_.begin(), queue_.end(), later );
+      due_.push_back( std::move( queue_.back().msg ) );
+      queue_.pop_back();
+    }
+    if ( not due_.empty() ) {
+      adapter_.write_batch( due_ );
+    }
+    if constexpr ( requires { adapter_.tick( ms_since_last_tick ); } ) {
+      adapter_.tick( ms_since_last_tick );
+    }
+  }
+
+  //! How many milliseconds until tick() has a segment to write, if any are on their way
+  std::optional<uint64_t> ms_until_next_tick() const
+  {
+    if ( queue_.empty() ) {
+      return {};
+    }
+    const uint64_t departure_ns = queue_.front().departure_ns;
+    return departure_ns <= now_ns_ ? 0 : ( departure_ns - now_ns_ + 999'999 ) / 1'000'000;
+  }
+
+  //! Number of segments on their way
+  size_t queued() const { return queue_.size(); }
+
+  //! Number of segments dropped (lost, or turned away by a full queue)
+  uint64_t dropped() const { return dropped_; }
+
+  //! \name
+  //! Reads are not emulated
+
+  //!@{
+  std::optional<TCPMessage> read() { return adapter_.read(); }
+  void read_batch( std::vector<TCPMessage>& segs ) { adapter_.read_batch( segs ); }
+  //!@}
+
+  //! \name
+  //! Passthrough functions to the underlying AdapterT instance
+
+  FileDescriptor& fd() { return adapter_.fd(); }                      //!< the underlying fd
+  void set_listening( const bool l ) { adapter_.set_listening( l ); } //!< FdAdapterBase::set_listening passthrough
+  const FdAdapterConfig& config() const { return adapter_.config(); } //!< FdAdapterBase::config passthrough
+  FdAdapterConfig& config_mut() { return adapter_.config_mut(); }     //!< FdAdapterBase::config_mut passthrough
+  AdapterT& adapter() { return adapter_; }                            //!< the underlying adapter
+};
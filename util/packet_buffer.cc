@@ -0,0 +1,130 @@
+#include "packet_buffer.hh"
+#include "packet_pool.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+PacketBuffer::Storage::~Storage()
+{
+  packet_pool::recycle( move( bytes ) );
+}
+
+shared_ptr<PacketBuffer::Storage> PacketBuffer::make_storage( const size_t size )
+{
+  string bytes = packet_pool::take_string();
+  bytes.resize( size );
+  // (the control block and the Storage share one allocation, which packet_pool recycles too)
+  return allocate_shared<Storage>( PoolAllocator<Storage> {}, move( bytes ) );
+}
+
+PacketBuffer::PacketBuffer( const size_t headroom, const size_t tailroom )
+  : storage_( make_storage( headroom + tailroom ) ), begin_( headroom ), end_( headroom )
+{}
+
+PacketBuffer::PacketBuffer( string&& bytes )
+  : storage_( allocate_shared<Storage>( PoolAllocator<Storage> {}, move( bytes ) ) )
+  , begin_( 0 )
+  , end_( storage_->bytes.size() )
+{}
+
+string_view PacketBuffer::view() const
+{
+  return storage_ ? string_view { storage_->bytes }.substr( begin_, size() ) : string_view {};
+}
+
+span<char> PacketBuffer::data()
+{
+  if ( shared() ) {
+    reserve( headroom(), tailroom() );
+  }
+  return storage_ ? span<char> { storage_->bytes }.subspan( begin_, size() ) : span<char> {};
+}
+
+void PacketBuffer::reserve( const size_t headroom, const size_t tailroom )
+{
+  if ( storage_ and not shared() and begin_ >= headroom and this->tailroom() >= tailroom ) {
+    return;
+  }
+
+  const size_t len = size();
+  auto storage = make_storage( headroom + len + tailroom );
+  ranges::copy( view(), storage->bytes.begin() + static_cast<ptrdiff_t>( headroom ) );
+  begin_ = headroom;
+  end_ = headroom + len;
+  storage_ = move( storage );
+}
+
+void PacketBuffer::prepend( const string_view bytes )
+{
+  // (growing leaves as much headroom again, for the headers of the layers further down)
+  reserve( begin_ >= bytes.size() ? begin_ : begin_ + 2 * bytes.size(), tailroom() );
+  begin_ -= bytes.size();
+  ranges::copy( bytes, storage_->bytes.begin() + static_cast<ptrdiff_t>( begin_ ) );
+}
+
+void PacketBuffer::append( const string_view bytes )
+{
+  ranges::copy( bytes, grow( bytes.size() ).begin() );
+}
+
+span<char> PacketBuffer::grow( const size_t len )
+{
+  reserve( headroom(), max( tailroom(), len ) );
+  end_ += len;
+  return span<char> { storage_->bytes }.subspan( end_ - len, len );
+}
+
+void PacketBuffer::remove_prefix( const size_t len )
+{
+  if ( len > size() ) {
+    throw out_of_range( "PacketBuffer::remove_prefix" );
+  }
+  begin_ += len;
+}
+
+void PacketBuffer::remove_suffix( const size_t len )
+{
+  if ( len > size() ) {
+    throw out_of_range( "PacketBuffer::remove_suffix" );
+  }
+  end_ -= len;
+}
+
+PacketBuffer PacketBuffer::slice( const size_t offset, const size_t len ) const
+{
+  if ( offset > size() or len > size() - offset ) {
+    throw out_of_range( "PacketBuffer::slice" );
+  }
+  PacketBuffer ret { *this };
+  ret.begin_ = begin_ + offset;
+  ret.end_ = ret.begin_ + len;
+  return ret;
+}
+
+string PacketBuffer::release()
+{
+  size_t offset = 0;
+  string bytes = release( offset );
+  bytes.erase( 0, offset ); // (in place)
+  return bytes;
+}
+
+string PacketBuffer::release( size_t& offset )
+{
+  string bytes;
+  offset = 0;
+  if ( storage_ and not shared() ) {
+    bytes = move( storage_->bytes );
+    bytes.resize( end_ );
+    offset = begin_;
+  } else if ( not empty() ) {
+    bytes = packet_pool::take_string();
+    bytes.assign( view() );
+  }
+  storage_.reset();
+  begin_ = end_ = 0;
+  return bytes;
+}
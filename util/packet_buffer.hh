@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+
+//! \brief A reference-counted packet buffer, with headroom for prepending headers and tailroom for appending
+//! \details The bytes of a PacketBuffer are a window onto storage that its copies share, so copying one, slicing
+//! it or stripping a header off either end copies no data. A layer sending a packet down reserves headroom once,
+//! and each layer below prepends its header in place; a layer receiving one strips its header by narrowing the
+//! window. Writing (prepend(), append(), data()) is copy-on-write: a buffer whose storage is shared first takes a
+//! copy of its own. Storage comes from, and goes back to, packet_pool.
+class PacketBuffer
+{
+public:
+  //! An empty buffer (with no storage)
+  PacketBuffer() = default;
+
+  //! An empty buffer with room for `headroom` bytes in front and `tailroom` bytes behind
+  PacketBuffer( size_t headroom, size_t tailroom );
+
+  //! Takes over `bytes` (without copying them), with no headroom
+  explicit PacketBuffer( std::string&& bytes );
+
+  size_t size() const { return end_ - begin_; }
+  bool empty() const { return begin_ == end_; }
+  size_t headroom() const { return begin_; }
+  size_t tailroom() const { return storage_ ? storage_->bytes.size() - end_ : 0; }
+
+  //! Whether another PacketBuffer shares this one's storage
+  bool shared() const { return storage_.use_count() > 1; }
+
+  std::string_view view() const;
+  operator std::string_view() const { return view(); } // NOLINT(*-explicit-*)
+
+  //! The bytes, for writing (takes a copy of the storage first if it is shared)
+  std::span<char> data();
+
+  //! Put `bytes` in front (in the headroom, if there is enough of it; otherwise the storage grows)
+  void prepend( std::string_view bytes );
+
+  //! Put `bytes` behind (in the tailroom, if there is enough of it; otherwise the storage grows)
+  void append( std::string_view bytes );
+
+  //! Make `len` more bytes of the tailroom part of the buffer, and return them for writing (e.g. by a read(2))
+  std::span<char> grow( size_t len );
+
+  //! Strip `len` bytes off the front or the back (they become headroom or tailroom); no data moves
+  void remove_prefix( size_t len );
+  void remove_suffix( size_t len );
+
+  //! A buffer of `len` bytes starting at `offset`, sharing this one's storage
+  PacketBuffer slice( size_t offset, size_t len ) const;
+
+  //! The bytes as a string, leaving the buffer empty. If this was the storage's only owner, the string is the
+  //! storage itself, with the headroom erased in place and the tailroom cut off; otherwise it is a copy.
+  std::string release();
+
+  //! Same, but leaves the headroom in the string for the caller to skip: the bytes start at `offset`
+  std::string release( size_t& offset );
+
+private:
+  //! The shared storage; its bytes go back to packet_pool when the last PacketBuffer lets go of them
+  struct Storage
+  {
+    std::string bytes;
+
+    explicit Storage( std::string&& b ) : bytes( std::move( b ) ) {}
+    Storage( const Storage& other ) = delete;
+    Storage& operator=( const Storage& other ) = delete;
+    ~Storage();
+  };
+
+  std::shared_ptr<Storage> storage_ {};
+  size_t begin_ {};
+  size_t end_ {};
+
+  //! Give this buffer storage of its own, with at least the given headroom and tailroom around its bytes
+  void reserve( size_t headroom, size_t tailroom );
+
+  static std::shared_ptr<Storage> make_storage( size_t size );
+};
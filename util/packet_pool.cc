@@ -0,0 +1,172 @@
+#include "packet_pool.hh"
+
+#include <array>
+#include <bit>
+#include <new>
+#include <utility>
+
+using namespace std;
+
+namespace packet_pool {
+
+namespace {
+// Bounds on what a thread keeps
+constexpr size_t MAX_STRINGS = 4096;
+constexpr size_t MAX_BUFFER_LISTS = 1024;
+constexpr size_t MAX_STRING_CAPACITY = 65536; // larger strings are freed, not kept
+constexpr size_t MAX_BLOCKS_PER_CLASS = 256;
+
+// Block size classes: 64, 128, ..., 4096 bytes (larger blocks come straight from operator new)
+constexpr size_t MIN_BLOCK_BITS = 6;
+constexpr size_t NUM_BLOCK_CLASSES = 7;
+
+size_t block_class( const size_t bytes )
+{
+  const size_t bits = bit_width( max<size_t>( bytes, 1 ) - 1 );
+  return bits <= MIN_BLOCK_BITS ? 0 : bits - MIN_BLOCK_BITS;
+}
+
+struct FreeBlock
+{
+  FreeBlock* next;
+};
+
+struct Freelists
+{
+  vector<string> strings {};
+  size_t string_bytes {}; // the capacity of `strings`, in all
+  vector<vector<string>> buffer_lists {};
+  array<FreeBlock*, NUM_BLOCK_CLASSES> blocks {};
+  array<size_t, NUM_BLOCK_CLASSES> block_counts {};
+
+  Freelists() = default;
+  Freelists( const Freelists& other ) = delete;
+  Freelists& operator=( const Freelists& other ) = delete;
+
+  ~Freelists();
+};
+
+// Set once a thread's freelists are gone (e.g. while static objects are destroyed after main returns), after which
+// buffers are simply allocated and freed
+thread_local bool destroyed = false;
+
+Freelists::~Freelists()
+{
+  destroyed = true;
+  for ( auto* block : blocks ) {
+    while ( block ) {
+      ::operator delete( exchange( block, block->next ) );
+    }
+  }
+}
+
+Freelists* freelists()
+{
+  thread_local Freelists lists;
+  return destroyed ? nullptr : &lists;
+}
+} // namespace
+
+string take_string()
+{
+  Freelists* lists = freelists();
+  if ( not lists or lists->strings.empty() ) {
+    return {};
+  }
+  auto& strings = lists->strings;
+  string buffer = move( strings.back() );
+  strings.pop_back();
+  lists->string_bytes -= buffer.capacity();
+  return buffer;
+}
+
+vector<string> take_buffers()
+{
+  Freelists* lists = freelists();
+  if ( not lists or lists->buffer_lists.empty() ) {
+    return {};
+  }
+  vector<string> buffers = move( lists->buffer_lists.back() );
+  lists->buffer_lists.pop_back();
+  return buffers;
+}
+
+void recycle( string&& buffer )
+{
+  Freelists* lists = freelists();
+  if ( not lists or buffer.capacity() <= string {}.capacity() or buffer.capacity() > MAX_STRING_CAPACITY
+       or lists->strings.size() >= MAX_STRINGS or lists->string_bytes + buffer.capacity() > MAX_STRING_BYTES ) {
+    return; // (nothing worth keeping, or enough kept already)
+  }
+  auto& strings = lists->strings;
+  if ( strings.capacity() == 0 ) {
+    strings.reserve( MAX_STRINGS );
+  }
+  buffer.clear();
+  lists->string_bytes += buffer.capacity();
+  strings.push_back( move( buffer ) );
+}
+
+void recycle( vector<string>&& buffers )
+{
+  for ( auto& buffer : buffers ) {
+    recycle( move( buffer ) );
+  }
+  Freelists* lists = freelists();
+  if ( not lists or buffers.capacity() == 0 or lists->buffer_lists.size() >= MAX_BUFFER_LISTS ) {
+    return;
+  }
+  if ( lists->buffer_lists.capacity() == 0 ) {
+    lists->buffer_lists.reserve( MAX_BUFFER_LISTS );
+  }
+  buffers.clear();
+  lists->buffer_lists.push_back( move( buffers ) );
+}
+
+size_t strings_available()
+{
+  const Freelists* lists = freelists();
+  return lists ? lists->strings.size() : 0;
+}
+
+size_t string_bytes_available()
+{
+  const Freelists* lists = freelists();
+  return lists ? lists->string_bytes : 0;
+}
+
+size_t buffers_available()
+{
+  const Freelists* lists = freelists();
+  return lists ? lists->buffer_lists.size() : 0;
+}
+
+void* allocate_block( const size_t bytes )
+{
+  const size_t size_class = block_class( bytes );
+  if ( size_class >= NUM_BLOCK_CLASSES ) {
+    return ::operator new( bytes );
+  }
+
+  Freelists* lists = freelists();
+  if ( FreeBlock* block = lists ? lists->blocks[size_class] : nullptr ) {
+    lists->blocks[size_class] = block->next;
+    --lists->block_counts[size_class];
+    return block;
+  }
+  return ::operator new( size_t { 1 } << ( size_class + MIN_BLOCK_BITS ) );
+}
+
+void deallocate_block( void* block, const size_t bytes )
+{
+  const size_t size_class = block_class( bytes );
+  Freelists* lists = freelists();
+  if ( not lists or size_class >= NUM_BLOCK_CLASSES or lists->block_counts[size_class] >= MAX_BLOCKS_PER_CLASS ) {
+    ::operator delete( block );
+    return;
+  }
+  lists->blocks[size_class] = new ( block ) FreeBlock { lists->blocks[size_class] };
+  ++lists->block_counts[size_class];
+}
+
+} // namespace packet_pool
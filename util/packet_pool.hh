@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <queue>
+#include <string>
+#include <vector>
+
+//! \brief Per-thread freelists of the buffers that packets are made of
+//! \details A packet's buffers (the strings holding its headers and payload, and the vector that lists them) are
+//! given back with recycle() once the packet is finished with -- e.g. after an interface has transmitted a frame --
+//! and handed out again, with their capacity, by take_string() and take_buffers(), e.g. by a Serializer building
+//! the next packet's headers. Once a thread's freelists are warm, building, sending and recycling a packet makes
+//! no allocation. Each thread has its own freelists (so there is no locking), bounded in length and in memory so
+//! that a burst doesn't keep its memory forever; a buffer may be recycled on a different thread than the one that
+//! took it.
+namespace packet_pool {
+
+//! An empty string, with the capacity of a recycled one if there is one
+std::string take_string();
+
+//! An empty vector of buffers, with the capacity of a recycled one if there is one
+std::vector<std::string> take_buffers();
+
+//! Keep a string to hand out again
+void recycle( std::string&& buffer );
+
+//! Keep a vector of buffers, and each of its buffers, to hand out again
+void recycle( std::vector<std::string>&& buffers );
+
+//! Most memory (in strings' capacity) that a thread's freelist of strings keeps
+constexpr size_t MAX_STRING_BYTES = 4 << 20;
+
+//! Number of strings and vectors waiting on the calling thread's freelists
+size_t strings_available();
+size_t buffers_available();
+
+//! Memory held by the strings waiting on the calling thread's freelist (at most MAX_STRING_BYTES)
+size_t string_bytes_available();
+
+//! Raw memory in power-of-two size classes, on per-thread freelists (for containers' nodes; see PoolAllocator)
+void* allocate_block( size_t bytes );
+void deallocate_block( void* block, size_t bytes );
+
+} // namespace packet_pool
+
+//! \brief A standard allocator that recycles memory through packet_pool's per-thread freelists
+//! \details For containers that allocate and free fixed-size nodes as packets pass through them, like the
+//! std::deque under a queue of frames: once warm, pushing and popping makes no call to operator new.
+template<class T>
+class PoolAllocator
+{
+public:
+  using value_type = T;
+
+  PoolAllocator() = default;
+
+  template<class U>
+  PoolAllocator( const PoolAllocator<U>& other [[maybe_unused]] ) // NOLINT(*-explicit-*): rebinding is implicit
+  {}
+
+  T* allocate( size_t n ) { return static_cast<T*>( packet_pool::allocate_block( n * sizeof( T ) ) ); }
+  void deallocate( T* block, size_t n ) { packet_pool::deallocate_block( block, n * sizeof( T ) ); }
+
+  template<class U>
+  bool operator==( const PoolAllocator<U>& other [[maybe_unused]] ) const
+  {
+    return true;
+  }
+};
+
+//! A queue whose nodes are recycled through packet_pool (used for the queues packets pass through)
+template<class T>
+using PooledQueue = std::queue<T, std::deque<T, PoolAllocator<T>>>;
+
+//! Same, as a deque
+template<class T>
+using PooledDeque = std::deque<T, PoolAllocator<T>>;
@@ -1,10 +1,12 @@
 #pragma once
 
+#include "packet_buffer.hh"
+#include "packet_pool.hh"
+
 #include <algorithm>
 #include <concepts>
 #include <cstdint>
 #include <cstring>
-#include <deque>
 #include <numeric>
 #include <span>
 #include <stdexcept>
@@ -17,38 +19,60 @@ class Parser//解析
   class BufferList//缓冲区
   {
     uint64_t size_ {};
-    std::deque<std::string> buffer_ {};//字符串双端序列
+    std::vector<std::string> buffer_ {}; // buffers before head_ have been consumed
+    size_t head_ {};
     uint64_t skip_ {};
 
   public:
     explicit BufferList( const std::vector<std::string>& buffers )
     {
+      buffer_.reserve( buffers.size() );
       for ( const auto& x : buffers ) {
         append( x );
       }
     }
 
+    // Takes over the storage of a buffer it holds the only reference to (its headroom is skipped, not erased)
+    explicit BufferList( PacketBuffer&& buffer )
+    {
+      buffer_ = packet_pool::take_buffers();
+      buffer_.push_back( buffer.release( skip_ ) );
+      size_ = buffer_.front().size() - skip_;
+      if ( size_ == 0 ) {
+        buffer_.clear();
+        skip_ = 0;
+      }
+    }
+
+    // Takes over the vector itself, not just its strings, so parsing a packet allocates nothing
+    explicit BufferList( std::vector<std::string>&& buffers ) : buffer_( std::move( buffers ) )
+    {
+      for ( const auto& x : buffer_ ) {
+        size_ += x.size();
+      }
+    }
+
     uint64_t size() const { return size_; }
     uint64_t serialized_length() const { return size(); }  //serialized连载
     bool empty() const { return size_ == 0; }
 
     std::string_view peek() const//查看缓冲区内的下一元素
     {
-      if ( buffer_.empty() ) {
+      if ( head_ == buffer_.size() ) {
         throw std::runtime_error( "peek on empty BufferList" );
       }
-      return std::string_view { buffer_.front() }.substr( skip_ );//从skip_开始到结束的字符串
+      return std::string_view { buffer_[head_] }.substr( skip_ );//从skip_开始到结束的字符串
     }
 
     void remove_prefix( uint64_t len )//删除缓冲区内len长度的数据
     {
-      while ( len and not buffer_.empty() ) {
+      while ( len and head_ < buffer_.size() ) {
         const uint64_t to_pop_now = std::min( len, peek().size() );
         skip_ += to_pop_now;
         len -= to_pop_now;
         size_ -= to_pop_now;
-        if ( skip_ == buffer_.front().size() ) {
-          buffer_.pop_front();
+        if ( skip_ == buffer_[head_].size() ) {
+          ++head_;
           skip_ = 0;
         }
       }
@@ -60,15 +84,18 @@ class Parser//解析
       if ( empty() ) {
         return;
       }
-      std::string first_str = std::move( buffer_.front() );
       if ( skip_ ) {
-        first_str = first_str.substr( skip_ );
+        buffer_[head_].erase( 0, skip_ ); // in place: no new allocation
       }
-      out.emplace_back( std::move( first_str ) );
-      buffer_.pop_front();
-      for ( auto&& x : buffer_ ) {
-        out.emplace_back( std::move( x ) );
+      for ( size_t i = 0; i < head_; ++i ) {
+        packet_pool::recycle( std::move( buffer_[i] ) ); // (e.g. the header that was just parsed)
       }
+      buffer_.erase( buffer_.begin(), buffer_.begin() + static_cast<std::ptrdiff_t>( head_ ) );
+      out.swap( buffer_ ); // (the vector itself moves on, too)
+      buffer_.clear();
+      head_ = 0;
+      skip_ = 0;
+      size_ = 0;
     }
 
     void dump_all( std::string& out )//将本来是多个字符串的out转化为一个字符串
@@ -92,10 +119,10 @@ class Parser//解析
         return {};
       }
       std::vector<std::string_view> ret;
-      ret.reserve( buffer_.size() );
+      ret.reserve( buffer_.size() - head_ );
       auto tmp_skip = skip_;
-      for ( const auto& x : buffer_ ) {
-        ret.push_back( std::string_view { x }.substr( tmp_skip ) );
+      for ( size_t i = head_; i < buffer_.size(); ++i ) {
+        ret.push_back( std::string_view { buffer_[i] }.substr( tmp_skip ) );
         tmp_skip = 0;
       }
       return ret;
@@ -120,6 +147,8 @@ class Parser//解析
 
 public:
   explicit Parser( const std::vector<std::string>& input ) : input_( input ) {}//使用bufferList对Parser进行初始化
+  explicit Parser( std::vector<std::string>&& input ) : input_( std::move( input ) ) {} // 接管缓冲区，不复制
+  explicit Parser( PacketBuffer&& input ) : input_( std::move( input ) ) {}
 
   const BufferList& input() const { return input_; }
 
@@ -171,17 +200,32 @@ public:
 
 class Serializer
 {
-  std::vector<std::string> output_ {};
-  std::string buffer_ {};
+  std::vector<std::string> output_ { packet_pool::take_buffers() }; // (recycled, when packet_pool has one)
+  std::string buffer_ {}; // (taken from packet_pool when the first integer is written into it)
 
 public:
   Serializer() = default;
   explicit Serializer( std::string&& buffer ) : buffer_( std::move( buffer ) ) {}
 
+  Serializer( const Serializer& other ) = delete;
+  Serializer& operator=( const Serializer& other ) = delete;
+  Serializer( Serializer&& other ) = default;
+  Serializer& operator=( Serializer&& other ) = default;
+
+  // Whatever wasn't released (e.g. after serializing only to checksum) goes back to packet_pool
+  ~Serializer()
+  {
+    packet_pool::recycle( std::move( buffer_ ) );
+    packet_pool::recycle( std::move( output_ ) );
+  }
+
   template<std::unsigned_integral T>
   void integer( const T val )//将原来的值转换为2进制，字节是计算机内存操作的最小单元，可表示 0-255 之间的任意整数。
   {
     constexpr uint64_t len = sizeof( T );
+    if ( buffer_.empty() and buffer_.capacity() <= std::string {}.capacity() ) {
+      buffer_ = packet_pool::take_string();
+    }
 
     for ( uint64_t i = 0; i < len; ++i ) {
       const uint8_t byte_val = val >> ( ( len - i - 1 ) * 8 );
@@ -221,6 +265,13 @@ public:
     flush();
     return output_;
   }
+
+  // Hand over the serialized buffers (leaves the Serializer empty)
+  std::vector<std::string> release()
+  {
+    flush();
+    return std::move( output_ );
+  }
 };
 
 // Helper to serialize any object (without constructing a Serializer of the caller's own)
@@ -229,7 +280,19 @@ std::vector<std::string> serialize( const T& obj )
 {
   Serializer s;
   obj.serialize( s );
-  return s.output();
+  return s.release();
+}
+
+// Serialize an object (e.g. a header) into the headroom in front of `buffer`
+template<class T>
+void prepend_serialized( PacketBuffer& buffer, const T& obj )
+{
+  Serializer s;
+  obj.serialize( s );
+  const auto& output = s.output();
+  for ( auto it = output.rbegin(); it != output.rend(); ++it ) {
+    buffer.prepend( *it );
+  }
 }
 
 // Helper to parse any object (without constructing a Parser of the caller's own). Returns true if successful.
@@ -240,3 +303,21 @@ bool parse( T& obj, const std::vector<std::string>& buffers, Targs&&... Fargs )
   obj.parse( p, std::forward<Targs>( Fargs )... );
   return not p.has_error();
 }
+
+// Same, but the parsed object may take over the buffers instead of copying them
+template<class T, typename... Targs>
+bool parse( T& obj, std::vector<std::string>&& buffers, Targs&&... Fargs )
+{
+  Parser p { std::move( buffers ) };
+  obj.parse( p, std::forward<Targs>( Fargs )... );
+  return not p.has_error();
+}
+
+// Same, from a PacketBuffer (whose storage the parsed object takes over, if nothing else shares it)
+template<class T, typename... Targs>
+bool parse( T& obj, PacketBuffer&& buffer, Targs&&... Fargs )
+{
+  Parser p { std::move( buffer ) };
+  obj.parse( p, std::forward<Targs>( Fargs )... );
+  return not p.has_error();
+}
@@ -0,0 +1,101 @@
+#include "path_mtu.hh"
+
+#include <algorithm>
+
+using namespace std;
+
+PathMTUProber::PathMTUProber( const PathMTUConfig& config )
+  : config_( config )
+  , payload_( config.initial_payload ? clamp( config.initial_payload, config.base_payload, config.max_payload )
+                                     : config.base_payload )
+  , high_( config.max_payload )
+{}
+
+optional<size_t> PathMTUProber::next_probe() const
+{
+  if ( probe_end_ or not searching() ) {
+    return {};
+  }
+  if ( losses_ > 0 ) {
+    return probe_size_; // (try the same size again)
+  }
+  return tried_max_ ? payload_ + ( high_ - payload_ + 1 ) / 2 : high_;
+}
+
+void PathMTUProber::probe_sent( const uint64_t end )
+{
+  if ( const auto size = next_probe() ) {
+    probe_size_ = *size;
+    probe_end_ = end;
+  }
+}
+
+void PathMTUProber::acknowledged( const uint64_t ackno )
+{
+  if ( not probe_end_ or ackno < *probe_end_ ) {
+    return;
+  }
+  payload_ = max( payload_, probe_size_ );
+  learned_ = true;
+  tried_max_ = true;
+  probe_end_.reset();
+  losses_ = 0;
+  idle_ms_ = 0;
+}
+
+void PathMTUProber::probe_lost()
+{
+  probe_end_.reset();
+  tried_max_ = true;
+  if ( ++losses_ >= config_.max_probes ) {
+    high_ = probe_size_ - 1;
+    losses_ = 0;
+    idle_ms_ = 0;
+  }
+}
+
+void PathMTUProber::black_hole()
+{
+  high_ = payload_ - 1;
+  payload_ = config_.base_payload;
+  learned_ = true;
+  probe_end_.reset();
+  losses_ = 0;
+  tried_max_ = true; // (the largest size is what just failed)
+  idle_ms_ = 0;
+}
+
+void PathMTUProber::tick( const uint64_t ms_since_last_tick )
+{
+  if ( searching() ) {
+    return;
+  }
+  idle_ms_ += ms_since_last_tick;
+  if ( idle_ms_ >= config_.raise_interval_ms and payload_ < config_.max_payload ) {
+    high_ = config_.max_payload; // the path may have grown
+    tried_max_ = false;
+    idle_ms_ = 0;
+  }
+}
+
+optional<size_t> PathMTUCache::lookup( const uint32_t destination, const uint64_t now_ms ) const
+{
+  const lock_guard lock { mutex_ };
+  const auto it = entries_.find( destination );
+  if ( it == entries_.end() or now_ms - it->second.learned_ms >= ENTRY_TTL_MS ) {
+    return {};
+  }
+  return it->second.payload_size;
+}
+
+void PathMTUCache::update( const uint32_t destination, const size_t payload_size, const uint64_t now_ms )
+{
+  const lock_guard lock { mutex_ };
+  entries_.insert_or_assign( destination, Entry { payload_size, now_ms } );
+}
+
+PathMTUCache& PathMTUCache::global()
+{
+  static PathMTUCache cache;
+  return cache;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+//! How a PathMTUProber searches (sizes are of segment payloads, not of datagrams)
+struct PathMTUConfig
+{
+  size_t base_payload = 1000;          //!< a size that works on any path (TCPConfig::MAX_PAYLOAD_SIZE)
+  size_t max_payload = 1460;           //!< the largest worth probing for (a 1500-byte MTU, less the headers)
+  size_t initial_payload = 0;          //!< a size learned for the path before (e.g. from PathMTUCache), or 0
+  size_t resolution = 16;              //!< the search ends once the bounds are this close
+  unsigned max_probes = 3;             //!< losses of a probe size before it is taken to be too large
+  uint64_t raise_interval_ms = 600000; //!< how long after a search ends to search again for a larger size
+};
+
+//! \brief Packetization-layer path MTU discovery ([RFC 4821](\ref rfc::rfc4821)), without ICMP
+//! \details The sender asks next_probe() whether to send its next segment as a probe, larger than the current
+//! payload size, and reports what became of it: acknowledged() raises the payload size to the probe's, while
+//! probe_lost() (a retransmission timeout on the probe) counts a loss, and after `max_probes` of them the size is
+//! taken to be too large. The search probes the largest size first (the usual answer), then halves the interval
+//! between what is known to work and what is known not to. A lost probe is not a sign of congestion. If segments
+//! of the current size start being lost, black_hole() falls back to the base size, and the search starts over.
+class PathMTUProber
+{
+public:
+  explicit PathMTUProber( const PathMTUConfig& config );
+
+  //! The largest payload to send in a segment that isn't a probe
+  size_t payload_size() const { return payload_; }
+  size_t base_payload() const { return config_.base_payload; }
+
+  //! The size to send the next segment at, as a probe, if a probe is due (none is in flight and the search
+  //! isn't over)
+  std::optional<size_t> next_probe() const;
+
+  //! A probe of size `next_probe()` went out, ending at absolute sequence number `end`
+  void probe_sent( uint64_t end );
+
+  //! Whether the segment ending at absolute sequence number `end` is the probe in flight
+  bool is_probe( uint64_t end ) const { return probe_end_ == end; }
+
+  //! The peer acknowledged everything before absolute sequence number `ackno`
+  void acknowledged( uint64_t ackno );
+
+  //! The probe in flight timed out
+  void probe_lost();
+
+  //! Segments of payload_size() keep being lost although smaller ones got through before: fall back to the base
+  void black_hole();
+
+  //! Time has passed (a finished search begins again after `raise_interval_ms`)
+  void tick( uint64_t ms_since_last_tick );
+
+  //! Whether the search for a larger size is still going
+  bool searching() const { return high_ >= payload_ + config_.resolution; }
+
+  //! Whether payload_size() was learned from the path (a probe was acknowledged, or a black hole found), rather
+  //! than being the size the prober started from
+  bool learned() const { return learned_; }
+
+private:
+  PathMTUConfig config_;
+  size_t payload_;                       // known to work
+  size_t high_;                          // the largest size not yet known to be too large
+  std::optional<uint64_t> probe_end_ {}; // the probe in flight, by where it ends
+  size_t probe_size_ {};
+  unsigned losses_ {};  // of probes of probe_size_
+  bool tried_max_ {};   // whether max_payload has been probed in this search
+  uint64_t idle_ms_ {}; // since the search ended
+  bool learned_ {};
+};
+
+//! \brief The payload sizes learned for each destination, so that a new connection starts from what earlier ones
+//! found ([RFC 4821](\ref rfc::rfc4821) section 5.4); entries expire, as a path may change. Thread-safe.
+class PathMTUCache
+{
+public:
+  static constexpr uint64_t ENTRY_TTL_MS = 600000;
+
+  //! The size learned for `destination` (an IPv4 address), if one was learned within ENTRY_TTL_MS of `now_ms`
+  std::optional<size_t> lookup( uint32_t destination, uint64_t now_ms ) const;
+
+  void update( uint32_t destination, size_t payload_size, uint64_t now_ms );
+
+  //! The cache shared by the process's connections
+  static PathMTUCache& global();
+
+private:
+  struct Entry
+  {
+    size_t payload_size;
+    uint64_t learned_ms;
+  };
+
+  mutable std::mutex mutex_ {};
+  std::unordered_map<uint32_t, Entry> entries_ {};
+};
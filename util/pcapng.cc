@@ -0,0 +1,223 @@
+#include "pcapng.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace {
+// Block types (pcapng, section 4)
+constexpr uint32_t SECTION_HEADER_BLOCK = 0x0A0D0D0A;
+constexpr uint32_t INTERFACE_DESCRIPTION_BLOCK = 1;
+constexpr uint32_t ENHANCED_PACKET_BLOCK = 6;
+constexpr uint32_t BYTE_ORDER_MAGIC = 0x1A2B3C4D;
+
+// Length of an Enhanced Packet Block without its packet data
+constexpr uint32_t EPB_OVERHEAD = 32;
+
+void put( string& out, const auto value )
+{
+  out.append( reinterpret_cast<const char*>( &value ), sizeof( value ) );
+}
+
+uint32_t padded( const uint32_t length )
+{
+  return ( length + 3 ) & ~3U;
+}
+
+// The blocks that begin every file: a section header, and the one interface
+string file_header( const PcapngWriter::LinkType link_type, const uint32_t snaplen )
+{
+  string out;
+  put( out, SECTION_HEADER_BLOCK );
+  put( out, uint32_t { 28 } );
+  put( out, BYTE_ORDER_MAGIC );
+  put( out, uint16_t { 1 } ); // version 1.0
+  put( out, uint16_t { 0 } );
+  put( out, UINT64_MAX ); // section length not given
+  put( out, uint32_t { 28 } );
+
+  put( out, INTERFACE_DESCRIPTION_BLOCK );
+  put( out, uint32_t { 20 } );
+  put( out, static_cast<uint16_t>( link_type ) );
+  put( out, uint16_t { 0 } );
+  put( out, snaplen );
+  put( out, uint32_t { 20 } ); // (timestamps default to microseconds)
+  return out;
+}
+} // namespace
+
+PcapngWriter::PcapngWriter( const PcapngConfig& config, const LinkType link_type )
+  : config_( config ), link_type_( link_type ), writer_()
+{
+  open_next_file(); // (throws here, not on the writer thread, if the file can't be opened)
+  writer_ = thread( [this] { write_loop(); } );
+}
+
+PcapngWriter::~PcapngWriter()
+{
+  {
+    const lock_guard lock { mutex_ };
+    stopping_ = true;
+  }
+  wake_.notify_one();
+  writer_.join();
+}
+
+void PcapngWriter::capture( span<const string> head, span<const string> tail )
+{
+  capture_pieces( head, tail );
+}
+
+void PcapngWriter::capture( span<const string_view> pieces )
+{
+  capture_pieces( pieces );
+}
+
+template<class... Pieces>
+void PcapngWriter::capture_pieces( const Pieces&... pieces )
+{
+  const auto timestamp_us = static_cast<uint64_t>(
+    duration_cast<microseconds>( system_clock::now().time_since_epoch() ).count() );
+
+  size_t length = 0;
+  const auto add_length = [&]( const auto& buffers ) {
+    for ( const auto& piece : buffers ) {
+      length += piece.size();
+    }
+  };
+  ( add_length( pieces ), ... );
+  const auto captured_length = static_cast<uint32_t>( min<size_t>( length, config_.snaplen ) );
+  const uint32_t block_length = EPB_OVERHEAD + padded( captured_length );
+
+  {
+    const lock_guard lock { mutex_ };
+    if ( pending_.size() + block_length > config_.buffer_limit ) {
+      ++dropped_;
+      return;
+    }
+
+    put( pending_, ENHANCED_PACKET_BLOCK );
+    put( pending_, block_length );
+    put( pending_, uint32_t { 0 } ); // interface
+    put( pending_, static_cast<uint32_t>( timestamp_us >> 32U ) );
+    put( pending_, static_cast<uint32_t>( timestamp_us ) );
+    put( pending_, captured_length );
+    put( pending_, static_cast<uint32_t>( length ) );
+
+    size_t remaining = captured_length;
+    const auto append = [&]( const auto& buffers ) {
+      for ( const string_view piece : buffers ) {
+        const size_t n = min( remaining, piece.size() );
+        pending_.append( piece.substr( 0, n ) );
+        remaining -= n;
+      }
+    };
+    ( append( pieces ), ... );
+    pending_.append( padded( captured_length ) - captured_length, '\0' );
+    put( pending_, block_length );
+
+    ++pending_count_;
+    ++captured_;
+  }
+  wake_.notify_one();
+}
+
+void PcapngWriter::flush()
+{
+  unique_lock lock { mutex_ };
+  written_.wait( lock, [&] { return written_count_ == captured_; } );
+}
+
+uint64_t PcapngWriter::captured() const
+{
+  const lock_guard lock { mutex_ };
+  return captured_;
+}
+
+uint64_t PcapngWriter::dropped() const
+{
+  const lock_guard lock { mutex_ };
+  return dropped_;
+}
+
+void PcapngWriter::write_loop()
+{
+  string blocks;
+  while ( true ) {
+    uint64_t count = 0;
+    {
+      unique_lock lock { mutex_ };
+      wake_.wait( lock, [&] { return stopping_ or not pending_.empty(); } );
+      if ( pending_.empty() ) {
+        break; // stopping, with everything written
+      }
+      blocks.clear();
+      swap( blocks, pending_ ); // (the capture side gets back the last buffer, and its capacity)
+      count = exchange( pending_count_, 0 );
+    }
+
+    const uint64_t unwritten = write_blocks( blocks );
+
+    {
+      const lock_guard lock { mutex_ };
+      captured_ -= unwritten; // (they count as dropped instead)
+      dropped_ += unwritten;
+      written_count_ += count - unwritten;
+    }
+    written_.notify_all();
+  }
+  file_.flush();
+}
+
+// Returns the number of blocks that could not be written (when rotation couldn't open the next file)
+uint64_t PcapngWriter::write_blocks( string_view blocks )
+{
+  uint64_t unwritten = 0;
+  bool open_failed = false; // (try to open the next file once per batch, not once per block)
+  while ( not blocks.empty() ) {
+    if ( config_.rotate_bytes != 0 and file_bytes_ >= config_.rotate_bytes and not open_failed ) {
+      try {
+        open_next_file();
+      } catch ( const exception& e ) {
+        cerr << "PcapngWriter: " << e.what() << "\n";
+        open_failed = true;
+      }
+    }
+    uint32_t block_length = 0;
+    memcpy( &block_length, blocks.data() + sizeof( uint32_t ), sizeof( block_length ) );
+    if ( file_.is_open() and file_.write( blocks.data(), block_length ) ) {
+      file_bytes_ += block_length;
+    } else {
+      ++unwritten;
+    }
+    blocks.remove_prefix( block_length );
+  }
+  file_.flush();
+  return unwritten;
+}
+
+void PcapngWriter::open_next_file()
+{
+  string path = config_.path;
+  if ( config_.rotate_bytes != 0 ) {
+    const uint64_t index = config_.ring_files == 0 ? file_index_ : file_index_ % config_.ring_files;
+    path += "." + to_string( index );
+    ++file_index_;
+  }
+
+  file_.close();
+  file_.clear();
+  file_.open( path, ios::binary | ios::trunc );
+  if ( not file_ ) {
+    throw runtime_error( "could not open capture file " + path );
+  }
+  const string header = file_header( link_type_, config_.snaplen );
+  file_.write( header.data(), static_cast<streamsize>( header.size() ) );
+  file_bytes_ = header.size();
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+
+//! How a PcapngWriter captures, and where it writes
+struct PcapngConfig
+{
+  std::string path;                       //!< capture file (with rotation, the prefix of the numbered files)
+  uint32_t snaplen = 262144;              //!< bytes kept of each packet (the rest is truncated, as tcpdump -s)
+  uint64_t rotate_bytes = 0;              //!< start a new file once one reaches this size (0: never)
+  uint32_t ring_files = 0;                //!< with rotation, reuse the oldest file after this many (0: never)
+  size_t buffer_limit = 64 * 1024 * 1024; //!< bytes waiting for the writer thread; packets beyond are dropped
+};
+
+//! \brief A writer of packet captures in pcapng format, which does its file I/O on a thread of its own
+//! \details capture() copies a packet (up to the snaplen) into an in-memory buffer, under a lock held only for
+//! that copy, and returns; the writer thread swaps the buffer out and writes it to the file. The capture never
+//! blocks on the disk: if the writer falls behind by more than PcapngConfig::buffer_limit, packets are dropped
+//! (and counted), as are those it can't write because a file couldn't be opened. With PcapngConfig::rotate_bytes,
+//! the capture goes to `path.0`, `path.1`, ..., each a complete pcapng file, as with tcpdump's -C and -W.
+class PcapngWriter
+{
+public:
+  //! Link types (from the tcpdump.org list) of the packets written
+  enum class LinkType : uint16_t
+  {
+    Ethernet = 1,
+    IPv4 = 228,
+  };
+
+  PcapngWriter( const PcapngConfig& config, LinkType link_type );
+  ~PcapngWriter();
+
+  PcapngWriter( const PcapngWriter& other ) = delete;
+  PcapngWriter& operator=( const PcapngWriter& other ) = delete;
+
+  //! Capture a packet, given as the concatenation of `pieces`, timestamped now
+  void capture( std::span<const std::string> pieces ) { capture( pieces, {} ); }
+
+  //! Capture a packet, given as the concatenation of `head` then `tail` (e.g. a header and its payload)
+  void capture( std::span<const std::string> head, std::span<const std::string> tail );
+
+  //! Capture a packet, given as the concatenation of `pieces` (e.g. views of the buffers handed to writev)
+  void capture( std::span<const std::string_view> pieces );
+
+  //! Wait until everything captured so far is written to the file
+  void flush();
+
+  //! Number of packets captured (and not dropped)
+  uint64_t captured() const;
+
+  //! Number of packets dropped because the writer thread fell behind, or couldn't open the next file to rotate to
+  uint64_t dropped() const;
+
+private:
+  PcapngConfig config_;
+  LinkType link_type_;
+
+  mutable std::mutex mutex_ {};
+  std::condition_variable wake_ {};    //!< the writer has something to do
+  std::condition_variable written_ {}; //!< the writer has written what it had
+  std::string pending_ {};             //!< packet blocks captured, not yet taken by the writer
+  uint64_t pending_count_ {};          //!< number of blocks in pending_
+  uint64_t captured_ {};
+  uint64_t written_count_ {};
+  uint64_t dropped_ {};
+  bool stopping_ {};
+
+  // Owned by the writer thread
+  std::ofstream file_ {};
+  uint64_t file_bytes_ {};
+  uint64_t file_index_ {};
+
+  std::thread writer_;
+
+  template<class... Pieces>
+  void capture_pieces( const Pieces&... pieces );
+  void write_loop();
+  uint64_t write_blocks( std::string_view blocks );
+  void open_next_file();
+};
@@ -0,0 +1,162 @@
+#include "perf_counters.hh"
+
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <linux/perf_event.h>
+#include <sstream>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+// The perf event type and config of each counter, in the order of PerfCounters::Counter
+struct EventType
+{
+  uint32_t type;
+  uint64_t config;
+};
+
+constexpr uint64_t cache_read_miss( const uint64_t cache )
+{
+  return cache | ( PERF_COUNT_HW_CACHE_OP_READ << 8U ) | ( PERF_COUNT_HW_CACHE_RESULT_MISS << 16U );
+}
+
+constexpr array<EventType, PerfCounters::NUM_COUNTERS> EVENT_TYPES { {
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  { PERF_TYPE_HW_CACHE, cache_read_miss( PERF_COUNT_HW_CACHE_L1D ) },
+  { PERF_TYPE_HW_CACHE, cache_read_miss( PERF_COUNT_HW_CACHE_LL ) },
+  { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+} };
+
+// What read(2) gives for a counter opened with the formats below
+struct CounterValue
+{
+  uint64_t value;
+  uint64_t time_enabled;
+  uint64_t time_running;
+};
+} // namespace
+
+PerfCounters::PerfCounters()
+{
+  for ( size_t i = 0; i < NUM_COUNTERS; ++i ) {
+    perf_event_attr attr {};
+    attr.size = sizeof( attr );
+    attr.type = EVENT_TYPES[i].type;
+    attr.config = EVENT_TYPES[i].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1; // (which an unprivileged process may still count with perf_event_paranoid = 2)
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    const long fd = syscall( SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC );
+    if ( fd < 0 ) {
+      if ( reason_.empty() ) {
+        reason_ = "perf_event_open: "s + strerror( errno );
+      }
+      continue;
+    }
+    fds_[i].emplace( static_cast<int>( fd ) );
+  }
+
+  if ( available() ) {
+    reason_.clear();
+  }
+}
+
+void PerfCounters::start()
+{
+  for ( auto& fd : fds_ ) {
+    if ( fd ) {
+      ioctl( fd->fd_num(), PERF_EVENT_IOC_RESET, 0 );
+      ioctl( fd->fd_num(), PERF_EVENT_IOC_ENABLE, 0 );
+    }
+  }
+}
+
+void PerfCounters::stop()
+{
+  for ( auto& fd : fds_ ) {
+    if ( fd ) {
+      ioctl( fd->fd_num(), PERF_EVENT_IOC_DISABLE, 0 );
+    }
+  }
+}
+
+PerfCounters::Reading PerfCounters::read() const
+{
+  Reading reading;
+  for ( size_t i = 0; i < NUM_COUNTERS; ++i ) {
+    CounterValue value {};
+    if ( not fds_[i] or ::read( fds_[i]->fd_num(), &value, sizeof( value ) ) != sizeof( value ) ) {
+      continue;
+    }
+    if ( value.time_running == 0 ) {
+      continue; // (the counter never got onto the hardware)
+    }
+    if ( value.time_running < value.time_enabled ) {
+      const double scale = static_cast<double>( value.time_enabled ) / static_cast<double>( value.time_running );
+      value.value = static_cast<uint64_t>( static_cast<double>( value.value ) * scale );
+    }
+    reading.counts.at( i ) = value.value;
+  }
+  return reading;
+}
+
+string PerfCounters::report( const double items, const string_view unit ) const
+{
+  return available() ? read().per( items, unit ) : "no hardware counters (" + reason_ + ")";
+}
+
+bool PerfCounters::available() const
+{
+  for ( const auto& fd : fds_ ) {
+    if ( fd ) {
+      return true;
+    }
+  }
+  return false;
+}
+
+string_view PerfCounters::name( const Counter counter )
+{
+  switch ( counter ) {
+    case Counter::Cycles:
+      return "cycles";
+    case Counter::Instructions:
+      return "instructions";
+    case Counter::L1DMisses:
+      return "L1d-misses";
+    case Counter::LLCMisses:
+      return "LLC-misses";
+    case Counter::BranchMisses:
+      return "branch-misses";
+  }
+  return "unknown";
+}
+
+string PerfCounters::Reading::per( const double items, const string_view unit ) const
+{
+  ostringstream out;
+  out << fixed;
+  for ( size_t i = 0; i < NUM_COUNTERS; ++i ) {
+    if ( not counts.at( i ) ) {
+      continue;
+    }
+    const auto counter = static_cast<Counter>( i );
+    const double rate = static_cast<double>( *counts.at( i ) ) / items;
+    out << ( out.tellp() > 0 ? ", " : "" ) << setprecision( rate < 0.1 ? 4 : 2 ) << rate << " " << name( counter )
+        << "/" << unit;
+
+    const auto cycles = ( *this )[Counter::Cycles];
+    if ( counter == Counter::Instructions and cycles and *cycles > 0 ) {
+      const double ipc = static_cast<double>( *counts.at( i ) ) / static_cast<double>( *cycles );
+      out << " (IPC " << setprecision( 2 ) << ipc << ")";
+    }
+  }
+  return out.tellp() > 0 ? out.str() : "no hardware counters";
+}
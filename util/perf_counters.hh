@@ -0,0 +1,66 @@
+#pragma once
+
+#include "file_descriptor.hh"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+//! \brief Hardware performance counters around a region of code, via perf_event_open(2)
+//! \details Counts, for the calling thread in user space only, the cycles, instructions, L1 data cache and
+//! last-level cache read misses, and branch mispredictions between start() and stop(). A counter the kernel won't
+//! open (no PMU in a VM, a restrictive perf_event_paranoid, a seccomp filter...) is left out, so callers can always
+//! use the class; its counts are then missing from read().
+class PerfCounters
+{
+public:
+  enum class Counter : uint8_t
+  {
+    Cycles,
+    Instructions,
+    L1DMisses,
+    LLCMisses,
+    BranchMisses,
+  };
+  static constexpr size_t NUM_COUNTERS = 5;
+
+  //! Counts from one region; a counter that couldn't be opened has no value
+  struct Reading
+  {
+    std::array<std::optional<uint64_t>, NUM_COUNTERS> counts {};
+
+    std::optional<uint64_t> operator[]( Counter counter ) const
+    {
+      return counts.at( static_cast<size_t>( counter ) );
+    }
+
+    //! The counts per item, e.g. "3.10 cycles/byte, 5.02 instructions/byte (IPC 1.62), ..."
+    std::string per( double items, std::string_view unit ) const;
+  };
+
+  PerfCounters();
+
+  void start(); //!< zero the counters and start counting
+  void stop();  //!< stop counting
+
+  //! The counts (scaled up if the kernel had to share the hardware counters with other events)
+  Reading read() const;
+
+  //! read().per( items, unit ), or why there are no counts
+  std::string report( double items, std::string_view unit ) const;
+
+  //! Whether any counter could be opened
+  bool available() const;
+
+  //! Why the counters are missing, if they are (e.g. "perf_event_open: Permission denied")
+  const std::string& unavailable_reason() const { return reason_; }
+
+  static std::string_view name( Counter counter );
+
+private:
+  std::array<std::optional<FileDescriptor>, NUM_COUNTERS> fds_ {};
+  std::string reason_ {};
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+//! \brief A value written by one thread and read by others without locks
+//! \details The writer never waits. A reader copies the value and retries if a store overlapped the copy, so it
+//! always sees a value that was stored as a whole. The value is kept as atomic words (relaxed, ordered by fences
+//! around a sequence counter), which makes the concurrent copy well-defined rather than a data race.
+template<class T>
+class SeqLock
+{
+  static_assert( std::is_trivially_copyable_v<T> );
+
+  static constexpr size_t WORDS = ( sizeof( T ) + sizeof( uint64_t ) - 1 ) / sizeof( uint64_t );
+
+  std::atomic<uint64_t> sequence_ {}; //!< odd while a store is in progress
+  std::array<std::atomic<uint64_t>, WORDS> words_ {};
+
+public:
+  //! Replace the value (from one thread at a time)
+  void store( const T& value )
+  {
+    std::array<uint64_t, WORDS> words {};
+    std::memcpy( words.data(), &value, sizeof( T ) );
+
+    const uint64_t sequence = sequence_.load( std::memory_order_relaxed );
+    sequence_.store( sequence + 1, std::memory_order_relaxed );
+    std::atomic_thread_fence( std::memory_order_release );
+    for ( size_t i = 0; i < WORDS; ++i ) {
+      words_[i].store( words[i], std::memory_order_relaxed );
+    }
+    sequence_.store( sequence + 2, std::memory_order_release );
+  }
+
+  //! A copy of the value (from any thread)
+  T load() const
+  {
+    std::array<uint64_t, WORDS> words {};
+    while ( true ) {
+      const uint64_t before = sequence_.load( std::memory_order_acquire );
+      for ( size_t i = 0; i < WORDS; ++i ) {
+        words[i] = words_[i].load( std::memory_order_relaxed );
+      }
+      std::atomic_thread_fence( std::memory_order_acquire );
+      if ( before % 2 == 0 and before == sequence_.load( std::memory_order_relaxed ) ) {
+        break;
+      }
+    }
+
+    T value;
+    std::memcpy( static_cast<void*>( &value ), words.data(), sizeof( T ) );
+    return value;
+  }
+};
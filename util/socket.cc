@@ -2,6 +2,7 @@
 
 #include "exception.hh"
 
+#include <array>
 #include <cstddef>
 #include <linux/if_packet.h>
 #include <net/if.h>
@@ -11,6 +12,11 @@
 
 using namespace std;
 
+namespace {
+constexpr size_t max_batch = 64;         // most datagrams moved by one recvmmsg or sendmmsg call
+constexpr size_t max_batch_iovecs = 256; // most buffers gathered by one sendmmsg call
+} // namespace
+
 // default constructor for socket of (subclassed) domain and type
 //! \param[in] domain is as described in [socket(7)](\ref man7::socket), probably `AF_INET` or `AF_UNIX`
 //! \param[in] type is as described in [socket(7)](\ref man7::socket)
@@ -125,6 +131,7 @@ void DatagramSocket::recv( Address& source_address, string& payload )
   payload.clear();
   payload.resize( kReadBufferSize );
 
+  register_syscall();
   const ssize_t recv_len = CheckSystemCall(
     "recvfrom",
     ::recvfrom( fd_num(), payload.data(), payload.size(), MSG_TRUNC, datagram_source_address, &fromlen ) );
@@ -140,6 +147,7 @@ void DatagramSocket::recv( Address& source_address, string& payload )
 
 void DatagramSocket::sendto( const Address& destination, const string_view payload )
 {
+  register_syscall();
   CheckSystemCall(
     "sendto", ::sendto( fd_num(), payload.data(), payload.length(), 0, destination.raw(), destination.size() ) );
   register_write();
@@ -147,10 +155,77 @@ void DatagramSocket::sendto( const Address& destination, const string_view paylo
 
 void DatagramSocket::send( const string_view payload )
 {
+  register_syscall();
   CheckSystemCall( "send", ::send( fd_num(), payload.data(), payload.length(), 0 ) );
   register_write();
 }
 
+//! \note If a payload is too small to hold the datagram received into it, this method throws a std::runtime_error
+size_t DatagramSocket::recv_batch( const span<string> payloads )
+{
+  array<mmsghdr, max_batch> messages {};
+  array<iovec, max_batch> iovecs {};
+  const size_t count = min( payloads.size(), max_batch );
+  for ( size_t i = 0; i < count; ++i ) {
+    if ( payloads[i].empty() ) {
+      payloads[i].resize( kReadBufferSize );
+    }
+    iovecs.at( i ) = { payloads[i].data(), payloads[i].size() };
+    messages.at( i ).msg_hdr.msg_iov = &iovecs.at( i );
+    messages.at( i ).msg_hdr.msg_iovlen = 1;
+  }
+
+  register_syscall();
+  const auto received = static_cast<size_t>( CheckSystemCall(
+    "recvmmsg", ::recvmmsg( fd_num(), messages.data(), count, MSG_WAITFORONE, nullptr ) ) );
+
+  for ( size_t i = 0; i < received; ++i ) {
+    if ( messages.at( i ).msg_hdr.msg_flags & MSG_TRUNC ) {
+      throw runtime_error( "recvmmsg (oversized datagram)" );
+    }
+    payloads[i].resize( messages.at( i ).msg_len );
+  }
+
+  if ( received > 0 ) {
+    register_read();
+  }
+  return received;
+}
+
+size_t DatagramSocket::send_batch( const span<const vector<string>> datagrams )
+{
+  array<mmsghdr, max_batch> messages {};
+  array<iovec, max_batch_iovecs> iovecs {};
+  size_t count = 0;
+  size_t used = 0;
+  for ( const auto& datagram : datagrams ) {
+    if ( count == max_batch or used + datagram.size() > max_batch_iovecs ) {
+      break;
+    }
+    messages.at( count ).msg_hdr.msg_iov = &iovecs.at( used );
+    messages.at( count ).msg_hdr.msg_iovlen = datagram.size();
+    for ( const auto& buffer : datagram ) {
+      iovecs.at( used++ ) = { const_cast<char*>( buffer.data() ), buffer.size() }; // NOLINT(*-const-cast)
+    }
+    ++count;
+  }
+
+  if ( count == 0 ) {
+    if ( datagrams.empty() ) {
+      return 0;
+    }
+    throw runtime_error( "sendmmsg (datagram has too many buffers)" );
+  }
+
+  register_syscall();
+  const auto sent
+    = static_cast<size_t>( CheckSystemCall( "sendmmsg", ::sendmmsg( fd_num(), messages.data(), count, 0 ) ) );
+  if ( sent > 0 ) {
+    register_write();
+  }
+  return sent;
+}
+
 // mark the socket as listening for incoming connections
 //! \param[in] backlog is the number of waiting connections to queue (see [listen(2)](\ref man2::listen))
 void TCPSocket::listen( const int backlog )
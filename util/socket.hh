@@ -5,6 +5,7 @@
 
 #include <cstdint>
 #include <functional>
+#include <span>
 #include <sys/socket.h>
 
 //! \brief Base class for network sockets (TCP, UDP, etc.)
@@ -71,6 +72,17 @@ public:
 
   //! Send datagram to the socket's connected address (must call connect() first)
   void send( std::string_view payload );
+
+  //! \brief Receive several datagrams with one [recvmmsg(2)](\ref man2::recvmmsg) call
+  //! \details Each payload's size is the room for one datagram (empty payloads get a default size), and is
+  //! then resized to the datagram received into it. Waits only for the first datagram.
+  //! \returns the number of datagrams received (0 if a non-blocking socket has none)
+  size_t recv_batch( std::span<std::string> payloads );
+
+  //! \brief Send several datagrams (each gathered from a list of buffers) to the socket's connected address with
+  //! one [sendmmsg(2)](\ref man2::sendmmsg) call
+  //! \returns the number of datagrams sent, which may be fewer than given
+  size_t send_batch( std::span<const std::vector<std::string>> datagrams );
 };
 
 //! A wrapper around [UDP sockets](\ref man7::udp)
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+template<class T>
+class Task;
+
+namespace task_detail {
+//! What every Task's promise keeps: who to resume at the end, and how the coroutine ended if it threw
+struct PromiseBase
+{
+  std::coroutine_handle<> continuation { std::noop_coroutine() }; //!< the coroutine awaiting this one
+  std::exception_ptr exception {};
+
+  //! Resume the awaiting coroutine in place of returning to whoever resumed this one (so that a long chain of
+  //! tasks finishing one after another doesn't grow the stack)
+  struct FinalAwaiter
+  {
+    bool await_ready() noexcept { return false; }
+    template<class PromiseT>
+    std::coroutine_handle<> await_suspend( std::coroutine_handle<PromiseT> finished ) noexcept
+    {
+      return finished.promise().continuation;
+    }
+    void await_resume() noexcept {}
+  };
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+  FinalAwaiter final_suspend() noexcept { return {}; }
+  void unhandled_exception() { exception = std::current_exception(); }
+};
+
+template<class T>
+struct Promise : PromiseBase
+{
+  std::optional<T> value {};
+
+  void return_value( T v ) { value.emplace( std::move( v ) ); }
+  T result()
+  {
+    if ( exception ) {
+      std::rethrow_exception( exception );
+    }
+    return std::move( *value );
+  }
+};
+
+template<>
+struct Promise<void> : PromiseBase
+{
+  void return_void() {}
+  void result()
+  {
+    if ( exception ) {
+      std::rethrow_exception( exception );
+    }
+  }
+};
+} // namespace task_detail
+
+//! A coroutine that produces a T for the coroutine that co_awaits it
+//! \details A Task does nothing until it is awaited; it then runs until it first suspends, and when it finishes,
+//! its awaiter resumes with the result (or the exception the task threw). Tasks have no thread or stack of their
+//! own: each runs on whatever thread resumes it, and its frame lives until the Task object is destroyed.
+template<class T = void>
+class Task
+{
+public:
+  struct promise_type : task_detail::Promise<T>
+  {
+    Task get_return_object() { return Task { std::coroutine_handle<promise_type>::from_promise( *this ) }; }
+  };
+
+  Task( Task&& other ) noexcept : handle_( std::exchange( other.handle_, {} ) ) {}
+  Task& operator=( Task&& other ) noexcept
+  {
+    std::swap( handle_, other.handle_ );
+    return *this;
+  }
+  Task( const Task& other ) = delete;
+  Task& operator=( const Task& other ) = delete;
+
+  ~Task()
+  {
+    if ( handle_ ) {
+      handle_.destroy();
+    }
+  }
+
+  //! \name Awaiting a Task starts it, and resumes the awaiter with its result
+  //!@{
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend( std::coroutine_handle<> awaiter ) noexcept
+  {
+    handle_.promise().continuation = awaiter;
+    return handle_;
+  }
+  T await_resume() { return handle_.promise().result(); }
+  //!@}
+
+private:
+  explicit Task( std::coroutine_handle<promise_type> handle ) : handle_( handle ) {}
+
+  std::coroutine_handle<promise_type> handle_;
+};
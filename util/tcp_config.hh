@@ -1,6 +1,7 @@
 #pragma once
 
 #include "address.hh"
+#include "path_mtu.hh"
 #include "wrapping_integers.hh"
 
 #include <cstddef>
@@ -20,6 +21,8 @@ public:
   size_t recv_capacity = DEFAULT_CAPACITY; //!< Receive capacity, in bytes
   size_t send_capacity = DEFAULT_CAPACITY; //!< Sender capacity, in bytes
   Wrap32 isn { 137 };                      //!< Default initial sequence number
+  bool mtu_probing = false;                //!< Probe for a larger segment size than MAX_PAYLOAD_SIZE (RFC 4821)
+  PathMTUConfig path_mtu {};               //!< How to probe, if mtu_probing is set
 };
 
 //! Config for classes derived from FdAdapter
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "four_tuple.hh"
+#include "random.hh"
+#include "tcp_config.hh"
+#include "tcp_peer.hh"
+#include "tuntap_adapter.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//! Many TCP connections over one TUN device
+//! \details The demultiplexer reads every datagram from the device and hands each TCP segment to the TCPPeer of
+//! the connection it belongs to, found by 4-tuple in a hash table. A SYN to a listening port creates a
+//! connection, which joins that port's accept queue once the handshake completes. Segments that belong to no
+//! connection are dropped.
+//!
+//! Everything runs on the caller's thread: call receive() when the device is readable, push() after writing to
+//! a connection's outbound stream (or reading from its inbound stream, which opens the window), and tick() once
+//! ms_until_next_tick() has passed. Only connections with a timer running (a retransmission, or lingering after
+//! the streams finish) are kept in the timer heap, so idle connections cost nothing per tick.
+class TCPDemux
+{
+public:
+  //! Construct from the adapter of the device that carries the connections (its configuration is ignored)
+  explicit TCPDemux( TCPOverIPv4OverTunFdAdapter&& adapter );
+
+  //! Accept connections to `port` (on any local address), using `config` (with a fresh ISN for each), and queue
+  //! up to `backlog` of them, counting those still completing the handshake
+  void listen( uint16_t port, const TCPConfig& config, size_t backlog = 128 );
+
+  //! Stop accepting connections to `port`, and reset those not yet accepted
+  void stop_listening( uint16_t port );
+
+  //! Take the next established connection from `port`'s accept queue, if any
+  std::optional<FourTuple> accept( uint16_t port );
+
+  //! Start connecting from `tuple`'s local address and port to its remote ones (the connection is established
+  //! once peer( tuple ).has_ackno())
+  void connect( const TCPConfig& config, const FourTuple& tuple );
+
+  //! The TCPPeer of a connection (throws std::out_of_range if there is none)
+  TCPPeer& peer( const FourTuple& tuple );
+
+  //! Whether there is a connection with this 4-tuple
+  bool contains( const FourTuple& tuple ) const { return connections_.contains( tuple ); }
+
+  //! Number of connections, including those not yet accepted
+  size_t size() const { return connections_.size(); }
+
+  //! Reset a connection: send a RST and fail both of its streams, so that it is no longer active (it stays
+  //! until erase())
+  void reset( const FourTuple& tuple );
+
+  //! Forget a connection, resetting it first if it is still active
+  void erase( const FourTuple& tuple );
+
+  //! Read the datagrams queued on the device and deliver each segment to its connection. Each connection that
+  //! got segments replies at most once to them, and is appended to `ready` (once).
+  void receive( std::vector<FourTuple>& ready );
+
+  //! Let a connection send what its outbound stream and the window allow
+  void push( const FourTuple& tuple );
+
+  //! Tell the connections whose timers are due how much time has passed, and forget those that finished before
+  //! they were accepted. The others are appended to `ready`, like those that receive segments.
+  void tick( std::vector<FourTuple>& ready );
+
+  //! How many milliseconds until tick() has something to do, if ever
+  std::optional<uint64_t> ms_until_next_tick();
+
+  //! Access the underlying file descriptor
+  FileDescriptor& fd() { return adapter_.fd(); }
+
+private:
+  struct Connection
+  {
+    TCPPeer peer;
+    Wrap32 isn;                          //!< our ISN, to recognize the ACK that completes the handshake
+    bool pending;                        //!< accepted from a listening port, but not yet handshaken
+    uint64_t last_tick;                  //!< when the TCPPeer was last told the time
+    std::optional<uint64_t> deadline {}; //!< when it next needs to be, if ever
+  };
+
+  //! An entry in the timer heap; entries whose connection has gone or has moved its deadline are skipped
+  struct TimerEntry
+  {
+    uint64_t deadline;
+    FourTuple tuple;
+  };
+
+  struct Listener
+  {
+    TCPConfig config;
+    size_t backlog;
+    size_t pending {};                   //!< connections to this port still completing the handshake
+    std::deque<FourTuple> established {}; //!< the accept queue
+  };
+
+  TCPOverIPv4OverTunFdAdapter adapter_;
+  std::unordered_map<FourTuple, Connection, FourTupleHash> connections_ {};
+  std::unordered_map<uint16_t, Listener> listeners_ {};
+  std::default_random_engine rng_ { get_random_engine() }; //!< for the ISNs of accepted connections
+  std::vector<TimerEntry> timers_ {};                        //!< min-heap by deadline
+
+  std::vector<std::pair<FourTuple, TCPMessage>> inbound_ {}; //!< segments read in one batch (reused)
+  std::vector<TCPMessage> delivery_ {};                       //!< one connection's share of the batch (reused)
+  std::vector<TCPMessage> outbound_ {};                       //!< segments sent by one connection (reused)
+
+  //! Every TCPPeer's transmit function: queue the segment, to be written by flush()
+  const TCPPeer::TransmitFunction transmit_ {
+    [this]( TCPMessage msg ) { outbound_.push_back( std::move( msg ) ); } };
+
+  //! Create a connection for a SYN to a listening port, if there is room for it
+  Connection* accept_syn( const FourTuple& tuple, const TCPMessage& syn, uint64_t now );
+
+  //! Deliver delivery_ to the connection
+  void deliver( const FourTuple& tuple, uint64_t now, std::vector<FourTuple>& ready );
+
+  //! Tell the connection's TCPPeer how much time has passed since it was last told
+  void catch_up( Connection& connection, uint64_t now );
+
+  //! Write the segments a connection queued in outbound_, and put its next deadline in the timer heap
+  void flush( const FourTuple& tuple, Connection& connection );
+};
@@ -3,9 +3,12 @@
 #include "byte_stream.hh"
 #include "eventloop.hh"
 #include "file_descriptor.hh"
+#include "seqlock.hh"
 #include "socket.hh"
 #include "tcp_config.hh"
+#include "tcp_over_udp.hh"
 #include "tcp_peer.hh"
+#include "tcp_stats.hh"
 #include "tuntap_adapter.hh"
 
 #include <atomic>
@@ -58,6 +61,9 @@ public:
   // Return peer address from underlying datagram adapter
   const Address& peer_address() const { return _datagram_adapter.config().destination; }
 
+  //! The connection's statistics, as of the TCPPeer thread's last trip around its event loop (from any thread)
+  TCPStats stats() const { return _stats.load(); }
+
 protected:
   //! Adapter to underlying datagram socket (e.g., UDP or IP)
   AdaptT _datagram_adapter;
@@ -78,6 +84,33 @@ private:
   //! Process events while specified condition is true
   void _tcp_loop( const std::function<bool()>& condition );
 
+  //! Tell the TCPPeer how much time has passed since the last tick
+  void _tick();
+
+  //! Make sure an EventLoop timer wakes the TCPPeer thread when the TCPPeer next needs a tick
+  void _schedule_tick();
+
+  size_t _tick_category {};                            //!< EventLoop category of the tick timer
+  std::optional<EventLoop::RuleHandle> _tick_timer {}; //!< timer set by _schedule_tick()
+  std::optional<uint64_t> _tick_deadline {};           //!< its deadline (on the timestamp_ms() clock)
+  uint64_t _last_tick {};                              //!< when the TCPPeer was last ticked (timestamp_ms())
+
+  std::vector<TCPMessage> _inbound {};  //!< segments read in one batch (reused)
+  std::vector<TCPMessage> _outbound {}; //!< segments sent by the TCPPeer since the last _flush_outbound()
+
+  //! The TCPPeer's transmit function: queue the segment, to be written with the rest of the batch
+  const TCPPeer::TransmitFunction _transmit {
+    [this]( TCPMessage msg ) { _outbound.push_back( std::move( msg ) ); } };
+
+  //! Write the queued segments to the datagram adapter
+  void _flush_outbound();
+
+  //! Snapshot of the TCPPeer's statistics, published by the TCPPeer thread for stats()
+  SeqLock<TCPStats> _stats {};
+
+  //! Publish the TCPPeer's statistics
+  void _publish_stats();
+
   //! Main loop of TCPPeer thread
   void _tcp_main();
 
@@ -98,6 +131,7 @@ private:
 
 using TCPOverIPv4MinnowSocket = TCPMinnowSocket<TCPOverIPv4OverTunFdAdapter>;
 using LossyTCPOverIPv4MinnowSocket = TCPMinnowSocket<LossyFdAdapter<TCPOverIPv4OverTunFdAdapter>>;
+using TCPOverUDPMinnowSocket = TCPMinnowSocket<TCPOverUDPSocketAdapter>;
 
 //! \class TCPMinnowSocket
 //! This class involves the simultaneous operation of two threads.
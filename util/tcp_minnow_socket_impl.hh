@@ -15,7 +15,8 @@
 #include <unistd.h>
 #include <utility>
 
-static constexpr size_t TCP_TICK_MS = 10;
+//! Longest the TCPPeer thread sleeps without a timer or fd event, so that it notices _abort
+static constexpr int TCP_MAX_SLEEP_MS = 100;
 
 inline uint64_t timestamp_ms()
 {
@@ -28,9 +29,12 @@ inline uint64_t timestamp_ms()
 template<TCPDatagramAdapter AdaptT>
 void TCPMinnowSocket<AdaptT>::_tcp_loop( const std::function<bool()>& condition )
 {
-  auto base_time = timestamp_ms();
+  _last_tick = timestamp_ms();
   while ( condition() ) {
-    auto ret = _eventloop.wait_next_event( TCP_TICK_MS );
+    _flush_outbound();
+    _schedule_tick();
+    _publish_stats();
+    auto ret = _eventloop.wait_next_event( TCP_MAX_SLEEP_MS );
     if ( ret == EventLoop::Result::Exit or _abort ) {
       break;
     }
@@ -39,13 +43,74 @@ void TCPMinnowSocket<AdaptT>::_tcp_loop( const std::function<bool()>& condition
       throw std::runtime_error( "_tcp_loop entered before TCPPeer initialized" );
     }
 
-    if ( _tcp.value().active() ) {
-      const auto next_time = timestamp_ms();
-      _tcp.value().tick( next_time - base_time, [&]( auto x ) { _datagram_adapter.write( x ); } );
-      _datagram_adapter.tick( next_time - base_time );
-      base_time = next_time;
+    _tick();
+  }
+  _flush_outbound();
+  _publish_stats();
+
+  if ( _tick_timer ) {
+    _tick_timer->cancel();
+    _tick_timer.reset();
+    _tick_deadline.reset();
+  }
+}
+
+template<TCPDatagramAdapter AdaptT>
+void TCPMinnowSocket<AdaptT>::_tick()
+{
+  if ( _tcp.has_value() and _tcp.value().active() ) {
+    const auto next_time = timestamp_ms();
+    _tcp.value().tick( next_time - _last_tick, _transmit );
+    _datagram_adapter.tick( next_time - _last_tick );
+    _last_tick = next_time;
+  }
+}
+
+template<TCPDatagramAdapter AdaptT>
+void TCPMinnowSocket<AdaptT>::_flush_outbound()
+{
+  if ( not _outbound.empty() ) {
+    _datagram_adapter.write_batch( _outbound );
+    _outbound.clear();
+  }
+}
+
+template<TCPDatagramAdapter AdaptT>
+void TCPMinnowSocket<AdaptT>::_publish_stats()
+{
+  if ( _tcp.has_value() ) {
+    _stats.store( _tcp->stats() );
+  }
+}
+
+template<TCPDatagramAdapter AdaptT>
+void TCPMinnowSocket<AdaptT>::_schedule_tick()
+{
+  std::optional<uint64_t> deadline;
+  if ( _tcp.has_value() and _tcp.value().active() ) {
+    if ( const auto ms = _tcp.value().ms_until_next_tick() ) {
+      deadline = _last_tick + ms.value();
     }
   }
+
+  if ( deadline == _tick_deadline ) {
+    return;
+  }
+
+  if ( _tick_timer ) {
+    _tick_timer->cancel();
+    _tick_timer.reset();
+  }
+  _tick_deadline = deadline;
+
+  if ( deadline ) {
+    const EventLoop::Clock::time_point when { std::chrono::milliseconds( deadline.value() ) };
+    _tick_timer = _eventloop.add_timer( _tick_category, when, [&] {
+      _tick_timer.reset();
+      _tick_deadline.reset();
+      _tick();
+    } );
+  }
 }
 
 //! \param[in] data_socket_pair is a pair of connected AF_UNIX SOCK_STREAM sockets
@@ -65,6 +130,7 @@ template<TCPDatagramAdapter AdaptT>
 void TCPMinnowSocket<AdaptT>::_initialize_TCP( const TCPConfig& config )
 {
   _tcp.emplace( config );
+  _tick_category = _eventloop.add_category( "tick TCPPeer" );
 
   // Set up the event loop
 
@@ -86,9 +152,10 @@ void TCPMinnowSocket<AdaptT>::_initialize_TCP( const TCPConfig& config )
     _datagram_adapter.fd(),
     Direction::In,
     [&] {
-      if ( auto seg = _datagram_adapter.read() ) {
-        _tcp->receive( std::move( seg.value() ), [&]( auto x ) { _datagram_adapter.write( x ); } );
-      }
+      // take everything that has arrived, so the TCPPeer replies (at most) once to the whole batch
+      _inbound.clear();
+      _datagram_adapter.read_batch( _inbound );
+      _tcp->receive( _inbound, _transmit );
 
       // debugging output:
       if ( _thread_data.eof() and _tcp.value().sender().sequence_numbers_in_flight() == 0 and not _fully_acked ) {
@@ -121,7 +188,7 @@ void TCPMinnowSocket<AdaptT>::_initialize_TCP( const TCPConfig& config )
                   << " still in flight).\n";
       }
 
-      _tcp->push( [&]( auto x ) { _datagram_adapter.write( x ); } );
+      _tcp->push( _transmit );
     },
     [&] {
       return ( _tcp->active() ) and ( not _outbound_shutdown )
@@ -226,7 +293,13 @@ void TCPMinnowSocket<AdaptT>::connect( const TCPConfig& c_tcp, const FdAdapterCo
     throw std::runtime_error( "connect() with TCPConnection already initialized" );
   }
 
-  _initialize_TCP( c_tcp );
+  TCPConfig config = c_tcp;
+  if ( config.mtu_probing ) {
+    // start from what an earlier connection to the same host found
+    const auto learned = PathMTUCache::global().lookup( c_ad.destination.ipv4_numeric(), timestamp_ms() );
+    config.path_mtu.initial_payload = learned.value_or( config.path_mtu.initial_payload );
+  }
+  _initialize_TCP( config );
 
   _datagram_adapter.config_mut() = c_ad;
 
@@ -236,7 +309,7 @@ void TCPMinnowSocket<AdaptT>::connect( const TCPConfig& c_tcp, const FdAdapterCo
     throw std::runtime_error( "TCPPeer not successfully initialized" );
   }
 
-  _tcp->push( [&]( auto x ) { _datagram_adapter.write( x ); } );
+  _tcp->push( _transmit );
 
   if ( _tcp->sender().sequence_numbers_in_flight() != 1 ) {
     throw std::runtime_error( "After TCPConnection::connect(), expected sequence_numbers_in_flight() == 1" );
@@ -286,6 +359,12 @@ void TCPMinnowSocket<AdaptT>::_tcp_main()
       std::cerr << "DEBUG: minnow TCP connection finished "
                 << ( _tcp->inbound_reader().has_error() ? "uncleanly.\n" : "cleanly.\n" );
     }
+    if ( const auto& prober = _tcp->sender().prober(); prober and prober->learned() ) {
+      // (a size that was only the starting point would overwrite what an earlier connection learned)
+      PathMTUCache::global().update( _datagram_adapter.config().destination.ipv4_numeric(),
+                                     _tcp->sender().max_payload_size(),
+                                     timestamp_ms() );
+    }
     _tcp.reset();
   } catch ( const std::exception& e ) {
     std::cerr << "Exception in TCPConnection runner thread: " << e.what() << "\n";
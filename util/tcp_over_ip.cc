@@ -23,7 +23,8 @@ using namespace std;
 //! `_listen` flag and records the source and destination addresses and port numbers
 //! from the TCP header; it uses this information to filter future reads.
 //! \returns a std::optional<TCPSegment> that is empty if the segment was invalid or unrelated
-optional<TCPMessage> TCPOverIPv4Adapter::unwrap_tcp_in_ip( const InternetDatagram& ip_dgram )
+optional<TCPMessage> TCPOverIPv4Adapter::unwrap_tcp_in_ip( const InternetDatagram& ip_dgram,
+                                                           const bool checksum_verified )
 {
   // is the IPv4 datagram for us?
   // Note: it's valid to bind to address "0" (INADDR_ANY) and reply from actual address contacted
@@ -36,28 +37,23 @@ optional<TCPMessage> TCPOverIPv4Adapter::unwrap_tcp_in_ip( const InternetDatagra
     return {};
   }
 
-  // does the IPv4 datagram claim that its payload is a TCP segment?
-  if ( ip_dgram.header.proto != IPv4Header::PROTO_TCP ) {
-    return {};
-  }
-
-  // is the payload a valid TCP segment?
-  TCPSegment tcp_seg;
-  if ( not parse( tcp_seg, ip_dgram.payload, ip_dgram.header.pseudo_checksum() ) ) {
+  FourTuple tuple;
+  auto msg = parse_tcp_in_ip( ip_dgram, checksum_verified, tuple );
+  if ( not msg ) {
     return {};
   }
 
   // is the TCP segment for us?
-  if ( tcp_seg.udinfo.dst_port != config().source.port() ) {
+  if ( tuple.local_port != config().source.port() ) {
     return {};
   }
 
   // should we target this source addr/port (and use its destination addr as our source) in reply?
   if ( listening() ) {
-    if ( tcp_seg.message.sender.SYN and not tcp_seg.message.sender.RST ) {
+    if ( msg->sender.SYN and not msg->sender.RST ) {
       config_mutable().source = Address { inet_ntoa( { htobe32( ip_dgram.header.dst ) } ), config().source.port() };
       config_mutable().destination
-        = Address { inet_ntoa( { htobe32( ip_dgram.header.src ) } ), tcp_seg.udinfo.src_port };
+        = Address { inet_ntoa( { htobe32( ip_dgram.header.src ) } ), tuple.remote_port };
       set_listening( false );
     } else {
       return {};
@@ -65,26 +61,56 @@ optional<TCPMessage> TCPOverIPv4Adapter::unwrap_tcp_in_ip( const InternetDatagra
   }
 
   // is the TCP segment from our peer?
-  if ( tcp_seg.udinfo.src_port != config().destination.port() ) {
+  if ( tuple.remote_port != config().destination.port() ) {
     return {};
   }
 
-  return tcp_seg.message;
+  return msg;
+}
+
+FourTuple TCPOverIPv4Adapter::connection() const
+{
+  return { config().source.ipv4_numeric(),
+           config().destination.ipv4_numeric(),
+           config().source.port(),
+           config().destination.port() };
+}
+
+//! \returns a std::optional<TCPMessage> that is empty if the datagram does not hold a valid TCP segment
+optional<TCPMessage> TCPOverIPv4Adapter::parse_tcp_in_ip( const InternetDatagram& ip_dgram,
+                                                          const bool checksum_verified,
+                                                          FourTuple& tuple )
+{
+  // does the IPv4 datagram claim that its payload is a TCP segment?
+  if ( ip_dgram.header.proto != IPv4Header::PROTO_TCP ) {
+    return {};
+  }
+
+  // is the payload a valid TCP segment?
+  TCPSegment tcp_seg;
+  const auto pseudo_checksum = checksum_verified ? optional<uint32_t> {} : ip_dgram.header.pseudo_checksum();
+  if ( not parse( tcp_seg, ip_dgram.payload, pseudo_checksum ) ) {
+    return {};
+  }
+
+  tuple = { ip_dgram.header.dst, ip_dgram.header.src, tcp_seg.udinfo.dst_port, tcp_seg.udinfo.src_port };
+  return move( tcp_seg.message );
 }
 
 //! Takes a TCP segment, sets port numbers as necessary, and wraps it in an IPv4 datagram
-//! \param[in] seg is the TCP segment to convert
-InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip( const TCPMessage& msg )
+//! \param[in] msg is the TCP segment to convert
+//! \param[in] tuple is the connection it belongs to
+InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip( const TCPMessage& msg, const FourTuple& tuple )
 {
   TCPSegment seg { .message = msg };
   // set the port numbers in the TCP segment
-  seg.udinfo.src_port = config().source.port();
-  seg.udinfo.dst_port = config().destination.port();
+  seg.udinfo.src_port = tuple.local_port;
+  seg.udinfo.dst_port = tuple.remote_port;
 
   // create an Internet Datagram and set its addresses and length
   InternetDatagram ip_dgram;
-  ip_dgram.header.src = config().source.ipv4_numeric();
-  ip_dgram.header.dst = config().destination.ipv4_numeric();
+  ip_dgram.header.src = tuple.local_address;
+  ip_dgram.header.dst = tuple.remote_address;
   ip_dgram.header.len = ip_dgram.header.hlen * 4 + 20 /* tcp header len */ + seg.message.sender.payload.size();
 
   // set payload, calculating TCP checksum using information from IP header
@@ -94,3 +120,33 @@ InternetDatagram TCPOverIPv4Adapter::wrap_tcp_in_ip( const TCPMessage& msg )
 
   return ip_dgram;
 }
+
+//! Like wrap_tcp_in_ip, but for checksum offload: the TCP checksum field holds only the pseudo-header's sum, so
+//! the payload never has to be read (or even gathered in one place)
+//! \param[in] msg is the TCP segment whose header to convert (its payload is ignored)
+//! \param[in] payload_length is the length of the payload that will follow the header
+//! \param[in] tuple is the connection it belongs to
+InternetDatagram TCPOverIPv4Adapter::wrap_tcp_header_in_ip( const TCPMessage& msg,
+                                                            const size_t payload_length,
+                                                            const FourTuple& tuple )
+{
+  TCPSegment seg { .message = { .sender = { .seqno = msg.sender.seqno,
+                                            .SYN = msg.sender.SYN,
+                                            .payload = {},
+                                            .FIN = msg.sender.FIN,
+                                            .RST = msg.sender.RST },
+                                .receiver = msg.receiver } };
+  seg.udinfo.src_port = tuple.local_port;
+  seg.udinfo.dst_port = tuple.remote_port;
+
+  InternetDatagram ip_dgram;
+  ip_dgram.header.src = tuple.local_address;
+  ip_dgram.header.dst = tuple.remote_address;
+  ip_dgram.header.len = ip_dgram.header.hlen * 4 + 20 /* tcp header len */ + payload_length;
+
+  seg.compute_partial_checksum( ip_dgram.header.pseudo_checksum() );
+  ip_dgram.header.compute_checksum();
+  ip_dgram.payload = serialize( seg );
+
+  return ip_dgram;
+}
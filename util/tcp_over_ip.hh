@@ -1,6 +1,7 @@
 #pragma once
 
 #include "fd_adapter.hh"
+#include "four_tuple.hh"
 #include "ipv4_datagram.hh"
 #include "tcp_segment.hh"
 
@@ -10,7 +11,26 @@
 class TCPOverIPv4Adapter : public FdAdapterBase
 {
 public:
-  std::optional<TCPMessage> unwrap_tcp_in_ip( const InternetDatagram& ip_dgram );
+  //! \param[in] checksum_verified skips the TCP checksum (the kernel vouched for it, or offloaded it)
+  std::optional<TCPMessage> unwrap_tcp_in_ip( const InternetDatagram& ip_dgram, bool checksum_verified = false );
 
-  InternetDatagram wrap_tcp_in_ip( const TCPMessage& msg );
+  InternetDatagram wrap_tcp_in_ip( const TCPMessage& msg ) { return wrap_tcp_in_ip( msg, connection() ); }
+
+  //! The current connection's addresses and ports, from the configuration
+  FourTuple connection() const;
+
+  //! Parse the TCP segment that `ip_dgram` carries, whichever connection it belongs to, and set `tuple` to that
+  //! connection (seen from our end)
+  static std::optional<TCPMessage> parse_tcp_in_ip( const InternetDatagram& ip_dgram,
+                                                    bool checksum_verified,
+                                                    FourTuple& tuple );
+
+  //! Wrap `msg` in an IPv4 datagram that belongs to connection `tuple`
+  static InternetDatagram wrap_tcp_in_ip( const TCPMessage& msg, const FourTuple& tuple );
+
+  //! Wrap just the header of `msg` (whose payload the caller sends right after it, `payload_length` bytes in
+  //! all), leaving the TCP checksum for the kernel to finish
+  static InternetDatagram wrap_tcp_header_in_ip( const TCPMessage& msg,
+                                                 size_t payload_length,
+                                                 const FourTuple& tuple );
 };
@@ -0,0 +1,121 @@
+#include "tcp_over_udp.hh"
+
+#include "parser.hh"
+
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+namespace {
+constexpr size_t max_datagram_size = 2048; // room for a segment of TCPConfig::MAX_PAYLOAD_SIZE, and then some
+
+// The datagram just received into `buffer`, for the segment's payload to take over without a copy; `buffer` is
+// replaced with one from packet_pool (which the caller sizes for the next datagram)
+PacketBuffer take_received( string& buffer )
+{
+  return PacketBuffer { exchange( buffer, packet_pool::take_string() ) };
+}
+} // namespace
+
+TCPOverUDPSocketAdapter::TCPOverUDPSocketAdapter( UDPSocket&& sock )
+  : _sock( move( sock ) ), _recv_buffers( kMaxBatch, string( max_datagram_size, 0 ) )
+{}
+
+void TCPOverUDPSocketAdapter::connect_to_peer()
+{
+  if ( not _connected ) {
+    _sock.connect( config().destination );
+    _connected = true;
+  }
+}
+
+optional<TCPMessage> TCPOverUDPSocketAdapter::unwrap_tcp_in_udp( PacketBuffer&& payload ) const
+{
+  TCPSegment tcp_seg;
+  if ( not parse( tcp_seg, move( payload ), 0 ) ) {
+    return {};
+  }
+  return move( tcp_seg.message );
+}
+
+vector<string> TCPOverUDPSocketAdapter::wrap_tcp_in_udp( const TCPMessage& msg ) const
+{
+  TCPSegment seg { .message = msg };
+  seg.udinfo.src_port = config().source.port();
+  seg.udinfo.dst_port = config().destination.port();
+  seg.compute_checksum( 0 );
+  return serialize( seg );
+}
+
+//! \details While listening, the first SYN determines the peer: its address becomes the configured destination
+//! and the socket is connected to it.
+optional<TCPMessage> TCPOverUDPSocketAdapter::read()
+{
+  if ( _connected ) {
+    string& payload = _recv_buffers.front();
+    payload.resize( max_datagram_size );
+    if ( _sock.recv_batch( span( &payload, 1 ) ) == 0 ) {
+      return {};
+    }
+    return unwrap_tcp_in_udp( take_received( payload ) );
+  }
+
+  Address source { "0", 0 };
+  string payload;
+  _sock.recv( source, payload );
+  auto msg = unwrap_tcp_in_udp( PacketBuffer { move( payload ) } );
+  if ( not msg or not listening() ) {
+    return msg; // (before connecting, datagrams from anyone but the peer are not expected)
+  }
+
+  if ( not msg->sender.SYN or msg->sender.RST ) {
+    return {};
+  }
+  config_mutable().destination = source;
+  set_listening( false );
+  connect_to_peer();
+  return msg;
+}
+
+void TCPOverUDPSocketAdapter::write( const TCPMessage& seg )
+{
+  connect_to_peer();
+  write_batch( span( &seg, 1 ) );
+}
+
+void TCPOverUDPSocketAdapter::read_batch( vector<TCPMessage>& segs )
+{
+  if ( not _connected ) {
+    if ( auto msg = read() ) {
+      segs.push_back( move( *msg ) );
+    }
+    return;
+  }
+
+  const size_t received = _sock.recv_batch( _recv_buffers );
+  for ( size_t i = 0; i < received; ++i ) {
+    if ( auto msg = unwrap_tcp_in_udp( take_received( _recv_buffers[i] ) ) ) {
+      segs.push_back( move( *msg ) );
+    }
+    _recv_buffers[i].resize( max_datagram_size ); // ready for the next batch
+  }
+}
+
+void TCPOverUDPSocketAdapter::write_batch( const span<const TCPMessage> segs )
+{
+  connect_to_peer();
+
+  _send_buffers.clear();
+  for ( const auto& seg : segs ) {
+    _send_buffers.push_back( wrap_tcp_in_udp( seg ) );
+  }
+
+  for ( size_t sent = 0; sent < _send_buffers.size(); ) {
+    const size_t n = _sock.send_batch( span( _send_buffers ).subspan( sent ) );
+    if ( n == 0 ) {
+      return; // a non-blocking socket's buffer is full: drop the rest, as the network might
+    }
+    sent += n;
+  }
+}
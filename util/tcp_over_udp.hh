@@ -0,0 +1,52 @@
+#pragma once
+
+#include "fd_adapter.hh"
+#include "packet_buffer.hh"
+#include "socket.hh"
+#include "tcp_segment.hh"
+#include "tuntap_adapter.hh"
+
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+//! \brief A FD adapter that carries TCP segments as the payloads of UDP datagrams
+//! \details The TCP checksum covers only the segment (there is no IP pseudo-header to include). Once the peer is
+//! known (it is set in the configuration before connecting, or learned from the SYN while listening), the UDP
+//! socket is connected to it, so that only the peer's datagrams are received and batches can be moved with
+//! [recvmmsg(2)](\ref man2::recvmmsg) and [sendmmsg(2)](\ref man2::sendmmsg).
+class TCPOverUDPSocketAdapter : public FdAdapterBase
+{
+private:
+  UDPSocket _sock;
+  bool _connected = false;
+
+  std::vector<std::string> _recv_buffers;                 //!< preallocated, one per datagram of a batch
+  std::vector<std::vector<std::string>> _send_buffers {}; //!< the serialized datagrams of a batch
+
+  void connect_to_peer();
+  std::optional<TCPMessage> unwrap_tcp_in_udp( PacketBuffer&& payload ) const;
+  std::vector<std::string> wrap_tcp_in_udp( const TCPMessage& msg ) const;
+
+public:
+  //! Construct from a bound (but unconnected) UDPSocket
+  explicit TCPOverUDPSocketAdapter( UDPSocket&& sock );
+
+  //! Attempts to read a datagram and parse the TCP segment it carries
+  std::optional<TCPMessage> read();
+
+  //! Sends a TCP segment as a UDP datagram to the peer
+  void write( const TCPMessage& seg );
+
+  //! Reads up to kMaxBatch datagrams with one system call, appending the TCP segments they carry to `segs`
+  void read_batch( std::vector<TCPMessage>& segs );
+
+  //! Sends the segments with as few system calls as possible (one per 64 datagrams)
+  void write_batch( std::span<const TCPMessage> segs );
+
+  //! Access underlying file descriptor
+  FileDescriptor& fd() { return _sock; }
+};
+
+static_assert( TCPDatagramAdapter<TCPOverUDPSocketAdapter> );
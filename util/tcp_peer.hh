@@ -6,19 +6,32 @@
 #include "tcp_segment.hh"
 #include "tcp_sender.hh"
 #include "tcp_sender_message.hh"
+#include "tcp_stats.hh"
+#include "trace.hh"
 
+#include <algorithm>
+#include <cstdint>
 #include <functional>
 #include <optional>
+#include <vector>
 
 class TCPPeer
 {
-  auto make_send( const auto& transmit )
+  auto make_send( const auto& transmit, bool retransmission = false )
   {
-    return [&]( const TCPSenderMessage& x ) { send( x, transmit ); };
+    return [&, retransmission]( const TCPSenderMessage& x ) {
+      stats_.retransmissions += retransmission;
+      send( x, transmit, retransmission ? trace::Event::Retransmit : trace::Event::SegmentSent );
+    };
   }
 
 public:
-  explicit TCPPeer( const TCPConfig& cfg ) : cfg_( cfg ) {}
+  explicit TCPPeer( const TCPConfig& cfg ) : cfg_( cfg )
+  {
+    if ( cfg_.mtu_probing ) {
+      sender_.enable_mtu_probing( cfg_.path_mtu );
+    }
+  }
 
   Writer& outbound_writer() { return sender_.writer(); }
   Reader& inbound_reader() { return receiver_.reader(); }
@@ -31,7 +44,7 @@ public:
   void tick( uint64_t t, const TransmitFunction& transmit )
   {
     cumulative_time_ += t;
-    sender_.tick( t, make_send( transmit ) );
+    sender_.tick( t, make_send( transmit, true ) ); // (the sender only sends from tick() to retransmit)
   }
   bool has_ackno() const { return receiver_.send().ackno.has_value(); }
 
@@ -39,12 +52,21 @@ public:
   bool active() const
   {
     const bool any_errors = receiver_.reader().has_error() or sender_.writer().has_error();
-    const bool sender_active = sender_.sequence_numbers_in_flight() or not sender_.reader().is_finished();
-    const bool receiver_active = not receiver_.writer().is_closed();
-    const bool lingering
-      = linger_after_streams_finish_ and ( cumulative_time_ < time_of_last_receipt_ + 10UL * cfg_.rt_timeout );
+    const bool lingering = linger_after_streams_finish_ and ( cumulative_time_ < linger_deadline() );
 
-    return ( not any_errors ) and ( sender_active or receiver_active or lingering );
+    return ( not any_errors ) and ( streams_active() or lingering );
+  }
+
+  /* How many milliseconds until tick() has something to do (retransmit, or stop lingering), if ever? */
+  std::optional<uint64_t> ms_until_next_tick() const
+  {
+    std::optional<uint64_t> next = sender_.ms_until_timeout();
+    if ( linger_after_streams_finish_ and not streams_active() ) {
+      const uint64_t until_linger_ends
+        = cumulative_time_ < linger_deadline() ? linger_deadline() - cumulative_time_ : 0;
+      next = next ? std::min( *next, until_linger_ends ) : until_linger_ends;
+    }
+    return next;
   }
 
   void receive( TCPMessage msg, const TransmitFunction& transmit )
@@ -53,6 +75,51 @@ public:
       return;
     }
 
+    absorb( std::move( msg ) );
+
+    // Send reply if needed.
+    if ( need_send_ ) {
+      send( sender_.make_empty_message(), transmit );
+    }
+  }
+
+  /* Receive a batch of messages (e.g. everything that arrived in one wakeup), then reply at most once */
+  void receive( std::vector<TCPMessage>& msgs, const TransmitFunction& transmit )
+  {
+    for ( auto& msg : msgs ) {
+      if ( not active() ) {
+        return;
+      }
+      absorb( std::move( msg ) );
+    }
+
+    if ( need_send_ ) {
+      send( sender_.make_empty_message(), transmit );
+    }
+  }
+
+  /* Counters and connection state, as of now */
+  TCPStats stats() const
+  {
+    TCPStats stats = stats_;
+    stats.sequence_numbers_in_flight = sender_.sequence_numbers_in_flight();
+    stats.send_window = send_window_.value_or( 0 );
+    stats.receive_window = receiver_.send().window_size;
+    stats.reassembler_bytes_pending = receiver_.reassembler().bytes_pending();
+    // the RTO starts at rt_timeout and doubles with each consecutive retransmission
+    stats.rto_ms = uint64_t { cfg_.rt_timeout } << std::min<uint64_t>( sender_.consecutive_retransmissions(), 32 );
+    stats.max_payload_size = sender_.max_payload_size();
+    return stats;
+  }
+
+  // Testing interface
+  const TCPReceiver& receiver() const { return receiver_; }
+  const TCPSender& sender() const { return sender_; }
+
+private:
+  /* Give a message to the receiver and the sender, and note whether it needs a reply */
+  void absorb( TCPMessage msg )
+  {
     // Record time in case this peer has to linger after streams finish.
     time_of_last_receipt_ = cumulative_time_;
 
@@ -64,6 +131,9 @@ public:
     const auto our_ackno = receiver_.send().ackno;
     need_send_ |= ( our_ackno.has_value() and msg.sender.seqno + 1 == our_ackno.value() );
 
+    trace_segment( trace::Event::SegmentReceived, msg );
+    count_received( msg, our_ackno );
+
     // Did the inbound stream finish before the outbound stream? If so, no need to linger after streams finish.
     if ( receiver_.writer().is_closed() and not sender_.reader().is_finished() ) {
       linger_after_streams_finish_ = false;
@@ -74,32 +144,74 @@ public:
 
     // Give incoming TCPReceiverMessage to sender.
     sender_.receive( msg.receiver );
+  }
 
-    // Send reply if needed.
-    if ( need_send_ ) {
-      send( sender_.make_empty_message(), transmit );
+  /* Count a message before the receiver and sender see it */
+  void count_received( const TCPMessage& msg, const std::optional<Wrap32>& our_ackno )
+  {
+    ++stats_.segments_received;
+    stats_.bytes_received += msg.sender.payload.size();
+
+    if ( our_ackno.has_value() and msg.sender.sequence_length() > 0 ) {
+      // where the segment starts, relative to the next sequence number expected
+      const auto offset = static_cast<int32_t>( msg.sender.seqno.raw_value_ - our_ackno->raw_value_ );
+      if ( offset + static_cast<int64_t>( msg.sender.sequence_length() ) <= 0 ) {
+        ++stats_.duplicate_segments;
+      } else if ( offset > 0 ) {
+        ++stats_.out_of_order_segments;
+      }
     }
-  }
 
-  // Testing interface
-  const TCPReceiver& receiver() const { return receiver_; }
-  const TCPSender& sender() const { return sender_; }
+    if ( msg.receiver.ackno.has_value() and send_window_ != msg.receiver.window_size ) {
+      stats_.zero_window_events += msg.receiver.window_size == 0;
+      send_window_ = msg.receiver.window_size;
+      MINNOW_TRACEPOINT(
+        trace::Event::WindowUpdate, 0, msg.receiver.ackno->raw_value_, msg.receiver.window_size );
+    }
+  }
 
-private:
   TCPConfig cfg_;
   TCPSender sender_ { ByteStream { cfg_.send_capacity }, cfg_.isn, cfg_.rt_timeout };
   TCPReceiver receiver_ { Reassembler { ByteStream { cfg_.recv_capacity } } };
 
   bool need_send_ {};
 
-  void send( const TCPSenderMessage& sender_message, const TransmitFunction& transmit )
+  void send( const TCPSenderMessage& sender_message,
+             const TransmitFunction& transmit,
+             trace::Event event = trace::Event::SegmentSent )
   {
+    ++stats_.segments_sent;
+    stats_.bytes_sent += sender_message.payload.size();
+
     TCPMessage msg { sender_message, receiver_.send() };
+    trace_segment( event, msg );
     transmit( std::move( msg ) );
     need_send_ = false;
   }
 
+  static void trace_segment( [[maybe_unused]] trace::Event event, [[maybe_unused]] const TCPMessage& msg )
+  {
+    MINNOW_TRACEPOINT( event,
+                       ( msg.sender.SYN ? trace::SYN : 0 ) | ( msg.sender.FIN ? trace::FIN : 0 )
+                         | ( msg.sender.RST ? trace::RST : 0 ) | ( msg.receiver.ackno ? trace::ACK : 0 ),
+                       msg.sender.seqno.raw_value_,
+                       msg.sender.sequence_length(),
+                       msg.receiver.ackno.value_or( Wrap32 { 0 } ).raw_value_ );
+  }
+
+  bool streams_active() const
+  {
+    const bool sender_active = sender_.sequence_numbers_in_flight() or not sender_.reader().is_finished();
+    const bool receiver_active = not receiver_.writer().is_closed();
+    return sender_active or receiver_active;
+  }
+
+  uint64_t linger_deadline() const { return time_of_last_receipt_ + 10UL * cfg_.rt_timeout; }
+
   bool linger_after_streams_finish_ { true }; // one peer may need to linger to make sure all closure conditions met
   uint64_t cumulative_time_ {};
   uint64_t time_of_last_receipt_ {};
+
+  TCPStats stats_ {};
+  std::optional<uint16_t> send_window_ {}; // window last advertised by the peer
 };
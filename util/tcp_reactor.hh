@@ -0,0 +1,129 @@
+#pragma once
+
+#include "eventloop.hh"
+#include "file_descriptor.hh"
+#include "four_tuple.hh"
+#include "tcp_config.hh"
+#include "tcp_demux.hh"
+#include "tuntap_adapter.hh"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//! Many TCP connections served by one thread
+//! \details A TCPReactor drives a TCPDemux from an EventLoop: one rule reads the TUN device, and one timer wakes
+//! the loop when the earliest connection needs a tick. Applications do their work in callbacks, which all run
+//! on the thread that calls run(). Nothing blocks, and a connection costs its TCPPeer and a little bookkeeping,
+//! not a thread and a socketpair as with TCPMinnowSocket.
+class TCPReactor
+{
+public:
+  class Connection;
+
+  //! What an application does with a connection; each callback may read, write() and close() it
+  struct Handlers
+  {
+    std::function<void( Connection& )> on_open = []( Connection& ) {};     //!< established
+    std::function<void( Connection& )> on_readable = []( Connection& ) {}; //!< inbound bytes, or the end of them
+    std::function<void( Connection& )> on_writable = []( Connection& ) {}; //!< room after a write() fell short
+    std::function<void( Connection& )> on_close = []( Connection& ) {};    //!< finished or reset; then forgotten
+  };
+
+  //! One connection, as the application sees it
+  class Connection
+  {
+    friend class TCPReactor;
+
+    TCPReactor& reactor_;
+    FourTuple tuple_;
+    TCPPeer& peer_;
+    Handlers handlers_;
+    bool open_ {};          //!< on_open has been called
+    bool eof_reported_ {};  //!< on_readable has been called for the end of the inbound stream
+    bool want_writable_ {}; //!< a write() fell short, so call on_writable once there is room
+
+    Connection( TCPReactor& reactor, const FourTuple& tuple, TCPPeer& peer, Handlers handlers )
+      : reactor_( reactor ), tuple_( tuple ), peer_( peer ), handlers_( std::move( handlers ) )
+    {}
+
+  public:
+    const FourTuple& tuple() const { return tuple_; }
+
+    //! The bytes that have arrived (pop them once consumed)
+    Reader& inbound() { return peer_.inbound_reader(); }
+
+    //! Take as much of `data` as fits in the outbound stream and send what the window allows. Returns the number
+    //! of bytes taken; if that is less than `data.size()`, on_writable is called once there is room.
+    size_t write( std::string_view data );
+
+    //! Finish the outbound stream (the connection closes once the peer finishes its own)
+    void close();
+
+    //! Reset the connection
+    void abort();
+
+    //! Replace the connection's callbacks
+    void set_handlers( Handlers handlers ) { handlers_ = std::move( handlers ); }
+
+    //! The underlying TCPPeer
+    const TCPPeer& peer() const { return peer_; }
+  };
+
+  //! Construct from the adapter of the device that carries the connections
+  explicit TCPReactor( TCPOverIPv4OverTunFdAdapter&& adapter,
+                       EventLoop::Backend backend = EventLoop::Backend::Epoll );
+
+  //! Accept connections to `port`, with callbacks `handlers` (see TCPDemux::listen)
+  void listen( uint16_t port, const TCPConfig& config, const Handlers& handlers, size_t backlog = 1024 );
+
+  //! Connect from `tuple`'s local address and port to its remote ones; `handlers.on_open` is called once the
+  //! connection is established
+  Connection& connect( const TCPConfig& config, const FourTuple& tuple, Handlers handlers );
+
+  //! Serve the connections until stop() is called
+  void run();
+
+  //! Make run() return (from a callback, or from any other thread)
+  void stop();
+
+  //! Number of connections, including those still completing the handshake
+  size_t size() const { return demux_.size(); }
+
+  //! Whether there is a connection with this 4-tuple (still open, or closing)
+  bool contains( const FourTuple& tuple ) const { return demux_.contains( tuple ); }
+
+  //! The EventLoop, to add rules and timers of the application's own
+  EventLoop& loop() { return loop_; }
+
+private:
+  TCPDemux demux_;
+  EventLoop loop_;
+
+  std::unordered_map<FourTuple, Connection, FourTupleHash> connections_ {}; //!< those the application knows of
+  std::unordered_map<uint16_t, Handlers> listeners_ {};
+  std::vector<FourTuple> ready_ {};   //!< connections with something to report (reused)
+  std::vector<FourTuple> aborted_ {}; //!< connections aborted since the EventLoop last woke up
+
+  size_t tick_category_ {};
+  std::optional<EventLoop::RuleHandle> tick_timer_ {};           //!< wakes the loop for the next tick
+  std::optional<EventLoop::Clock::time_point> tick_deadline_ {}; //!< when it is set for
+
+  FileDescriptor stop_event_; //!< an eventfd that stop() writes to, to wake the loop
+  std::atomic<bool> stopped_ {};
+
+  //! Accept what the listening ports have queued, then let each ready connection's callbacks run
+  void dispatch();
+
+  //! Call a connection's callbacks for whatever has changed, and forget it once it has closed
+  void dispatch( Connection& connection );
+
+  //! Make sure the EventLoop wakes up when the demultiplexer next needs a tick
+  void schedule_tick();
+};
@@ -8,14 +8,16 @@ static constexpr uint32_t TCPHeaderMinLen = 5; // 32-bit words
 
 using namespace std;
 
-void TCPSegment::parse( Parser& parser, uint32_t datagram_layer_pseudo_checksum )
+void TCPSegment::parse( Parser& parser, optional<uint32_t> datagram_layer_pseudo_checksum )
 {
   /* verify checksum */
-  InternetChecksum check { datagram_layer_pseudo_checksum };
-  check.add( parser.buffer() );
-  if ( check.value() ) {
-    parser.set_error();
-    return;
+  if ( datagram_layer_pseudo_checksum.has_value() ) {
+    InternetChecksum check { *datagram_layer_pseudo_checksum };
+    check.add( parser.buffer() );
+    if ( check.value() ) {
+      parser.set_error();
+      return;
+    }
   }
 
   uint32_t raw32 {};
@@ -89,3 +91,8 @@ void TCPSegment::compute_checksum( uint32_t datagram_layer_pseudo_checksum )
   check.add( s.output() );
   udinfo.cksum = check.value();
 }
+
+void TCPSegment::compute_partial_checksum( uint32_t datagram_layer_pseudo_checksum )
+{
+  udinfo.cksum = static_cast<uint16_t>( ~InternetChecksum { datagram_layer_pseudo_checksum }.value() );
+}
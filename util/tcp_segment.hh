@@ -5,6 +5,8 @@
 #include "tcp_sender_message.hh"
 #include "udinfo.hh"
 
+#include <optional>
+
 struct TCPMessage
 {
   TCPSenderMessage sender {};
@@ -16,8 +18,12 @@ struct TCPSegment
   TCPMessage message {};
   UserDatagramInfo udinfo {};
 
-  void parse( Parser& parser, uint32_t datagram_layer_pseudo_checksum );
+  // (without a pseudo-checksum, the checksum is not verified: the kernel already did, or offered to skip it)
+  void parse( Parser& parser, std::optional<uint32_t> datagram_layer_pseudo_checksum );
   void serialize( Serializer& serializer ) const;
 
   void compute_checksum( uint32_t datagram_layer_pseudo_checksum );
+
+  // For checksum offload: store just the pseudo-header's sum, which the kernel completes over the segment
+  void compute_partial_checksum( uint32_t datagram_layer_pseudo_checksum );
 };
@@ -0,0 +1,16 @@
+#include "tcp_stats.hh"
+
+#include <sstream>
+
+using namespace std;
+
+string TCPStats::to_string() const
+{
+  stringstream ss;
+  ss << "sent=" << segments_sent << "/" << bytes_sent << "B"
+     << " retx=" << retransmissions << " received=" << segments_received << "/" << bytes_received << "B"
+     << " dup=" << duplicate_segments << " ooo=" << out_of_order_segments << " zero_window=" << zero_window_events
+     << " in_flight=" << sequence_numbers_in_flight << " snd_wnd=" << send_window << " rcv_wnd=" << receive_window
+     << " pending=" << reassembler_bytes_pending << "B rto=" << rto_ms << "ms mss=" << max_payload_size << "B";
+  return ss.str();
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+//! What a TCPPeer has done so far, and the state of its connection (like Linux's `struct tcp_info`)
+//! \details The counters are kept by TCPPeer as it sends and receives; the rest is read from the sender and
+//! receiver when the snapshot is taken. Every field is a uint64_t, so a snapshot can be published through a
+//! SeqLock.
+struct TCPStats
+{
+  //! \name Counters
+  //!@{
+  uint64_t segments_sent {};         //!< segments transmitted, including retransmissions and bare ACKs
+  uint64_t bytes_sent {};            //!< payload bytes transmitted, including retransmissions
+  uint64_t retransmissions {};       //!< segments retransmitted after a timeout
+  uint64_t segments_received {};     //!< segments received
+  uint64_t bytes_received {};        //!< payload bytes received, including duplicates
+  uint64_t duplicate_segments {};    //!< received segments that were already entirely acknowledged
+  uint64_t out_of_order_segments {}; //!< received segments that began beyond the next byte expected
+  uint64_t zero_window_events {};    //!< times the peer's advertised window closed
+  //!@}
+
+  //! \name State when the snapshot was taken
+  //!@{
+  uint64_t sequence_numbers_in_flight {}; //!< sent but not yet acknowledged
+  uint64_t send_window {};                //!< window last advertised by the peer
+  uint64_t receive_window {};             //!< window advertised to the peer
+  uint64_t reassembler_bytes_pending {};  //!< bytes received out of order, waiting for a gap to be filled
+  uint64_t rto_ms {};                     //!< current retransmission timeout
+  uint64_t max_payload_size {};           //!< largest segment payload the sender sends (see TCPConfig::mtu_probing)
+  //!@}
+
+  //! One line, `name=value` for each field
+  std::string to_string() const;
+};
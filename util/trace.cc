@@ -0,0 +1,243 @@
+#include "trace.hh"
+
+#include "address.hh"
+#include "ethernet_header.hh"
+
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#if defined( __x86_64__ )
+#include <x86intrin.h>
+#endif
+
+using namespace std;
+using namespace std::chrono;
+
+namespace trace {
+
+namespace {
+constexpr array<char, 8> MAGIC { 'M', 'N', 'T', 'R', 'A', 'C', 'E', '1' };
+
+uint64_t steady_ns()
+{
+  return duration_cast<nanoseconds>( steady_clock::now().time_since_epoch() ).count();
+}
+
+// Every thread's ring (kept after the thread exits, until the program does), and when tracing started
+struct Registry
+{
+  mutex lock {};
+  vector<shared_ptr<Ring>> rings {};
+  uint64_t start_tsc { timestamp() };
+  uint64_t start_ns { steady_ns() };
+};
+
+Registry& registry()
+{
+  static Registry registry;
+  return registry;
+}
+
+// Header of a dump file; then, for each ring, a RingHeader and its records
+struct FileHeader
+{
+  array<char, 8> magic;
+  uint64_t start_tsc; // the two clocks, read together when tracing started and when the dump was written
+  uint64_t start_ns;
+  uint64_t end_tsc;
+  uint64_t end_ns;
+  uint64_t rings;
+};
+
+struct RingHeader
+{
+  uint32_t thread;
+  uint32_t record_size;
+  uint64_t records;
+};
+
+template<class T>
+void read_exactly( ifstream& file, T* data, size_t count = 1 )
+{
+  if ( not file.read( reinterpret_cast<char*>( data ), static_cast<streamsize>( sizeof( T ) * count ) ) ) {
+    throw runtime_error( "trace dump is truncated" );
+  }
+}
+
+string ip( uint32_t address )
+{
+  return Address::from_ipv4_numeric( address ).ip();
+}
+} // namespace
+
+vector<Record> Ring::snapshot() const
+{
+  const uint64_t head = written();
+  const uint64_t count = min( head, CAPACITY );
+  vector<Record> records;
+  records.reserve( count );
+  for ( uint64_t i = head - count; i < head; ++i ) {
+    records.push_back( records_[i % CAPACITY] );
+  }
+  return records;
+}
+
+uint64_t timestamp()
+{
+#if defined( __x86_64__ )
+  return __rdtsc();
+#else
+  return steady_ns();
+#endif
+}
+
+Ring& this_thread_ring()
+{
+  thread_local const shared_ptr<Ring> ring = [] {
+    Registry& reg = registry();
+    const lock_guard guard { reg.lock };
+    reg.rings.push_back( make_shared<Ring>( static_cast<uint32_t>( reg.rings.size() ) ) );
+    return reg.rings.back();
+  }();
+  return *ring;
+}
+
+void dump( const string& path )
+{
+  Registry& reg = registry();
+
+  // the longer the span between the two readings of the clocks, the better the TSC's rate is known
+  constexpr uint64_t MIN_CALIBRATION_NS = 10'000'000;
+  const uint64_t elapsed_ns = steady_ns() - reg.start_ns;
+  if ( elapsed_ns < MIN_CALIBRATION_NS ) {
+    this_thread::sleep_for( nanoseconds( MIN_CALIBRATION_NS - elapsed_ns ) );
+  }
+
+  const lock_guard guard { reg.lock };
+  const FileHeader header { MAGIC, reg.start_tsc, reg.start_ns, timestamp(), steady_ns(), reg.rings.size() };
+
+  ofstream file { path, ios::binary | ios::trunc };
+  file.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+  for ( const auto& ring : reg.rings ) {
+    const vector<Record> records = ring->snapshot();
+    const RingHeader ring_header { ring->thread(), sizeof( Record ), records.size() };
+    file.write( reinterpret_cast<const char*>( &ring_header ), sizeof( ring_header ) );
+    file.write( reinterpret_cast<const char*>( records.data() ),
+                static_cast<streamsize>( records.size() * sizeof( Record ) ) );
+  }
+  if ( not file.flush() ) {
+    throw runtime_error( "could not write trace dump to " + path );
+  }
+}
+
+Dump read_dump( const string& path )
+{
+  ifstream file { path, ios::binary };
+  if ( not file ) {
+    throw runtime_error( "could not open trace dump " + path );
+  }
+
+  FileHeader header {};
+  read_exactly( file, &header );
+  if ( header.magic != MAGIC ) {
+    throw runtime_error( path + " is not a trace dump" );
+  }
+
+  Dump dump;
+  const uint64_t ticks = header.end_tsc - header.start_tsc;
+  dump.ns_per_tick = ticks == 0 ? 1 : static_cast<double>( header.end_ns - header.start_ns ) / ticks;
+  dump.first_tsc = UINT64_MAX;
+
+  for ( uint64_t i = 0; i < header.rings; ++i ) {
+    RingHeader ring_header {};
+    read_exactly( file, &ring_header );
+    if ( ring_header.record_size != sizeof( Record ) ) {
+      throw runtime_error( "trace dump has records of an unknown size" );
+    }
+    vector<Record> records( ring_header.records );
+    read_exactly( file, records.data(), records.size() );
+    for ( const auto& record : records ) {
+      dump.first_tsc = min( dump.first_tsc, record.tsc );
+    }
+    dump.threads.emplace_back( ring_header.thread, move( records ) );
+  }
+
+  if ( dump.first_tsc == UINT64_MAX ) {
+    dump.first_tsc = header.start_tsc;
+  }
+  return dump;
+}
+
+string_view name( const Event event )
+{
+  switch ( event ) {
+    case Event::SegmentSent:
+      return "segment-sent";
+    case Event::SegmentReceived:
+      return "segment-received";
+    case Event::Retransmit:
+      return "retransmit";
+    case Event::WindowUpdate:
+      return "window-update";
+    case Event::ARPMiss:
+      return "arp-miss";
+    case Event::RouteMiss:
+      return "route-miss";
+    case Event::RouteAdded:
+      return "route-added";
+    case Event::InterfaceAdded:
+      return "interface-added";
+  }
+  return "unknown";
+}
+
+vector<pair<string_view, string>> fields( const Record& record )
+{
+  switch ( record.event ) {
+    case Event::SegmentSent:
+    case Event::SegmentReceived:
+    case Event::Retransmit: {
+      string flags;
+      for ( const auto& [flag, flag_name] : { pair { SYN, "SYN" }, { FIN, "FIN" }, { RST, "RST" } } ) {
+        if ( record.flags & flag ) {
+          flags += flags.empty() ? flag_name : string( "|" ) + flag_name;
+        }
+      }
+      vector<pair<string_view, string>> ret { { "seqno", to_string( record.a ) },
+                                              { "length", to_string( record.b ) } };
+      if ( record.flags & ACK ) {
+        ret.emplace_back( "ackno", to_string( record.c ) );
+      }
+      if ( not flags.empty() ) {
+        ret.emplace_back( "flags", flags );
+      }
+      return ret;
+    }
+    case Event::WindowUpdate:
+      return { { "ackno", to_string( record.a ) }, { "window", to_string( record.b ) } };
+    case Event::ARPMiss:
+      return { { "next_hop", ip( record.a ) }, { "waiting", to_string( record.b ) } };
+    case Event::RouteMiss:
+      return { { "destination", ip( record.a ) } };
+    case Event::RouteAdded:
+      return { { "prefix", ip( record.a ) + "/" + to_string( record.b ) },
+               { "next_hop", record.c == 0 ? "(direct)" : ip( record.c ) },
+               { "interface", to_string( record.flags ) } };
+    case Event::InterfaceAdded: {
+      const uint64_t bits = uint64_t { record.b } << 32U | record.c;
+      EthernetAddress ethernet {};
+      for ( size_t i = 0; i < ethernet.size(); ++i ) {
+        ethernet.at( i ) = static_cast<uint8_t>( bits >> ( 8 * ( ethernet.size() - 1 - i ) ) );
+      }
+      return { { "ip", ip( record.a ) }, { "ethernet", to_string( ethernet ) } };
+    }
+  }
+  return {};
+}
+
+} // namespace trace
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+//! \brief Binary event tracing for the TCP/IP stack
+//! \details A tracepoint records a fixed-size Record, stamped with the timestamp counter, into a ring that belongs
+//! to the calling thread, so recording takes no lock and makes no system call. Each ring keeps its latest
+//! Ring::CAPACITY records. trace::dump() writes every thread's ring to a file, and the trace_decode app turns the
+//! file into text or Chrome trace JSON (for chrome://tracing or Perfetto).
+//!
+//! Tracepoints are written with MINNOW_TRACEPOINT(), which compiles to nothing unless MINNOW_TRACE is defined
+//! (configure with `-DMINNOW_TRACE=OFF` to remove them).
+namespace trace {
+
+//! What happened at a tracepoint
+enum class Event : uint16_t
+{
+  SegmentSent = 1, //!< a = seqno, b = sequence length, c = ackno; flags are the segment's SegmentFlags
+  SegmentReceived, //!< (as SegmentSent)
+  Retransmit,      //!< (as SegmentSent) a segment sent again after a timeout
+  WindowUpdate,    //!< a = ackno, b = window advertised by the peer
+  ARPMiss,         //!< a = next hop's IP address, b = datagrams now waiting for it
+  RouteMiss,       //!< a = destination IP address of the dropped datagram
+  RouteAdded,      //!< a = prefix, b = prefix length, c = next hop (0 if direct); flags = interface number
+  InterfaceAdded,  //!< a = IP address, b and c = Ethernet address (first two bytes, then last four)
+};
+
+//! Flags of a segment event
+enum SegmentFlags : uint16_t
+{
+  SYN = 1,
+  FIN = 2,
+  RST = 4,
+  ACK = 8,
+};
+
+//! One event, as recorded
+struct Record
+{
+  uint64_t tsc; //!< timestamp() when it was recorded
+  Event event;
+  uint16_t flags;
+  uint32_t a;
+  uint32_t b;
+  uint32_t c;
+};
+
+static_assert( sizeof( Record ) == 24 );
+
+//! The events recorded by one thread, the oldest overwritten first
+//! \details Only the owning thread records. Another thread may take a snapshot() once the owner has stopped (e.g.
+//! after joining it); records written during a snapshot may be missing or torn.
+class Ring
+{
+public:
+  static constexpr uint64_t CAPACITY = 1 << 16;
+
+  explicit Ring( uint32_t thread ) : records_( CAPACITY ), thread_( thread ) {}
+
+  void record( const Record& record )
+  {
+    const uint64_t head = head_.load( std::memory_order_relaxed );
+    records_[head % CAPACITY] = record;
+    head_.store( head + 1, std::memory_order_release );
+  }
+
+  //! The records still in the ring, oldest first
+  std::vector<Record> snapshot() const;
+
+  uint32_t thread() const { return thread_; }
+
+  //! Number of records ever written (including those overwritten)
+  uint64_t written() const { return head_.load( std::memory_order_acquire ); }
+
+private:
+  std::vector<Record> records_;
+  std::atomic<uint64_t> head_ {}; //!< where the next record goes
+  uint32_t thread_;               //!< numbered in the order threads first recorded
+};
+
+//! The timestamp counter (the TSC on x86-64; elsewhere, nanoseconds on the steady clock)
+uint64_t timestamp();
+
+//! The calling thread's ring (created the first time the thread asks)
+Ring& this_thread_ring();
+
+//! Record an event in the calling thread's ring
+inline void record( Event event, uint16_t flags = 0, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0 )
+{
+  this_thread_ring().record( { timestamp(), event, flags, a, b, c } );
+}
+
+//! Write every thread's ring to a file
+void dump( const std::string& path );
+
+//! A dump, read back
+struct Dump
+{
+  double ns_per_tick {};  //!< to convert Record::tsc to time
+  uint64_t first_tsc {};  //!< timestamp of the earliest record
+  std::vector<std::pair<uint32_t, std::vector<Record>>> threads {}; //!< each ring's thread and records
+};
+
+//! Read a file written by dump()
+Dump read_dump( const std::string& path );
+
+//! Name of an event, e.g. "segment-sent"
+std::string_view name( Event event );
+
+//! The fields of a record, as (name, value) pairs, e.g. ( "seqno", "12345" )
+std::vector<std::pair<std::string_view, std::string>> fields( const Record& record );
+
+} // namespace trace
+
+#ifdef MINNOW_TRACE
+#define MINNOW_TRACEPOINT( ... ) ::trace::record( __VA_ARGS__ )
+#else
+#define MINNOW_TRACEPOINT( ... ) static_cast<void>( 0 )
+#endif
@@ -1,11 +1,18 @@
 #include "tun.hh"
 #include "exception.hh"
+#include "random.hh"
 
+#include <algorithm>
+#include <array>
 #include <cstring>
 #include <fcntl.h>
+#include <linux/bpf.h>
 #include <linux/if.h>
 #include <linux/if_tun.h>
 #include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
 
 static constexpr const char* CLONEDEV = "/dev/net/tun";
 
@@ -14,6 +21,8 @@ using namespace std;
 //! \param[in] devname is the name of the TUN or TAP device, specified at its creation.
 //! \param[in] is_tun is `true` for a TUN device (expects IP datagrams), or `false` for a TAP device (expects
 //! Ethernet frames)
+//! \param[in] multi_queue is `true` to attach a new queue of a device created with IFF_MULTI_QUEUE
+//! \param[in] vnet_header is `true` to exchange each datagram with a `virtio_net_hdr` in front
 //!
 //! To create a TUN device, you should already have run
 //!
@@ -21,13 +30,19 @@ using namespace std;
 //!
 //! as root before calling this function.
 
-TunTapFD::TunTapFD( const string& devname, const bool is_tun )
-  : FileDescriptor( ::CheckSystemCall( "open", open( CLONEDEV, O_RDWR | O_CLOEXEC ) ) )
+TunTapFD::TunTapFD( const string& devname, const bool is_tun, const bool multi_queue, const bool vnet_header )
+  : FileDescriptor( ::CheckSystemCall( "open", open( CLONEDEV, O_RDWR | O_CLOEXEC ) ) ), vnet_header_( vnet_header )
 {
   struct ifreq tun_req
   {};
 
   tun_req.ifr_flags = static_cast<int16_t>( ( is_tun ? IFF_TUN : IFF_TAP ) | IFF_NO_PI ); // no packetinfo
+  if ( multi_queue ) {
+    tun_req.ifr_flags = static_cast<int16_t>( tun_req.ifr_flags | IFF_MULTI_QUEUE );
+  }
+  if ( vnet_header ) {
+    tun_req.ifr_flags = static_cast<int16_t>( tun_req.ifr_flags | IFF_VNET_HDR );
+  }
 
   // copy devname to ifr_name, making sure to null terminate
 
@@ -36,3 +51,151 @@ TunTapFD::TunTapFD( const string& devname, const bool is_tun )
 
   CheckSystemCall( "ioctl", ioctl( fd_num(), TUNSETIFF, static_cast<void*>( &tun_req ) ) );
 }
+
+void TunTapFD::set_offload( const unsigned flags )
+{
+  CheckSystemCall( "ioctl", ioctl( fd_num(), TUNSETOFFLOAD, static_cast<unsigned long>( flags ) ) );
+}
+
+namespace {
+// eBPF registers (R1 holds the program's argument, R6-R9 survive packet loads)
+constexpr uint8_t R0 = 0, R1 = 1, R6 = 6, R7 = 7, R8 = 8;
+
+// FourTuple::flow_hash's multiplier, as a 32-bit immediate
+constexpr auto MULTIPLIER = static_cast<int32_t>( 0x9E3779B1U );
+
+constexpr bpf_insn insn( uint8_t code, uint8_t dst, uint8_t src, int16_t off, int32_t imm )
+{
+  bpf_insn result {};
+  result.code = code;
+  result.dst_reg = dst & 0xf;
+  result.src_reg = src & 0xf;
+  result.off = off;
+  result.imm = imm;
+  return result;
+}
+
+// R0 = the `size` bytes at offset `imm` of the datagram (or at R`src` + `imm`, for BPF_IND), in host order
+constexpr bpf_insn load_packet( uint8_t mode, uint8_t size, uint8_t src, int32_t imm )
+{
+  return insn( BPF_LD | mode | size, 0, src, 0, imm );
+}
+
+// The steering program: FourTuple::flow_hash of an IPv4 datagram's addresses and (for TCP and UDP) ports.
+// The kernel sends the datagram to queue (hash % 2^16) % number of queues.
+constexpr array<bpf_insn, 25> steering_program {
+  insn( BPF_ALU64 | BPF_MOV | BPF_X, R6, R1, 0, 0 ),       //     r6 = skb (required by packet loads)
+  load_packet( BPF_ABS, BPF_B, 0, 0 ),                     //     r0 = version and header length
+  insn( BPF_ALU64 | BPF_MOV | BPF_X, R7, R0, 0, 0 ),       //     r7 = r0
+  insn( BPF_ALU64 | BPF_RSH | BPF_K, R0, 0, 0, 4 ),        //     r0 >>= 4
+  insn( BPF_JMP | BPF_JNE | BPF_K, R0, 0, 18, 4 ),         //     if r0 != 4 goto not_ipv4
+  insn( BPF_ALU64 | BPF_AND | BPF_K, R7, 0, 0, 0xf ),      //     r7 &= 0xf
+  insn( BPF_ALU64 | BPF_LSH | BPF_K, R7, 0, 0, 2 ),        //     r7 <<= 2 (header length in bytes)
+  load_packet( BPF_ABS, BPF_W, 0, 12 ),                    //     r0 = source address
+  insn( BPF_ALU64 | BPF_MOV | BPF_X, R8, R0, 0, 0 ),       //     r8 = r0
+  load_packet( BPF_ABS, BPF_W, 0, 16 ),                    //     r0 = destination address
+  insn( BPF_ALU | BPF_XOR | BPF_X, R8, R0, 0, 0 ),         //     r8 ^= r0
+  load_packet( BPF_ABS, BPF_B, 0, 9 ),                     //     r0 = protocol
+  insn( BPF_JMP | BPF_JEQ | BPF_K, R0, 0, 1, 6 ),          //     if r0 == TCP goto ports
+  insn( BPF_JMP | BPF_JNE | BPF_K, R0, 0, 4, 17 ),         //     if r0 != UDP goto mix
+  load_packet( BPF_IND, BPF_H, R7, 0 ),                    // ports: r0 = source port
+  insn( BPF_ALU | BPF_XOR | BPF_X, R8, R0, 0, 0 ),         //     r8 ^= r0
+  load_packet( BPF_IND, BPF_H, R7, 2 ),                    //     r0 = destination port
+  insn( BPF_ALU | BPF_XOR | BPF_X, R8, R0, 0, 0 ),         //     r8 ^= r0
+  insn( BPF_ALU | BPF_MUL | BPF_K, R8, 0, 0, MULTIPLIER ), // mix: r8 *= 0x9E3779B1
+  insn( BPF_ALU | BPF_MOV | BPF_X, R0, R8, 0, 0 ),         //     r0 = r8
+  insn( BPF_ALU | BPF_RSH | BPF_K, R0, 0, 0, 16 ),         //     r0 >>= 16
+  insn( BPF_ALU | BPF_XOR | BPF_X, R0, R8, 0, 0 ),         //     r0 ^= r8
+  insn( BPF_JMP | BPF_EXIT, 0, 0, 0, 0 ),                  //     return r0
+  insn( BPF_ALU64 | BPF_MOV | BPF_K, R0, 0, 0, 0 ),        // not_ipv4: r0 = 0
+  insn( BPF_JMP | BPF_EXIT, 0, 0, 0, 0 ),                  //     return r0
+};
+
+// Load the steering program and attach it to the device behind `fd`; returns false if the kernel refused
+bool install_steering_program( FileDescriptor& fd )
+{
+  constexpr const char* license = "GPL";
+  bpf_attr attr {};
+  attr.prog_type = BPF_PROG_TYPE_SOCKET_FILTER;
+  attr.insns = reinterpret_cast<uint64_t>( steering_program.data() ); // NOLINT(*-reinterpret-cast)
+  attr.insn_cnt = steering_program.size();
+  attr.license = reinterpret_cast<uint64_t>( license ); // NOLINT(*-reinterpret-cast)
+
+  const long prog_fd = ::syscall( __NR_bpf, BPF_PROG_LOAD, &attr, sizeof( attr ) ); // NOLINT(*-vararg)
+  if ( prog_fd < 0 ) {
+    return false;
+  }
+
+  // the device keeps its own reference to the program
+  FileDescriptor program { static_cast<int>( prog_fd ) };
+  int prog_fd_num = program.fd_num();
+  return ioctl( fd.fd_num(), TUNSETSTEERINGEBPF, &prog_fd_num ) == 0;
+}
+} // namespace
+
+TunQueues::TunQueues( const string& devname, const size_t count )
+{
+  if ( count == 0 or count > kMaxQueues ) {
+    throw runtime_error( "TunQueues: a TUN device has between 1 and " + to_string( kMaxQueues ) + " queues" );
+  }
+
+  queues_.reserve( count );
+  for ( size_t i = 0; i < count; ++i ) {
+    queues_.emplace_back( devname, true );
+  }
+  steered_ = install_steering_program( queues_.front() );
+}
+
+size_t TunQueues::default_count()
+{
+  return clamp( static_cast<size_t>( thread::hardware_concurrency() ), size_t { 1 }, kMaxQueues );
+}
+
+size_t TunQueues::queue_for( const FourTuple& tuple ) const
+{
+  // the kernel truncates the steering program's result to 16 bits
+  return static_cast<uint16_t>( tuple.flow_hash() ) % queues_.size();
+}
+
+uint16_t TunQueues::local_port_for( const uint32_t local_address,
+                                    const uint32_t remote_address,
+                                    const uint16_t remote_port,
+                                    const size_t index ) const
+{
+  constexpr uint16_t first_port = 32768, num_ports = 28232; // Linux's default ephemeral range
+
+  auto rng = get_random_engine();
+  const auto start = uniform_int_distribution<uint16_t> { 0, num_ports - 1 }( rng );
+  for ( uint16_t i = 0; i < num_ports; ++i ) {
+    const auto port = static_cast<uint16_t>( first_port + ( start + i ) % num_ports );
+    if ( queue_for( { local_address, remote_address, port, remote_port } ) == index ) {
+      return port;
+    }
+  }
+  throw runtime_error( "TunQueues: no local port maps to queue " + to_string( index ) );
+}
+
+void TunQueues::run( const function<void( size_t, TunFD& )>& worker )
+{
+  vector<thread> threads;
+  vector<exception_ptr> errors( queues_.size() );
+  threads.reserve( queues_.size() );
+  for ( size_t i = 0; i < queues_.size(); ++i ) {
+    threads.emplace_back( [&, i] {
+      try {
+        worker( i, queues_[i] );
+      } catch ( ... ) {
+        errors[i] = current_exception();
+      }
+    } );
+  }
+
+  for ( auto& t : threads ) {
+    t.join();
+  }
+  for ( const auto& error : errors ) {
+    if ( error ) {
+      rethrow_exception( error );
+    }
+  }
+}
@@ -1,16 +1,29 @@
 #pragma once
 
 #include "file_descriptor.hh"
+#include "four_tuple.hh"
 
+#include <cstdint>
+#include <functional>
 #include <string>
+#include <vector>
 
 //! A FileDescriptor to a [Linux TUN/TAP](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
 class TunTapFD : public FileDescriptor
 {
+  bool vnet_header_ {};
+
 public:
   //! Open an existing persistent [TUN or TAP
   //! device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
-  explicit TunTapFD( const std::string& devname, bool is_tun );
+  explicit TunTapFD( const std::string& devname, bool is_tun, bool multi_queue = false, bool vnet_header = false );
+
+  //! Whether every datagram read or written is preceded by a `virtio_net_hdr` (IFF_VNET_HDR), which describes
+  //! checksum and segmentation offloads
+  bool vnet_header() const { return vnet_header_; }
+
+  //! Tell the kernel which offloads (TUN_F_* flags) the datagrams it hands us may use
+  void set_offload( unsigned flags );
 };
 
 //! A FileDescriptor to a [Linux TUN](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
@@ -18,7 +31,11 @@ class TunFD : public TunTapFD
 {
 public:
   //! Open an existing persistent [TUN device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
-  explicit TunFD( const std::string& devname ) : TunTapFD( devname, true ) {}
+  //! If `multi_queue` is true, the device must have been created with IFF_MULTI_QUEUE, and each TunFD is a
+  //! separate queue of it.
+  explicit TunFD( const std::string& devname, bool multi_queue = false, bool vnet_header = false )
+    : TunTapFD( devname, true, multi_queue, vnet_header )
+  {}
 };
 
 //! A FileDescriptor to a [Linux TAP](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
@@ -28,3 +45,47 @@ public:
   //! Open an existing persistent [TAP device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
   explicit TapFD( const std::string& devname ) : TunTapFD( devname, false ) {}
 };
+
+//! The queues of a multi-queue TUN device, one per worker thread
+//! \details The kernel hands each datagram it sends to the device to one queue, picked by a BPF program that
+//! hashes the datagram's 4-tuple with FourTuple::flow_hash. A worker that reads and writes only its own queue
+//! therefore sees all of its connections' traffic and nobody else's, without sharing anything with other
+//! workers. Create the device with
+//!
+//!     ip tuntap add mode tun multi_queue user `username` name `devname`
+class TunQueues
+{
+  std::vector<TunFD> queues_ {};
+  bool steered_ {};
+
+public:
+  //! Largest number of queues Linux allows on one device
+  static constexpr size_t kMaxQueues = 256;
+
+  //! Attach `count` queues to TUN device `devname` (by default, one per core) and install the steering program
+  explicit TunQueues( const std::string& devname, size_t count = default_count() );
+
+  //! One queue per core
+  static size_t default_count();
+
+  size_t size() const { return queues_.size(); }
+  TunFD& queue( size_t index ) { return queues_.at( index ); }
+
+  //! Whether the steering program is installed. Loading BPF needs CAP_BPF (or root); without it, the kernel
+  //! sends each flow to whichever queue last wrote one of its datagrams, which agrees with queue_for() only for
+  //! flows that are kept busy.
+  bool steered() const { return steered_; }
+
+  //! The queue that carries the connection's datagrams
+  size_t queue_for( const FourTuple& tuple ) const;
+
+  //! A local port, chosen at random from the ephemeral range, such that the connection from `local_address`
+  //! to `remote_address`:`remote_port` is carried by queue `index`
+  uint16_t local_port_for( uint32_t local_address,
+                           uint32_t remote_address,
+                           uint16_t remote_port,
+                           size_t index ) const;
+
+  //! Call `worker( index, queue )` for every queue, each on its own thread, and wait for them all to return
+  void run( const std::function<void( size_t, TunFD& )>& worker );
+};
@@ -1,20 +1,228 @@
 #include "tuntap_adapter.hh"
 #include "parser.hh"
+#include "packet_pool.hh"
+
+#include <chrono>
+#include <cstring>
+#include <linux/if_tun.h>
+#include <string_view>
 
 using namespace std;
+using namespace std::chrono;
 
-optional<TCPMessage> TCPOverIPv4OverTunFdAdapter::read()
+namespace {
+// struct virtio_net_hdr, as the TUN device reads and writes it (<linux/virtio_net.h> does not compile as C++)
+struct VirtioNetHeader
+{
+  uint8_t flags;
+  uint8_t gso_type;
+  uint16_t hdr_len;     // length of the headers copied into each segment
+  uint16_t gso_size;    // payload size of each segment
+  uint16_t csum_start;  // where to start checksumming
+  uint16_t csum_offset; // where to store the checksum, after csum_start
+};
+static_assert( sizeof( VirtioNetHeader ) == 10 );
+
+constexpr uint8_t VIRTIO_NET_HDR_F_NEEDS_CSUM = 1; // the checksum is only partial
+constexpr uint8_t VIRTIO_NET_HDR_F_DATA_VALID = 2; // the checksum has been verified
+constexpr uint8_t VIRTIO_NET_HDR_GSO_TCPV4 = 1;    // a TCP/IPv4 super-segment
+
+constexpr size_t max_datagram_size = 65535; // an IPv4 datagram (or super-segment) at its largest
+constexpr size_t tcp_header_length = 20;    // the TCP header we write (no options)
+constexpr size_t tcp_checksum_offset = 16;  // where the checksum lives in the TCP header
+
+// the most payload one super-segment can carry
+constexpr size_t max_payload = max_datagram_size - IPv4Header::LENGTH - tcp_header_length;
+
+// Can `next` ride in the same super-segment as `prev`? The kernel cuts a super-segment into pieces of the
+// first segment's size, so every segment but the last must be that size, and they must be contiguous.
+bool continues( const TCPMessage& prev, const TCPMessage& next, const size_t segment_size )
+{
+  return prev.sender.payload.size() == segment_size and not next.sender.payload.empty()
+         and not( prev.sender.SYN or prev.sender.FIN or prev.sender.RST )
+         and not( next.sender.SYN or next.sender.RST )
+         and next.sender.seqno == prev.sender.seqno + static_cast<uint32_t>( segment_size )
+         and next.receiver.ackno == prev.receiver.ackno
+         and next.receiver.window_size == prev.receiver.window_size;
+}
+} // namespace
+
+TCPOverIPv4OverTunFdAdapter::TCPOverIPv4OverTunFdAdapter( TunFD&& tun ) : _tun( move( tun ) )
+{
+  _tun.set_blocking( false );
+  if ( _tun.vnet_header() ) {
+    // accept partially checksummed datagrams, and super-segments coalesced by the kernel
+    _tun.set_offload( TUN_F_CSUM | TUN_F_TSO4 );
+  }
+  _read_buffer.resize( ( _tun.vnet_header() ? sizeof( VirtioNetHeader ) : 0 ) + max_datagram_size );
+}
+
+template<class DeliverT>
+void TCPOverIPv4OverTunFdAdapter::deliver_whole( InternetDatagram&& ip_dgram,
+                                                 const bool checksum_verified,
+                                                 const DeliverT& deliver )
+{
+  if ( not ip_dgram.header.mf and ip_dgram.header.offset == 0 ) {
+    deliver( ip_dgram, checksum_verified );
+    return;
+  }
+
+  const auto now_ms = duration_cast<milliseconds>( steady_clock::now().time_since_epoch() ).count();
+  if ( auto whole = _fragments.add( move( ip_dgram ), now_ms ) ) {
+    deliver( *whole, false ); // (the kernel vouches only for whole datagrams)
+  }
+}
+
+template<class DeliverT>
+bool TCPOverIPv4OverTunFdAdapter::read_datagram( const DeliverT& deliver )
 {
-  vector<string> strs( 2 );
-  strs.front().resize( IPv4Header::LENGTH );
-  _tun.read( strs );
+  const size_t length = _tun.read( span<char> { _read_buffer } );
+  if ( length == 0 ) {
+    return false; // nothing to read
+  }
+
+  VirtioNetHeader vnet {};
+  size_t header_length = 0;
+  if ( _tun.vnet_header() ) {
+    if ( length < sizeof( vnet ) ) {
+      return true;
+    }
+    memcpy( &vnet, _read_buffer.data(), sizeof( vnet ) );
+    header_length = sizeof( vnet );
+  }
 
+  const string_view datagram = string_view { _read_buffer }.substr( header_length, length - header_length );
+  if ( _capture ) {
+    _capture->capture( { &datagram, 1 } );
+  }
+
+  // the datagram moves into a recycled string, which its payload then keeps
+  string bytes = packet_pool::take_string();
+  bytes.assign( datagram );
   InternetDatagram ip_dgram;
-  const vector<string> buffers = { strs.at( 0 ), strs.at( 1 ) };
-  if ( parse( ip_dgram, buffers ) ) {
-    return unwrap_tcp_in_ip( ip_dgram );
+  if ( parse( ip_dgram, PacketBuffer { move( bytes ) } ) ) {
+    // a segment from the local stack may carry only a partial checksum (the kernel trusts itself)
+    const bool checksum_verified
+      = ( vnet.flags & ( VIRTIO_NET_HDR_F_NEEDS_CSUM | VIRTIO_NET_HDR_F_DATA_VALID ) ) != 0;
+    deliver_whole( move( ip_dgram ), checksum_verified, deliver );
+  }
+  return true;
+}
+
+bool TCPOverIPv4OverTunFdAdapter::read_one( optional<TCPMessage>& seg )
+{
+  return read_datagram( [&]( const InternetDatagram& ip_dgram, const bool checksum_verified ) {
+    seg = unwrap_tcp_in_ip( ip_dgram, checksum_verified );
+  } );
+}
+
+optional<TCPMessage> TCPOverIPv4OverTunFdAdapter::read()
+{
+  optional<TCPMessage> seg;
+  read_one( seg );
+  return seg;
+}
+
+void TCPOverIPv4OverTunFdAdapter::read_batch( vector<TCPMessage>& segs )
+{
+  for ( size_t i = 0; i < kMaxBatch; ++i ) {
+    optional<TCPMessage> seg;
+    if ( not read_one( seg ) ) {
+      return; // the queue is empty
+    }
+    if ( seg ) {
+      segs.push_back( move( *seg ) );
+    }
+  }
+}
+
+void TCPOverIPv4OverTunFdAdapter::read_batch( vector<pair<FourTuple, TCPMessage>>& segs )
+{
+  for ( size_t i = 0; i < kMaxBatch; ++i ) {
+    const bool read_something
+      = read_datagram( [&]( const InternetDatagram& ip_dgram, const bool checksum_verified ) {
+          FourTuple tuple;
+          if ( auto seg = parse_tcp_in_ip( ip_dgram, checksum_verified, tuple ) ) {
+            segs.emplace_back( tuple, move( *seg ) );
+          }
+        } );
+    if ( not read_something ) {
+      return; // the queue is empty
+    }
+  }
+}
+
+void TCPOverIPv4OverTunFdAdapter::write( const TCPMessage& seg )
+{
+  write_batch( { &seg, 1 } );
+}
+
+void TCPOverIPv4OverTunFdAdapter::write_batch( const span<const TCPMessage> segs, const FourTuple& tuple )
+{
+  if ( not _tun.vnet_header() ) {
+    for ( const auto& seg : segs ) {
+      const auto datagram = serialize( wrap_tcp_in_ip( seg, tuple ) );
+      if ( _capture ) {
+        _capture->capture( datagram );
+      }
+      _tun.write( datagram );
+    }
+    return;
+  }
+
+  size_t begin = 0;
+  while ( begin < segs.size() ) {
+    const size_t segment_size = segs[begin].sender.payload.size();
+    size_t end = begin + 1;
+    size_t payload_length = segment_size;
+    while ( end < segs.size() and continues( segs[end - 1], segs[end], segment_size )
+            and payload_length + segs[end].sender.payload.size() <= max_payload ) {
+      payload_length += segs[end].sender.payload.size();
+      ++end;
+    }
+    write_offloaded( segs.subspan( begin, end - begin ), tuple );
+    begin = end;
+  }
+}
+
+void TCPOverIPv4OverTunFdAdapter::write_offloaded( const span<const TCPMessage> segs, const FourTuple& tuple )
+{
+  TCPMessage header = segs.front();
+  header.sender.FIN = segs.back().sender.FIN;
+  size_t payload_length = 0;
+  for ( const auto& seg : segs ) {
+    payload_length += seg.sender.payload.size();
+  }
+
+  const InternetDatagram ip_dgram = wrap_tcp_header_in_ip( header, payload_length, tuple );
+  const size_t header_length = ip_dgram.header.hlen * 4UL;
+
+  VirtioNetHeader vnet {};
+  vnet.flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+  vnet.csum_start = header_length;
+  vnet.csum_offset = tcp_checksum_offset;
+  if ( segs.size() > 1 ) {
+    vnet.gso_type = VIRTIO_NET_HDR_GSO_TCPV4;
+    vnet.gso_size = segs.front().sender.payload.size();
+    vnet.hdr_len = header_length + tcp_header_length;
+  }
+
+  // build the virtio header and the IPv4 and TCP headers back to front in one buffer, then gather it and every
+  // payload into one write
+  PacketBuffer headers { sizeof( vnet ) + header_length + tcp_header_length, 0 };
+  prepend_serialized( headers, ip_dgram );
+  vector<string_view> buffers;
+  buffers.reserve( 1 + segs.size() );
+  buffers.emplace_back( headers );
+  for ( const auto& seg : segs ) {
+    buffers.emplace_back( seg.sender.payload );
+  }
+  if ( _capture ) {
+    _capture->capture( buffers ); // (as the kernel gets it: before segmentation, with the checksum unfinished)
   }
-  return {};
+  headers.prepend( { reinterpret_cast<const char*>( &vnet ), sizeof( vnet ) } ); // NOLINT(*-reinterpret-cast)
+  buffers.front() = headers;
+  _tun.write( buffers );
 }
 
 //! Specialize LossyFdAdapter to TCPOverIPv4OverTunFdAdapter
@@ -1,15 +1,21 @@
 #pragma once
 
+#include "ipv4_fragments.hh"
+#include "pcapng.hh"
 #include "tcp_over_ip.hh"
 #include "tcp_segment.hh"
 #include "tun.hh"
 
+#include <memory>
 #include <optional>
+#include <span>
+#include <string>
 #include <unordered_map>
 #include <utility>
+#include <vector>
 
 template<class T>
-concept TCPDatagramAdapter = requires( T a, TCPMessage seg ) {
+concept TCPDatagramAdapter = requires( T a, TCPMessage seg, std::vector<TCPMessage> segs ) {
   {
     a.write( seg )
   } -> std::same_as<void>;
@@ -17,23 +23,84 @@ concept TCPDatagramAdapter = requires( T a, TCPMessage seg ) {
   {
     a.read()
   } -> std::same_as<std::optional<TCPMessage>>;
+
+  {
+    a.write_batch( segs )
+  } -> std::same_as<void>;
+
+  {
+    a.read_batch( segs )
+  } -> std::same_as<void>;
 };
 
 //! \brief A FD adapter for IPv4 datagrams read from and written to a TUN device
+//! \details If the TunFD was opened with a virtio-net header, the adapter offloads work to the kernel: it leaves
+//! TCP checksums for the kernel to compute (or skip, for local delivery), hands it each run of consecutive
+//! full-sized segments as one super-segment of up to 64 KiB (TCP segmentation offload), and accepts the
+//! coalesced super-segments and unchecksummed segments the kernel hands back.
 class TCPOverIPv4OverTunFdAdapter : public TCPOverIPv4Adapter
 {
 private:
   TunFD _tun;
+  std::string _read_buffer {}; //!< Room for one datagram of up to 64 KiB (and, with offloads, its virtio header)
+  IPv4FragmentReassembler _fragments {}; //!< fragments of the datagrams read, until each datagram is whole
+  std::shared_ptr<PcapngWriter> _capture {}; //!< if set, gets every datagram read from or written to the device
+
+  //! Hands `ip_dgram` to `deliver` if it is whole, or the datagram it completes if it is a fragment
+  template<class DeliverT>
+  void deliver_whole( InternetDatagram&& ip_dgram, bool checksum_verified, const DeliverT& deliver );
+
+  //! Reads one datagram (returning false if there was none) and, if it parses, hands it to
+  //! `deliver( ip_dgram, checksum_verified )`
+  template<class DeliverT>
+  bool read_datagram( const DeliverT& deliver );
+
+  //! Reads one datagram (returning false if there was none) and sets `seg` if it held a TCP segment related to
+  //! the current connection
+  bool read_one( std::optional<TCPMessage>& seg );
+
+  //! Writes `segs` (consecutive segments, all full-sized except maybe the last) as one datagram with a
+  //! virtio-net header, which has the kernel finish the checksum and split the datagram back into segments
+  void write_offloaded( std::span<const TCPMessage> segs, const FourTuple& tuple );
 
 public:
-  //! Construct from a TunFD
-  explicit TCPOverIPv4OverTunFdAdapter( TunFD&& tun ) : _tun( std::move( tun ) ) {}
+  //! Construct from a TunFD (made non-blocking, so that read_batch() can drain it)
+  explicit TCPOverIPv4OverTunFdAdapter( TunFD&& tun );
 
   //! Attempts to read and parse an IPv4 datagram containing a TCP segment related to the current connection
   std::optional<TCPMessage> read();
 
   //! Creates an IPv4 datagram from a TCP segment and writes it to the TUN device
-  void write( const TCPMessage& seg ) { _tun.write( serialize( wrap_tcp_in_ip( seg ) ) ); }
+  void write( const TCPMessage& seg );
+
+  //! Reads the datagrams queued on the TUN device (up to kMaxBatch), appending the TCP segments related to the
+  //! current connection to `segs`
+  //! \note A TUN device hands over one datagram per [read(2)](\ref man2::read), so this costs one system call
+  //! per datagram, plus one to find the queue empty
+  void read_batch( std::vector<TCPMessage>& segs );
+
+  //! Writes each segment as an IPv4 datagram (one system call each: a TUN device takes one datagram per write).
+  //! With offloads, each run of full-sized segments takes one datagram, and one system call, in all.
+  void write_batch( std::span<const TCPMessage> segs ) { write_batch( segs, connection() ); }
+
+  //! \name
+  //! For many connections over one device (see TCPDemux): these ignore the configuration and the listening flag
+
+  //!@{
+  //! Reads the datagrams queued on the TUN device (up to kMaxBatch), appending every TCP segment to `segs`,
+  //! with the connection (seen from our end) it belongs to
+  void read_batch( std::vector<std::pair<FourTuple, TCPMessage>>& segs );
+
+  //! Writes segments that belong to connection `tuple`, as write_batch() does
+  void write_batch( std::span<const TCPMessage> segs, const FourTuple& tuple );
+  //!@}
+
+  //! Capture every datagram read from or written to the device, as the bytes that cross it (less any virtio-net
+  //! header), to `writer` (whose link type should be PcapngWriter::LinkType::IPv4); null to stop
+  void set_capture( std::shared_ptr<PcapngWriter> writer ) { _capture = std::move( writer ); }
+
+  //! The reassembler that fragmented datagrams read from the device go through
+  const IPv4FragmentReassembler& fragments() const { return _fragments; }
 
   //! Access the underlying TUN device
   explicit operator TunFD&() { return _tun; }